@@ -499,8 +499,8 @@ node_object_functions (const void *parent,
 		       NihList *   structs,
 		       NihList *   externs)
 {
-	char *code = NULL;
-	int   first = TRUE;
+	nih_local NihStrBuf *buf = NULL;
+	int                 first = TRUE;
 
 	nih_assert (prefix != NULL);
 	nih_assert (node != NULL);
@@ -509,8 +509,8 @@ node_object_functions (const void *parent,
 	nih_assert (structs != NULL);
 	nih_assert (externs != NULL);
 
-	code = nih_strdup (parent, "");
-	if (! code)
+	buf = nih_str_buf_new (NULL);
+	if (! buf)
 		return NULL;
 
 	NIH_LIST_FOREACH (&node->interfaces, interface_iter) {
@@ -531,7 +531,7 @@ node_object_functions (const void *parent,
 			nih_list_init (&method_externs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -542,9 +542,9 @@ node_object_functions (const void *parent,
 			if (! object_func)
 				goto error;
 
-			if (! nih_strcat_sprintf (&code, parent,
-						  "static %s",
-						  object_func))
+			if (nih_str_buf_sprintf (buf,
+						 "static %s",
+						 object_func) < 0)
 				goto error;
 
 			if (method->async) {
@@ -554,10 +554,10 @@ node_object_functions (const void *parent,
 				if (! reply_func)
 					goto error;
 
-				if (! nih_strcat_sprintf (&code, parent,
-							  "\n"
-							  "%s",
-							  reply_func))
+				if (nih_str_buf_sprintf (buf,
+							 "\n"
+							 "%s",
+							 reply_func) < 0)
 					goto error;
 			}
 
@@ -567,7 +567,7 @@ node_object_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
@@ -577,21 +577,21 @@ node_object_functions (const void *parent,
 				if (! type_to_extern (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (handlers, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&method_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&method_externs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (externs, &func->entry);
 			}
 		}
@@ -612,24 +612,24 @@ node_object_functions (const void *parent,
 				goto error;
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
-			if (! nih_strcat (&code, parent, object_func))
+			if (nih_str_buf_append (buf, object_func) < 0)
 				goto error;
 
 			NIH_LIST_FOREACH_SAFE (&signal_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&signal_externs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (externs, &func->entry);
 			}
 		}
@@ -647,7 +647,7 @@ node_object_functions (const void *parent,
 			nih_list_init (&property_structs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -659,14 +659,14 @@ node_object_functions (const void *parent,
 				if (! get_func)
 					goto error;
 
-				if (! nih_strcat_sprintf (&code, parent,
-							  "static %s",
-							  get_func))
+				if (nih_str_buf_sprintf (buf,
+							 "static %s",
+							 get_func) < 0)
 					goto error;
 			}
 
 			if (property->access == NIH_DBUS_READWRITE) {
-				if (! nih_strcat (&code, parent, "\n"))
+				if (nih_str_buf_append (buf, "\n") < 0)
 					goto error;
 
 				/* Don't duplicate structures; these will
@@ -683,9 +683,9 @@ node_object_functions (const void *parent,
 				if (! set_func)
 					goto error;
 
-				if (! nih_strcat_sprintf (&code, parent,
-							  "static %s",
-							  set_func))
+				if (nih_str_buf_sprintf (buf,
+							 "static %s",
+							 set_func) < 0)
 					goto error;
 			}
 
@@ -695,7 +695,7 @@ node_object_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
@@ -705,23 +705,21 @@ node_object_functions (const void *parent,
 				if (! type_to_extern (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (handlers, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&property_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 		}
 	}
 
-	return code;
+	return nih_str_buf_finish (buf, parent);
 error:
-	nih_free (code);
-
 	return NULL;
 }
 
@@ -776,8 +774,8 @@ node_proxy_functions (const void *parent,
 		      NihList *   typedefs,
 		      NihList *   externs)
 {
-	char *code = NULL;
-	int   first = TRUE;
+	nih_local NihStrBuf *buf = NULL;
+	int                 first = TRUE;
 
 	nih_assert (prefix != NULL);
 	nih_assert (node != NULL);
@@ -786,8 +784,8 @@ node_proxy_functions (const void *parent,
 	nih_assert (typedefs != NULL);
 	nih_assert (externs != NULL);
 
-	code = nih_strdup (parent, "");
-	if (! code)
+	buf = nih_str_buf_new (NULL);
+	if (! buf)
 		return NULL;
 
 	NIH_LIST_FOREACH (&node->interfaces, interface_iter) {
@@ -812,7 +810,7 @@ node_proxy_functions (const void *parent,
 			nih_list_init (&method_externs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -835,15 +833,15 @@ node_proxy_functions (const void *parent,
 			if (! sync_func)
 				goto error;
 
-			if (! nih_strcat_sprintf (&code, parent,
-						  "%s"
-						  "\n"
-						  "static %s"
-						  "\n"
-						  "%s",
-						  proxy_func,
-						  notify_func,
-						  sync_func))
+			if (nih_str_buf_sprintf (buf,
+						 "%s"
+						 "\n"
+						 "static %s"
+						 "\n"
+						 "%s",
+						 proxy_func,
+						 notify_func,
+						 sync_func) < 0)
 				goto error;
 
 			NIH_LIST_FOREACH_SAFE (&method_prototypes, iter) {
@@ -852,28 +850,28 @@ node_proxy_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&method_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&method_typedefs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (typedefs, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&method_externs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (externs, &func->entry);
 			}
 		}
@@ -890,7 +888,7 @@ node_proxy_functions (const void *parent,
 			nih_list_init (&signal_typedefs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -901,9 +899,9 @@ node_proxy_functions (const void *parent,
 			if (! proxy_func)
 				goto error;
 
-			if (! nih_strcat_sprintf (&code, parent,
-						  "static %s",
-						  proxy_func))
+			if (nih_str_buf_sprintf (buf,
+						 "static %s",
+						 proxy_func) < 0)
 				goto error;
 
 			NIH_LIST_FOREACH_SAFE (&signal_prototypes, iter) {
@@ -912,21 +910,21 @@ node_proxy_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&signal_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&signal_typedefs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (typedefs, &func->entry);
 			}
 		}
@@ -950,7 +948,7 @@ node_proxy_functions (const void *parent,
 			nih_list_init (&property_externs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -974,20 +972,20 @@ node_proxy_functions (const void *parent,
 				if (! get_sync_func)
 					goto error;
 
-				if (! nih_strcat_sprintf (&code, parent,
-							  "%s"
-							  "\n"
-							  "static %s"
-							  "\n"
-							  "%s",
-							  get_func,
-							  get_notify_func,
-							  get_sync_func))
+				if (nih_str_buf_sprintf (buf,
+							 "%s"
+							 "\n"
+							 "static %s"
+							 "\n"
+							 "%s",
+							 get_func,
+							 get_notify_func,
+							 get_sync_func) < 0)
 					goto error;
 			}
 
 			if (property->access == NIH_DBUS_READWRITE)
-				if (! nih_strcat (&code, parent, "\n"))
+				if (nih_str_buf_append (buf, "\n") < 0)
 					goto error;
 
 			if (property->access != NIH_DBUS_READ) {
@@ -1013,15 +1011,15 @@ node_proxy_functions (const void *parent,
 				if (! set_sync_func)
 					goto error;
 
-				if (! nih_strcat_sprintf (&code, parent,
-							  "%s"
-							  "\n"
-							  "static %s"
-							  "\n"
-							  "%s",
-							  set_func,
-							  set_notify_func,
-							  set_sync_func))
+				if (nih_str_buf_sprintf (buf,
+							 "%s"
+							 "\n"
+							 "static %s"
+							 "\n"
+							 "%s",
+							 set_func,
+							 set_notify_func,
+							 set_sync_func) < 0)
 					goto error;
 			}
 
@@ -1031,28 +1029,28 @@ node_proxy_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&property_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&property_typedefs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (typedefs, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&property_externs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (externs, &func->entry);
 			}
 		}
@@ -1073,7 +1071,7 @@ node_proxy_functions (const void *parent,
 			nih_list_init (&all_externs);
 
 			if (! first)
-				if (! nih_strcat (&code, parent, "\n\n"))
+				if (nih_str_buf_append (buf, "\n\n") < 0)
 					goto error;
 			first = FALSE;
 
@@ -1096,15 +1094,15 @@ node_proxy_functions (const void *parent,
 			if (! get_all_sync_func)
 				goto error;
 
-			if (! nih_strcat_sprintf (&code, parent,
-						  "%s"
-						  "\n"
-						  "static %s"
-						  "\n"
-						  "%s",
-						  get_all_func,
-						  get_all_notify_func,
-						  get_all_sync_func))
+			if (nih_str_buf_sprintf (buf,
+						 "%s"
+						 "\n"
+						 "static %s"
+						 "\n"
+						 "%s",
+						 get_all_func,
+						 get_all_notify_func,
+						 get_all_sync_func) < 0)
 				goto error;
 
 			NIH_LIST_FOREACH_SAFE (&all_prototypes, iter) {
@@ -1113,36 +1111,34 @@ node_proxy_functions (const void *parent,
 				if (! type_to_static (&func->type, func))
 					goto error;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (prototypes, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&all_structs, iter) {
 				TypeStruct *structure = (TypeStruct *)iter;
 
-				nih_ref (structure, code);
+				nih_ref (structure, buf->str);
 				nih_list_add (structs, &structure->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&all_typedefs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (typedefs, &func->entry);
 			}
 
 			NIH_LIST_FOREACH_SAFE (&all_externs, iter) {
 				TypeFunc *func = (TypeFunc *)iter;
 
-				nih_ref (func, code);
+				nih_ref (func, buf->str);
 				nih_list_add (externs, &func->entry);
 			}
 		}
 	}
 
-	return code;
+	return nih_str_buf_finish (buf, parent);
 error:
-	nih_free (code);
-
 	return NULL;
 }
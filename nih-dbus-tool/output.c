@@ -96,11 +96,13 @@ output (const char *source_path,
 	NihList         typedefs;
 	NihList         vars;
 	NihList         externs;
-	nih_local char *array = NULL;
-	nih_local char *code = NULL;
-	nih_local char *source = NULL;
-	nih_local char *header = NULL;
-	nih_local char *sentinel = NULL;
+	nih_local char *     source_preamble = NULL;
+	nih_local char *     header_preamble = NULL;
+	nih_local char *     array = NULL;
+	nih_local char *     code = NULL;
+	nih_local NihStrBuf *source = NULL;
+	nih_local NihStrBuf *header = NULL;
+	nih_local char *     sentinel = NULL;
 
 	nih_assert (source_path != NULL);
 	nih_assert (source_fd >= 0);
@@ -119,31 +121,42 @@ output (const char *source_path,
 	/* Start off the text of the source file with the copyright preamble
 	 * and the list of includes.
 	 */
-	source = output_preamble (NULL, source_path);
+	source = nih_str_buf_new (NULL);
 	if (! source) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
-	if (! nih_strcat (&source, NULL,
-			  "#ifdef HAVE_CONFIG_H\n"
-			  "# include <config.h>\n"
-			  "#endif /* HAVE_CONFIG_H */\n"
-			  "\n"
-			  "\n"
-			  "#include <dbus/dbus.h>\n"
-			  "\n"
-			  "#include <stdint.h>\n"
-			  "#include <string.h>\n"
-			  "\n"
-			  "#include <nih/macros.h>\n"
-			  "#include <nih/alloc.h>\n"
-			  "#include <nih/string.h>\n"
-			  "#include <nih/logging.h>\n"
-			  "#include <nih/error.h>\n"
-			  "\n"
-			  "#include <nih-dbus/dbus_error.h>\n"
-			  "#include <nih-dbus/dbus_message.h>\n")) {
+	source_preamble = output_preamble (NULL, source_path);
+	if (! source_preamble) {
+		nih_error_raise_no_memory ();
+		return -1;
+	}
+
+	if (nih_str_buf_append (source, source_preamble) < 0) {
+		nih_error_raise_no_memory ();
+		return -1;
+	}
+
+	if (nih_str_buf_append (source,
+				"#ifdef HAVE_CONFIG_H\n"
+				"# include <config.h>\n"
+				"#endif /* HAVE_CONFIG_H */\n"
+				"\n"
+				"\n"
+				"#include <dbus/dbus.h>\n"
+				"\n"
+				"#include <stdint.h>\n"
+				"#include <string.h>\n"
+				"\n"
+				"#include <nih/macros.h>\n"
+				"#include <nih/alloc.h>\n"
+				"#include <nih/string.h>\n"
+				"#include <nih/logging.h>\n"
+				"#include <nih/error.h>\n"
+				"\n"
+				"#include <nih-dbus/dbus_error.h>\n"
+				"#include <nih-dbus/dbus_message.h>\n") < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
@@ -151,37 +164,48 @@ output (const char *source_path,
 	/* Start off the text of the header file with the copyright preamble,
 	 * sentinel and list of includes.
 	 */
-	header = output_preamble (NULL, NULL);
+	header = nih_str_buf_new (NULL);
 	if (! header) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
+	header_preamble = output_preamble (NULL, NULL);
+	if (! header_preamble) {
+		nih_error_raise_no_memory ();
+		return -1;
+	}
+
+	if (nih_str_buf_append (header, header_preamble) < 0) {
+		nih_error_raise_no_memory ();
+		return -1;
+	}
+
 	sentinel = output_sentinel (NULL, header_path);
 	if (! sentinel) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
-	if (! nih_strcat_sprintf (&header, NULL,
-				  "#ifndef %s\n"
-				  "#define %s\n"
-				  "\n",
-				  sentinel,
-				  sentinel)) {
+	if (nih_str_buf_sprintf (header,
+				 "#ifndef %s\n"
+				 "#define %s\n"
+				 "\n",
+				 sentinel,
+				 sentinel) < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
-	if (! nih_strcat (&header, NULL,
-			  "#include <dbus/dbus.h>\n"
-			  "\n"
-			  "#include <stdint.h>\n"
-			  "\n"
-			  "#include <nih/macros.h>\n"
-			  "\n"
-			  "#include <nih-dbus/dbus_interface.h>\n"
-			  "#include <nih-dbus/dbus_message.h>\n")) {
+	if (nih_str_buf_append (header,
+				"#include <dbus/dbus.h>\n"
+				"\n"
+				"#include <stdint.h>\n"
+				"\n"
+				"#include <nih/macros.h>\n"
+				"\n"
+				"#include <nih-dbus/dbus_interface.h>\n"
+				"#include <nih-dbus/dbus_message.h>\n") < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
@@ -198,8 +222,8 @@ output (const char *source_path,
 	 * prototypes, extern prototypes, etc.
 	 */
 	if (object) {
-		if (! nih_strcat (&source, NULL,
-				  "#include <nih-dbus/dbus_object.h>\n")) {
+		if (nih_str_buf_append (source,
+					"#include <nih-dbus/dbus_object.h>\n") < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -212,16 +236,16 @@ output (const char *source_path,
 			return -1;
 		}
 	} else {
-		if (! nih_strcat (&source, NULL,
-				  "#include <nih-dbus/dbus_pending_data.h>\n"
-				  "#include <nih-dbus/dbus_proxy.h>\n")) {
+		if (nih_str_buf_append (source,
+					"#include <nih-dbus/dbus_pending_data.h>\n"
+					"#include <nih-dbus/dbus_proxy.h>\n") < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
 
-		if (! nih_strcat (&header, NULL,
-				  "#include <nih-dbus/dbus_pending_data.h>\n"
-				  "#include <nih-dbus/dbus_proxy.h>\n")) {
+		if (nih_str_buf_append (header,
+					"#include <nih-dbus/dbus_pending_data.h>\n"
+					"#include <nih-dbus/dbus_proxy.h>\n") < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -238,20 +262,20 @@ output (const char *source_path,
 	/* errors.h is always the last header by style, followed by the
 	 * header itself.
 	 */
-	if (! nih_strcat_sprintf (&source, NULL,
-				  "#include <nih-dbus/errors.h>\n"
-				  "\n"
-				  "#include \"%s\"\n"
-				  "\n"
-				  "\n",
-				  header_path)) {
+	if (nih_str_buf_sprintf (source,
+				 "#include <nih-dbus/errors.h>\n"
+				 "\n"
+				 "#include \"%s\"\n"
+				 "\n"
+				 "\n",
+				 header_path) < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
-	if (! nih_strcat (&header, NULL,
-			  "\n"
-			  "\n")) {
+	if (nih_str_buf_append (header,
+				"\n"
+				"\n") < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
@@ -270,12 +294,12 @@ output (const char *source_path,
 			return -1;
 		}
 
-		if (! nih_strcat_sprintf (&source, NULL,
-					  "/* Prototypes for static functions */\n"
-					  "%s"
-					  "\n"
-					  "\n",
-					  block)) {
+		if (nih_str_buf_sprintf (source,
+					 "/* Prototypes for static functions */\n"
+					 "%s"
+					 "\n"
+					 "\n",
+					 block) < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -293,12 +317,12 @@ output (const char *source_path,
 			return -1;
 		}
 
-		if (! nih_strcat_sprintf (&source, NULL,
-					  "/* Prototypes for externally implemented handler functions */\n"
-					  "%s"
-					  "\n"
-					  "\n",
-					  block)) {
+		if (nih_str_buf_sprintf (source,
+					 "/* Prototypes for externally implemented handler functions */\n"
+					 "%s"
+					 "\n"
+					 "\n",
+					 block) < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -308,24 +332,24 @@ output (const char *source_path,
 	 * prototypes, interfaces, etc. for the node.  These refer to the
 	 * above prototypes.
 	 */
-	if (! nih_strcat_sprintf (&source, NULL,
-				  "%s"
-				  "\n"
-				  "\n",
-				  array)) {
+	if (nih_str_buf_sprintf (source,
+				 "%s"
+				 "\n"
+				 "\n",
+				 array) < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
 	/* Finally append all of the function code.
 	 */
-	if (! nih_strcat (&source, NULL, code)) {
+	if (nih_str_buf_append (source, code) < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
 	/* Write it */
-	if (output_write (source_fd, source) < 0)
+	if (output_write (source_fd, source->str) < 0)
 		return -1;
 
 
@@ -343,16 +367,16 @@ output (const char *source_path,
 				return -1;
 			}
 
-			if (! nih_strcat_sprintf (&header, NULL,
-						  "%s"
-						  "\n",
-						  block)) {
+			if (nih_str_buf_sprintf (header,
+						 "%s"
+						 "\n",
+						 block) < 0) {
 				nih_error_raise_no_memory ();
 				return -1;
 			}
 		}
 
-		if (! nih_strcat (&header, NULL, "\n")) {
+		if (nih_str_buf_append (header, "\n") < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -373,23 +397,23 @@ output (const char *source_path,
 				return -1;
 			}
 
-			if (! nih_strcat_sprintf (&header, NULL,
-						  "%s"
-						  "\n",
-						  block)) {
+			if (nih_str_buf_sprintf (header,
+						 "%s"
+						 "\n",
+						 block) < 0) {
 				nih_error_raise_no_memory ();
 				return -1;
 			}
 		}
 
-		if (! nih_strcat (&header, NULL, "\n")) {
+		if (nih_str_buf_append (header, "\n") < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
 	}
 
-	if (! nih_strcat (&header, NULL,
-			  "NIH_BEGIN_EXTERN\n")) {
+	if (nih_str_buf_append (header,
+				"NIH_BEGIN_EXTERN\n") < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
@@ -406,11 +430,11 @@ output (const char *source_path,
 			return -1;
 		}
 
-		if (! nih_strcat_sprintf (&header, NULL,
-					  "\n"
-					  "%s"
-					  "\n",
-					  block)) {
+		if (nih_str_buf_sprintf (header,
+					 "\n"
+					 "%s"
+					 "\n",
+					 block) < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
@@ -428,27 +452,27 @@ output (const char *source_path,
 			return -1;
 		}
 
-		if (! nih_strcat_sprintf (&header, NULL,
-					  "\n"
-					  "%s"
-					  "\n",
-					  block)) {
+		if (nih_str_buf_sprintf (header,
+					 "\n"
+					 "%s"
+					 "\n",
+					 block) < 0) {
 			nih_error_raise_no_memory ();
 			return -1;
 		}
 	}
 
-	if (! nih_strcat_sprintf (&header, NULL,
-				  "NIH_END_EXTERN\n"
-				  "\n"
-				  "#endif /* %s */\n",
-				  sentinel)) {
+	if (nih_str_buf_sprintf (header,
+				 "NIH_END_EXTERN\n"
+				 "\n"
+				 "#endif /* %s */\n",
+				 sentinel) < 0) {
 		nih_error_raise_no_memory ();
 		return -1;
 	}
 
 	/* Write it */
-	if (output_write (header_fd, header) < 0)
+	if (output_write (header_fd, header->str) < 0)
 		return -1;
 
 	return 0;
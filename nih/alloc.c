@@ -717,6 +717,29 @@ nih_alloc_ref_lookup (NihAllocCtx *parent,
 	return NULL;
 }
 
+/**
+ * nih_alloc_shared:
+ * @ptr: object to query.
+ *
+ * Determines whether @ptr is referenced by more than one parent, which
+ * may include the special NULL parent; an object that is not shared may
+ * be modified by its only parent without affecting anything else.
+ *
+ * Returns: TRUE if @ptr has more than one parent, FALSE otherwise.
+ **/
+int
+nih_alloc_shared (const void *ptr)
+{
+	NihAllocCtx *ctx;
+
+	nih_assert (ptr != NULL);
+
+	ctx = NIH_ALLOC_CTX (ptr);
+	nih_assert (ctx->destructor != NIH_ALLOC_FINALISED);
+
+	return ctx->parents.next != ctx->parents.prev;
+}
+
 
 /**
  * nih_alloc_size:
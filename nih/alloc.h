@@ -324,6 +324,7 @@ void   nih_ref                       (const void *ptr, const void *parent);
 void   nih_unref                     (void *ptr, const void *parent);
 
 int    nih_alloc_parent              (const void *ptr, const void *parent);
+int    nih_alloc_shared              (const void *ptr);
 
 size_t nih_alloc_size                (const void *ptr);
 
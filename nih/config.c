@@ -25,9 +25,16 @@
 
 
 #include <sys/types.h>
+#include <sys/stat.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
@@ -39,6 +46,165 @@
 #include <nih/errors.h>
 
 
+/**
+ * NihConfigClass:
+ *
+ * Bits set in the nih_config_class table for each character, describing
+ * which of the NIH_CONFIG_WS and NIH_CONFIG_CNL sets it belongs to and
+ * whether it's special within a token.
+ **/
+typedef enum {
+	NIH_CONFIG_CLASS_WS    = 01,
+	NIH_CONFIG_CLASS_CNL   = 02,
+	NIH_CONFIG_CLASS_TOKEN = 04,
+} NihConfigClass;
+
+/**
+ * nih_config_class:
+ *
+ * Table of character classes indexed by character, so that classifying
+ * a character while parsing is a single lookup rather than a call to
+ * strchr() scanning the NIH_CONFIG_WS or NIH_CONFIG_CNL strings.
+ *
+ * Since strchr() always finds the terminating NUL of its set, the NUL
+ * character is a member of every class; NIH_CONFIG_CLASS_TOKEN marks
+ * those characters that begin a quote or escape within a token.
+ **/
+static const unsigned char nih_config_class[256] = {
+	['\0'] = (NIH_CONFIG_CLASS_WS | NIH_CONFIG_CLASS_CNL
+		  | NIH_CONFIG_CLASS_TOKEN),
+	[' ']  = NIH_CONFIG_CLASS_WS,
+	['\t'] = NIH_CONFIG_CLASS_WS,
+	['\r'] = NIH_CONFIG_CLASS_WS,
+	['#']  = NIH_CONFIG_CLASS_CNL,
+	['\n'] = NIH_CONFIG_CLASS_CNL,
+	['"']  = NIH_CONFIG_CLASS_TOKEN,
+	['\''] = NIH_CONFIG_CLASS_TOKEN,
+	['\\'] = NIH_CONFIG_CLASS_TOKEN,
+};
+
+/**
+ * NIH_CONFIG_IS_WS:
+ * @_c: character to check.
+ *
+ * Returns: TRUE if @_c is in NIH_CONFIG_WS.
+ **/
+#define NIH_CONFIG_IS_WS(_c) \
+	(nih_config_class[(unsigned char)(_c)] & NIH_CONFIG_CLASS_WS)
+
+/**
+ * NIH_CONFIG_IS_CNL:
+ * @_c: character to check.
+ *
+ * Returns: TRUE if @_c is in NIH_CONFIG_CNL.
+ **/
+#define NIH_CONFIG_IS_CNL(_c) \
+	(nih_config_class[(unsigned char)(_c)] & NIH_CONFIG_CLASS_CNL)
+
+
+/**
+ * NIH_CONFIG_CACHE_MAGIC:
+ *
+ * Bytes found at the start of every binary configuration cache written
+ * by nih_config_parse_cached(), used to reject files that are not caches
+ * at all.
+ **/
+#define NIH_CONFIG_CACHE_MAGIC "NIHCFGC"
+
+
+/**
+ * NihConfigCacheHeader:
+ * @magic: NIH_CONFIG_CACHE_MAGIC,
+ * @version: NIH_CONFIG_CACHE_VERSION,
+ * @nstanzas: number of stanza records following the header,
+ * @dev: device of source file,
+ * @ino: inode of source file,
+ * @size: size of source file,
+ * @mtime_sec: modification time of source file,
+ * @mtime_nsec: nanoseconds part of @mtime_sec,
+ * @ctime_sec: status change time of source file,
+ * @ctime_nsec: nanoseconds part of @ctime_sec,
+ * @start_pos: offset within source file that parsing began,
+ * @end_pos: offset within source file that parsing finished,
+ * @end_lines: number of lines parsed,
+ * @strings_len: length of string table following the stanza records.
+ *
+ * This structure is found at the start of a binary configuration cache,
+ * it identifies the source file the cache was built from so that stale
+ * caches can be detected without reading the source.  All fields are
+ * fixed-size and stored in host byte order since the cache is never
+ * expected to be shared between machines.
+ **/
+typedef struct nih_config_cache_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t nstanzas;
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t  mtime_sec;
+	int64_t  mtime_nsec;
+	int64_t  ctime_sec;
+	int64_t  ctime_nsec;
+	uint64_t start_pos;
+	uint64_t end_pos;
+	uint64_t end_lines;
+	uint64_t strings_len;
+} NihConfigCacheHeader;
+
+/**
+ * NihConfigCacheRecord:
+ * @pos: offset of stanza arguments within source file,
+ * @lines: number of lines between the start of parsing and @pos,
+ * @name: offset of stanza name within string table.
+ *
+ * A stanza record is stored in the binary configuration cache for each
+ * stanza found in the source file, in order.  Replaying the cache calls
+ * the handler for @name with the position and line number given, so the
+ * top-level scan of whitespace, comments and stanza names is skipped.
+ **/
+typedef struct nih_config_cache_record {
+	uint64_t pos;
+	uint64_t lines;
+	uint64_t name;
+} NihConfigCacheRecord;
+
+/**
+ * NihConfigCacheStanza:
+ * @name: stanza name,
+ * @pos: offset of stanza arguments within file,
+ * @lines: number of lines between the start of parsing and @pos.
+ *
+ * In-memory form of NihConfigCacheRecord used while parsing.
+ **/
+typedef struct nih_config_cache_stanza {
+	char   *name;
+	size_t  pos;
+	size_t  lines;
+} NihConfigCacheStanza;
+
+/**
+ * NihConfigCacheBuilder:
+ * @start_lineno: line number that parsing began at,
+ * @stanzas: array of stanzas found,
+ * @nstanzas: number of entries in @stanzas,
+ * @failed: TRUE if a stanza could not be recorded.
+ *
+ * Used while parsing a file with nih_config_parse_cached() to record the
+ * stanza stream for writing out to the cache once parsing succeeds.
+ *
+ * @stanzas is grown geometrically, so may have room for more entries
+ * than @nstanzas.  Once @failed is set, no further stanzas are recorded
+ * and the cache is not written.
+ **/
+typedef struct nih_config_cache_builder {
+	size_t                start_lineno;
+	NihConfigCacheStanza *stanzas;
+	size_t                nstanzas;
+	int                   failed;
+} NihConfigCacheBuilder;
+
+
 /* Prototypes for static functions */
 static int              nih_config_block_end  (const char *file, size_t len,
 					       size_t *lineno, size_t *pos,
@@ -47,6 +213,40 @@ static int              nih_config_block_end  (const char *file, size_t len,
 	__attribute__ ((warn_unused_result));
 static NihConfigStanza *nih_config_get_stanza (const char *name,
 					       NihConfigStanza *stanzas);
+static int              nih_config_stanza_internal (const char *file,
+						    size_t len, size_t *pos,
+						    size_t *lineno,
+						    NihConfigStanza *stanzas,
+						    void *data,
+						    NihConfigCacheBuilder *cache)
+	__attribute__ ((warn_unused_result));
+static int              nih_config_file_internal (const char *file,
+						  size_t len, size_t *pos,
+						  size_t *lineno,
+						  NihConfigStanza *stanzas,
+						  void *data,
+						  NihConfigCacheBuilder *cache)
+	__attribute__ ((warn_unused_result));
+static int              nih_config_cache_add (NihConfigCacheBuilder *cache,
+						  const char *name,
+						  size_t pos, size_t lineno)
+	__attribute__ ((warn_unused_result));
+static char *           nih_config_cache_read_file (const void *parent,
+							const char *filename,
+							struct stat *statbuf,
+							size_t *len,
+							int *stable);
+static const char *     nih_config_cache_load (const char *cachename,
+					       const struct stat *statbuf,
+					       size_t start_pos,
+					       NihConfigStanza *stanzas,
+					       size_t *maplen);
+static void             nih_config_cache_write (const char *cachename,
+						const struct stat *statbuf,
+						size_t start_pos,
+						size_t end_pos,
+						size_t end_lines,
+						NihConfigCacheBuilder *cache);
 
 
 /**
@@ -84,7 +284,7 @@ nih_config_has_token (const char *file,
 	nih_assert (file != NULL);
 
 	p = (pos ? *pos : 0);
-	if ((p < len) && (! strchr (NIH_CONFIG_CNL, file[p]))) {
+	if ((p < len) && (! NIH_CONFIG_IS_CNL (file[p]))) {
 		return TRUE;
 	} else {
 		return FALSE;
@@ -141,12 +341,15 @@ nih_config_token (const char *file,
 		  int         dequote,
 		  size_t     *toklen)
 {
-	size_t  p, ws = 0, nlws = 0, qc = 0, i = 0;
-	int     slash = FALSE, quote = 0, nl = FALSE, ret = 0;
+	NihStrDelim dset;
+	size_t      p, ws = 0, nlws = 0, qc = 0, i = 0;
+	int         slash = FALSE, quote = 0, nl = FALSE, ret = 0;
 
 	nih_assert (file != NULL);
 	nih_assert (delim != NULL);
 
+	nih_str_delim_init (&dset, delim);
+
 	/* We keep track of the following:
 	 *   slash  whether a \ is in effect
 	 *   quote  whether " or ' is in effect (set to which)
@@ -170,7 +373,7 @@ nih_config_token (const char *file,
 					(*lineno)++;
 				continue;
 			} else if ((file[p] == '\\')
-				   || strchr (NIH_CONFIG_WS, file[p])) {
+				   || NIH_CONFIG_IS_WS (file[p])) {
 				extra++;
 				if (dequote)
 					qc++;
@@ -189,16 +392,16 @@ nih_config_token (const char *file,
 				if (lineno)
 					(*lineno)++;
 				continue;
-			} else if (strchr (NIH_CONFIG_WS, file[p])) {
+			} else if (NIH_CONFIG_IS_WS (file[p])) {
 				ws++;
 				continue;
 			}
 		} else if ((file[p] == '\"') || (file[p] == '\'')) {
 			quote = file[p];
 			isq = TRUE;
-		} else if (strchr (delim, file[p])) {
+		} else if (NIH_STR_IS_DELIM (&dset, file[p])) {
 			break;
-		} else if (strchr (NIH_CONFIG_WS, file[p])) {
+		} else if (NIH_CONFIG_IS_WS (file[p])) {
 			ws++;
 			continue;
 		}
@@ -235,6 +438,28 @@ nih_config_token (const char *file,
 		ws = 0;
 		nl = FALSE;
 		extra = 0;
+
+		/* Outside of a quote, the characters that follow up to the
+		 * next whitespace, delimiter, quote or escape need no special
+		 * handling, so copy them in one go.
+		 */
+		if (! quote) {
+			size_t run;
+
+			for (run = p + 1; run < len; run++)
+				if ((nih_config_class[(unsigned char)file[run]]
+				     & (NIH_CONFIG_CLASS_WS
+					| NIH_CONFIG_CLASS_TOKEN))
+				    || NIH_STR_IS_DELIM (&dset, file[run]))
+					break;
+
+			if (dest) {
+				memcpy (dest + i, file + p + 1, run - p - 1);
+				i += run - p - 1;
+			}
+
+			p = run - 1;
+		}
 	}
 
 	/* Add the NULL byte */
@@ -432,8 +657,12 @@ nih_config_next_line (const char *file,
 	nih_assert (pos != NULL);
 
 	/* Spool forwards until the end of the line */
-	while ((*pos < len) && (file[*pos] != '\n'))
-		(*pos)++;
+	if (*pos < len) {
+		const char *nl;
+
+		nl = memchr (file + *pos, '\n', len - *pos);
+		*pos = (nl ? (size_t)(nl - file) : len);
+	}
 
 	/* Step over it */
 	if (*pos < len) {
@@ -487,7 +716,7 @@ nih_config_skip_whitespace (const char *file,
 			} else {
 				break;
 			}
-		} else if (! strchr (NIH_CONFIG_WS, file[*pos])) {
+		} else if (! NIH_CONFIG_IS_WS (file[*pos])) {
 			break;
 		}
 
@@ -778,7 +1007,7 @@ nih_config_parse_block (const void *parent,
 
 		if (lines == 1) {
 			/* Count whitespace on the first line */
-			while ((p < len) && strchr (NIH_CONFIG_WS, file[p]))
+			while ((p < len) && NIH_CONFIG_IS_WS (file[p]))
 				p++;
 
 			ws = p - line_start;
@@ -940,7 +1169,7 @@ nih_config_block_end (const char *file,
 	p = *pos;
 
 	/* Skip initial whitespace */
-	while ((p < len) && strchr (NIH_CONFIG_WS, file[p]))
+	while ((p < len) && NIH_CONFIG_IS_WS (file[p]))
 		p++;
 
 	/* Check the first word (check we have at least 4 chars because of
@@ -950,12 +1179,12 @@ nih_config_block_end (const char *file,
 		return FALSE;
 
 	/* Must be whitespace after */
-	if (file[p + 3] && ! strchr (NIH_CONFIG_WS, file[p + 3]))
+	if (file[p + 3] && ! NIH_CONFIG_IS_WS (file[p + 3]))
 		return FALSE;
 
 	/* Find the second word */
 	p += 3;
-	while ((p < len) && strchr (NIH_CONFIG_WS, file[p]))
+	while ((p < len) && NIH_CONFIG_IS_WS (file[p]))
 		p++;
 
 	/* Check the second word */
@@ -965,7 +1194,7 @@ nih_config_block_end (const char *file,
 
 	/* May be followed by whitespace */
 	p += strlen (type);
-	while ((p < len) && strchr (NIH_CONFIG_WS, file[p]))
+	while ((p < len) && NIH_CONFIG_IS_WS (file[p]))
 		p++;
 
 	/* May be a comment, in which case eat up to the newline
@@ -1061,6 +1290,38 @@ nih_config_parse_stanza (const char      *file,
 			 size_t          *lineno,
 			 NihConfigStanza *stanzas,
 			 void            *data)
+{
+	nih_assert (file != NULL);
+	nih_assert (stanzas != NULL);
+
+	return nih_config_stanza_internal (file, len, pos, lineno,
+					   stanzas, data, NULL);
+}
+
+/**
+ * nih_config_stanza_internal:
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number,
+ * @stanzas: table of stanza handlers,
+ * @data: pointer to pass to stanza handler,
+ * @cache: cache builder to record stanza in.
+ *
+ * Implements nih_config_parse_stanza(), additionally recording the name
+ * of the stanza found and the position and line number of its arguments
+ * in @cache if that is not NULL.
+ *
+ * Returns: zero on success or negative value on raised error.
+ **/
+static int
+nih_config_stanza_internal (const char            *file,
+			    size_t                 len,
+			    size_t                *pos,
+			    size_t                *lineno,
+			    NihConfigStanza       *stanzas,
+			    void                  *data,
+			    NihConfigCacheBuilder *cache)
 {
 	NihConfigStanza *stanza;
 	nih_local char  *name = NULL;
@@ -1084,6 +1345,22 @@ nih_config_parse_stanza (const char      *file,
 		nih_return_error (-1, NIH_CONFIG_UNKNOWN_STANZA,
 				  _(NIH_CONFIG_UNKNOWN_STANZA_STR));
 
+	/* Failing to record the stanza only costs us the cache, so give
+	 * up on that and carry on parsing.
+	 */
+	if (cache && (! cache->failed)) {
+		nih_assert (lineno != NULL);
+
+		if (nih_config_cache_add (cache, name, p, *lineno) < 0) {
+			if (cache->stanzas)
+				nih_free (cache->stanzas);
+
+			cache->stanzas = NULL;
+			cache->nstanzas = 0;
+			cache->failed = TRUE;
+		}
+	}
+
 	ret = stanza->handler (data, stanza, file, len, &p, lineno);
 
 finish:
@@ -1093,6 +1370,60 @@ finish:
 	return ret;
 }
 
+/**
+ * nih_config_cache_add:
+ * @cache: cache builder to record stanza in,
+ * @name: name of stanza,
+ * @pos: offset of stanza arguments within file,
+ * @lineno: line number of @pos.
+ *
+ * Appends a record of the stanza @name to @cache, at least doubling the
+ * size of the array of stanzas when it must be reallocated so that
+ * recording each stanza takes constant time on average.
+ *
+ * Returns: zero on success or negative value if insufficient memory.
+ **/
+static int
+nih_config_cache_add (NihConfigCacheBuilder *cache,
+		      const char            *name,
+		      size_t                 pos,
+		      size_t                 lineno)
+{
+	NihConfigCacheStanza *stanza;
+	size_t                size;
+
+	nih_assert (cache != NULL);
+	nih_assert (name != NULL);
+
+	size = (cache->stanzas
+		? nih_alloc_size (cache->stanzas) / sizeof (NihConfigCacheStanza)
+		: 0);
+	if (cache->nstanzas >= size) {
+		NihConfigCacheStanza *new_stanzas;
+
+		size = (size ? size * 2 : 8);
+		if (size >= SIZE_MAX / sizeof (NihConfigCacheStanza))
+			return -1;
+
+		new_stanzas = nih_realloc (cache->stanzas, cache,
+					   sizeof (NihConfigCacheStanza) * size);
+		if (! new_stanzas)
+			return -1;
+
+		cache->stanzas = new_stanzas;
+	}
+
+	stanza = &cache->stanzas[cache->nstanzas];
+	stanza->name = nih_strdup (cache->stanzas, name);
+	if (! stanza->name)
+		return -1;
+
+	stanza->pos = pos;
+	stanza->lines = lineno - cache->start_lineno;
+	cache->nstanzas++;
+
+	return 0;
+}
 
 /**
  * nih_config_parse_file:
@@ -1127,6 +1458,37 @@ nih_config_parse_file (const char      *file,
 		       size_t          *lineno,
 		       NihConfigStanza *stanzas,
 		       void            *data)
+{
+	nih_assert (file != NULL);
+	nih_assert (stanzas != NULL);
+
+	return nih_config_file_internal (file, len, pos, lineno,
+					 stanzas, data, NULL);
+}
+
+/**
+ * nih_config_file_internal:
+ * @file: file or string to parse,
+ * @len: length of @file,
+ * @pos: offset within @file,
+ * @lineno: line number,
+ * @stanzas: table of stanza handlers,
+ * @data: pointer to pass to stanza handler,
+ * @cache: cache builder to record stanzas in.
+ *
+ * Implements nih_config_parse_file(), additionally recording each stanza
+ * found in @cache if that is not NULL.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+nih_config_file_internal (const char            *file,
+			  size_t                 len,
+			  size_t                *pos,
+			  size_t                *lineno,
+			  NihConfigStanza       *stanzas,
+			  void                  *data,
+			  NihConfigCacheBuilder *cache)
 {
 	int    ret = -1;
 	size_t p;
@@ -1138,7 +1500,7 @@ nih_config_parse_file (const char      *file,
 
 	while (p < len) {
 		/* Skip initial whitespace */
-		while ((p < len) && strchr (NIH_CONFIG_WS, file[p]))
+		while ((p < len) && NIH_CONFIG_IS_WS (file[p]))
 			p++;
 
 		/* Skip lines with only comments in them; because has_token
@@ -1154,8 +1516,8 @@ nih_config_parse_file (const char      *file,
 		}
 
 		/* Must have a stanza, parse it */
-		if (nih_config_parse_stanza (file, len, &p, lineno,
-						     stanzas, data) < 0)
+		if (nih_config_stanza_internal (file, len, &p, lineno,
+						stanzas, data, cache) < 0)
 			goto finish;
 	}
 
@@ -1212,3 +1574,469 @@ nih_config_parse (const char      *filename,
 
 	return ret;
 }
+
+
+/**
+ * nih_config_parse_cached:
+ * @filename: name of file to parse,
+ * @cachename: name of binary cache file,
+ * @pos: offset within @file,
+ * @lineno: line number,
+ * @stanzas: table of stanza handlers,
+ * @data: pointer to pass to stanza handler.
+ *
+ * Reads @filename into memory and parses configuration lines from it in
+ * the same manner as nih_config_parse(), but uses the binary cache stored
+ * in @cachename to avoid scanning the file for stanzas.
+ *
+ * The cache records the identity of @filename (device, inode, size and
+ * modification times) along with the name, position and line number of
+ * each stanza found; when it matches, the stanza handlers are called
+ * directly at the recorded positions without tokenising the whitespace,
+ * comments and stanza names between them.  Handlers still receive the
+ * text of @filename so that they may parse their own arguments.
+ *
+ * When @cachename does not exist, is stale, was written by a different
+ * version of this library or otherwise fails validation, @filename is
+ * parsed as text and, if that succeeds, a fresh cache is written out to
+ * @cachename.  Failure to record the stanzas or write the cache is not an
+ * error.
+ *
+ * If @pos is given then it will be used as the offset within @file to
+ * begin (otherwise the start is assumed), and will be updated to point
+ * to @delim or past the end of the file.
+ *
+ * If @lineno is given it will be incremented each time a new line is
+ * discovered in the file.  Handlers always receive a line number, even
+ * if @lineno is NULL.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+int
+nih_config_parse_cached (const char      *filename,
+			 const char      *cachename,
+			 size_t          *pos,
+			 size_t          *lineno,
+			 NihConfigStanza *stanzas,
+			 void            *data)
+{
+	nih_local char        *file = NULL;
+	NihConfigCacheBuilder *cache;
+	struct stat            statbuf;
+	const char            *map = NULL;
+	size_t                 len, maplen, p, line;
+	int                    stable, ret = -1;
+
+	nih_assert (filename != NULL);
+	nih_assert (cachename != NULL);
+	nih_assert (stanzas != NULL);
+
+	file = nih_config_cache_read_file (NULL, filename, &statbuf, &len,
+					   &stable);
+	if (! file)
+		return -1;
+
+	p = (pos ? *pos : 0);
+	line = 1;
+
+	/* Replay the cache if it's valid for the text we read; if the file
+	 * changed while we were reading it, we can't tell which version we
+	 * have, so neither use nor write the cache.
+	 */
+	if (stable)
+		map = nih_config_cache_load (cachename, &statbuf, p, stanzas,
+					     &maplen);
+	if (map) {
+		const NihConfigCacheHeader *header;
+		const NihConfigCacheRecord *records;
+		const char *                strings;
+
+		header = (const NihConfigCacheHeader *)map;
+		records = (const NihConfigCacheRecord *)(map + sizeof (NihConfigCacheHeader));
+		strings = (const char *)(records + header->nstanzas);
+
+		for (uint32_t i = 0; i < header->nstanzas; i++) {
+			NihConfigStanza *stanza;
+
+			stanza = nih_config_get_stanza (strings + records[i].name,
+							stanzas);
+			nih_assert (stanza != NULL);
+
+			p = records[i].pos;
+			line = 1 + records[i].lines;
+
+			if (stanza->handler (data, stanza, file, len,
+					     &p, &line) < 0)
+				goto finish;
+		}
+
+		p = header->end_pos;
+		line = 1 + header->end_lines;
+		ret = 0;
+
+		goto finish;
+	}
+
+	/* Cache is missing or stale, parse the text and record the stanzas
+	 * as we go, writing them out if the parse succeeds.  If there's
+	 * not enough memory to record them, just parse the text.
+	 */
+	cache = nih_new (file, NihConfigCacheBuilder);
+	if (cache) {
+		cache->start_lineno = line;
+		cache->stanzas = NULL;
+		cache->nstanzas = 0;
+		cache->failed = FALSE;
+	}
+
+	ret = nih_config_file_internal (file, len, &p, &line,
+					stanzas, data, cache);
+	if ((ret == 0) && stable && cache && (! cache->failed))
+		nih_config_cache_write (cachename, &statbuf, pos ? *pos : 0,
+					p, line - 1, cache);
+
+finish:
+	if (map)
+		nih_file_unmap ((void *)map, maplen);
+
+	if (pos)
+		*pos = p;
+	if (lineno)
+		*lineno = line;
+
+	return ret;
+}
+
+/**
+ * nih_config_cache_read_file:
+ * @parent: parent object for new string,
+ * @filename: name of file to read,
+ * @statbuf: stat of file read,
+ * @len: pointer to store length of file,
+ * @stable: set to FALSE if the file changed while being read.
+ *
+ * Reads @filename into memory, filling @statbuf with the details of the
+ * file from the same descriptor the text is read from so that the cache
+ * is validated against the file actually read.  The descriptor is
+ * checked again once the file has been read, and @stable set to FALSE if
+ * it was modified in the mean time.  If the file was truncated while it
+ * was being read, the text that could be read is returned with @len set
+ * to its length and @stable set to FALSE.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: contents of file, which is not NULL terminated, or NULL on
+ * raised error.
+ **/
+static char *
+nih_config_cache_read_file (const void  *parent,
+			    const char  *filename,
+			    struct stat *statbuf,
+			    size_t      *len,
+			    int         *stable)
+{
+	struct stat  after;
+	char        *file = NULL;
+	size_t       done;
+	int          fd;
+
+	nih_assert (filename != NULL);
+	nih_assert (statbuf != NULL);
+	nih_assert (len != NULL);
+	nih_assert (stable != NULL);
+
+	fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		nih_return_system_error (NULL);
+
+	if (fstat (fd, statbuf) < 0)
+		goto error;
+
+	if ((statbuf->st_size < 0)
+	    || ((uintmax_t)statbuf->st_size > SIZE_MAX)) {
+		errno = EFBIG;
+		goto error;
+	}
+
+	*len = statbuf->st_size;
+
+	file = nih_alloc (parent, *len ? *len : 1);
+	if (! file)
+		goto error;
+
+	done = 0;
+	while (done < *len) {
+		ssize_t ret;
+
+		ret = read (fd, file + done, *len - done);
+		if ((ret < 0) && (errno == EINTR)) {
+			continue;
+		} else if (ret < 0) {
+			goto error;
+		} else if (ret == 0) {
+			/* File was truncated while we were reading it */
+			*len = done;
+			break;
+		}
+
+		done += ret;
+	}
+
+	if (fstat (fd, &after) < 0)
+		goto error;
+
+	*stable = ((*len == (size_t)statbuf->st_size)
+		   && (after.st_size == statbuf->st_size)
+		   && (after.st_mtim.tv_sec == statbuf->st_mtim.tv_sec)
+		   && (after.st_mtim.tv_nsec == statbuf->st_mtim.tv_nsec)
+		   && (after.st_ctim.tv_sec == statbuf->st_ctim.tv_sec)
+		   && (after.st_ctim.tv_nsec == statbuf->st_ctim.tv_nsec));
+
+	close (fd);
+	return file;
+
+error:
+	nih_error_raise_system ();
+	if (file)
+		nih_free (file);
+	close (fd);
+	return NULL;
+}
+
+/**
+ * nih_config_cache_load:
+ * @cachename: name of binary cache file,
+ * @statbuf: stat of source file,
+ * @start_pos: offset within source file that parsing begins,
+ * @stanzas: table of stanza handlers,
+ * @maplen: pointer to store length of mapping.
+ *
+ * Maps the binary cache @cachename into memory and validates it against
+ * the source file identity in @statbuf, checking that all offsets within
+ * it are in range and that every stanza it names can be found in
+ * @stanzas.
+ *
+ * Any error mapping the cache is discarded, since the caller simply falls
+ * back to parsing the text.
+ *
+ * Returns: mapped cache that should be unmapped with nih_file_unmap(),
+ * or NULL if the cache is not valid.
+ **/
+static const char *
+nih_config_cache_load (const char        *cachename,
+		       const struct stat *statbuf,
+		       size_t             start_pos,
+		       NihConfigStanza   *stanzas,
+		       size_t            *maplen)
+{
+	const NihConfigCacheHeader *header;
+	const NihConfigCacheRecord *records;
+	const char *                strings;
+	char *                      map;
+	uint64_t                    last_pos;
+
+	nih_assert (cachename != NULL);
+	nih_assert (statbuf != NULL);
+	nih_assert (stanzas != NULL);
+	nih_assert (maplen != NULL);
+
+	map = nih_file_map (cachename, O_RDONLY, maplen);
+	if (! map) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_free (err);
+
+		return NULL;
+	}
+
+	if (*maplen < sizeof (NihConfigCacheHeader))
+		goto invalid;
+
+	header = (const NihConfigCacheHeader *)map;
+	if (memcmp (header->magic, NIH_CONFIG_CACHE_MAGIC,
+		    sizeof (header->magic))
+	    || (header->version != NIH_CONFIG_CACHE_VERSION))
+		goto invalid;
+
+	/* Check the cache was built from this version of the file */
+	if ((header->dev != (uint64_t)statbuf->st_dev)
+	    || (header->ino != (uint64_t)statbuf->st_ino)
+	    || (header->size != (uint64_t)statbuf->st_size)
+	    || (header->mtime_sec != (int64_t)statbuf->st_mtim.tv_sec)
+	    || (header->mtime_nsec != (int64_t)statbuf->st_mtim.tv_nsec)
+	    || (header->ctime_sec != (int64_t)statbuf->st_ctim.tv_sec)
+	    || (header->ctime_nsec != (int64_t)statbuf->st_ctim.tv_nsec)
+	    || (header->start_pos != start_pos))
+		goto invalid;
+
+	/* And that it's all there */
+	if ((header->nstanzas > ((*maplen - sizeof (NihConfigCacheHeader))
+				 / sizeof (NihConfigCacheRecord)))
+	    || (*maplen != (sizeof (NihConfigCacheHeader)
+			    + (sizeof (NihConfigCacheRecord) * header->nstanzas)
+			    + header->strings_len))
+	    || (header->end_pos > header->size))
+		goto invalid;
+
+	records = (const NihConfigCacheRecord *)(map + sizeof (NihConfigCacheHeader));
+	strings = (const char *)(records + header->nstanzas);
+
+	if (header->strings_len && strings[header->strings_len - 1])
+		goto invalid;
+
+	/* Stanzas must be in order and each must name a known handler,
+	 * otherwise we'd call some handlers and then fail part way through.
+	 */
+	last_pos = start_pos;
+	for (uint32_t i = 0; i < header->nstanzas; i++) {
+		if ((records[i].pos < last_pos)
+		    || (records[i].pos > header->end_pos)
+		    || (records[i].lines > header->end_lines)
+		    || (records[i].name >= header->strings_len))
+			goto invalid;
+
+		if (! nih_config_get_stanza (strings + records[i].name,
+					     stanzas))
+			goto invalid;
+
+		last_pos = records[i].pos;
+	}
+
+	return map;
+
+invalid:
+	nih_file_unmap (map, *maplen);
+	return NULL;
+}
+
+/**
+ * nih_config_cache_write:
+ * @cachename: name of binary cache file,
+ * @statbuf: stat of source file,
+ * @start_pos: offset within source file that parsing began,
+ * @end_pos: offset within source file that parsing finished,
+ * @end_lines: number of lines parsed,
+ * @cache: stanzas recorded while parsing.
+ *
+ * Serialises the stanzas recorded in @cache into the binary cache file
+ * @cachename, identified by the source file details in @statbuf.
+ *
+ * The cache is written to a temporary file alongside @cachename and
+ * renamed over it so that readers never see a partial cache.  The cache
+ * is only an optimisation, so any error is discarded.
+ **/
+static void
+nih_config_cache_write (const char            *cachename,
+			const struct stat     *statbuf,
+			size_t                 start_pos,
+			size_t                 end_pos,
+			size_t                 end_lines,
+			NihConfigCacheBuilder *cache)
+{
+	nih_local char       *tmpname = NULL;
+	nih_local char       *buf = NULL;
+	NihConfigCacheHeader *header;
+	NihConfigCacheRecord *records;
+	char                 *strings;
+	size_t                strings_len, buflen, written;
+	int                   fd;
+
+	nih_assert (cachename != NULL);
+	nih_assert (statbuf != NULL);
+	nih_assert (cache != NULL);
+
+	strings_len = 0;
+	for (size_t i = 0; i < cache->nstanzas; i++)
+		strings_len += strlen (cache->stanzas[i].name) + 1;
+
+	buflen = (sizeof (NihConfigCacheHeader)
+		  + (sizeof (NihConfigCacheRecord) * cache->nstanzas)
+		  + strings_len);
+	buf = nih_alloc (NULL, buflen);
+	if (! buf)
+		return;
+
+	header = (NihConfigCacheHeader *)buf;
+	memset (header, 0, sizeof (NihConfigCacheHeader));
+	memcpy (header->magic, NIH_CONFIG_CACHE_MAGIC, sizeof (header->magic));
+	header->version = NIH_CONFIG_CACHE_VERSION;
+	header->nstanzas = cache->nstanzas;
+	header->dev = statbuf->st_dev;
+	header->ino = statbuf->st_ino;
+	header->size = statbuf->st_size;
+	header->mtime_sec = statbuf->st_mtim.tv_sec;
+	header->mtime_nsec = statbuf->st_mtim.tv_nsec;
+	header->ctime_sec = statbuf->st_ctim.tv_sec;
+	header->ctime_nsec = statbuf->st_ctim.tv_nsec;
+	header->start_pos = start_pos;
+	header->end_pos = end_pos;
+	header->end_lines = end_lines;
+	header->strings_len = strings_len;
+
+	records = (NihConfigCacheRecord *)(buf + sizeof (NihConfigCacheHeader));
+	strings = (char *)(records + cache->nstanzas);
+
+	strings_len = 0;
+	for (size_t i = 0; i < cache->nstanzas; i++) {
+		size_t namelen;
+
+		records[i].pos = cache->stanzas[i].pos;
+		records[i].lines = cache->stanzas[i].lines;
+		records[i].name = strings_len;
+
+		namelen = strlen (cache->stanzas[i].name) + 1;
+		memcpy (strings + strings_len, cache->stanzas[i].name, namelen);
+		strings_len += namelen;
+	}
+
+	/* Write to a uniquely named file in the same directory, so that
+	 * concurrent writers can't clobber each other's half-written cache
+	 * and the rename below is atomic.
+	 */
+	tmpname = nih_sprintf (NULL, "%s.XXXXXX", cachename);
+	if (! tmpname)
+		return;
+
+	fd = mkstemp (tmpname);
+	if (fd < 0)
+		return;
+
+	if (fchmod (fd, 0644) < 0) {
+		close (fd);
+		unlink (tmpname);
+		return;
+	}
+
+	written = 0;
+	while (written < buflen) {
+		ssize_t ret;
+
+		ret = write (fd, buf + written, buflen - written);
+		if ((ret < 0) && (errno == EINTR)) {
+			continue;
+		} else if (ret < 0) {
+			close (fd);
+			unlink (tmpname);
+			return;
+		}
+
+		written += ret;
+	}
+
+	/* Make sure the contents are on disk before the rename makes them
+	 * visible, otherwise a crash could leave a valid header pointing at
+	 * garbage.
+	 */
+	if (fsync (fd) < 0) {
+		close (fd);
+		unlink (tmpname);
+		return;
+	}
+
+	if ((close (fd) < 0) || (rename (tmpname, cachename) < 0))
+		unlink (tmpname);
+}
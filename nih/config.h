@@ -35,6 +35,10 @@
  *
  * Configuration can be parsed as a file with nih_config_parse_file() or
  * as a string with nih_config_parse().
+ *
+ * To speed up parsing of files that rarely change, nih_config_parse_cached()
+ * keeps a binary cache of the stanzas found in a file and replays it while
+ * the file is unchanged.
  **/
 
 #include <sys/types.h>
@@ -127,6 +131,15 @@ struct nih_config_stanza {
 #define NIH_CONFIG_CNLWS " \t\r#\n"
 
 
+/**
+ * NIH_CONFIG_CACHE_VERSION:
+ *
+ * Version of the binary cache format written by nih_config_parse_cached();
+ * caches with any other version are ignored and rewritten.
+ **/
+#define NIH_CONFIG_CACHE_VERSION 1
+
+
 NIH_BEGIN_EXTERN
 
 int       nih_config_has_token       (const char *file, size_t len,
@@ -182,6 +195,11 @@ int       nih_config_parse           (const char *filename, size_t *pos,
 				      size_t *lineno, NihConfigStanza *stanzas,
 				      void *data)
 	__attribute__ ((warn_unused_result));
+int       nih_config_parse_cached    (const char *filename,
+				      const char *cachename, size_t *pos,
+				      size_t *lineno, NihConfigStanza *stanzas,
+				      void *data)
+	__attribute__ ((warn_unused_result));
 
 NIH_END_EXTERN
 
@@ -42,6 +42,8 @@ enum {
 
 	NIH_DIR_LOOP_DETECTED,
 
+	NIH_IO_LINE_TOO_LONG,
+
 	/* 0x20000 thru 0x2FFFF reserved for applications */
 	NIH_ERROR_APPLICATION_START = 0x20000L,
 
@@ -62,4 +64,6 @@ enum {
 
 #define NIH_DIR_LOOP_DETECTED_STR          N_("Directory loop detected")
 
+#define NIH_IO_LINE_TOO_LONG_STR           N_("Line too long")
+
 #endif /* NIH_ERRORS_H */
@@ -0,0 +1,576 @@
+/* libnih
+ *
+ * flat_hash.c - open addressing hash table implementation
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <endian.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/logging.h>
+#include <nih/alloc.h>
+
+#include "flat_hash.h"
+
+
+/**
+ * LSB:
+ *
+ * Group word with the lowest bit of each control byte set, used to
+ * broadcast a byte to each position in the group.
+ **/
+#define LSB 0x0101010101010101ULL
+
+/**
+ * MSB:
+ *
+ * Group word with the highest bit of each control byte set, the result
+ * of matching a group has only these bits set for matching slots.
+ **/
+#define MSB 0x8080808080808080ULL
+
+
+/* Prototypes for static functions */
+static size_t nih_flat_hash_pick_capacity (size_t entries);
+static int    nih_flat_hash_resize        (NihFlatHash *hash,
+					   size_t capacity);
+static size_t nih_flat_hash_find_free     (NihFlatHash *hash,
+					   uint32_t hashval);
+static NihFlatHashSlot *nih_flat_hash_probe (NihFlatHash *hash,
+					     const void *key,
+					     uint32_t hashval);
+
+
+/**
+ * nih_flat_hash_group:
+ * @ctrl: control bytes of group.
+ *
+ * Loads the control bytes of a group into a single word so that they may
+ * be examined together, with the control byte of the first slot in the
+ * lowest bits regardless of the byte order of the machine.
+ *
+ * Returns: group word.
+ **/
+static inline uint64_t
+nih_flat_hash_group (const uint8_t *ctrl)
+{
+	uint64_t group;
+
+	memcpy (&group, ctrl, sizeof (group));
+
+	return le64toh (group);
+}
+
+/**
+ * nih_flat_hash_match:
+ * @group: group word,
+ * @h2: seven-bit hash to look for.
+ *
+ * Matches every control byte in @group against @h2.  This may rarely
+ * report a full slot that does not match, but never misses one that does.
+ *
+ * Returns: MSB bit set for each matching slot.
+ **/
+static inline uint64_t
+nih_flat_hash_match (uint64_t group,
+		     uint8_t  h2)
+{
+	uint64_t x = group ^ (LSB * h2);
+
+	return (x - LSB) & ~x & MSB;
+}
+
+/**
+ * nih_flat_hash_match_empty:
+ * @group: group word.
+ *
+ * Returns: MSB bit set for each empty slot in @group.
+ **/
+static inline uint64_t
+nih_flat_hash_match_empty (uint64_t group)
+{
+	return group & ~(group << 1) & MSB;
+}
+
+/**
+ * nih_flat_hash_match_free:
+ * @group: group word.
+ *
+ * Returns: MSB bit set for each empty or deleted slot in @group.
+ **/
+static inline uint64_t
+nih_flat_hash_match_free (uint64_t group)
+{
+	return group & MSB;
+}
+
+/**
+ * nih_flat_hash_first:
+ * @match: result of matching a group.
+ *
+ * Returns: index within the group of the first slot set in @match.
+ **/
+static inline size_t
+nih_flat_hash_first (uint64_t match)
+{
+	return __builtin_ctzll (match) / 8;
+}
+
+
+/**
+ * nih_flat_hash_new:
+ * @parent: parent of new hash,
+ * @entries: rough number of entries expected,
+ * @hash_function: function used to obtain hash for keys,
+ * @cmp_function: function used to compare keys.
+ *
+ * Allocates a new hash table with enough slots to hold @entries without
+ * being resized; the table is never shrunk below this size.
+ *
+ * Keys are stored as pointers, so must remain valid while the entry is in
+ * the table, to convert a key into a hash @hash_function must be provided
+ * and to compare keys @cmp_function must be provided.  The
+ * nih_flat_hash_string_new() macro wraps this function for the common
+ * case of a string key.
+ *
+ * The slots are allocated as a child of the returned hash table using
+ * nih_alloc().
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned hash table.  When all parents
+ * of the returned hash table are freed, the returned hash table will also be
+ * freed.
+ *
+ * Returns: the new hash table or NULL if the allocation failed.
+ **/
+NihFlatHash *
+nih_flat_hash_new (const void      *parent,
+		   size_t           entries,
+		   NihHashFunction  hash_function,
+		   NihCmpFunction   cmp_function)
+{
+	NihFlatHash *hash;
+
+	nih_assert (hash_function != NULL);
+	nih_assert (cmp_function != NULL);
+
+	hash = nih_new (parent, NihFlatHash);
+	if (! hash)
+		return NULL;
+
+	hash->slots = NULL;
+	hash->ctrl = NULL;
+	hash->capacity = 0;
+
+	hash->entries = 0;
+	hash->growth_left = 0;
+	hash->min_capacity = nih_flat_hash_pick_capacity (entries);
+
+	hash->hash_function = hash_function;
+	hash->cmp_function = cmp_function;
+
+	if (nih_flat_hash_resize (hash, hash->min_capacity) < 0) {
+		nih_free (hash);
+		return NULL;
+	}
+
+	return hash;
+}
+
+/**
+ * nih_flat_hash_pick_capacity:
+ * @entries: number of entries.
+ *
+ * Picks the number of slots for a hash table that will hold @entries,
+ * which is the smallest power of two that leaves at least one in eight
+ * slots empty.
+ *
+ * Returns: number of slots.
+ **/
+static size_t
+nih_flat_hash_pick_capacity (size_t entries)
+{
+	size_t capacity;
+
+	capacity = NIH_FLAT_HASH_GROUP;
+	while (capacity - capacity / 8 < entries)
+		capacity *= 2;
+
+	return capacity;
+}
+
+/**
+ * nih_flat_hash_resize:
+ * @hash: hash table,
+ * @capacity: new number of slots.
+ *
+ * Allocates a new array of @capacity slots for @hash, moving the existing
+ * entries into it and discarding any deleted slots.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+static int
+nih_flat_hash_resize (NihFlatHash *hash,
+		      size_t       capacity)
+{
+	NihFlatHashSlot *old_slots;
+	uint8_t         *old_ctrl;
+	size_t           old_capacity;
+	void            *block;
+
+	nih_assert (hash != NULL);
+	nih_assert (capacity >= NIH_FLAT_HASH_GROUP);
+	nih_assert (capacity - capacity / 8 >= hash->entries);
+
+	/* Slots and control bytes share a single allocation, with the
+	 * slots first so they're aligned.
+	 */
+	block = nih_alloc (hash, capacity * (sizeof (NihFlatHashSlot) + 1));
+	if (! block)
+		return -1;
+
+	old_slots = hash->slots;
+	old_ctrl = hash->ctrl;
+	old_capacity = hash->capacity;
+
+	hash->slots = block;
+	hash->ctrl = (uint8_t *)(hash->slots + capacity);
+	hash->capacity = capacity;
+	hash->growth_left = capacity - capacity / 8 - hash->entries;
+
+	memset (hash->ctrl, NIH_FLAT_HASH_EMPTY, capacity);
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		uint32_t hashval;
+		size_t   idx;
+
+		if (! NIH_FLAT_HASH_FULL (old_ctrl[i]))
+			continue;
+
+		hashval = hash->hash_function (old_slots[i].key);
+		idx = nih_flat_hash_find_free (hash, hashval);
+
+		hash->ctrl[idx] = hashval & 0x7f;
+		hash->slots[idx] = old_slots[i];
+	}
+
+	if (old_slots)
+		nih_free (old_slots);
+
+	return 0;
+}
+
+/**
+ * nih_flat_hash_find_free:
+ * @hash: hash table,
+ * @hashval: hash of key.
+ *
+ * Finds the first empty or deleted slot in the probe sequence for
+ * @hashval; there must always be one.
+ *
+ * Returns: index of slot.
+ **/
+static size_t
+nih_flat_hash_find_free (NihFlatHash *hash,
+			 uint32_t     hashval)
+{
+	size_t mask, group, step;
+
+	nih_assert (hash != NULL);
+
+	mask = hash->capacity / NIH_FLAT_HASH_GROUP - 1;
+	group = (hashval >> 7) & mask;
+
+	for (step = 1; ; step++) {
+		size_t   base = group * NIH_FLAT_HASH_GROUP;
+		uint64_t match;
+
+		match = nih_flat_hash_match_free (
+			nih_flat_hash_group (&hash->ctrl[base]));
+		if (match)
+			return base + nih_flat_hash_first (match);
+
+		group = (group + step) & mask;
+	}
+}
+
+
+/**
+ * nih_flat_hash_reserve:
+ * @hash: hash table,
+ * @entries: number of entries.
+ *
+ * Ensures that @hash has enough slots to hold @entries without being
+ * resized again, which saves repeatedly resizing the table when a large
+ * number of entries are about to be inserted.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+nih_flat_hash_reserve (NihFlatHash *hash,
+		       size_t       entries)
+{
+	size_t capacity;
+
+	nih_assert (hash != NULL);
+
+	if (entries <= hash->entries + hash->growth_left)
+		return 0;
+
+	capacity = nih_flat_hash_pick_capacity (entries);
+	if (capacity < hash->capacity)
+		capacity = hash->capacity;
+
+	return nih_flat_hash_resize (hash, capacity);
+}
+
+/**
+ * nih_flat_hash_insert:
+ * @hash: destination hash table,
+ * @key: key of entry,
+ * @value: value of entry.
+ *
+ * Adds an entry to @hash with the key @key and value @value, replacing
+ * the value of any existing entry with the same key; in that case the
+ * existing key pointer is kept.
+ *
+ * The table is resized when there are no more empty slots to use, which
+ * moves every entry; so pointers to slots returned by nih_flat_hash_find()
+ * are not valid after this function is called.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+nih_flat_hash_insert (NihFlatHash *hash,
+		      const void  *key,
+		      void        *value)
+{
+	NihFlatHashSlot *slot;
+	uint32_t         hashval;
+	size_t           idx;
+
+	nih_assert (hash != NULL);
+	nih_assert (key != NULL);
+
+	hashval = hash->hash_function (key);
+
+	slot = nih_flat_hash_probe (hash, key, hashval);
+	if (slot) {
+		slot->value = value;
+		return 0;
+	}
+
+	idx = nih_flat_hash_find_free (hash, hashval);
+
+	/* Reusing a deleted slot is always fine, but taking an empty one
+	 * requires there to be some to spare; otherwise resize the table,
+	 * growing it unless there are enough deleted slots that it would
+	 * be half-empty once they're discarded.
+	 */
+	if ((hash->ctrl[idx] == NIH_FLAT_HASH_EMPTY) && (! hash->growth_left)) {
+		size_t capacity;
+
+		capacity = nih_flat_hash_pick_capacity (hash->entries
+							+ hash->entries / 2
+							+ 1);
+		if (capacity < hash->min_capacity)
+			capacity = hash->min_capacity;
+
+		if (nih_flat_hash_resize (hash, capacity) < 0)
+			return -1;
+
+		idx = nih_flat_hash_find_free (hash, hashval);
+	}
+
+	if (hash->ctrl[idx] == NIH_FLAT_HASH_EMPTY)
+		hash->growth_left--;
+
+	hash->ctrl[idx] = hashval & 0x7f;
+	hash->slots[idx].key = key;
+	hash->slots[idx].value = value;
+	hash->entries++;
+
+	return 0;
+}
+
+/**
+ * nih_flat_hash_find:
+ * @hash: hash table to search,
+ * @key: key to look for.
+ *
+ * Finds the entry in @hash with a key of @key, calling the hash's
+ * comparison function only for slots whose control byte matches.
+ *
+ * The returned slot may be used to change the value of the entry, or
+ * passed to nih_flat_hash_remove(); it is only valid until the next
+ * entry is inserted into the table.
+ *
+ * Returns: slot of entry found or NULL if no entry existed.
+ **/
+NihFlatHashSlot *
+nih_flat_hash_find (NihFlatHash *hash,
+		    const void  *key)
+{
+	nih_assert (hash != NULL);
+	nih_assert (key != NULL);
+
+	return nih_flat_hash_probe (hash, key, hash->hash_function (key));
+}
+
+/**
+ * nih_flat_hash_probe:
+ * @hash: hash table to search,
+ * @key: key to look for,
+ * @hashval: hash of @key.
+ *
+ * Finds the entry in @hash with a key of @key, whose hash has already
+ * been calculated.
+ *
+ * Returns: slot of entry found or NULL if no entry existed.
+ **/
+static NihFlatHashSlot *
+nih_flat_hash_probe (NihFlatHash *hash,
+		     const void  *key,
+		     uint32_t     hashval)
+{
+	uint8_t h2;
+	size_t  mask, group, step;
+
+	nih_assert (hash != NULL);
+	nih_assert (key != NULL);
+
+	h2 = hashval & 0x7f;
+
+	mask = hash->capacity / NIH_FLAT_HASH_GROUP - 1;
+	group = (hashval >> 7) & mask;
+
+	/* Probe whole groups in triangular order, which visits every group
+	 * when the number of groups is a power of two; a group with an
+	 * empty slot ends the search since the key would have been placed
+	 * there.
+	 */
+	for (step = 1; ; step++) {
+		size_t   base = group * NIH_FLAT_HASH_GROUP;
+		uint64_t ctrl, match;
+
+		ctrl = nih_flat_hash_group (&hash->ctrl[base]);
+		for (match = nih_flat_hash_match (ctrl, h2); match;
+		     match &= match - 1) {
+			NihFlatHashSlot *slot;
+
+			slot = &hash->slots[base + nih_flat_hash_first (match)];
+			if (! hash->cmp_function (key, slot->key))
+				return slot;
+		}
+
+		if (nih_flat_hash_match_empty (ctrl))
+			return NULL;
+
+		group = (group + step) & mask;
+	}
+}
+
+/**
+ * nih_flat_hash_lookup:
+ * @hash: hash table to search,
+ * @key: key to look for.
+ *
+ * Finds the entry in @hash with a key of @key and returns its value.  If
+ * NULL values are stored in the table, use nih_flat_hash_find() to
+ * distinguish them from missing entries.
+ *
+ * Returns: value of entry found or NULL if no entry existed.
+ **/
+void *
+nih_flat_hash_lookup (NihFlatHash *hash,
+		      const void  *key)
+{
+	NihFlatHashSlot *slot;
+
+	slot = nih_flat_hash_find (hash, key);
+
+	return slot ? slot->value : NULL;
+}
+
+/**
+ * nih_flat_hash_erase:
+ * @hash: hash table,
+ * @key: key of entry to remove.
+ *
+ * Removes the entry in @hash with a key of @key, if there is one.
+ *
+ * Returns: TRUE if an entry was removed, FALSE if no entry existed.
+ **/
+int
+nih_flat_hash_erase (NihFlatHash *hash,
+		     const void  *key)
+{
+	NihFlatHashSlot *slot;
+
+	slot = nih_flat_hash_find (hash, key);
+	if (! slot)
+		return FALSE;
+
+	nih_flat_hash_remove (hash, slot);
+
+	return TRUE;
+}
+
+/**
+ * nih_flat_hash_remove:
+ * @hash: hash table,
+ * @slot: slot of entry to remove.
+ *
+ * Removes the entry in @slot, which must be full, from @hash.  This does
+ * not move any other entries, so may be called on the entry being visited
+ * by NIH_FLAT_HASH_FOREACH().
+ **/
+void
+nih_flat_hash_remove (NihFlatHash     *hash,
+		      NihFlatHashSlot *slot)
+{
+	size_t idx, base;
+
+	nih_assert (hash != NULL);
+	nih_assert (slot != NULL);
+
+	idx = slot - hash->slots;
+	nih_assert (idx < hash->capacity);
+	nih_assert (NIH_FLAT_HASH_FULL (hash->ctrl[idx]));
+
+	/* If the group still has an empty slot, no search could have
+	 * continued past it to another group, so this slot can be made
+	 * empty again; otherwise it must be marked as deleted.
+	 */
+	base = idx - idx % NIH_FLAT_HASH_GROUP;
+	if (nih_flat_hash_match_empty (nih_flat_hash_group (&hash->ctrl[base]))) {
+		hash->ctrl[idx] = NIH_FLAT_HASH_EMPTY;
+		hash->growth_left++;
+	} else {
+		hash->ctrl[idx] = NIH_FLAT_HASH_DELETED;
+	}
+
+	slot->key = NULL;
+	slot->value = NULL;
+	hash->entries--;
+}
@@ -0,0 +1,189 @@
+/* libnih
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NIH_FLAT_HASH_H
+#define NIH_FLAT_HASH_H
+
+/**
+ * Provides a hash table implementation using open addressing, where the
+ * key and value pointers of each entry are stored directly in a single
+ * array of slots rather than in separately allocated list entries.  This
+ * is more compact than NihHash, and a lookup usually touches only two
+ * cache lines; however entries may not be moved between tables and lists,
+ * and the slots move whenever the table is resized.
+ *
+ * Alongside the slots is an array of control bytes, one for each slot,
+ * which record whether the slot is empty, deleted or full; for full slots
+ * they also hold seven bits of the hash of the key.  Lookups examine the
+ * control bytes of a group of eight slots at a time, so that the key
+ * function need only be called for slots whose control byte matches.
+ *
+ * The hash and comparison functions are given when creating the table
+ * with nih_flat_hash_new(), or for the common case of string keys you may
+ * use nih_flat_hash_string_new() instead.
+ *
+ * Entries are added or replaced with nih_flat_hash_insert(), found with
+ * nih_flat_hash_lookup() or nih_flat_hash_find() and removed with
+ * nih_flat_hash_erase() or nih_flat_hash_remove().  The table may be
+ * iterated with NIH_FLAT_HASH_FOREACH().
+ **/
+
+#include <nih/macros.h>
+#include <nih/hash.h>
+
+
+/**
+ * NIH_FLAT_HASH_GROUP:
+ *
+ * Number of slots whose control bytes are examined together.
+ **/
+#define NIH_FLAT_HASH_GROUP 8
+
+/**
+ * NIH_FLAT_HASH_EMPTY:
+ *
+ * Control byte of a slot that has never been used since the table was
+ * last resized.
+ **/
+#define NIH_FLAT_HASH_EMPTY 0x80
+
+/**
+ * NIH_FLAT_HASH_DELETED:
+ *
+ * Control byte of a slot whose entry has been removed, but which lookups
+ * must continue past.
+ **/
+#define NIH_FLAT_HASH_DELETED 0xfe
+
+/**
+ * NIH_FLAT_HASH_FULL:
+ * @ctrl: control byte.
+ *
+ * Returns: TRUE if @ctrl is the control byte of a slot containing an entry.
+ **/
+#define NIH_FLAT_HASH_FULL(ctrl) (! ((ctrl) & 0x80))
+
+
+/**
+ * NihFlatHashSlot:
+ * @key: key of entry,
+ * @value: value of entry.
+ *
+ * Each entry in an NihFlatHash is stored in one of these slots; the
+ * contents of unused slots are undefined.
+ **/
+typedef struct nih_flat_hash_slot {
+	const void *key;
+	void       *value;
+} NihFlatHashSlot;
+
+/**
+ * NihFlatHash:
+ * @slots: array of slots,
+ * @ctrl: array of control bytes for @slots,
+ * @capacity: number of slots,
+ * @entries: number of entries in the table,
+ * @growth_left: number of empty slots that may be used before resizing,
+ * @min_capacity: number of slots never shrunk below,
+ * @hash_function: function used to obtain hash of keys,
+ * @cmp_function: function used to compare keys.
+ *
+ * This structure represents an open-addressed hash table.  @capacity is
+ * always a power of two, and at least one in eight slots is kept empty
+ * so that lookups for missing keys end quickly.
+ **/
+typedef struct nih_flat_hash {
+	NihFlatHashSlot *slots;
+	uint8_t         *ctrl;
+	size_t           capacity;
+
+	size_t           entries;
+	size_t           growth_left;
+	size_t           min_capacity;
+
+	NihHashFunction  hash_function;
+	NihCmpFunction   cmp_function;
+} NihFlatHash;
+
+
+/**
+ * NIH_FLAT_HASH_FOREACH:
+ * @hash: hash table to iterate,
+ * @iter: name of iterator variable.
+ *
+ * Expands to a for statement that iterates over each entry in @hash,
+ * setting @iter to the NihFlatHashSlot of each entry for the block within
+ * the loop.
+ *
+ * The entry being visited may be removed with nih_flat_hash_remove(), but
+ * no entries may be added since that could cause the slots to be moved.
+ **/
+#define NIH_FLAT_HASH_FOREACH(hash, iter)				\
+	for (NihFlatHashSlot *iter = (hash)->slots;			\
+	     iter < (hash)->slots + (hash)->capacity; iter++)		\
+		if (! NIH_FLAT_HASH_FULL ((hash)->ctrl[iter		\
+						       - (hash)->slots])) \
+			continue;					\
+		else
+
+
+/**
+ * nih_flat_hash_string_new:
+ * @parent: parent of new hash,
+ * @entries: rough number of entries expected.
+ *
+ * Allocates a new hash table with enough slots for @entries, with constant
+ * string keys compared case sensitively.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned hash table.  When all parents
+ * of the returned hash table are freed, the returned hash table will also be
+ * freed.
+ *
+ * Returns: the new hash table or NULL if the allocation failed.
+ **/
+#define nih_flat_hash_string_new(parent, entries)			\
+	nih_flat_hash_new (parent, entries,				\
+			   (NihHashFunction)nih_hash_string_hash,	\
+			   (NihCmpFunction)nih_hash_string_cmp)
+
+
+NIH_BEGIN_EXTERN
+
+NihFlatHash *    nih_flat_hash_new     (const void *parent, size_t entries,
+					NihHashFunction hash_function,
+					NihCmpFunction cmp_function)
+	__attribute__ ((warn_unused_result, malloc));
+
+int              nih_flat_hash_reserve (NihFlatHash *hash, size_t entries)
+	__attribute__ ((warn_unused_result));
+
+int              nih_flat_hash_insert  (NihFlatHash *hash, const void *key,
+					void *value)
+	__attribute__ ((warn_unused_result));
+
+NihFlatHashSlot *nih_flat_hash_find    (NihFlatHash *hash, const void *key);
+void *           nih_flat_hash_lookup  (NihFlatHash *hash, const void *key);
+
+int              nih_flat_hash_erase   (NihFlatHash *hash, const void *key);
+void             nih_flat_hash_remove  (NihFlatHash *hash,
+					NihFlatHashSlot *slot);
+
+NIH_END_EXTERN
+
+#endif /* NIH_FLAT_HASH_H */
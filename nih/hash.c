@@ -1,6 +1,6 @@
 /* libnih
  *
- * hash.c - Fuller/Noll/Vo hash table implementation
+ * hash.c - hash table implementation
  *
  * Copyright © 2009 Scott James Remnant <scott@netsplit.com>.
  * Copyright © 2009 Canonical Ltd.
@@ -24,11 +24,18 @@
 #endif /* HAVE_CONFIG_H */
 
 
+#include <sys/auxv.h>
+
+#include <endian.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <nih/macros.h>
 #include <nih/logging.h>
 #include <nih/alloc.h>
+#include <nih/string.h>
 
 #include "hash.h"
 
@@ -49,6 +56,17 @@
  **/
 #define FNV_OFFSET_BASIS 2166136261UL
 
+/**
+ * HASH_P0, HASH_P1, HASH_P2, HASH_P3:
+ *
+ * Odd 64-bit constants with evenly mixed bits, used by
+ * nih_hash_string_hash_len() to mix the key with the seed.
+ **/
+#define HASH_P0 0xa0761d6478bd642fULL
+#define HASH_P1 0xe7037ed1a0b428dbULL
+#define HASH_P2 0x8ebc6af09c88c6e3ULL
+#define HASH_P3 0x589965cc75374cc3ULL
+
 
 /**
  * primes:
@@ -70,6 +88,129 @@ static const uint32_t primes[] = {
 static const size_t num_primes = sizeof (primes) / sizeof (uint32_t);
 
 
+/**
+ * hash_seed:
+ *
+ * Seed mixed into every string hash, chosen at random for each process
+ * so that the bins in which keys are placed cannot be predicted; set by
+ * nih_hash_seed_init() or nih_hash_set_seed().
+ **/
+static uint64_t hash_seed = 0;
+
+/**
+ * hash_seeded:
+ *
+ * TRUE once hash_seed has been set.
+ **/
+static int hash_seeded = FALSE;
+
+/**
+ * hash_fnv_compat:
+ *
+ * TRUE if nih_hash_string_hash() and nih_hash_string_hash_len() should
+ * return the unseeded FNV-1 hashes returned by earlier versions of this
+ * library, see nih_hash_set_fnv_compat().
+ **/
+static int hash_fnv_compat = FALSE;
+
+
+/**
+ * NIH_HASH_FREEZE_LOAD:
+ *
+ * Average number of keys in each bucket of a frozen hash table when
+ * first attempting to find displacements.
+ **/
+#define NIH_HASH_FREEZE_LOAD 4
+
+
+/**
+ * NihHashFreezeKey:
+ * @hash: hash of key,
+ * @index: order in which the entry was found,
+ * @entry: entry,
+ * @key: string key, when generating C.
+ *
+ * Used while freezing a hash table to sort the entries by their hash.
+ **/
+typedef struct nih_hash_freeze_key {
+	uint32_t    hash;
+	size_t      index;
+	NihList    *entry;
+	const char *key;
+} NihHashFreezeKey;
+
+
+/**
+ * NIH_HASH_MAX_LOAD:
+ *
+ * Average number of entries in each bin above which the hash table is
+ * grown.
+ **/
+#define NIH_HASH_MAX_LOAD 2
+
+/**
+ * NIH_HASH_MIN_LOAD:
+ *
+ * The hash table is shrunk when there are fewer than one entry for each
+ * this number of bins.
+ **/
+#define NIH_HASH_MIN_LOAD 4
+
+/**
+ * NIH_HASH_REHASH_BINS:
+ *
+ * Number of old bins moved into the new bins by each operation on a hash
+ * table being resized.
+ **/
+#define NIH_HASH_REHASH_BINS 4
+
+/**
+ * NIH_HASH_USED_WORDS:
+ * @size: number of bins.
+ *
+ * Returns: number of words in the bitmap of used bins for @size bins.
+ **/
+#define NIH_HASH_USED_WORDS(size) (((size) + 63) / 64)
+
+/**
+ * NIH_HASH_SUMMARY_WORDS:
+ * @size: number of bins.
+ *
+ * Returns: number of words in the summary of the bitmap of used bins for
+ * @size bins, which follows the bitmap itself.
+ **/
+#define NIH_HASH_SUMMARY_WORDS(size) ((NIH_HASH_USED_WORDS (size) + 63) / 64)
+
+
+/* Prototypes for static functions */
+static size_t   nih_hash_pick_size (size_t entries);
+static void     nih_hash_step      (NihHash *hash);
+static void     nih_hash_move_bin  (NihHash *hash, NihList *bin);
+static NihList *nih_hash_key_bin   (NihHash *hash, uint32_t hashval);
+static void     nih_hash_resize    (NihHash *hash, size_t entries);
+static uint64_t *nih_hash_used_new (NihList *bins, size_t size)
+	__attribute__ ((warn_unused_result, malloc));
+static void     nih_hash_use       (uint64_t *used, size_t size, size_t i);
+static void     nih_hash_unuse     (uint64_t *used, size_t size, size_t i);
+static size_t   nih_hash_used_next (const uint64_t *used, size_t size,
+				    size_t i);
+static size_t   nih_hash_next_bin  (NihHash *hash, size_t bin);
+static NihList *nih_hash_key_match (NihHash *hash, const void *key,
+				    uint32_t hashval);
+static NihList *nih_hash_bin_match (NihHash *hash, NihList *bin,
+				    NihList *start, const void *key,
+				    uint32_t hashval);
+static void     nih_hash_seed_init (void);
+static int      nih_hash_freeze_cmp (const void *a, const void *b);
+static int      nih_hash_freeze_c_cmp (const void *a, const void *b);
+static uint32_t *nih_hash_freeze_build (const void *parent,
+					const uint32_t *hashes, size_t size,
+					size_t *nbuckets, uint32_t *slots)
+	__attribute__ ((warn_unused_result, malloc));
+static char *   nih_hash_freeze_c_str (char **str, const char *src)
+	__attribute__ ((warn_unused_result));
+
+
 /**
  * nih_hash_new:
  * @parent: parent of new hash,
@@ -118,10 +259,7 @@ nih_hash_new (const void      *parent,
 	if (! hash)
 		return NULL;
 
-	/* Pick the largest prime number smaller than the number of entries */
-	hash->size = primes[0];
-	for (i = 0; (i < num_primes) && (primes[i] < entries); i++)
-		hash->size = primes[i];
+	hash->size = nih_hash_pick_size (entries);
 
 	/* Allocate bins */
 	hash->bins = nih_alloc (hash, sizeof (NihList) * hash->size);
@@ -134,13 +272,425 @@ nih_hash_new (const void      *parent,
 	for (i = 0; i < hash->size; i++)
 		nih_list_init (&hash->bins[i]);
 
+	hash->used = nih_hash_used_new (hash->bins, hash->size);
+	if (! hash->used) {
+		nih_free (hash);
+		return NULL;
+	}
+
+	hash->old_used = NULL;
+
 	hash->key_function = key_function;
 	hash->hash_function = hash_function;
 	hash->cmp_function = cmp_function;
+	hash->cache_hash = FALSE;
+
+	hash->min_size = hash->size;
+	hash->entries = 0;
+
+	hash->old_bins = NULL;
+	hash->old_size = 0;
+
+	hash->cursor = 0;
+	hash->counted = 0;
+	hash->added = 0;
+
+	hash->iterating = 0;
+
+	return hash;
+}
+
+/**
+ * nih_hash_cached_new:
+ * @parent: parent of new hash,
+ * @entries: rough number of entries expected,
+ * @key_function: function used to obtain keys for entries,
+ * @hash_function: function used to obtain hash for keys,
+ * @cmp_function: function used to compare keys.
+ *
+ * Allocates a new hash table in the same manner as nih_hash_new(), except
+ * that each member must begin with an NihHashEntry rather than an NihList.
+ *
+ * The hash of each entry's key is stored in its NihHashEntry header when
+ * it is added, so that entries with a different hash can be rejected
+ * without calling @key_function or @cmp_function, and entries can be
+ * moved when the table is resized without calling @hash_function.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned hash table.  When all parents
+ * of the returned hash table are freed, the returned hash table will also be
+ * freed.
+ *
+ * Returns: the new hash table or NULL if the allocation failed.
+ **/
+NihHash *
+nih_hash_cached_new (const void      *parent,
+		     size_t           entries,
+		     NihKeyFunction   key_function,
+		     NihHashFunction  hash_function,
+		     NihCmpFunction   cmp_function)
+{
+	NihHash *hash;
+
+	hash = nih_hash_new (parent, entries,
+			     key_function, hash_function, cmp_function);
+	if (! hash)
+		return NULL;
+
+	hash->cache_hash = TRUE;
 
 	return hash;
 }
 
+/**
+ * nih_hash_pick_size:
+ * @entries: number of entries.
+ *
+ * Picks the number of bins for a hash table that will hold @entries,
+ * which is the largest prime number smaller than @entries.
+ *
+ * Returns: number of bins.
+ **/
+static size_t
+nih_hash_pick_size (size_t entries)
+{
+	size_t size, i;
+
+	size = primes[0];
+	for (i = 0; (i < num_primes) && (primes[i] < entries); i++)
+		size = primes[i];
+
+	return size;
+}
+
+
+/**
+ * nih_hash_step:
+ * @hash: hash table.
+ *
+ * Called at the start of each operation on @hash to perform a small
+ * amount of housekeeping.  If the table is being resized, the entries
+ * in the next few old bins are moved into the new bins; otherwise the
+ * entries in the next bin are counted to correct the estimate of the
+ * number of entries in the table.
+ *
+ * When the estimate shows that the table is too full, or after counting
+ * every bin shows that it is too empty, resizing is begun.
+ *
+ * Nothing is done while the table is being iterated, since moving the
+ * entries would confuse the iterator.
+ **/
+static void
+nih_hash_step (NihHash *hash)
+{
+	nih_assert (hash != NULL);
+
+	if (hash->iterating)
+		return;
+
+	if (hash->old_bins) {
+		size_t i;
+
+		/* Move the entries from the next few old bins into the
+		 * new bins, counting them as we go.
+		 */
+		for (i = 0; ((i < NIH_HASH_REHASH_BINS)
+			     && (hash->cursor < hash->old_size)); i++)
+			nih_hash_move_bin (hash,
+					   &hash->old_bins[hash->cursor++]);
+
+		if (hash->cursor < hash->old_size)
+			return;
+
+		nih_free (hash->old_bins);
+		hash->old_bins = NULL;
+		hash->old_used = NULL;
+		hash->old_size = 0;
+	} else {
+		NihList *bin = &hash->bins[hash->cursor];
+
+		if (NIH_LIST_EMPTY (bin))
+			nih_hash_unuse (hash->used, hash->size, hash->cursor);
+
+		NIH_LIST_FOREACH (bin, iter)
+			hash->counted++;
+
+		if (++hash->cursor < hash->size) {
+			/* Only growth can be decided without a full count */
+			if (hash->entries > hash->size * NIH_HASH_MAX_LOAD)
+				nih_hash_resize (hash, hash->entries);
+
+			return;
+		}
+	}
+
+	/* Every bin has been counted, and any entries added since were
+	 * either counted or are in @added; use that as the estimate,
+	 * unless entries have been removed since.
+	 */
+	if (hash->counted + hash->added < hash->entries)
+		hash->entries = hash->counted + hash->added;
+
+	hash->cursor = 0;
+	hash->counted = 0;
+	hash->added = 0;
+
+	if ((hash->entries > hash->size * NIH_HASH_MAX_LOAD)
+	    || ((hash->size > hash->min_size)
+		&& (hash->entries < hash->size / NIH_HASH_MIN_LOAD)))
+		nih_hash_resize (hash, hash->entries);
+}
+
+/**
+ * nih_hash_move_bin:
+ * @hash: hash table,
+ * @bin: old bin.
+ *
+ * Moves the entries in @bin, which must be one of the old bins of @hash,
+ * onto the end of the appropriate new bins in the order they were
+ * added, counting them as we go.
+ **/
+static void
+nih_hash_move_bin (NihHash *hash,
+		   NihList *bin)
+{
+	nih_assert (hash != NULL);
+	nih_assert (bin != NULL);
+
+	while (! NIH_LIST_EMPTY (bin)) {
+		NihList  *entry = bin->next;
+		uint32_t  hashval;
+
+		if (hash->cache_hash) {
+			hashval = ((NihHashEntry *)entry)->hash;
+		} else {
+			hashval = hash->hash_function (
+				hash->key_function (entry));
+		}
+
+		nih_list_add (&hash->bins[hashval % hash->size], entry);
+		nih_hash_use (hash->used, hash->size, hashval % hash->size);
+		hash->counted++;
+	}
+}
+
+/**
+ * nih_hash_key_bin:
+ * @hash: hash table,
+ * @hashval: hash of key.
+ *
+ * Finds the bin that an entry with a hash of @hashval should be added
+ * to.  While the table is being resized, any entries in the old bin for
+ * @hashval are moved into the new bins first, so that entries with the
+ * same key are never split with newer ones ahead of older ones; when
+ * entries can't be moved because the table is being iterated, the old
+ * bin is returned instead if it has entries.
+ *
+ * Returns: bin to add entries with @hashval to.
+ **/
+static NihList *
+nih_hash_key_bin (NihHash  *hash,
+		  uint32_t  hashval)
+{
+	nih_assert (hash != NULL);
+
+	if (hash->old_bins) {
+		NihList *old_bin = &hash->old_bins[hashval % hash->old_size];
+
+		if (! NIH_LIST_EMPTY (old_bin)) {
+			if (hash->iterating)
+				return old_bin;
+
+			nih_hash_move_bin (hash, old_bin);
+		}
+	}
+
+	return &hash->bins[hashval % hash->size];
+}
+
+/**
+ * nih_hash_resize:
+ * @hash: hash table,
+ * @entries: number of entries.
+ *
+ * Begins resizing @hash to hold @entries by allocating a new bins array,
+ * keeping the current bins array as the old bins to be moved into it
+ * by nih_hash_step().  The new size is never smaller than the size the
+ * table was created with.
+ *
+ * Failure to allocate the new bins is not an error, the table is simply
+ * not resized.
+ **/
+static void
+nih_hash_resize (NihHash *hash,
+		 size_t   entries)
+{
+	NihList  *bins;
+	uint64_t *used;
+	size_t    size, i;
+
+	nih_assert (hash != NULL);
+	nih_assert (hash->old_bins == NULL);
+
+	size = nih_hash_pick_size (entries);
+	if (size < hash->min_size)
+		size = hash->min_size;
+	if (size == hash->size)
+		return;
+
+	bins = nih_alloc (hash, sizeof (NihList) * size);
+	if (! bins)
+		return;
+
+	for (i = 0; i < size; i++)
+		nih_list_init (&bins[i]);
+
+	used = nih_hash_used_new (bins, size);
+	if (! used) {
+		nih_free (bins);
+		return;
+	}
+
+	hash->old_bins = hash->bins;
+	hash->old_used = hash->used;
+	hash->old_size = hash->size;
+
+	hash->bins = bins;
+	hash->used = used;
+	hash->size = size;
+
+	/* Moving the entries counts them too */
+	hash->cursor = 0;
+	hash->counted = 0;
+	hash->added = 0;
+}
+
+
+/**
+ * nih_hash_used_new:
+ * @bins: bins array,
+ * @size: size of @bins.
+ *
+ * Allocates a bitmap of used bins for @bins, followed by its summary,
+ * with every bit clear.  The bitmap is a child of @bins so that it is
+ * freed along with them.
+ *
+ * Returns: new bitmap or NULL if insufficient memory.
+ **/
+static uint64_t *
+nih_hash_used_new (NihList *bins,
+		   size_t   size)
+{
+	uint64_t *used;
+	size_t    len;
+
+	nih_assert (bins != NULL);
+
+	len = (NIH_HASH_USED_WORDS (size) + NIH_HASH_SUMMARY_WORDS (size))
+		* sizeof (uint64_t);
+
+	used = nih_alloc (bins, len);
+	if (! used)
+		return NULL;
+
+	memset (used, 0, len);
+
+	return used;
+}
+
+/**
+ * nih_hash_use:
+ * @used: bitmap of used bins,
+ * @size: number of bins,
+ * @i: bin number.
+ *
+ * Marks bin @i as used in @used and its summary.
+ **/
+static inline void
+nih_hash_use (uint64_t *used,
+	      size_t    size,
+	      size_t    i)
+{
+	size_t word = i / 64;
+
+	nih_assert (i < size);
+
+	used[word] |= (uint64_t)1 << (i % 64);
+	used[NIH_HASH_USED_WORDS (size) + word / 64] |=
+		(uint64_t)1 << (word % 64);
+}
+
+/**
+ * nih_hash_unuse:
+ * @used: bitmap of used bins,
+ * @size: number of bins,
+ * @i: bin number.
+ *
+ * Marks bin @i as no longer used in @used, clearing the bit for its word
+ * in the summary if no other bin in that word is used.
+ **/
+static inline void
+nih_hash_unuse (uint64_t *used,
+		size_t    size,
+		size_t    i)
+{
+	size_t word = i / 64;
+
+	nih_assert (i < size);
+
+	used[word] &= ~((uint64_t)1 << (i % 64));
+	if (! used[word])
+		used[NIH_HASH_USED_WORDS (size) + word / 64] &=
+			~((uint64_t)1 << (word % 64));
+}
+
+/**
+ * nih_hash_used_next:
+ * @used: bitmap of used bins,
+ * @size: number of bins,
+ * @i: bin number to start from.
+ *
+ * Finds the first bin numbered @i or higher marked as used in @used,
+ * using the summary to skip words with no bins marked.
+ *
+ * Returns: bin number, or @size if there are no more.
+ **/
+static size_t
+nih_hash_used_next (const uint64_t *used,
+		    size_t          size,
+		    size_t          i)
+{
+	const uint64_t *summary;
+	size_t          words, word, sword;
+	uint64_t        bits;
+
+	if (i >= size)
+		return size;
+
+	word = i / 64;
+	bits = used[word] & (~(uint64_t)0 << (i % 64));
+	if (bits)
+		return word * 64 + __builtin_ctzll (bits);
+
+	words = NIH_HASH_USED_WORDS (size);
+	if (++word >= words)
+		return size;
+
+	summary = used + words;
+	sword = word / 64;
+	bits = summary[sword] & (~(uint64_t)0 << (word % 64));
+	while (! bits) {
+		if (++sword >= NIH_HASH_SUMMARY_WORDS (size))
+			return size;
+
+		bits = summary[sword];
+	}
+
+	word = sword * 64 + __builtin_ctzll (bits);
+
+	return word * 64 + __builtin_ctzll (used[word]);
+}
+
 
 /**
  * nih_hash_add:
@@ -170,9 +720,19 @@ nih_hash_add (NihHash *hash,
 	nih_assert (hash != NULL);
 	nih_assert (entry != NULL);
 
+	nih_hash_step (hash);
+
 	key = hash->key_function (entry);
-	hashval = hash->hash_function (key) % hash->size;
-	bin = &hash->bins[hashval];
+	hashval = hash->hash_function (key);
+	bin = nih_hash_key_bin (hash, hashval);
+
+	if (hash->cache_hash)
+		((NihHashEntry *)entry)->hash = hashval;
+
+	nih_hash_use (hash->used, hash->size, hashval % hash->size);
+
+	hash->entries++;
+	hash->added++;
 
 	return nih_list_add (bin, entry);
 }
@@ -208,14 +768,22 @@ nih_hash_add_unique (NihHash *hash,
 	nih_assert (hash != NULL);
 	nih_assert (entry != NULL);
 
+	nih_hash_step (hash);
+
 	key = hash->key_function (entry);
-	hashval = hash->hash_function (key) % hash->size;
-	bin = &hash->bins[hashval];
+	hashval = hash->hash_function (key);
+	bin = nih_hash_key_bin (hash, hashval);
 
-	NIH_LIST_FOREACH (bin, iter) {
-		if (! hash->cmp_function (key, hash->key_function (iter)))
-			return NULL;
-	}
+	if (nih_hash_key_match (hash, key, hashval))
+		return NULL;
+
+	if (hash->cache_hash)
+		((NihHashEntry *)entry)->hash = hashval;
+
+	nih_hash_use (hash->used, hash->size, hashval % hash->size);
+
+	hash->entries++;
+	hash->added++;
 
 	return nih_list_add (bin, entry);
 }
@@ -249,28 +817,35 @@ nih_hash_replace (NihHash *hash,
 {
 	const void *key;
 	uint32_t    hashval;
-	NihList    *bin, *ret = NULL;
+	NihList    *bin, *ret;
 
 	nih_assert (hash != NULL);
 	nih_assert (entry != NULL);
 
+	nih_hash_step (hash);
+
 	key = hash->key_function (entry);
-	hashval = hash->hash_function (key) % hash->size;
-	bin = &hash->bins[hashval];
+	hashval = hash->hash_function (key);
+	bin = nih_hash_key_bin (hash, hashval);
 
-	NIH_LIST_FOREACH (bin, iter) {
-		if (! hash->cmp_function (key, hash->key_function (iter))) {
-			ret = nih_list_remove (iter);
-			break;
-		}
+	ret = nih_hash_key_match (hash, key, hashval);
+
+	if (hash->cache_hash)
+		((NihHashEntry *)entry)->hash = hashval;
+
+	if (ret) {
+		nih_list_remove (ret);
+	} else {
+		hash->entries++;
+		hash->added++;
 	}
 
+	nih_hash_use (hash->used, hash->size, hashval % hash->size);
 	nih_list_add (bin, entry);
 
 	return ret;
 }
 
-
 /**
  * nih_hash_search:
  * @hash: hash table to search,
@@ -282,6 +857,8 @@ nih_hash_replace (NihHash *hash,
  * until one is found.
  *
  * The initial @entry can be found by passing NULL or using nih_hash_lookup().
+ * For tables created with nih_hash_cached_new(), the hash stored in @entry
+ * is used rather than hashing @key again.
  *
  * Returns: next entry in the hash or NULL if there are no more entries.
  **/
@@ -291,46 +868,919 @@ nih_hash_search (NihHash    *hash,
 		 NihList    *entry)
 {
 	uint32_t  hashval;
-	NihList  *bin;
+	NihList  *bin, *old_bin = NULL, *ret;
 
 	nih_assert (hash != NULL);
 	nih_assert (key != NULL);
 
-	hashval = hash->hash_function (key) % hash->size;
-	bin = &hash->bins[hashval];
+	nih_hash_step (hash);
 
-	NIH_LIST_FOREACH (bin, iter) {
-		if (iter == entry) {
-			entry = NULL;
-			continue;
-		} else if (entry) {
-			continue;
-		} else if (! hash->cmp_function (key, hash->key_function (iter))) {
-			return iter;
+	if (entry && hash->cache_hash) {
+		hashval = ((NihHashEntry *)entry)->hash;
+	} else {
+		hashval = hash->hash_function (key);
+	}
+
+	/* While resizing, entries with the key are moved out of the old bin
+	 * first, unless we're iterating; then entries in the old bin are
+	 * always newer than those in the new bin, since they were only
+	 * added there when the old bin had entries.  The new bin is searched
+	 * first since entries are moved from the old bin onto the end of it,
+	 * so that none can be missed or found twice if moved between calls.
+	 * The previous entry tells us which bin we're in, so the search
+	 * resumes from there.
+	 */
+	nih_hash_key_bin (hash, hashval);
+
+	bin = &hash->bins[hashval % hash->size];
+	if (hash->old_bins) {
+		old_bin = &hash->old_bins[hashval % hash->old_size];
+		if (NIH_LIST_EMPTY (old_bin))
+			old_bin = NULL;
+	}
+
+	if (entry) {
+		NihList *iter;
+
+		for (iter = entry->next; iter != bin; iter = iter->next) {
+			if (iter == old_bin) {
+				return nih_hash_bin_match (hash, old_bin,
+							   entry, key, hashval);
+			} else if (iter == entry) {
+				return NULL;
+			}
 		}
+
+		ret = nih_hash_bin_match (hash, bin, entry, key, hashval);
+	} else {
+		ret = nih_hash_bin_match (hash, bin, bin, key, hashval);
 	}
 
-	return NULL;
+	if ((! ret) && old_bin)
+		ret = nih_hash_bin_match (hash, old_bin, old_bin, key, hashval);
+
+	return ret;
 }
 
 /**
- * nih_hash_lookup:
- * @hash: hash table to search.
- * @key: key to look for.
- *
- * Finds the first entry in @hash with a key of @key by calling the hash's
- * NihKeyFunction on each entry in the appropriate bin until one is found.
+ * nih_hash_bin_match:
+ * @hash: hash table,
+ * @bin: bin to search,
+ * @start: entry to start after,
+ * @key: key to look for,
+ * @hashval: hash of @key.
  *
- * If multiple entries are expected, use nih_hash_search() instead.
+ * Finds the first entry after @start in @bin with a key of @key, which
+ * may be @bin itself to search from the beginning.  For tables created
+ * with nih_hash_cached_new(), entries whose stored hash differs from
+ * @hashval are skipped without calling the key or comparison functions.
  *
  * Returns: entry found or NULL if no entry existed.
  **/
-NihList *
-nih_hash_lookup (NihHash    *hash,
-		 const void *key)
+static NihList *
+nih_hash_bin_match (NihHash    *hash,
+		    NihList    *bin,
+		    NihList    *start,
+		    const void *key,
+		    uint32_t    hashval)
 {
-	return nih_hash_search (hash, key, NULL);
-}
+	NihList *iter;
+
+	nih_assert (hash != NULL);
+	nih_assert (bin != NULL);
+	nih_assert (start != NULL);
+	nih_assert (key != NULL);
+
+	for (iter = start->next; iter != bin; iter = iter->next) {
+		if (hash->cache_hash
+		    && (((NihHashEntry *)iter)->hash != hashval))
+			continue;
+
+		if (! hash->cmp_function (key, hash->key_function (iter)))
+			return iter;
+	}
+
+	return NULL;
+}
+
+/**
+ * nih_hash_key_match:
+ * @hash: hash table,
+ * @key: key to look for,
+ * @hashval: hash of @key.
+ *
+ * Finds the first entry in @hash with a key of @key, searching the old
+ * bin for @hashval as well as the new one while resizing.  Unlike
+ * nih_hash_search() this does no housekeeping, so bins found beforehand
+ * with nih_hash_key_bin() remain valid.
+ *
+ * Returns: entry found or NULL if no entry existed.
+ **/
+static NihList *
+nih_hash_key_match (NihHash    *hash,
+		    const void *key,
+		    uint32_t    hashval)
+{
+	NihList *bin, *ret;
+
+	nih_assert (hash != NULL);
+	nih_assert (key != NULL);
+
+	bin = &hash->bins[hashval % hash->size];
+	ret = nih_hash_bin_match (hash, bin, bin, key, hashval);
+	if ((! ret) && hash->old_bins) {
+		bin = &hash->old_bins[hashval % hash->old_size];
+		ret = nih_hash_bin_match (hash, bin, bin, key, hashval);
+	}
+
+	return ret;
+}
+
+/**
+ * nih_hash_lookup:
+ * @hash: hash table to search.
+ * @key: key to look for.
+ *
+ * Finds the first entry in @hash with a key of @key by calling the hash's
+ * NihKeyFunction on each entry in the appropriate bin until one is found.
+ *
+ * If multiple entries are expected, use nih_hash_search() instead.
+ *
+ * Returns: entry found or NULL if no entry existed.
+ **/
+NihList *
+nih_hash_lookup (NihHash    *hash,
+		 const void *key)
+{
+	return nih_hash_search (hash, key, NULL);
+}
+
+
+
+/**
+ * nih_hash_iter_begin:
+ * @hash: hash table to iterate.
+ *
+ * Begins iteration of @hash by NIH_HASH_FOREACH() or
+ * NIH_HASH_FOREACH_SAFE(), preventing entries being moved between bins
+ * until nih_hash_iter_end() is called with the returned iterator.
+ *
+ * Returns: iterator set to the first bin that contains entries.
+ **/
+NihHashIter
+nih_hash_iter_begin (NihHash *hash)
+{
+	NihHashIter iter;
+
+	nih_assert (hash != NULL);
+
+	hash->iterating++;
+
+	iter.hash = hash;
+	iter.bin = nih_hash_next_bin (hash, 0);
+
+	return iter;
+}
+
+/**
+ * nih_hash_iter_next:
+ * @iter: iterator.
+ *
+ * Advances @iter to the next bin that contains entries, or past the last
+ * bin if there are no more; this is called automatically by
+ * NIH_HASH_FOREACH() and NIH_HASH_FOREACH_SAFE().
+ **/
+void
+nih_hash_iter_next (NihHashIter *iter)
+{
+	nih_assert (iter != NULL);
+	nih_assert (iter->hash != NULL);
+
+	iter->bin = nih_hash_next_bin (iter->hash, iter->bin + 1);
+}
+
+/**
+ * nih_hash_iter_end:
+ * @iter: iterator.
+ *
+ * Ends iteration of the hash table begun with nih_hash_iter_begin(),
+ * this is called automatically when leaving the NIH_HASH_FOREACH() or
+ * NIH_HASH_FOREACH_SAFE() loops.
+ **/
+void
+nih_hash_iter_end (NihHashIter *iter)
+{
+	nih_assert (iter != NULL);
+	nih_assert (iter->hash != NULL);
+	nih_assert (iter->hash->iterating > 0);
+
+	iter->hash->iterating--;
+}
+
+/**
+ * nih_hash_next_bin:
+ * @hash: hash table,
+ * @bin: bin number to start from.
+ *
+ * Finds the first bin of @hash numbered @bin or higher that contains
+ * entries, numbering the old bins after the new ones as NIH_HASH_BIN()
+ * does.  Bins marked as used that are found to be empty are unmarked
+ * along the way.
+ *
+ * Returns: bin number, or NIH_HASH_NUM_BINS() if there are no more.
+ **/
+static size_t
+nih_hash_next_bin (NihHash *hash,
+		   size_t   bin)
+{
+	nih_assert (hash != NULL);
+
+	while (bin < hash->size) {
+		bin = nih_hash_used_next (hash->used, hash->size, bin);
+		if (bin == hash->size)
+			break;
+
+		if (! NIH_LIST_EMPTY (&hash->bins[bin]))
+			return bin;
+
+		nih_hash_unuse (hash->used, hash->size, bin++);
+	}
+
+	while (bin < hash->size + hash->old_size) {
+		size_t i;
+
+		i = nih_hash_used_next (hash->old_used, hash->old_size,
+					bin - hash->size);
+		bin = hash->size + i;
+		if (i == hash->old_size)
+			break;
+
+		if (! NIH_LIST_EMPTY (&hash->old_bins[i]))
+			return bin;
+
+		nih_hash_unuse (hash->old_used, hash->old_size, i);
+		bin++;
+	}
+
+	return NIH_HASH_NUM_BINS (hash);
+}
+
+
+/**
+ * nih_hash_freeze_mix:
+ * @hashval: hash of key,
+ * @salt: value mixed in.
+ *
+ * Mixes @hashval and @salt together into a new 32-bit hash, so that
+ * each value of @salt gives an independent hash of the key.
+ *
+ * Returns: 32-bit hash.
+ **/
+static inline uint32_t
+nih_hash_freeze_mix (uint32_t hashval,
+		     uint32_t salt)
+{
+	uint64_t x = ((uint64_t)salt << 32) | hashval;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+
+	return (uint32_t)x;
+}
+
+/**
+ * nih_frozen_hash_slot:
+ * @hashval: hash of key,
+ * @disp: displacement of each bucket,
+ * @nbuckets: number of buckets,
+ * @size: number of slots.
+ *
+ * Calculates the slot of a frozen hash table that a key with the hash
+ * @hashval is found in, by mixing it with the displacement found for its
+ * bucket when the table was frozen.
+ *
+ * This is used by NihFrozenHash and by the code generated by
+ * nih_hash_freeze_c(), so its result will not change in future versions
+ * of this library.
+ *
+ * Returns: slot number less than @size.
+ **/
+size_t
+nih_frozen_hash_slot (uint32_t        hashval,
+		      const uint32_t *disp,
+		      size_t          nbuckets,
+		      size_t          size)
+{
+	uint32_t bucket;
+
+	nih_assert (disp != NULL);
+	nih_assert (nbuckets > 0);
+	nih_assert (size > 0);
+
+	bucket = nih_hash_freeze_mix (hashval, 0) % nbuckets;
+
+	return nih_hash_freeze_mix (hashval, disp[bucket] + 1) % size;
+}
+
+/**
+ * nih_hash_freeze_build:
+ * @parent: parent of returned array,
+ * @hashes: distinct hashes of keys,
+ * @size: number of entries in @hashes,
+ * @nbuckets: pointer to store number of buckets,
+ * @slots: array to store slot of each hash.
+ *
+ * Finds a minimal perfect hash for @hashes using the compress, hash and
+ * displace algorithm: hashes are divided between buckets, and then for
+ * each bucket, largest first, a displacement is searched for that places
+ * every hash in that bucket into a distinct unused slot.
+ *
+ * The number of buckets is doubled whenever no displacement can be found
+ * for a bucket, which makes it more likely that one can.
+ *
+ * Returns: newly allocated array of *@nbuckets displacements, or NULL if
+ * insufficient memory or no perfect hash could be found.
+ **/
+static uint32_t *
+nih_hash_freeze_build (const void     *parent,
+		       const uint32_t *hashes,
+		       size_t          size,
+		       size_t         *nbuckets,
+		       uint32_t       *slots)
+{
+	size_t nb;
+
+	nih_assert (hashes != NULL);
+	nih_assert (size > 0);
+	nih_assert (nbuckets != NULL);
+	nih_assert (slots != NULL);
+
+	nb = (size + NIH_HASH_FREEZE_LOAD - 1) / NIH_HASH_FREEZE_LOAD;
+	for (;;) {
+		uint32_t *         disp;
+		nih_local size_t * start = NULL;
+		nih_local size_t * members = NULL;
+		nih_local size_t * order = NULL;
+		nih_local uint8_t *taken = NULL;
+		size_t             max_size = 0, i, j;
+		int                found = TRUE;
+
+		disp = nih_alloc (parent, sizeof (uint32_t) * nb);
+		start = nih_alloc (NULL, sizeof (size_t) * (nb + 1));
+		members = nih_alloc (NULL, sizeof (size_t) * size);
+		order = nih_alloc (NULL, sizeof (size_t) * nb);
+		taken = nih_alloc (NULL, size);
+		if ((! disp) || (! start) || (! members) || (! order)
+		    || (! taken)) {
+			if (disp)
+				nih_free (disp);
+			return NULL;
+		}
+
+		memset (disp, 0, sizeof (uint32_t) * nb);
+		memset (start, 0, sizeof (size_t) * (nb + 1));
+		memset (taken, 0, size);
+
+		/* Group the hashes by bucket, counting sort */
+		for (i = 0; i < size; i++)
+			start[nih_hash_freeze_mix (hashes[i], 0) % nb + 1]++;
+		for (i = 0; i < nb; i++) {
+			if (start[i + 1] > max_size)
+				max_size = start[i + 1];
+			start[i + 1] += start[i];
+		}
+		memcpy (order, start, sizeof (size_t) * nb);
+		for (i = 0; i < size; i++) {
+			size_t b = nih_hash_freeze_mix (hashes[i], 0) % nb;
+
+			members[order[b]++] = i;
+		}
+
+		/* Order the buckets largest first */
+		j = 0;
+		for (size_t sz = max_size; sz > 0; sz--)
+			for (i = 0; i < nb; i++)
+				if (start[i + 1] - start[i] == sz)
+					order[j++] = i;
+
+		for (i = 0; found && (i < j); i++) {
+			size_t   b = order[i];
+			size_t   first = start[b], last = start[b + 1];
+			uint64_t limit = (uint64_t)size * 16 + 1024;
+			uint64_t d;
+
+			if (limit > UINT32_MAX - 1)
+				limit = UINT32_MAX - 1;
+
+			for (d = 0; d < limit; d++) {
+				size_t k;
+
+				for (k = first; k < last; k++) {
+					size_t h = members[k];
+
+					slots[h] = (nih_hash_freeze_mix (hashes[h],
+									 d + 1)
+						    % size);
+					if (taken[slots[h]])
+						break;
+
+					taken[slots[h]] = TRUE;
+				}
+
+				if (k == last)
+					break;
+
+				while (k-- > first)
+					taken[slots[members[k]]] = FALSE;
+			}
+
+			if (d < limit) {
+				disp[b] = d;
+			} else {
+				found = FALSE;
+			}
+		}
+
+		if (found) {
+			*nbuckets = nb;
+			return disp;
+		}
+
+		nih_free (disp);
+		if (nb >= size)
+			return NULL;
+
+		nb = nb * 2 < size ? nb * 2 : size;
+	}
+}
+
+/**
+ * nih_hash_freeze_cmp:
+ * @a: key to compare,
+ * @b: key to compare against.
+ *
+ * Orders keys by hash, and then by the order in which they were found.
+ *
+ * Returns: integer less than, equal to or greater than zero if @a is
+ * respectively less then, equal to or greater than @b.
+ **/
+static int
+nih_hash_freeze_cmp (const void *a,
+		     const void *b)
+{
+	const NihHashFreezeKey *ka = a, *kb = b;
+
+	if (ka->hash != kb->hash)
+		return ka->hash < kb->hash ? -1 : 1;
+
+	return ka->index < kb->index ? -1 : (ka->index > kb->index);
+}
+
+/**
+ * nih_hash_freeze:
+ * @parent: parent of new frozen hash,
+ * @hash: hash table to freeze.
+ *
+ * Builds an immutable lookup table over the entries currently in @hash,
+ * using a minimal perfect hash so that each key is always found in the
+ * first slot examined, without searching any bins.  The table is a
+ * single contiguous allocation.
+ *
+ * The entries themselves remain members of @hash, and the frozen table
+ * merely points at them; so they must not be freed while it is in use,
+ * and entries added to or removed from @hash afterwards are not reflected
+ * in it.  Entries with the same key are all found, in the same order as
+ * nih_hash_search() would have returned them.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned table.  When all parents
+ * of the returned table are freed, the returned table will also be
+ * freed.
+ *
+ * Returns: the new frozen table or NULL if insufficient memory.
+ **/
+NihFrozenHash *
+nih_hash_freeze (const void *parent,
+		 NihHash    *hash)
+{
+	NihFrozenHash *             frozen;
+	nih_local NihHashFreezeKey *keys = NULL;
+	nih_local uint32_t *        hashes = NULL;
+	nih_local uint32_t *        slots = NULL;
+	nih_local uint32_t *        disp = NULL;
+	size_t                      entries = 0, size = 0, nbuckets = 0;
+	size_t                      i, j;
+	uint32_t *                  counts;
+
+	nih_assert (hash != NULL);
+
+	NIH_HASH_FOREACH (hash, iter)
+		entries++;
+
+	if (entries) {
+		keys = nih_alloc (NULL, sizeof (NihHashFreezeKey) * entries);
+		hashes = nih_alloc (NULL, sizeof (uint32_t) * entries);
+		slots = nih_alloc (NULL, sizeof (uint32_t) * entries);
+		if ((! keys) || (! hashes) || (! slots))
+			return NULL;
+
+		i = 0;
+		NIH_HASH_FOREACH (hash, iter) {
+			keys[i].entry = iter;
+			keys[i].index = i;
+			keys[i].key = NULL;
+
+			if (hash->cache_hash) {
+				keys[i].hash = ((NihHashEntry *)iter)->hash;
+			} else {
+				keys[i].hash = hash->hash_function (
+					hash->key_function (iter));
+			}
+
+			i++;
+		}
+
+		qsort (keys, entries, sizeof (NihHashFreezeKey),
+		       nih_hash_freeze_cmp);
+
+		for (i = 0; i < entries; i++)
+			if ((! size) || (hashes[size - 1] != keys[i].hash))
+				hashes[size++] = keys[i].hash;
+
+		disp = nih_hash_freeze_build (NULL, hashes, size,
+					      &nbuckets, slots);
+		if (! disp)
+			return NULL;
+	}
+
+	/* Entries are placed first so the pointers are aligned */
+	frozen = nih_alloc (parent, (sizeof (NihFrozenHash)
+				     + sizeof (NihList *) * entries
+				     + sizeof (uint32_t) * nbuckets
+				     + sizeof (uint32_t) * size
+				     + sizeof (uint32_t) * (size + 1)));
+	if (! frozen)
+		return NULL;
+
+	frozen->key_function = hash->key_function;
+	frozen->hash_function = hash->hash_function;
+	frozen->cmp_function = hash->cmp_function;
+
+	frozen->size = size;
+	frozen->nbuckets = nbuckets;
+	frozen->entries = entries;
+
+	frozen->table = (NihList **)(frozen + 1);
+	frozen->disp = (uint32_t *)(frozen->table + entries);
+	frozen->hashes = frozen->disp + nbuckets;
+	frozen->offsets = frozen->hashes + size;
+
+	if (nbuckets)
+		memcpy (frozen->disp, disp, sizeof (uint32_t) * nbuckets);
+
+	/* Count the entries for each slot, then place them in order */
+	counts = frozen->offsets;
+	memset (counts, 0, sizeof (uint32_t) * (size + 1));
+
+	for (i = 0, j = 0; i < entries; i++) {
+		if ((i > 0) && (keys[i].hash != keys[i - 1].hash))
+			j++;
+
+		frozen->hashes[slots[j]] = keys[i].hash;
+		counts[slots[j] + 1]++;
+	}
+
+	for (i = 0; i < size; i++)
+		counts[i + 1] += counts[i];
+
+	/* Each offset is advanced past the entries placed at it, which
+	 * leaves it at the offset of the next slot; so shift them back.
+	 */
+	for (i = 0, j = 0; i < entries; i++) {
+		if ((i > 0) && (keys[i].hash != keys[i - 1].hash))
+			j++;
+
+		frozen->table[counts[slots[j]]++] = keys[i].entry;
+	}
+
+	for (i = size; i > 0; i--)
+		counts[i] = counts[i - 1];
+	counts[0] = 0;
+
+	return frozen;
+}
+
+/**
+ * nih_frozen_hash_search:
+ * @frozen: frozen hash table to search,
+ * @key: key to look for,
+ * @entry: previous entry found.
+ *
+ * Finds all entries in @frozen with a key of @key, calling the key
+ * function only for the entries in the slot for @key, starting after
+ * @entry.
+ *
+ * The initial @entry can be found by passing NULL or using
+ * nih_frozen_hash_lookup().
+ *
+ * Returns: next entry in the table or NULL if there are no more entries.
+ **/
+NihList *
+nih_frozen_hash_search (const NihFrozenHash *frozen,
+			const void          *key,
+			NihList             *entry)
+{
+	uint32_t hashval;
+	size_t   slot, i, last;
+
+	nih_assert (frozen != NULL);
+	nih_assert (key != NULL);
+
+	if (! frozen->size)
+		return NULL;
+
+	hashval = frozen->hash_function (key);
+	slot = nih_frozen_hash_slot (hashval, frozen->disp,
+				     frozen->nbuckets, frozen->size);
+	if (frozen->hashes[slot] != hashval)
+		return NULL;
+
+	i = frozen->offsets[slot];
+	last = frozen->offsets[slot + 1];
+
+	if (entry) {
+		while ((i < last) && (frozen->table[i] != entry))
+			i++;
+		i++;
+	}
+
+	for (; i < last; i++)
+		if (! frozen->cmp_function (key,
+					    frozen->key_function (frozen->table[i])))
+			return frozen->table[i];
+
+	return NULL;
+}
+
+/**
+ * nih_frozen_hash_lookup:
+ * @frozen: frozen hash table to search,
+ * @key: key to look for.
+ *
+ * Finds the first entry in @frozen with a key of @key.
+ *
+ * If multiple entries are expected, use nih_frozen_hash_search() instead.
+ *
+ * Returns: entry found or NULL if no entry existed.
+ **/
+NihList *
+nih_frozen_hash_lookup (const NihFrozenHash *frozen,
+			const void          *key)
+{
+	return nih_frozen_hash_search (frozen, key, NULL);
+}
+
+
+/**
+ * nih_hash_freeze_c_cmp:
+ * @a: key to compare,
+ * @b: key to compare against.
+ *
+ * Orders string keys by hash, and then by the keys themselves.
+ *
+ * Returns: integer less than, equal to or greater than zero if @a is
+ * respectively less then, equal to or greater than @b.
+ **/
+static int
+nih_hash_freeze_c_cmp (const void *a,
+		       const void *b)
+{
+	const NihHashFreezeKey *ka = a, *kb = b;
+
+	if (ka->hash != kb->hash)
+		return ka->hash < kb->hash ? -1 : 1;
+
+	return strcmp (ka->key, kb->key);
+}
+
+/**
+ * nih_hash_freeze_c_str:
+ * @str: pointer to string to append to,
+ * @src: string to append.
+ *
+ * Appends @src to @str as a C string literal, escaping any characters
+ * that cannot appear within one.
+ *
+ * Returns: @str or NULL if insufficient memory.
+ **/
+static char *
+nih_hash_freeze_c_str (char       **str,
+		       const char  *src)
+{
+	nih_assert (str != NULL);
+	nih_assert (src != NULL);
+
+	if (! nih_strcat (str, NULL, "\""))
+		return NULL;
+
+	for (const unsigned char *c = (const unsigned char *)src; *c; c++) {
+		char *ret;
+
+		if ((*c == '"') || (*c == '\\')) {
+			ret = nih_strcat_sprintf (str, NULL, "\\%c", *c);
+		} else if ((*c < ' ') || (*c > '~')) {
+			ret = nih_strcat_sprintf (str, NULL, "\\%03o", *c);
+		} else {
+			ret = nih_strncat (str, NULL, (const char *)c, 1);
+		}
+
+		if (! ret)
+			return NULL;
+	}
+
+	return nih_strcat (str, NULL, "\"");
+}
+
+/**
+ * nih_hash_freeze_c:
+ * @parent: parent of returned string,
+ * @hash: hash table with string keys,
+ * @prefix: prefix of generated names.
+ *
+ * Generates C source code for a static lookup table containing each of
+ * the distinct string keys in @hash, so that tables known at build time
+ * need not be built at all at run time.
+ *
+ * The generated code declares a @prefix_keys array of the keys and a
+ * @prefix_lookup() function which returns the index of a key in that
+ * array or -1 if not found, using the same minimal perfect hash as
+ * nih_hash_freeze().  Since the table is generated in advance, the keys
+ * are hashed with nih_hash_fnv_hash() rather than a seeded hash, which
+ * the generated code calls along with nih_frozen_hash_slot(); it should
+ * include <string.h> and <nih/hash.h>.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: newly allocated string or NULL if insufficient memory.
+ **/
+char *
+nih_hash_freeze_c (const void *parent,
+		   NihHash    *hash,
+		   const char *prefix)
+{
+	nih_local char *            code = NULL;
+	nih_local NihHashFreezeKey *keys = NULL;
+	nih_local uint32_t *        hashes = NULL;
+	nih_local uint32_t *        slots = NULL;
+	nih_local uint32_t *        disp = NULL;
+	nih_local size_t *          order = NULL;
+	nih_local size_t *          offsets = NULL;
+	size_t                      entries = 0, nkeys = 0, size = 0;
+	size_t                      nbuckets = 0, i, j;
+
+	nih_assert (hash != NULL);
+	nih_assert (prefix != NULL);
+
+	code = nih_sprintf (NULL, "/* Generated by nih_hash_freeze_c() */\n\n");
+	if (! code)
+		return NULL;
+
+	NIH_HASH_FOREACH (hash, iter)
+		entries++;
+
+	if (! entries) {
+		if (! nih_strcat_sprintf (&code, NULL,
+					  "static int\n"
+					  "%s_lookup (const char *key)\n"
+					  "{\n"
+					  "\treturn -1;\n"
+					  "}\n", prefix))
+			return NULL;
+
+		return nih_strdup (parent, code);
+	}
+
+	keys = nih_alloc (NULL, sizeof (NihHashFreezeKey) * entries);
+	hashes = nih_alloc (NULL, sizeof (uint32_t) * entries);
+	slots = nih_alloc (NULL, sizeof (uint32_t) * entries);
+	order = nih_alloc (NULL, sizeof (size_t) * entries);
+	offsets = nih_alloc (NULL, sizeof (size_t) * (entries + 1));
+	if ((! keys) || (! hashes) || (! slots) || (! order) || (! offsets))
+		return NULL;
+
+	i = 0;
+	NIH_HASH_FOREACH (hash, iter) {
+		keys[i].entry = iter;
+		keys[i].index = i;
+		keys[i].key = hash->key_function (iter);
+		keys[i].hash = nih_hash_fnv_hash (keys[i].key);
+		i++;
+	}
+
+	qsort (keys, entries, sizeof (NihHashFreezeKey),
+	       nih_hash_freeze_c_cmp);
+
+	/* Drop duplicate keys, and collect the distinct hashes */
+	for (i = 0; i < entries; i++) {
+		if (nkeys && (! strcmp (keys[nkeys - 1].key, keys[i].key)))
+			continue;
+
+		keys[nkeys++] = keys[i];
+		if ((! size) || (hashes[size - 1] != keys[i].hash))
+			hashes[size++] = keys[i].hash;
+	}
+
+	disp = nih_hash_freeze_build (NULL, hashes, size, &nbuckets, slots);
+	if (! disp)
+		return NULL;
+
+	/* Order the keys by slot, keeping those with the same hash in
+	 * order.
+	 */
+	memset (offsets, 0, sizeof (size_t) * (size + 1));
+	for (i = 0, j = 0; i < nkeys; i++) {
+		if ((i > 0) && (keys[i].hash != keys[i - 1].hash))
+			j++;
+		offsets[slots[j] + 1]++;
+	}
+
+	for (i = 0; i < size; i++)
+		offsets[i + 1] += offsets[i];
+
+	/* As in nih_hash_freeze(), each offset is left at the next slot */
+	for (i = 0, j = 0; i < nkeys; i++) {
+		if ((i > 0) && (keys[i].hash != keys[i - 1].hash))
+			j++;
+		order[offsets[slots[j]]++] = i;
+	}
+
+	for (i = size; i > 0; i--)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+
+	if (! nih_strcat_sprintf (&code, NULL,
+				  "static const char *const %s_keys[] = {\n",
+				  prefix))
+		return NULL;
+
+	for (i = 0; i < nkeys; i++) {
+		if (! nih_strcat (&code, NULL, "\t"))
+			return NULL;
+		if (! nih_hash_freeze_c_str (&code, keys[order[i]].key))
+			return NULL;
+		if (! nih_strcat (&code, NULL, ",\n"))
+			return NULL;
+	}
+
+	if (! nih_strcat_sprintf (&code, NULL,
+				  "};\n\n"
+				  "static const uint32_t %s_disp[] = {",
+				  prefix))
+		return NULL;
+
+	for (i = 0; i < nbuckets; i++)
+		if (! nih_strcat_sprintf (&code, NULL, "%s%u,",
+					  i % 8 ? " " : "\n\t", disp[i]))
+			return NULL;
+
+	if (! nih_strcat_sprintf (&code, NULL,
+				  "\n};\n\n"
+				  "static const uint32_t %s_offsets[] = {",
+				  prefix))
+		return NULL;
+
+	for (i = 0; i <= size; i++)
+		if (! nih_strcat_sprintf (&code, NULL, "%s%zu,",
+					  i % 8 ? " " : "\n\t", offsets[i]))
+			return NULL;
+
+	if (! nih_strcat_sprintf (
+		    &code, NULL,
+		    "\n};\n\n"
+		    "static int\n"
+		    "%s_lookup (const char *key)\n"
+		    "{\n"
+		    "\tsize_t slot, i;\n"
+		    "\n"
+		    "\tslot = nih_frozen_hash_slot (nih_hash_fnv_hash (key),\n"
+		    "\t\t\t\t     %s_disp, %zu, %zu);\n"
+		    "\tfor (i = %s_offsets[slot]; i < %s_offsets[slot + 1]; i++)\n"
+		    "\t\tif (! strcmp (key, %s_keys[i]))\n"
+		    "\t\t\treturn i;\n"
+		    "\n"
+		    "\treturn -1;\n"
+		    "}\n",
+		    prefix, prefix, nbuckets, size, prefix, prefix, prefix))
+		return NULL;
+
+	return nih_strdup (parent, code);
+}
 
 
 /**
@@ -352,19 +1802,167 @@ nih_hash_string_key (NihList *entry)
 }
 
 /**
- * nih_hash_string_hash:
+ * nih_hash_string_entry_key:
+ * @entry: entry to create key for.
+ *
+ * Key function that can be used for any hash entry where the first member
+ * immediately after the NihHashEntry header is a pointer to the string
+ * containing the name.
+ *
+ * Returns: pointer to that string.
+ **/
+const char *
+nih_hash_string_entry_key (NihList *entry)
+{
+	nih_assert (entry != NULL);
+
+	return *((const char **)((char *)entry + sizeof (NihHashEntry)));
+}
+
+/**
+ * nih_hash_seed_init:
+ *
+ * Chooses a random seed for string hashes from the random bytes the
+ * kernel provides to every process, falling back to the time and process
+ * id where these are not available.
+ **/
+static void
+nih_hash_seed_init (void)
+{
+	const uint8_t *random;
+
+	random = (const uint8_t *)getauxval (AT_RANDOM);
+	if (random) {
+		/* Use the second half, the first is the stack protector */
+		memcpy (&hash_seed, random + 8, sizeof (hash_seed));
+	} else {
+		struct timespec ts;
+
+		clock_gettime (CLOCK_MONOTONIC, &ts);
+		hash_seed = (((uint64_t)ts.tv_sec << 32) ^ ts.tv_nsec
+			     ^ ((uint64_t)getpid () << 16));
+	}
+
+	hash_seeded = TRUE;
+}
+
+/**
+ * nih_hash_set_seed:
+ * @seed: new seed.
+ *
+ * Sets the seed mixed into the string hashes returned by
+ * nih_hash_string_hash() and nih_hash_string_hash_len() to @seed, rather
+ * than the random seed chosen for each process.  This is intended for
+ * test suites that need to reproduce a particular distribution of keys;
+ * it must not be called while any hash table using these functions has
+ * entries, since they could no longer be found.
+ **/
+void
+nih_hash_set_seed (uint64_t seed)
+{
+	hash_seed = seed;
+	hash_seeded = TRUE;
+}
+
+/**
+ * nih_hash_set_fnv_compat:
+ * @compat: TRUE to return FNV-1 hashes.
+ *
+ * Earlier versions of this library hashed strings with the unseeded FNV-1
+ * algorithm, so the bin an entry was placed in, and thus the order of
+ * iteration, was always the same.  Calling this function with @compat
+ * set to TRUE causes nih_hash_string_hash() and nih_hash_string_hash_len()
+ * to return those values again, for software that depends on them.
+ *
+ * This may only be called before any hash tables using these functions
+ * have entries.  Tables exposed to untrusted keys should instead use
+ * nih_hash_fnv_hash() only where the old values are actually required.
+ **/
+void
+nih_hash_set_fnv_compat (int compat)
+{
+	hash_fnv_compat = compat;
+}
+
+/**
+ * hash_read64:
+ * @ptr: pointer to eight bytes.
+ *
+ * Returns: bytes at @ptr as a little-endian 64-bit word.
+ **/
+static inline uint64_t
+hash_read64 (const uint8_t *ptr)
+{
+	uint64_t word;
+
+	memcpy (&word, ptr, sizeof (word));
+
+	return le64toh (word);
+}
+
+/**
+ * hash_read32:
+ * @ptr: pointer to four bytes.
+ *
+ * Returns: bytes at @ptr as a little-endian 32-bit word.
+ **/
+static inline uint64_t
+hash_read32 (const uint8_t *ptr)
+{
+	uint32_t word;
+
+	memcpy (&word, ptr, sizeof (word));
+
+	return le32toh (word);
+}
+
+/**
+ * hash_mix:
+ * @a: first word,
+ * @b: second word.
+ *
+ * Multiplies @a and @b to a 128-bit product and folds the two halves
+ * together, which mixes every bit of the inputs into every bit of the
+ * result.
+ *
+ * Returns: mixed word.
+ **/
+static inline uint64_t
+hash_mix (uint64_t a,
+	  uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else /* __SIZEOF_INT128__ */
+	uint64_t ha = a >> 32, hb = b >> 32;
+	uint64_t la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+
+	c += lo < t;
+
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif /* __SIZEOF_INT128__ */
+}
+
+/**
+ * nih_hash_fnv_hash:
  * @key: string key to hash.
  *
  * Generates and returns a 32-bit hash for the given string key using the
  * FNV-1 algorithm as documented at http://www.isthe.com/chongo/tech/comp/fnv/
  *
- * The returned key will need to be bounded within the number of bins
- * used in the hash table.
+ * This was the hash returned by nih_hash_string_hash() in earlier versions
+ * of this library; it is not seeded, so should not be used for keys that
+ * come from untrusted sources.
  *
  * Returns: 32-bit hash.
  **/
 uint32_t
-nih_hash_string_hash (const char *key)
+nih_hash_fnv_hash (const char *key)
 {
 	register uint32_t hash = FNV_OFFSET_BASIS;
 
@@ -378,6 +1976,123 @@ nih_hash_string_hash (const char *key)
 	return hash;
 }
 
+/**
+ * nih_hash_string_hash:
+ * @key: string key to hash.
+ *
+ * Generates and returns a 32-bit hash for the given string key, as
+ * nih_hash_string_hash_len() does for the length of @key.
+ *
+ * The returned key will need to be bounded within the number of bins
+ * used in the hash table.
+ *
+ * Returns: 32-bit hash.
+ **/
+uint32_t
+nih_hash_string_hash (const char *key)
+{
+	nih_assert (key != NULL);
+
+	if (hash_fnv_compat)
+		return nih_hash_fnv_hash (key);
+
+	return nih_hash_string_hash_len (key, strlen (key));
+}
+
+/**
+ * nih_hash_string_hash_len:
+ * @key: key to hash,
+ * @len: length of @key.
+ *
+ * Generates and returns a 32-bit hash for the first @len bytes of @key,
+ * which need not be NUL-terminated; the same hash is returned by
+ * nih_hash_string_hash() for a NUL-terminated string of that length.
+ *
+ * The key is read eight bytes at a time and mixed with a seed chosen at
+ * random for each process, following the design of Wang Yi's wyhash, so
+ * that collisions cannot be forced by choosing keys in advance.
+ *
+ * The returned key will need to be bounded within the number of bins
+ * used in the hash table.
+ *
+ * Returns: 32-bit hash.
+ **/
+uint32_t
+nih_hash_string_hash_len (const char *key,
+			  size_t      len)
+{
+	const uint8_t *ptr = (const uint8_t *)key;
+	uint64_t       seed, a, b, hash;
+
+	nih_assert (key != NULL);
+
+	if (hash_fnv_compat) {
+		uint32_t fnv = FNV_OFFSET_BASIS;
+
+		for (size_t i = 0; (i < len) && key[i]; i++) {
+			fnv *= FNV_PRIME;
+			fnv ^= key[i];
+		}
+
+		return fnv;
+	}
+
+	if (! hash_seeded)
+		nih_hash_seed_init ();
+
+	seed = hash_seed ^ hash_mix (hash_seed ^ HASH_P0, HASH_P1);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			size_t off = (len >> 3) << 2;
+
+			a = (hash_read32 (ptr) << 32) | hash_read32 (ptr + off);
+			b = ((hash_read32 (ptr + len - 4) << 32)
+			     | hash_read32 (ptr + len - 4 - off));
+		} else if (len > 0) {
+			a = (((uint64_t)ptr[0] << 16)
+			     | ((uint64_t)ptr[len >> 1] << 8)
+			     | ptr[len - 1]);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t left = len;
+
+		if (left > 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = hash_mix (hash_read64 (ptr) ^ HASH_P1,
+						 hash_read64 (ptr + 8) ^ seed);
+				see1 = hash_mix (hash_read64 (ptr + 16) ^ HASH_P2,
+						 hash_read64 (ptr + 24) ^ see1);
+				see2 = hash_mix (hash_read64 (ptr + 32) ^ HASH_P3,
+						 hash_read64 (ptr + 40) ^ see2);
+				ptr += 48;
+				left -= 48;
+			} while (left > 48);
+
+			seed ^= see1 ^ see2;
+		}
+
+		while (left > 16) {
+			seed = hash_mix (hash_read64 (ptr) ^ HASH_P1,
+					 hash_read64 (ptr + 8) ^ seed);
+			ptr += 16;
+			left -= 16;
+		}
+
+		a = hash_read64 (ptr + left - 16);
+		b = hash_read64 (ptr + left - 8);
+	}
+
+	hash = hash_mix (HASH_P1 ^ len, hash_mix (a ^ HASH_P1, b ^ seed));
+
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
 /**
  * nih_hash_string_cmp:
  * @key1: key to compare,
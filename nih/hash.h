@@ -37,6 +37,16 @@
  * one found as the first member in the structure after the list head.
  * For this case, you may use nih_hash_string_new() instead.
  *
+ * String keys are hashed with a seed chosen at random for each process,
+ * so that the bins an entry is placed in cannot be predicted; software
+ * that depends on the unseeded hashes of earlier versions may call
+ * nih_hash_set_fnv_compat() before creating any tables.
+ *
+ * Tables that are built once and then only read may be frozen with
+ * nih_hash_freeze() into an NihFrozenHash, which always finds a key in
+ * the first slot it examines; or for tables known at build time,
+ * nih_hash_freeze_c() generates the equivalent C source.
+ *
  * Entries may be added to a hash table using nih_hash_add(), no assumption
  * is made about whether duplicate entries are permitted or not.  To add
  * and fail if the entry already exists use nih_hash_add_unique(), to add
@@ -47,6 +57,20 @@
  *
  * To lookup the first value nih_hash_lookup() is a convenient simpler
  * function.
+ *
+ * The number of bins is chosen from the expected number of entries, but
+ * grows as entries are added and shrinks again once they're removed.  The
+ * entries are moved into the new bins a few at a time by each operation
+ * on the table, so that no one operation takes long; entries never change
+ * address, so pointers to them remain valid.
+ *
+ * Each table also keeps a bitmap of the bins that entries have been added
+ * to, so that iterating with NIH_HASH_FOREACH() costs time proportional
+ * to the number of entries rather than the number of bins.
+ *
+ * Tables created with nih_hash_cached_new() instead have members that
+ * begin with an NihHashEntry, which stores the hash of the key so that
+ * most non-matching entries can be skipped without examining their keys.
  **/
 
 #include <nih/macros.h>
@@ -94,7 +118,18 @@ typedef int (*NihCmpFunction) (const void *key1, const void *key2);
  * @size: size of bins array,
  * @key_function: function used to obtain keys for entries,
  * @hash_function: function used to obtain hash of keys,
- * @cmp_function: function used to compare keys.
+ * @cmp_function: function used to compare keys,
+ * @cache_hash: TRUE if members begin with an NihHashEntry,
+ * @min_size: size of bins array never shrunk below,
+ * @entries: estimated number of entries,
+ * @old_bins: array of bins being moved into @bins,
+ * @old_size: size of @old_bins array,
+ * @cursor: next bin to be moved or counted,
+ * @counted: number of entries counted since @cursor was reset,
+ * @added: number of entries added since @cursor was reset,
+ * @iterating: number of iterations in progress,
+ * @used: bitmap of bins that may contain entries,
+ * @old_used: bitmap of @old_bins that may contain entries.
  *
  * This structure represents a hash table which is more efficient for
  * looking up members than an ordinary list.
@@ -102,6 +137,25 @@ typedef int (*NihCmpFunction) (const void *key1, const void *key2);
  * Individual members of the hash table are NihList members as are the
  * bins themselves, so to remove an entry from the table you can just
  * use nih_list_remove().
+ *
+ * Since entries may be removed without the table knowing, @entries is
+ * only an estimate; each operation counts the entries in the bin at
+ * @cursor, correcting the estimate each time every bin has been counted.
+ * When the estimate shows the table to be too full or too empty, a new
+ * @bins array is allocated and the entries are moved over from @old_bins
+ * a few bins at a time by each following operation.  Neither happens
+ * while the table is being iterated.
+ *
+ * For the same reason the bit in @used for a bin is set whenever an entry
+ * is added to it, but only cleared when the bin is next found to be empty
+ * while iterating or counting.  @used is followed by a summary bitmap
+ * with a bit for each word of @used that is not zero, so that iteration
+ * can skip large numbers of empty bins at once.
+ *
+ * Because this housekeeping is done by every operation, including
+ * nih_hash_lookup() and nih_hash_search(), looking up an entry modifies
+ * the table; a table shared between threads needs the same locking for
+ * lookups as for changes.
  **/
 typedef struct nih_hash {
 	NihList         *bins;
@@ -110,8 +164,131 @@ typedef struct nih_hash {
 	NihKeyFunction   key_function;
 	NihHashFunction  hash_function;
 	NihCmpFunction   cmp_function;
+	int              cache_hash;
+
+	size_t           min_size;
+	size_t           entries;
+
+	NihList         *old_bins;
+	size_t           old_size;
+
+	size_t           cursor;
+	size_t           counted;
+	size_t           added;
+
+	unsigned int     iterating;
+
+	uint64_t        *used;
+	uint64_t        *old_used;
 } NihHash;
 
+/**
+ * NihHashEntry:
+ * @entry: list header,
+ * @hash: hash of the entry's key.
+ *
+ * Members of hash tables created with nih_hash_cached_new() must begin
+ * with this structure in place of the usual NihList header; @hash is set
+ * by the table when the entry is added, and must not be modified while
+ * the entry remains in it.
+ **/
+typedef struct nih_hash_entry {
+	NihList  entry;
+	uint32_t hash;
+} NihHashEntry;
+
+/**
+ * NihFrozenHash:
+ * @key_function: function used to obtain keys for entries,
+ * @hash_function: function used to obtain hash of keys,
+ * @cmp_function: function used to compare keys,
+ * @size: number of slots,
+ * @nbuckets: number of buckets,
+ * @entries: number of entries,
+ * @table: entries, ordered by slot,
+ * @disp: displacement of each bucket,
+ * @hashes: hash of the keys in each slot,
+ * @offsets: offset in @table of the entries in each slot.
+ *
+ * This structure represents an immutable lookup table built from the
+ * entries of an NihHash by nih_hash_freeze().  Each distinct hash of the
+ * keys has its own slot, calculated from the hash and the displacement
+ * of its bucket by nih_frozen_hash_slot(); the entries with that hash are
+ * found from @offsets[slot] up to @offsets[slot + 1] in @table.
+ *
+ * The structure and its arrays are a single allocation.
+ **/
+typedef struct nih_frozen_hash {
+	NihKeyFunction   key_function;
+	NihHashFunction  hash_function;
+	NihCmpFunction   cmp_function;
+
+	size_t           size;
+	size_t           nbuckets;
+	size_t           entries;
+
+	NihList        **table;
+	uint32_t        *disp;
+	uint32_t        *hashes;
+	uint32_t        *offsets;
+} NihFrozenHash;
+
+/**
+ * NihHashIter:
+ * @hash: hash table being iterated,
+ * @bin: index of bin being iterated.
+ *
+ * Used by NIH_HASH_FOREACH() and NIH_HASH_FOREACH_SAFE() to iterate the
+ * bins of @hash while preventing its entries being moved between bins.
+ * Bins numbered past the size of the bins array are those of the old bins
+ * array while the table is being resized; empty bins are skipped by
+ * nih_hash_iter_next(), and @bin is past the last bin once there are no
+ * more.
+ **/
+typedef struct nih_hash_iter {
+	NihHash *hash;
+	size_t   bin;
+} NihHashIter;
+
+
+/**
+ * NIH_HASH_BIN:
+ * @hash: hash table,
+ * @i: bin number.
+ *
+ * Returns the head of bin @i of @hash, where bins numbered past the size
+ * of the bins array are those of the old bins array while the table is
+ * being resized.
+ *
+ * Returns: list head of bin.
+ **/
+#define NIH_HASH_BIN(hash, i)						\
+	((i) < (hash)->size ? &(hash)->bins[(i)]			\
+	 : &(hash)->old_bins[(i) - (hash)->size])
+
+/**
+ * NIH_HASH_NUM_BINS:
+ * @hash: hash table.
+ *
+ * Returns: total number of bins in @hash, including the old bins while
+ * the table is being resized.
+ **/
+#define NIH_HASH_NUM_BINS(hash) ((hash)->size + (hash)->old_size)
+
+
+/**
+ * NIH_HASH_ITER_NEXT:
+ * @iter: iterator.
+ *
+ * Advances @iter to the next bin that contains entries, moving straight
+ * to the following bin when it's not empty and only otherwise calling
+ * nih_hash_iter_next() to skip the empty bins.
+ **/
+#define NIH_HASH_ITER_NEXT(iter)					\
+	((((iter).bin + 1 < (iter).hash->size)				\
+	  && ! NIH_LIST_EMPTY (&(iter).hash->bins[(iter).bin + 1]))	\
+	 ? (void)(iter).bin++ : nih_hash_iter_next (&(iter)))
+
 
 /**
  * NIH_HASH_FOREACH:
@@ -121,7 +298,9 @@ typedef struct nih_hash {
  * Expands to nested for statements that iterate over each entry in each
  * bin of @hash, except the bin head pointer, setting @iter to each entry
  * for the block within the loop.  A variable named _@iter_i is used to
- * iterate the hash bins.
+ * iterate the hash bins, and prevents the table being resized until the
+ * loop is finished.  Bins to which no entry has been added are skipped
+ * without being examined.
  *
  * This is the cheapest form of iteration, however it is not safe to perform
  * various modifications to the hash; most importantly, you must not change
@@ -130,11 +309,19 @@ typedef struct nih_hash {
  *
  * However since it doesn't modify the hash being iterated in any way, it
  * is safe to traverse or iterate the hash again while iterating.
+ *
+ * The hash itself must not be freed within the loop, even if you break
+ * out of it afterwards, since the iteration is ended by
+ * nih_hash_iter_end() once the loop is left.
  **/
 #define NIH_HASH_FOREACH(hash, iter)					\
-	for (size_t _##iter##_i = 0; _##iter##_i < (hash)->size;	\
-	     _##iter##_i++)						\
-		NIH_LIST_FOREACH (&(hash)->bins[_##iter##_i], iter)
+	for (NihHashIter _##iter##_i					\
+		     __attribute__((cleanup(nih_hash_iter_end)))	\
+		     = nih_hash_iter_begin (hash);			\
+	     _##iter##_i.bin < NIH_HASH_NUM_BINS (_##iter##_i.hash);	\
+	     NIH_HASH_ITER_NEXT (_##iter##_i))				\
+		NIH_LIST_FOREACH (NIH_HASH_BIN (_##iter##_i.hash,	\
+						_##iter##_i.bin), iter)
 
 /**
  * NIH_HASH_FOREACH_SAFE:
@@ -144,7 +331,8 @@ typedef struct nih_hash {
  * Expands to nested for statements that iterate over each entry in each
  * bin of @hash, except for the bin head pointer, setting @iter to each
  * entry for the block within the loop.  A variable named _@iter_i is used
- * to iterate the hash bins.
+ * to iterate the hash bins, and prevents the table being resized until the
+ * loop is finished.
  *
  * The iteration is performed safely by placing a cursor node after @iter;
  * this means that any node including @iter can be removed from the hash,
@@ -159,11 +347,18 @@ typedef struct nih_hash {
  * iterating - including performing lookups.  If you need to perform
  * multiple iterations, lookups, or reference the next or previous pointers
  * of a node, you must use NIH_HASH_FOREACH().
+ *
+ * As with NIH_HASH_FOREACH(), the hash itself must not be freed within
+ * the loop.
  **/
 #define NIH_HASH_FOREACH_SAFE(hash, iter)				\
-	for (size_t _##iter##_i = 0; _##iter##_i < (hash)->size;	\
-	     _##iter##_i++)						\
-		NIH_LIST_FOREACH_SAFE (&(hash)->bins[_##iter##_i], iter)
+	for (NihHashIter _##iter##_i					\
+		     __attribute__((cleanup(nih_hash_iter_end)))	\
+		     = nih_hash_iter_begin (hash);			\
+	     _##iter##_i.bin < NIH_HASH_NUM_BINS (_##iter##_i.hash);	\
+	     NIH_HASH_ITER_NEXT (_##iter##_i))				\
+		NIH_LIST_FOREACH_SAFE (NIH_HASH_BIN (_##iter##_i.hash,	\
+						     _##iter##_i.bin), iter)
 
 
 /**
@@ -197,6 +392,32 @@ typedef struct nih_hash {
 		      (NihCmpFunction)nih_hash_string_cmp)
 
 
+/**
+ * nih_hash_string_cached_new:
+ * @parent: parent of new hash,
+ * @entries: rough number of entries expected,
+ *
+ * Allocates a new hash table in the same manner as nih_hash_string_new(),
+ * except that individual members of the hash table begin with an
+ * NihHashEntry, which has a constant string as the first member after it
+ * that can be used as the hash key.  The hash of each key is stored in
+ * the entry so that most non-matching entries are skipped without a
+ * string comparison.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned hash table.  When all parents
+ * of the returned hash table are freed, the returned hash table will also be
+ * freed.
+ *
+ * Returns: the new hash table or NULL if the allocation failed.
+ **/
+#define nih_hash_string_cached_new(parent, entries)			\
+	nih_hash_cached_new (parent, entries,				\
+			     (NihKeyFunction)nih_hash_string_entry_key,	\
+			     (NihHashFunction)nih_hash_string_hash,	\
+			     (NihCmpFunction)nih_hash_string_cmp)
+
+
 NIH_BEGIN_EXTERN
 
 NihHash *   nih_hash_new          (const void *parent, size_t entries,
@@ -204,6 +425,11 @@ NihHash *   nih_hash_new          (const void *parent, size_t entries,
 				   NihHashFunction hash_function,
 				   NihCmpFunction cmp_function)
 	__attribute__ ((warn_unused_result, malloc));
+NihHash *   nih_hash_cached_new   (const void *parent, size_t entries,
+				   NihKeyFunction key_function,
+				   NihHashFunction hash_function,
+				   NihCmpFunction cmp_function)
+	__attribute__ ((warn_unused_result, malloc));
 
 NihList *   nih_hash_add          (NihHash *hash, NihList *entry);
 NihList *   nih_hash_add_unique   (NihHash *hash, NihList *entry);
@@ -213,8 +439,31 @@ NihList *   nih_hash_search       (NihHash *hash, const void *key,
 				   NihList *entry);
 NihList *   nih_hash_lookup       (NihHash *hash, const void *key);
 
+NihFrozenHash *nih_hash_freeze    (const void *parent, NihHash *hash)
+	__attribute__ ((warn_unused_result, malloc));
+NihList *   nih_frozen_hash_search (const NihFrozenHash *frozen,
+				    const void *key, NihList *entry);
+NihList *   nih_frozen_hash_lookup (const NihFrozenHash *frozen,
+				    const void *key);
+size_t      nih_frozen_hash_slot  (uint32_t hashval, const uint32_t *disp,
+				   size_t nbuckets, size_t size);
+
+char *      nih_hash_freeze_c     (const void *parent, NihHash *hash,
+				   const char *prefix)
+	__attribute__ ((warn_unused_result, malloc));
+
+NihHashIter nih_hash_iter_begin   (NihHash *hash);
+void        nih_hash_iter_next    (NihHashIter *iter);
+void        nih_hash_iter_end     (NihHashIter *iter);
+
+void        nih_hash_set_seed     (uint64_t seed);
+void        nih_hash_set_fnv_compat (int compat);
+
 const char *nih_hash_string_key   (NihList *entry);
+const char *nih_hash_string_entry_key (NihList *entry);
 uint32_t    nih_hash_string_hash  (const char *key);
+uint32_t    nih_hash_string_hash_len (const char *key, size_t len);
+uint32_t    nih_hash_fnv_hash     (const char *key);
 int         nih_hash_string_cmp   (const char *key1, const char *key2);
 
 NIH_END_EXTERN
@@ -0,0 +1,264 @@
+/* libnih
+ *
+ * intern.c - interned string pools
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/logging.h>
+
+#include "intern.h"
+
+
+/**
+ * NihInternEntry:
+ * @entry: hash table entry header,
+ * @str: interned string,
+ * @pool: pool containing @str, or NULL once it has been freed,
+ * @size: number of bytes counted in the pool for @str.
+ *
+ * Records a string in a pool; it is allocated as a child of the string
+ * so that it's freed, and removed from the pool, along with it.
+ **/
+typedef struct nih_intern_entry {
+	NihHashEntry  entry;
+	const char   *str;
+	NihIntern    *pool;
+	size_t        size;
+} NihInternEntry;
+
+
+/* Prototypes for static functions */
+static int nih_intern_destroy       (NihIntern *pool);
+static int nih_intern_entry_destroy (NihInternEntry *entry);
+
+
+/**
+ * nih_intern_new:
+ * @parent: parent of new pool.
+ *
+ * Allocates a new, empty, pool of interned strings.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned pool.  When all parents
+ * of the returned pool are freed, the returned pool will also be
+ * freed; the strings in it are not.
+ *
+ * Returns: the new pool or NULL if the allocation failed.
+ **/
+NihIntern *
+nih_intern_new (const void *parent)
+{
+	NihIntern *pool;
+
+	pool = nih_new (parent, NihIntern);
+	if (! pool)
+		return NULL;
+
+	pool->strings = nih_hash_cached_new (
+		pool, 0,
+		(NihKeyFunction)nih_hash_string_entry_key,
+		(NihHashFunction)nih_hash_string_hash,
+		(NihCmpFunction)nih_hash_string_cmp);
+	if (! pool->strings) {
+		nih_free (pool);
+		return NULL;
+	}
+
+	pool->count = 0;
+	pool->bytes = 0;
+
+	nih_alloc_set_destructor (pool, nih_intern_destroy);
+
+	return pool;
+}
+
+/**
+ * nih_intern_destroy:
+ * @pool: pool being freed.
+ *
+ * Destructor for a pool of interned strings, which may outlive it; each
+ * string is removed from the pool's hash table before it is freed.
+ *
+ * Returns: zero.
+ **/
+static int
+nih_intern_destroy (NihIntern *pool)
+{
+	NihHash *hash;
+
+	nih_assert (pool != NULL);
+
+	hash = pool->strings;
+	NIH_HASH_FOREACH_SAFE (hash, iter) {
+		NihInternEntry *entry = (NihInternEntry *)iter;
+
+		entry->pool = NULL;
+		nih_list_remove (&entry->entry.entry);
+	}
+
+	return 0;
+}
+
+/**
+ * nih_intern_entry_destroy:
+ * @entry: entry being freed.
+ *
+ * Destructor for the record of an interned string, which removes it from
+ * the pool when the string is freed.
+ *
+ * Returns: zero.
+ **/
+static int
+nih_intern_entry_destroy (NihInternEntry *entry)
+{
+	nih_assert (entry != NULL);
+
+	if (entry->pool) {
+		entry->pool->count--;
+		entry->pool->bytes -= entry->size;
+	}
+
+	return nih_list_destroy (&entry->entry.entry);
+}
+
+
+/**
+ * nih_intern_strdup:
+ * @pool: pool of strings,
+ * @parent: parent of string,
+ * @str: string to intern.
+ *
+ * Returns the string in @pool equal to @str, adding a copy of @str to
+ * @pool if there is none, and adds a reference to it from @parent.  The
+ * same pointer is returned for every equal string while any references
+ * to it remain, and it must not be modified.
+ *
+ * @parent must not be NULL.  When all parents of the returned string
+ * are freed, or have dropped their reference with nih_unref(), it will
+ * also be freed and removed from @pool.
+ *
+ * Returns: interned string or NULL if insufficient memory.
+ **/
+const char *
+nih_intern_strdup (NihIntern  *pool,
+		   const void *parent,
+		   const char *str)
+{
+	NihInternEntry *entry;
+	char           *new_str;
+	size_t          len;
+
+	nih_assert (pool != NULL);
+	nih_assert (parent != NULL);
+	nih_assert (str != NULL);
+
+	entry = (NihInternEntry *)nih_hash_lookup (pool->strings, str);
+	if (entry) {
+		nih_ref (entry->str, parent);
+		return entry->str;
+	}
+
+	len = strlen (str);
+
+	new_str = nih_strndup (parent, str, len);
+	if (! new_str)
+		return NULL;
+
+	entry = nih_new (new_str, NihInternEntry);
+	if (! entry) {
+		nih_free (new_str);
+		return NULL;
+	}
+
+	nih_list_init (&entry->entry.entry);
+	nih_alloc_set_destructor (entry, nih_intern_entry_destroy);
+
+	entry->str = new_str;
+	entry->pool = pool;
+	entry->size = len + 1 + sizeof (NihInternEntry);
+
+	nih_hash_add (pool->strings, &entry->entry.entry);
+
+	pool->count++;
+	pool->bytes += entry->size;
+
+	return new_str;
+}
+
+/**
+ * nih_intern_lookup:
+ * @pool: pool of strings,
+ * @str: string to look up.
+ *
+ * Finds the string in @pool equal to @str without adding a reference to
+ * it, so that it can be used as a key to search a hash table compared
+ * with nih_intern_cmp().
+ *
+ * Returns: interned string or NULL if @pool has no string equal to @str.
+ **/
+const char *
+nih_intern_lookup (NihIntern  *pool,
+		   const char *str)
+{
+	NihInternEntry *entry;
+
+	nih_assert (pool != NULL);
+	nih_assert (str != NULL);
+
+	entry = (NihInternEntry *)nih_hash_lookup (pool->strings, str);
+
+	return entry ? entry->str : NULL;
+}
+
+
+/**
+ * nih_intern_cmp:
+ * @key1: key to compare,
+ * @key2: key to compare against.
+ *
+ * Comparison function for hash tables keyed by interned strings; equal
+ * strings from the same pool are the same pointer, so the strings are
+ * only compared when the pointers differ.  It may be used with
+ * nih_hash_string_hash() as the hash function.
+ *
+ * Returns: integer less than, equal to or greater than zero if @key1 is
+ * respectively less then, equal to or greater than @key2.
+ **/
+int
+nih_intern_cmp (const char *key1,
+		const char *key2)
+{
+	nih_assert (key1 != NULL);
+	nih_assert (key2 != NULL);
+
+	if (key1 == key2)
+		return 0;
+
+	return strcmp (key1, key2);
+}
@@ -0,0 +1,78 @@
+/* libnih
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NIH_INTERN_H
+#define NIH_INTERN_H
+
+/**
+ * Provides pools of interned strings, so that names repeated across many
+ * objects are stored once and may be compared by their address.
+ *
+ * Pools are created with nih_intern_new(), and strings added to them with
+ * nih_intern_strdup() which returns the same constant string for every
+ * call with an equal string.  Each call adds a reference to the string
+ * from the parent given, in the same manner as nih_ref(), so the string
+ * is freed once all of its parents have been freed or have dropped their
+ * reference with nih_unref(); it is removed from the pool at that point.
+ *
+ * Interned strings must never be modified.  Since equal strings from the
+ * same pool are always the same pointer, nih_intern_cmp() may be used as
+ * the comparison function of a hash table keyed by them, only comparing
+ * the strings themselves when the pointers differ.
+ *
+ * Each pool counts the strings it holds and the bytes they occupy, so
+ * that the memory used by it can be reported.  Freeing the pool does
+ * not free the strings, which remain valid until their parents are freed.
+ **/
+
+#include <nih/macros.h>
+#include <nih/hash.h>
+
+
+/**
+ * NihIntern:
+ * @strings: hash table of strings,
+ * @count: number of strings in the pool,
+ * @bytes: number of bytes used by strings in the pool.
+ *
+ * This structure represents a pool of interned strings; @count and @bytes
+ * may be read to report its size, @bytes includes the terminating NUL of
+ * each string and the pool's record of it.
+ **/
+typedef struct nih_intern {
+	NihHash *strings;
+	size_t   count;
+	size_t   bytes;
+} NihIntern;
+
+
+NIH_BEGIN_EXTERN
+
+NihIntern * nih_intern_new    (const void *parent)
+	__attribute__ ((warn_unused_result, malloc));
+
+const char *nih_intern_strdup (NihIntern *pool, const void *parent,
+			       const char *str)
+	__attribute__ ((warn_unused_result));
+const char *nih_intern_lookup (NihIntern *pool, const char *str);
+
+int         nih_intern_cmp    (const char *key1, const char *key2);
+
+NIH_END_EXTERN
+
+#endif /* NIH_INTERN_H */
@@ -39,6 +39,10 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#if HAVE_VALGRIND_VALGRIND_H
+#include <valgrind/valgrind.h>
+#endif /* HAVE_VALGRIND_VALGRIND_H */
+
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/string.h>
@@ -51,6 +55,49 @@
 #include "io.h"
 
 
+/**
+ * NIH_IO_BUFFER_SHRINK_FACTOR:
+ *
+ * Buffers are only reallocated to a smaller size once the memory
+ * allocated for them is this many times the size needed, so that a
+ * buffer whose length varies is not repeatedly shrunk and grown again.
+ **/
+#define NIH_IO_BUFFER_SHRINK_FACTOR 4
+
+/**
+ * NIH_IO_BUFFER_MAX_GROW:
+ *
+ * Default for the largest number of bytes a buffer grows by at once;
+ * buffers double in size until they reach this, and then grow by this
+ * much at a time.
+ **/
+#define NIH_IO_BUFFER_MAX_GROW (1024 * 1024)
+
+/**
+ * NIH_IO_SEND_BATCH:
+ *
+ * Largest number of queued messages sent with a single call to
+ * sendmmsg().
+ **/
+#define NIH_IO_SEND_BATCH 16
+
+/**
+ * NIH_IO_RECV_BATCH:
+ *
+ * Largest number of messages received with a single call to recvmmsg(),
+ * and of received messages kept to be reused.
+ **/
+#define NIH_IO_RECV_BATCH 16
+
+/**
+ * NIH_IO_CONTROL_SIZE:
+ *
+ * Bytes of control data that may be received with each message of a
+ * batch, enough for credentials and several file descriptors.
+ **/
+#define NIH_IO_CONTROL_SIZE 256
+
+
 /* Prototypes for static functions */
 static void           nih_io_watcher        (NihIo *io, NihIoWatch *watch,
 					     NihIoEvents events);
@@ -61,7 +108,26 @@ static inline ssize_t nih_io_watcher_write  (NihIo *io, NihIoWatch *watch)
 static void           nih_io_closed         (NihIo *io);
 static void           nih_io_error          (NihIo *io);
 static void           nih_io_shutdown_check (NihIo *io);
+static void           nih_io_water_check    (NihIo *io);
 static NihIoMessage * nih_io_first_message  (NihIo *io);
+static ssize_t        nih_io_message_peek   (int fd);
+static int            nih_io_message_recv_into (NihIoMessage *message,
+						int fd, size_t size,
+						size_t *len);
+static void           nih_io_message_close_rights (struct msghdr *msghdr);
+static NihIoMessage * nih_io_message_take   (NihIo *io);
+static void           nih_io_message_release (NihIo *io,
+					      NihIoMessage *message);
+#if HAVE_RECVMMSG
+static ssize_t        nih_io_message_recv_batch (NihIo *io, int fd);
+#endif /* HAVE_RECVMMSG */
+static void           nih_io_message_msghdr (NihIoMessage *message,
+					     struct msghdr *msghdr,
+					     struct iovec *iov);
+static int            nih_io_write_internal (NihIo *io, const char *str,
+					     size_t len, const char *format,
+					     va_list *args)
+	__attribute__ ((warn_unused_result));
 
 
 /**
@@ -269,6 +335,11 @@ nih_io_buffer_new (const void *parent)
 	buffer->buf = NULL;
 	buffer->size = 0;
 	buffer->len = 0;
+	buffer->off = 0;
+
+	buffer->min_size = 0;
+	buffer->max_grow = NIH_IO_BUFFER_MAX_GROW;
+	buffer->scan = 0;
 
 	return buffer;
 }
@@ -280,8 +351,23 @@ nih_io_buffer_new (const void *parent)
  *
  * This function resizes the given @buffer so there is enough space for
  * both the current data and @grow additional bytes (which may be zero).
- * If there is more room than there needs to be, the buffer may actually
- * be decreased in size.
+ * If there is much more room than there needs to be, the buffer may
+ * actually be decreased in size, though never below its minimum size.
+ *
+ * Buffers double in size each time they need to grow until they're
+ * larger than their maximum growth, after which they grow by that much
+ * each time, so adding data a little at a time only reallocates the
+ * buffer a few times.
+ *
+ * Room left at the start of the buffer by nih_io_buffer_shrink() is
+ * reclaimed by moving the data back to the start when there is not
+ * enough room after it, provided that reclaims at least as many bytes
+ * as are moved; otherwise the buffer is grown as well, so that a full
+ * buffer used as a queue doesn't move all of its data for every few
+ * bytes taken from the front.
+ *
+ * Buffers are allocated at the size needed, and then grow geometrically
+ * from there.
  *
  * Returns: zero on success, negative value if insufficient memory.
  **/
@@ -290,38 +376,86 @@ nih_io_buffer_resize (NihIoBuffer *buffer,
 		      size_t       grow)
 {
 	char   *new_buf;
-	size_t  new_len, new_size;
+	size_t  new_len, new_size, total;
+	int     need_room, cheap;
 
 	nih_assert (buffer != NULL);
+	nih_assert (buffer->max_grow > 0);
 
 	new_len = buffer->len + grow;
 	if (! new_len) {
 		/* No bytes to store, so clean up the buffer */
 		if (buffer->buf)
-			nih_unref (buffer->buf, buffer);
+			nih_unref (buffer->buf - buffer->off, buffer);
 
 		buffer->buf = NULL;
 		buffer->size = 0;
+		buffer->off = 0;
 
 		return 0;
 	}
 
-	/* Round buffer to next largest multiple of BUFSIZ */
-	new_size = ((new_len - 1) / BUFSIZ) * BUFSIZ + BUFSIZ;
-	if (new_size == buffer->size)
+	new_size = nih_max (new_len, buffer->min_size);
+
+	/* Leave the buffer alone if there's room after the data and it's
+	 * not so much larger than it needs to be that it should shrink.
+	 */
+	total = buffer->off + buffer->size;
+	need_room = (new_len > buffer->size);
+	if ((! need_room)
+	    && (total / NIH_IO_BUFFER_SHRINK_FACTOR < new_size))
+		return 0;
+
+	/* Move the data back to the start of the memory, which may leave
+	 * enough room without reallocating; but unless that reclaims at
+	 * least as much as it moves, grow the buffer too so that we don't
+	 * have to do it again soon.
+	 */
+	cheap = (buffer->off >= buffer->len);
+	if (buffer->off) {
+		buffer->buf -= buffer->off;
+		memmove (buffer->buf, buffer->buf + buffer->off, buffer->len);
+
+		buffer->size = total;
+		buffer->off = 0;
+	}
+
+	if ((new_len <= buffer->size) && (cheap || (! need_room))
+	    && (buffer->size / NIH_IO_BUFFER_SHRINK_FACTOR < new_size))
 		return 0;
 
+	/* Grow geometrically from the current size */
+	if (buffer->size
+	    && ((new_len > buffer->size) || (need_room && (! cheap)))) {
+		size_t size = buffer->size;
+
+		do {
+			size_t step;
+
+			step = nih_min (size, buffer->max_grow);
+			if (size > SIZE_MAX - step)
+				return -1;
+
+			size += step;
+		} while (size < new_len);
+
+		new_size = nih_max (new_size, size);
+	}
+
 	/* Adjust buffer memory */
 	new_buf = nih_realloc (buffer->buf, buffer, new_size);
 	if (! new_buf)
 		return -1;
 
-	/* Clear the area between the old and new size; this is because we
-	 * tend to pass these buffers to syscalls, and passing around
-	 * unintialised data upsets people.
+#if HAVE_VALGRIND_VALGRIND_H
+	/* Clear the area between the old and new size when running under
+	 * valgrind; we tend to pass these buffers to syscalls, and it
+	 * complains about uninitialised data in them.  Otherwise this just
+	 * doubles the memory written for large buffers.
 	 */
-	if (new_size > buffer->size)
+	if (RUNNING_ON_VALGRIND && (new_size > buffer->size))
 		memset (new_buf + buffer->size, '\0', new_size - buffer->size);
+#endif /* HAVE_VALGRIND_VALGRIND_H */
 
 	/* Note: don't adjust the length */
 	buffer->buf = new_buf;
@@ -384,8 +518,13 @@ nih_io_buffer_pop (const void  *parent,
  * @buffer: buffer to shrink,
  * @len: bytes to remove from the front.
  *
- * Removes @len bytes from the beginning of @buffer and moves the rest
- * of the data up to begin there.
+ * Removes @len bytes from the beginning of @buffer, so that the data
+ * begins after them.
+ *
+ * The rest of the data is not moved, the room before it is reclaimed by
+ * nih_io_buffer_resize() once it's needed; so removing data in small
+ * pieces takes time proportional to the number of pieces rather than
+ * the number of pieces multiplied by the length of the data.
  **/
 void
 nih_io_buffer_shrink (NihIoBuffer *buffer,
@@ -395,8 +534,20 @@ nih_io_buffer_shrink (NihIoBuffer *buffer,
 
 	len = nih_min (len, buffer->len);
 
-	memmove (buffer->buf, buffer->buf + len, buffer->len - len);
+	buffer->buf += len;
+	buffer->size -= len;
 	buffer->len -= len;
+	buffer->off += len;
+	buffer->scan -= nih_min (len, buffer->scan);
+
+	/* When the buffer is empty we can start again from the beginning
+	 * without moving anything.
+	 */
+	if (! buffer->len) {
+		buffer->buf -= buffer->off;
+		buffer->size += buffer->off;
+		buffer->off = 0;
+	}
 
 	/* Don't worry if this fails, it just means the buffer is larger
 	 * than it needs to be.
@@ -433,6 +584,87 @@ nih_io_buffer_push (NihIoBuffer *buffer,
 	return 0;
 }
 
+/**
+ * nih_io_buffer_printf:
+ * @buffer: buffer to extend,
+ * @format: printf format string.
+ *
+ * Pushes data formatted according to the printf-style @format string onto
+ * the end of @buffer, increasing the size if necessary.  The terminating
+ * NULL is not included.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+nih_io_buffer_printf (NihIoBuffer *buffer,
+		      const char  *format,
+		      ...)
+{
+	va_list args;
+	int     ret;
+
+	nih_assert (buffer != NULL);
+	nih_assert (format != NULL);
+
+	va_start (args, format);
+	ret = nih_io_buffer_vprintf (buffer, format, args);
+	va_end (args);
+
+	return ret;
+}
+
+/**
+ * nih_io_buffer_vprintf:
+ * @buffer: buffer to extend,
+ * @format: printf format string,
+ * @args: arguments to format string.
+ *
+ * Pushes data formatted according to the printf-style @format string onto
+ * the end of @buffer, increasing the size if necessary.  The terminating
+ * NULL is not included.
+ *
+ * The data is formatted straight into the unused space at the end of
+ * @buffer, so it's only formatted a second time when @buffer has to grow
+ * to fit it.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+nih_io_buffer_vprintf (NihIoBuffer *buffer,
+		       const char  *format,
+		       va_list      args)
+{
+	va_list args_copy;
+	int     len;
+
+	nih_assert (buffer != NULL);
+	nih_assert (format != NULL);
+
+	va_copy (args_copy, args);
+	len = vsnprintf (buffer->buf ? buffer->buf + buffer->len : NULL,
+			 buffer->size - buffer->len, format, args_copy);
+	va_end (args_copy);
+
+	nih_assert (len >= 0);
+
+	/* vsnprintf() needs room for the NULL, even though we don't keep
+	 * it, so that's what we grow the buffer by if it didn't fit.
+	 */
+	if ((size_t)len >= buffer->size - buffer->len) {
+		if (nih_io_buffer_resize (buffer, len + 1) < 0)
+			return -1;
+
+		va_copy (args_copy, args);
+		vsnprintf (buffer->buf + buffer->len, len + 1,
+			   format, args_copy);
+		va_end (args_copy);
+	}
+
+	buffer->len += len;
+
+	return 0;
+}
+
 
 /**
  * nih_io_message_new:
@@ -554,8 +786,8 @@ nih_io_message_add_control (NihIoMessage *message,
  * @len: number of bytes read.
  *
  * Allocates a new NihIoMessage structure and fills it with a message
- * received on @fd with recvmsg().  The buffer is increased in size until
- * all of the message can fit within it.  @len is set to contain the actual
+ * received on @fd with recvmsg().  The buffer is sized to hold all of
+ * the message before it is received.  @len is set to contain the actual
  * number of bytes read.
  *
  * The message structure is allocated using nih_alloc() and normally
@@ -578,94 +810,153 @@ nih_io_message_recv  (const void *parent,
 		      int         fd,
 		      size_t     *len)
 {
-	NihIoMessage          *message;
-	nih_local NihIoBuffer *ctrl_buf = NULL;
-	struct msghdr          msghdr;
-	struct iovec           iov[1];
-	struct cmsghdr        *cmsg;
-	ssize_t                recv_len;
+	NihIoMessage *message;
+	ssize_t       size;
 
 	nih_assert (fd >= 0);
 	nih_assert (len != NULL);
 
 	message = nih_io_message_new (parent);
 	if (! message)
-		goto error;
+		nih_return_no_memory_error (NULL);
 
-	/* Allocate a buffer to store received control messages in */
-	ctrl_buf = nih_io_buffer_new (NULL);
-	if (! ctrl_buf)
-		goto error;
-
-	/* Reserve enough space to hold the name based on the socket type */
-	switch (nih_io_get_family (fd)) {
-	case PF_UNIX:
-		message->addrlen = sizeof (struct sockaddr_un);
-		break;
-	case PF_INET:
-		message->addrlen = sizeof (struct sockaddr_in);
-		break;
-	case PF_INET6:
-		message->addrlen = sizeof (struct sockaddr_in6);
-		break;
-	default:
-		message->addrlen = 0;
+	size = nih_io_message_peek (fd);
+	if ((size < 0)
+	    || (nih_io_message_recv_into (message, fd, size, len) < 0)) {
+		nih_free (message);
+		return NULL;
 	}
 
-	if (message->addrlen) {
-		message->addr = nih_alloc (message, message->addrlen);
-		if (! message->addr)
-			goto error;
+	return message;
+}
+
+/**
+ * nih_io_message_peek:
+ * @fd: file descriptor to read from.
+ *
+ * Finds the length of the next message waiting on @fd without receiving
+ * it, or any file descriptors passed with it.
+ *
+ * Returns: length of message, negative value on raised error.
+ **/
+static ssize_t
+nih_io_message_peek (int fd)
+{
+	struct msghdr msghdr;
+	ssize_t       size;
+
+	nih_assert (fd >= 0);
+
+	msghdr.msg_name = NULL;
+	msghdr.msg_namelen = 0;
+	msghdr.msg_iov = NULL;
+	msghdr.msg_iovlen = 0;
+	msghdr.msg_control = NULL;
+	msghdr.msg_controllen = 0;
+	msghdr.msg_flags = 0;
+
+	size = recvmsg (fd, &msghdr, MSG_PEEK | MSG_TRUNC);
+	if (size < 0)
+		nih_return_system_error (-1);
+
+	return size;
+}
+
+/**
+ * nih_io_message_recv_into:
+ * @message: empty message to fill,
+ * @fd: file descriptor to read from,
+ * @size: length of message from nih_io_message_peek(),
+ * @len: number of bytes read.
+ *
+ * Fills @message, which must have no data or control messages, with a
+ * message of @size bytes received on @fd with recvmsg(); the buffer is
+ * sized once to hold it.  @len is set to contain the actual number of
+ * bytes read.
+ *
+ * If @message already has an address buffer, it is reused to receive the
+ * address of the sender.
+ *
+ * If the control data received was truncated, any file descriptors passed
+ * are closed and an EMSGSIZE error is raised.
+ *
+ * Returns: zero on success, negative value on raised error.
+ **/
+static int
+nih_io_message_recv_into (NihIoMessage *message,
+			  int           fd,
+			  size_t        size,
+			  size_t       *len)
+{
+	struct msghdr   msghdr;
+	struct iovec    iov[1];
+	struct cmsghdr *cmsg;
+	ssize_t         recv_len;
+	union {
+		struct cmsghdr hdr;
+		char           buf[BUFSIZ];
+	} control;
+
+	nih_assert (message != NULL);
+	nih_assert (message->data->len == 0);
+	nih_assert (message->control[0] == NULL);
+	nih_assert (fd >= 0);
+	nih_assert (len != NULL);
 
-		msghdr.msg_name = message->addr;
-		msghdr.msg_namelen = message->addrlen;
+	/* Reserve enough space to hold the name based on the socket type */
+	if (! message->addr) {
+		switch (nih_io_get_family (fd)) {
+		case PF_UNIX:
+			message->addrlen = sizeof (struct sockaddr_un);
+			break;
+		case PF_INET:
+			message->addrlen = sizeof (struct sockaddr_in);
+			break;
+		case PF_INET6:
+			message->addrlen = sizeof (struct sockaddr_in6);
+			break;
+		default:
+			message->addrlen = 0;
+		}
+
+		if (message->addrlen) {
+			message->addr = nih_alloc (message, message->addrlen);
+			if (! message->addr)
+				nih_return_no_memory_error (-1);
+		}
 	} else {
-		msghdr.msg_name = NULL;
-		msghdr.msg_namelen = 0;
+		message->addrlen = nih_alloc_size (message->addr);
 	}
 
-	/* Set the flags to indicate a truncated message so that we allocate
-	 * some initial buffer space.
-	 */
-	msghdr.msg_flags = MSG_TRUNC | MSG_CTRUNC;
-
-	do {
-		/* Increase the size of the message buffer */
-		if ((msghdr.msg_flags & MSG_TRUNC)
-		    && (nih_io_buffer_resize (message->data,
-					      (message->data->size
-					       + BUFSIZ)) < 0))
-			goto error;
-
-		msghdr.msg_iov = iov;
-		msghdr.msg_iovlen = 1;
-		iov[0].iov_base = message->data->buf;
-		iov[0].iov_len = message->data->size;
+	if (nih_io_buffer_resize (message->data, size) < 0)
+		nih_return_no_memory_error (-1);
 
-		/* Increase the size of the control buffer */
-		if ((msghdr.msg_flags & MSG_CTRUNC)
-		    && (nih_io_buffer_resize (ctrl_buf, (ctrl_buf->size
-							 + BUFSIZ)) < 0))
-			goto error;
+	msghdr.msg_name = message->addr;
+	msghdr.msg_namelen = message->addrlen;
 
-		msghdr.msg_control = ctrl_buf->buf;
-		msghdr.msg_controllen = ctrl_buf->size;
+	msghdr.msg_iov = iov;
+	msghdr.msg_iovlen = 1;
+	iov[0].iov_base = message->data->buf;
+	iov[0].iov_len = message->data->size;
 
-		msghdr.msg_flags = 0;
+	msghdr.msg_control = control.buf;
+	msghdr.msg_controllen = sizeof (control.buf);
 
-		/* Peek at the message to determine whether or not it has
-		 * been truncated.
-		 */
-		recv_len = recvmsg (fd, &msghdr, MSG_PEEK);
-		if (recv_len < 0)
-			goto error;
-	} while ((msghdr.msg_flags & MSG_TRUNC)
-		 || (msghdr.msg_flags & MSG_CTRUNC));
+	msghdr.msg_flags = 0;
 
-	/* Receive properly this time */
 	recv_len = recvmsg (fd, &msghdr, 0);
 	if (recv_len < 0)
-		goto error;
+		nih_return_system_error (-1);
+
+	/* Control data that didn't fit can't be passed on; close any file
+	 * descriptors we did receive so they don't leak.
+	 */
+	if (msghdr.msg_flags & MSG_CTRUNC) {
+		nih_io_message_close_rights (&msghdr);
+
+		errno = EMSGSIZE;
+		nih_return_system_error (-1);
+	}
 
 	/* Update the lengths, both to the caller and of the message structure
 	 * buffers based on what was actually received.
@@ -689,13 +980,254 @@ nih_io_message_recv  (const void *parent,
 						      CMSG_DATA (cmsg)));
 	}
 
+	return 0;
+}
+
+/**
+ * nih_io_message_close_rights:
+ * @msghdr: message header received.
+ *
+ * Closes any file descriptors passed in the control data received into
+ * @msghdr, for a message that is being discarded.
+ **/
+static void
+nih_io_message_close_rights (struct msghdr *msghdr)
+{
+	struct cmsghdr *cmsg;
+
+	nih_assert (msghdr != NULL);
+
+	for (cmsg = CMSG_FIRSTHDR (msghdr); cmsg;
+	     cmsg = CMSG_NXTHDR (msghdr, cmsg)) {
+		const int *fds;
+		size_t     nfds, i;
+
+		if ((cmsg->cmsg_level != SOL_SOCKET)
+		    || (cmsg->cmsg_type != SCM_RIGHTS))
+			continue;
+
+		fds = (const int *)CMSG_DATA (cmsg);
+		nfds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+
+		for (i = 0; i < nfds; i++)
+			close (fds[i]);
+	}
+}
+
+/**
+ * nih_io_message_take:
+ * @io: structure to receive message with.
+ *
+ * Obtains an empty message to receive into for @io, reusing one released
+ * with nih_io_message_release() if there is one.  The message is a child
+ * of @io and not in any list.
+ *
+ * Returns: empty message, or NULL if insufficient memory.
+ **/
+static NihIoMessage *
+nih_io_message_take (NihIo *io)
+{
+	NihIoMessage *message;
+
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_MESSAGE);
+
+	if (NIH_LIST_EMPTY (io->spare_q))
+		return nih_io_message_new (io);
+
+	message = (NihIoMessage *)nih_list_remove (io->spare_q->next);
+	io->spare_count--;
+
 	return message;
+}
 
-error:
-	nih_error_raise_system ();
-	if (message)
-		nih_free (message);
-	return NULL;
+/**
+ * nih_io_message_release:
+ * @io: structure message was received with,
+ * @message: message to release.
+ *
+ * Drops the reference @io holds to @message, a received message that
+ * has been read.  If nothing else holds a reference, the message is
+ * emptied and kept to be reused by nih_io_message_take() instead of
+ * being freed.
+ **/
+static void
+nih_io_message_release (NihIo        *io,
+			NihIoMessage *message)
+{
+	struct cmsghdr **ptr;
+
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_MESSAGE);
+	nih_assert (message != NULL);
+
+	if (nih_alloc_shared (message)
+	    || (! nih_alloc_parent (message, io))
+	    || (io->spare_count >= NIH_IO_RECV_BATCH)) {
+		nih_unref (message, io);
+		return;
+	}
+
+	nih_io_buffer_shrink (message->data, message->data->len);
+
+	for (ptr = message->control; *ptr; ptr++)
+		nih_free (*ptr);
+	message->control[0] = NULL;
+
+	nih_list_add (io->spare_q, &message->entry);
+	io->spare_count++;
+}
+
+#if HAVE_RECVMMSG
+/**
+ * nih_io_message_recv_batch:
+ * @io: structure to receive messages with,
+ * @fd: file descriptor to read from.
+ *
+ * Receives as many messages as are waiting on @fd, up to
+ * NIH_IO_RECV_BATCH, with a single call to recvmmsg() and adds them to
+ * the receive queue of @io.  Messages are received into an area of
+ * memory kept by @io for the purpose, with room for messages of up to
+ * the size given to nih_io_set_message_size(), and copied out.
+ *
+ * Longer messages, and those with more control data than can be held,
+ * are discarded along with any file descriptors passed with them; the
+ * others are queued before an EMSGSIZE error is raised.
+ *
+ * Returns: number of messages received, negative value on raised error.
+ **/
+static ssize_t
+nih_io_message_recv_batch (NihIo *io,
+			   int    fd)
+{
+	struct mmsghdr          msgvec[NIH_IO_RECV_BATCH];
+	struct iovec            iov[NIH_IO_RECV_BATCH];
+	struct sockaddr_storage addr[NIH_IO_RECV_BATCH];
+	char                   *control, *data;
+	int                     count, i, truncated = FALSE;
+
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_MESSAGE);
+	nih_assert (io->msg_size > 0);
+	nih_assert (fd >= 0);
+
+	if (! io->recv_area) {
+		io->recv_area = nih_alloc (io, (NIH_IO_RECV_BATCH
+						* (NIH_IO_CONTROL_SIZE
+						   + io->msg_size)));
+		if (! io->recv_area)
+			nih_return_no_memory_error (-1);
+	}
+
+	control = io->recv_area;
+	data = control + NIH_IO_RECV_BATCH * NIH_IO_CONTROL_SIZE;
+
+	for (i = 0; i < NIH_IO_RECV_BATCH; i++) {
+		struct msghdr *msghdr = &msgvec[i].msg_hdr;
+
+		msghdr->msg_name = &addr[i];
+		msghdr->msg_namelen = sizeof (addr[i]);
+
+		msghdr->msg_iov = &iov[i];
+		msghdr->msg_iovlen = 1;
+		iov[i].iov_base = data + i * io->msg_size;
+		iov[i].iov_len = io->msg_size;
+
+		msghdr->msg_control = control + i * NIH_IO_CONTROL_SIZE;
+		msghdr->msg_controllen = NIH_IO_CONTROL_SIZE;
+
+		msghdr->msg_flags = 0;
+	}
+
+	count = recvmmsg (fd, msgvec, NIH_IO_RECV_BATCH, 0, NULL);
+	if (count < 0)
+		nih_return_system_error (-1);
+
+	/* Having received the messages, we can't put them back, so copying
+	 * them into the queue must succeed.
+	 */
+	for (i = 0; i < count; i++) {
+		struct msghdr  *msghdr = &msgvec[i].msg_hdr;
+		NihIoMessage   *message;
+		struct cmsghdr *cmsg;
+
+		if (msghdr->msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+			nih_io_message_close_rights (msghdr);
+			truncated = TRUE;
+			continue;
+		}
+
+		message = NIH_MUST (nih_io_message_take (io));
+
+		NIH_ZERO (nih_io_buffer_push (message->data, iov[i].iov_base,
+					      msgvec[i].msg_len));
+
+		if (msghdr->msg_namelen) {
+			if ((! message->addr)
+			    || (nih_alloc_size (message->addr)
+				< msghdr->msg_namelen))
+				message->addr = NIH_MUST (nih_realloc (
+						message->addr, message,
+						msghdr->msg_namelen));
+
+			memcpy (message->addr, &addr[i], msghdr->msg_namelen);
+		}
+		message->addrlen = msghdr->msg_namelen;
+
+		for (cmsg = CMSG_FIRSTHDR (msghdr); cmsg;
+		     cmsg = CMSG_NXTHDR (msghdr, cmsg)) {
+			size_t len;
+
+			len = cmsg->cmsg_len
+				- CMSG_ALIGN (sizeof (struct cmsghdr));
+			NIH_ZERO (nih_io_message_add_control (
+					  message, cmsg->cmsg_level,
+					  cmsg->cmsg_type, len,
+					  CMSG_DATA (cmsg)));
+		}
+
+		nih_list_add (io->recv_q, &message->entry);
+	}
+
+	if (truncated) {
+		errno = EMSGSIZE;
+		nih_return_system_error (-1);
+	}
+
+	return count;
+}
+#endif /* HAVE_RECVMMSG */
+
+/**
+ * nih_io_message_msghdr:
+ * @message: message to be sent,
+ * @msghdr: header to fill in,
+ * @iov: single element vector to fill in.
+ *
+ * Fills in @msghdr and @iov to send the address and data of @message,
+ * without any control data.
+ **/
+static void
+nih_io_message_msghdr (NihIoMessage  *message,
+		       struct msghdr *msghdr,
+		       struct iovec  *iov)
+{
+	nih_assert (message != NULL);
+	nih_assert (msghdr != NULL);
+	nih_assert (iov != NULL);
+
+	msghdr->msg_name = message->addr;
+	msghdr->msg_namelen = message->addrlen;
+
+	msghdr->msg_iov = iov;
+	msghdr->msg_iovlen = 1;
+	iov->iov_base = message->data->buf;
+	iov->iov_len = message->data->len;
+
+	msghdr->msg_control = NULL;
+	msghdr->msg_controllen = 0;
+
+	msghdr->msg_flags = 0;
 }
 
 /**
@@ -726,37 +1258,32 @@ nih_io_message_send (NihIoMessage *message,
 	nih_assert (message != NULL);
 	nih_assert (fd >= 0);
 
-	msghdr.msg_name = message->addr;
-	msghdr.msg_namelen = message->addrlen;
-
-	msghdr.msg_iov = iov;
-	msghdr.msg_iovlen = 1;
-	iov[0].iov_base = message->data->buf;
-	iov[0].iov_len = message->data->len;
+	nih_io_message_msghdr (message, &msghdr, iov);
 
 	/* Allocate a buffer in which we store the control messages that we
-	 * need to send.
+	 * need to send, if there are any.
 	 */
-	ctrl_buf = nih_io_buffer_new (NULL);
-	if (! ctrl_buf)
-		nih_return_system_error (-1);
-
-	for (ptr = message->control; *ptr; ptr++) {
-		size_t len;
-
-		len = CMSG_SPACE ((*ptr)->cmsg_len
-				  - CMSG_ALIGN (sizeof (struct cmsghdr)));
-		if (nih_io_buffer_resize (ctrl_buf, len) < 0)
+	if (*message->control) {
+		ctrl_buf = nih_io_buffer_new (NULL);
+		if (! ctrl_buf)
 			nih_return_system_error (-1);
 
-		memcpy (ctrl_buf->buf + ctrl_buf->len, *ptr, (*ptr)->cmsg_len);
-		ctrl_buf->len += len;
-	}
+		for (ptr = message->control; *ptr; ptr++) {
+			size_t len;
 
-	msghdr.msg_control = ctrl_buf->buf;
-	msghdr.msg_controllen = ctrl_buf->len;
+			len = CMSG_SPACE ((*ptr)->cmsg_len
+					  - CMSG_ALIGN (sizeof (struct cmsghdr)));
+			if (nih_io_buffer_resize (ctrl_buf, len) < 0)
+				nih_return_system_error (-1);
 
-	msghdr.msg_flags = 0;
+			memcpy (ctrl_buf->buf + ctrl_buf->len, *ptr,
+				(*ptr)->cmsg_len);
+			ctrl_buf->len += len;
+		}
+
+		msghdr.msg_control = ctrl_buf->buf;
+		msghdr.msg_controllen = ctrl_buf->len;
+	}
 
 	len = sendmsg (fd, &msghdr, 0);
 	if (len < 0)
@@ -839,6 +1366,23 @@ nih_io_reopen (const void        *parent,
 	io->shutdown = FALSE;
 	io->free = NULL;
 
+	io->high_water = 0;
+	io->low_water = 0;
+	io->full = NIH_IO_NONE;
+	io->full_handler = NULL;
+
+	io->read_budget = 0;
+
+	io->spare_q = NULL;
+	io->spare_count = 0;
+	io->msg_size = 0;
+	io->recv_area = NULL;
+
+	memset (&io->get_delim, 0, sizeof (io->get_delim));
+	io->max_line = 0;
+	io->discarding = FALSE;
+	io->line_too_long = FALSE;
+
 	switch (io->type) {
 	case NIH_IO_STREAM:
 		io->send_buf = nih_io_buffer_new (io);
@@ -859,38 +1403,189 @@ nih_io_reopen (const void        *parent,
 		if (! io->recv_q)
 			goto error;
 
-		break;
-	default:
-		nih_assert_not_reached ();
-	}
+		io->spare_q = nih_list_new (io);
+		if (! io->spare_q)
+			goto error;
+
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	/* Watcher function is called at first only if we have data to read */
+	io->watch = nih_io_add_watch (io, fd, NIH_IO_READ,
+				      (NihIoWatcher)nih_io_watcher, io);
+	if (! io->watch)
+		goto error;
+
+	/* Irritating signal, means we terminate if the remote end
+	 * disconnects between a read() and a write() ... far better to
+	 * just get an errno!
+	 */
+	nih_signal_set_ignore (SIGPIPE);
+
+	/* We want to be able to repeatedly call read and write on the
+	 * file descriptor so we always get maximum throughput, and we
+	 * don't want to end up blocking; so set the socket so that
+	 * doesn't happen.
+	 */
+	if (nih_io_set_nonblock (fd) < 0)
+		goto error;
+
+	nih_alloc_set_destructor (io, nih_io_destroy);
+
+	return io;
+error:
+	nih_error_raise_system ();
+	nih_free (io);
+	return NULL;
+}
+
+/**
+ * nih_io_set_buffer_size:
+ * @io: structure to change,
+ * @recv_size: expected size of received data,
+ * @send_size: expected size of data to be sent.
+ *
+ * Gives hints of how much data @io, which must be in stream mode, will
+ * usually hold in its receive and send buffers; the buffers are allocated
+ * at these sizes when they're first needed and are not reduced below them
+ * while they hold data, so that reading and writing large amounts of data
+ * doesn't grow them in several steps.
+ *
+ * Either may be zero to use the default size.
+ **/
+void
+nih_io_set_buffer_size (NihIo  *io,
+			size_t  recv_size,
+			size_t  send_size)
+{
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_STREAM);
+
+	io->recv_buf->min_size = recv_size;
+	io->send_buf->min_size = send_size;
+}
+
+/**
+ * nih_io_set_watermarks:
+ * @io: structure to change,
+ * @low_water: size full buffers must drain to,
+ * @high_water: size at which buffers are full,
+ * @full_handler: function called when the send buffer fills or drains.
+ *
+ * Limits the amount of data held in the buffers of @io, which must be in
+ * stream mode, so that a fast sender or slow reader cannot cause them to
+ * grow without bound.
+ *
+ * Reads into the receive buffer stop at @high_water bytes, after which no
+ * more data is read from the file descriptor until it has drained to
+ * @low_water bytes or fewer; the reader is still called for the data in
+ * it.
+ *
+ * Data written is always added to the send buffer, but once it holds at
+ * least @high_water bytes @full_handler, if not NULL, is called and
+ * NIH_IO_WRITE set in the full member of @io; both happen again once it
+ * has drained to @low_water bytes or fewer.  Writers should stop until
+ * then.
+ *
+ * @high_water may be zero to remove the limits.
+ **/
+void
+nih_io_set_watermarks (NihIo            *io,
+		       size_t            low_water,
+		       size_t            high_water,
+		       NihIoFullHandler  full_handler)
+{
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_STREAM);
+	nih_assert (low_water <= high_water);
+
+	io->high_water = high_water;
+	io->low_water = low_water;
+	io->full_handler = full_handler;
+
+	nih_io_water_check (io);
+}
+
+/**
+ * nih_io_set_read_budget:
+ * @io: structure to change,
+ * @budget: bytes or messages to read at once.
+ *
+ * Limits how much is read from the file descriptor of @io each time it
+ * becomes readable to @budget bytes in stream mode, or @budget messages
+ * in message mode, so that a busy descriptor cannot keep the main loop
+ * from other descriptors and timers.  Anything left is read on the next
+ * iteration of the main loop, since the descriptor remains readable.
+ *
+ * In stream mode no read asks for more than is left of @budget, so at
+ * most @budget bytes are read at once.
+ *
+ * @budget may be zero to read until no more data is available.
+ **/
+void
+nih_io_set_read_budget (NihIo  *io,
+			size_t  budget)
+{
+	nih_assert (io != NULL);
+
+	io->read_budget = budget;
+}
 
-	/* Watcher function is called at first only if we have data to read */
-	io->watch = nih_io_add_watch (io, fd, NIH_IO_READ,
-				      (NihIoWatcher)nih_io_watcher, io);
-	if (! io->watch)
-		goto error;
+/**
+ * nih_io_set_message_size:
+ * @io: structure to change,
+ * @size: largest message expected.
+ *
+ * Declares that no message longer than @size bytes is expected on @io,
+ * which must be in message mode, so that several messages can be received
+ * with each call into memory sized for them in advance rather than each
+ * message needing its length found first.  Memory for NIH_IO_RECV_BATCH
+ * messages of @size bytes is kept with @io for this.
+ *
+ * Any longer message received is discarded and the error handler called
+ * with EMSGSIZE, as is one with too much control data.
+ *
+ * @size may be zero to receive each message separately, sized to fit.
+ **/
+void
+nih_io_set_message_size (NihIo  *io,
+			 size_t  size)
+{
+	nih_assert (io != NULL);
+	nih_assert (io->type == NIH_IO_MESSAGE);
 
-	/* Irritating signal, means we terminate if the remote end
-	 * disconnects between a read() and a write() ... far better to
-	 * just get an errno!
-	 */
-	nih_signal_set_ignore (SIGPIPE);
+	if (io->recv_area && (size != io->msg_size)) {
+		nih_free (io->recv_area);
+		io->recv_area = NULL;
+	}
 
-	/* We want to be able to repeatedly call read and write on the
-	 * file descriptor so we always get maximum throughput, and we
-	 * don't want to end up blocking; so set the socket so that
-	 * doesn't happen.
-	 */
-	if (nih_io_set_nonblock (fd) < 0)
-		goto error;
+	io->msg_size = size;
+}
 
-	nih_alloc_set_destructor (io, nih_io_destroy);
+/**
+ * nih_io_set_max_line:
+ * @io: structure to change,
+ * @max_line: longest line accepted.
+ *
+ * Limits the lines returned by nih_io_get() for @io to @max_line bytes,
+ * not including the delimiter, so that a line which never ends cannot
+ * fill the receive buffer.  The data of a longer line received so far is
+ * discarded and the error handler called with NIH_IO_LINE_TOO_LONG once
+ * the reader returns, the default being to close the descriptor.  In stream mode, the rest of
+ * the line is discarded as it is received, up to and including the
+ * delimiter, rather than being returned as a line of its own.
+ *
+ * @max_line may be zero for lines of any length.
+ **/
+void
+nih_io_set_max_line (NihIo  *io,
+		     size_t  max_line)
+{
+	nih_assert (io != NULL);
 
-	return io;
-error:
-	nih_error_raise_system ();
-	nih_free (io);
-	return NULL;
+	io->max_line = max_line;
 }
 
 
@@ -1000,6 +1695,20 @@ nih_io_watcher (NihIo       *io,
 		if (caught_free)
 			return;
 
+		/* Report a line too long found by the reader now that it
+		 * has returned.
+		 */
+		if (io->line_too_long) {
+			io->line_too_long = FALSE;
+
+			nih_error_raise (NIH_IO_LINE_TOO_LONG,
+					 _(NIH_IO_LINE_TOO_LONG_STR));
+			nih_io_error (io);
+			if (caught_free)
+				return;
+			goto finish;
+		}
+
 		/* Deal with socket being closed */
 		if ((io->type == NIH_IO_STREAM) && (! len)) {
 			nih_io_closed (io);
@@ -1039,6 +1748,9 @@ finish:
 	if (io->free == &caught_free)
 		io->free = NULL;
 
+	/* Stop or resume reading if the reader changed the buffer */
+	nih_io_water_check (io);
+
 	/* Shut down the socket if it is empty */
 	nih_io_shutdown_check (io);
 }
@@ -1054,7 +1766,9 @@ finish:
  * small.
  *
  * It returns once a call errors or returns zero to indicate that the
- * remote end closed.
+ * remote end closed, or once the read budget of @io has been used; any
+ * data left means the descriptor is still ready next time through the
+ * main loop.
  *
  * Returns: size of last read, zero if remote end closed and negative
  * value on raised error.
@@ -1064,24 +1778,42 @@ nih_io_watcher_read (NihIo      *io,
 		     NihIoWatch *watch)
 {
 	ssize_t len = 0;
+	size_t  used = 0;
 
 	nih_assert (io != NULL);
 	nih_assert (watch != NULL);
 
 	for (;;) {
 		NihIoMessage *message;
+		size_t        room;
 
 		switch (io->type) {
 		case NIH_IO_STREAM:
 			/* Make sure there's room for at least 80 bytes
-			 * (random minimum read).
+			 * (random minimum read), making room for BUFSIZ
+			 * when we have to since buffers are otherwise only
+			 * sized for the data they hold.
 			 */
-			if (nih_io_buffer_resize (io->recv_buf, 80) < 0)
+			if ((io->recv_buf->size - io->recv_buf->len < 80)
+			    && (nih_io_buffer_resize (io->recv_buf,
+						      BUFSIZ) < 0))
 				nih_return_system_error (-1);
 
+			/* Don't read more than is left of the budget, or
+			 * past the high watermark; the room in the buffer
+			 * may be far larger.
+			 */
+			room = io->recv_buf->size - io->recv_buf->len;
+			if (io->read_budget)
+				room = nih_min (room, io->read_budget - used);
+			if (io->high_water
+			    && (io->recv_buf->len < io->high_water))
+				room = nih_min (room, (io->high_water
+						       - io->recv_buf->len));
+
 			len = read (watch->fd,
 				    io->recv_buf->buf + io->recv_buf->len,
-				    io->recv_buf->size - io->recv_buf->len);
+				    room);
 			if (len < 0) {
 				nih_return_system_error (-1);
 			} else if (len > 0) {
@@ -1090,22 +1822,56 @@ nih_io_watcher_read (NihIo      *io,
 				return 0;
 			}
 
+			/* Stop once the buffer is full */
+			if (io->high_water
+			    && (io->recv_buf->len >= io->high_water))
+				return len;
+
+			used += len;
 			break;
 		case NIH_IO_MESSAGE:
-			/* Use BUFSIZ as the maximum message size. */
-			len = BUFSIZ;
-			message = nih_io_message_recv (io, watch->fd,
-						       (size_t *)&len);
-			if (! message) {
+#if HAVE_RECVMMSG
+			if (io->msg_size) {
+				len = nih_io_message_recv_batch (io, watch->fd);
+				if (len < 0)
+					return -1;
+
+				/* Fewer messages than asked for means
+				 * there are no more waiting.
+				 */
+				if (len < NIH_IO_RECV_BATCH)
+					return len;
+
+				used += len;
+				break;
+			}
+#endif /* HAVE_RECVMMSG */
+
+			len = nih_io_message_peek (watch->fd);
+			if (len < 0)
+				return -1;
+
+			message = nih_io_message_take (io);
+			if (! message)
+				nih_return_no_memory_error (-1);
+
+			if (nih_io_message_recv_into (message, watch->fd, len,
+						      (size_t *)&len) < 0) {
+				nih_unref (message, io);
 				return -1;
-			} else {
-				nih_list_add (io->recv_q, &message->entry);
 			}
 
+			nih_list_add (io->recv_q, &message->entry);
+
+			used++;
 			break;
 		default:
 			nih_assert_not_reached ();
 		}
+
+		/* Give other descriptors and timers a turn */
+		if (io->read_budget && (used >= io->read_budget))
+			return len;
 	}
 
 	return len;
@@ -1139,13 +1905,21 @@ nih_io_watcher_write (NihIo      *io,
 	switch (io->type) {
 	case NIH_IO_STREAM:
 		while (io->send_buf->len) {
-			len = write (watch->fd, io->send_buf->buf,
-				     io->send_buf->len);
+			size_t want = io->send_buf->len;
+
+			len = write (watch->fd, io->send_buf->buf, want);
 
 			if (len < 0)
 				nih_return_system_error (-1);
 
 			nih_io_buffer_shrink (io->send_buf, len);
+
+			/* A short write means the descriptor is full, so
+			 * wait for it to be writable again rather than
+			 * making a call that would only fail.
+			 */
+			if ((size_t)len < want)
+				break;
 		}
 
 		/* Don't check for writability if we have nothing to write */
@@ -1156,6 +1930,45 @@ nih_io_watcher_write (NihIo      *io,
 	case NIH_IO_MESSAGE:
 		while (! NIH_LIST_EMPTY (io->send_q)) {
 			NihIoMessage *message;
+#if HAVE_SENDMMSG
+			struct mmsghdr msgvec[NIH_IO_SEND_BATCH];
+			struct iovec   iov[NIH_IO_SEND_BATCH];
+			int            count = 0;
+			int            sent, i;
+
+			/* Send as many queued messages as we can with a
+			 * single call; messages with control data are sent
+			 * on their own below.
+			 */
+			NIH_LIST_FOREACH (io->send_q, iter) {
+				message = (NihIoMessage *)iter;
+
+				if ((count == NIH_IO_SEND_BATCH)
+				    || *message->control)
+					break;
+
+				nih_io_message_msghdr (message,
+						       &msgvec[count].msg_hdr,
+						       &iov[count]);
+				msgvec[count].msg_len = 0;
+				count++;
+			}
+
+			if (count > 1) {
+				sent = sendmmsg (watch->fd, msgvec, count, 0);
+				if (sent < 0)
+					nih_return_system_error (-1);
+
+				for (i = 0; i < sent; i++) {
+					message = (NihIoMessage *)io->send_q->next;
+					len = msgvec[i].msg_len;
+
+					nih_unref (message, io);
+				}
+
+				continue;
+			}
+#endif /* HAVE_SENDMMSG */
 
 			message = (NihIoMessage *)io->send_q->next;
 			len = nih_io_message_send (message, watch->fd);
@@ -1290,6 +2103,59 @@ nih_io_shutdown_check (NihIo *io)
 	}
 }
 
+/**
+ * nih_io_water_check:
+ * @io: structure to check.
+ *
+ * Checks whether the buffers of the NihIo structure have reached its high
+ * watermark, or drained to its low watermark, since the last check and
+ * stops or resumes reading and calls the full handler accordingly.  Call
+ * whenever you add data to or remove data from a buffer.
+ **/
+static void
+nih_io_water_check (NihIo *io)
+{
+	NihIoEvents full;
+
+	nih_assert (io != NULL);
+
+	if (io->type != NIH_IO_STREAM)
+		return;
+
+	full = io->full;
+	if (! io->high_water) {
+		full = NIH_IO_NONE;
+	} else {
+		if (io->recv_buf->len >= io->high_water) {
+			full |= NIH_IO_READ;
+		} else if (io->recv_buf->len <= io->low_water) {
+			full &= ~NIH_IO_READ;
+		}
+
+		if (io->send_buf->len >= io->high_water) {
+			full |= NIH_IO_WRITE;
+		} else if (io->send_buf->len <= io->low_water) {
+			full &= ~NIH_IO_WRITE;
+		}
+	}
+
+	if ((full ^ io->full) & NIH_IO_READ) {
+		if (full & NIH_IO_READ) {
+			io->watch->events &= ~NIH_IO_READ;
+		} else {
+			io->watch->events |= NIH_IO_READ;
+		}
+	}
+
+	if ((full ^ io->full) & NIH_IO_WRITE) {
+		io->full = full;
+		if (io->full_handler)
+			io->full_handler (io->data, io);
+	}
+
+	io->full = full;
+}
+
 /**
  * nih_io_destroy:
  * @io: structure to be destroyed.
@@ -1483,49 +2349,50 @@ nih_io_read (const void *parent,
 	str = nih_io_buffer_pop (parent, buf, len);
 
 	if (message && (! message->data->len))
-		nih_unref (message, io);
+		nih_io_message_release (io, message);
 
 finish:
+	nih_io_water_check (io);
 	nih_io_shutdown_check (io);
 
 	return str;
 }
 
 /**
- * nih_io_write:
- * @io: structure to write to,
- * @str: data to write,
- * @len: length of @str.
+ * nih_io_peek:
+ * @io: structure to read from,
+ * @len: number of bytes available.
  *
- * Writes @len bytes from @str into the send buffer of @io, or into a new
- * message placed in the send queue.  The data will not be sent immediately
- * but whenever possible.
+ * Obtains the data in the receive buffer of @io or the oldest message in
+ * the receive queue without copying it or removing it, so that it may be
+ * examined in place; @len is set to the number of bytes available.  Data
+ * that has been dealt with is then removed with nih_io_consume().
  *
- * Care should be taken to ensure @len does not include the NULL
- * terminator unless you really want that sent.
+ * The data is not NULL terminated, and remains valid only until data is
+ * removed from @io or more is received.
  *
- * Returns: zero on success, negative value if insufficient memory.
+ * Returns: pointer to data, or NULL if there is none.
  **/
-int
-nih_io_write (NihIo      *io,
-	      const char *str,
-	      size_t      len)
+const char *
+nih_io_peek (NihIo  *io,
+	     size_t *len)
 {
-	nih_local NihIoMessage *message = NULL;
-	NihIoBuffer *           buf;
+	NihIoMessage *message;
+	NihIoBuffer  *buf;
 
 	nih_assert (io != NULL);
-	nih_assert (str != NULL);
+	nih_assert (len != NULL);
 
 	switch (io->type) {
 	case NIH_IO_STREAM:
-		message = NULL;
-		buf = io->send_buf;
+		buf = io->recv_buf;
 		break;
 	case NIH_IO_MESSAGE:
-		message = nih_io_message_new (NULL);
-		if (! message)
-			return -1;
+		message = nih_io_first_message (io);
+		if (! message) {
+			*len = 0;
+			return NULL;
+		}
 
 		buf = message->data;
 		break;
@@ -1533,16 +2400,80 @@ nih_io_write (NihIo      *io,
 		nih_assert_not_reached ();
 	}
 
-	if (nih_io_buffer_push (buf, str, len) < 0)
-		return -1;
+	*len = buf->len;
 
-	if (message) {
-		nih_io_send_message (io, message);
-	} else if (buf->len) {
-		io->watch->events |= NIH_IO_WRITE;
+	return buf->len ? buf->buf : NULL;
+}
+
+/**
+ * nih_io_consume:
+ * @io: structure to read from,
+ * @len: number of bytes to remove.
+ *
+ * Removes @len bytes from the start of the receive buffer of @io or the
+ * oldest message in the receive queue, usually once they have been
+ * examined with nih_io_peek(), without copying them.
+ *
+ * If there are not @len bytes in the buffer or message, all there is
+ * will be removed.  If the message has no more data in the buffer, it is
+ * removed from the receive queue, and the next call to nih_io_peek() will
+ * operate on the next oldest message in the queue.
+ **/
+void
+nih_io_consume (NihIo  *io,
+		size_t  len)
+{
+	NihIoMessage *message;
+
+	nih_assert (io != NULL);
+
+	switch (io->type) {
+	case NIH_IO_STREAM:
+		nih_io_buffer_shrink (io->recv_buf, len);
+		break;
+	case NIH_IO_MESSAGE:
+		message = nih_io_first_message (io);
+		if (! message)
+			break;
+
+		nih_io_buffer_shrink (message->data, len);
+
+		if (! message->data->len)
+			nih_io_message_release (io, message);
+
+		break;
+	default:
+		nih_assert_not_reached ();
 	}
 
-	return 0;
+	nih_io_water_check (io);
+	nih_io_shutdown_check (io);
+}
+
+/**
+ * nih_io_write:
+ * @io: structure to write to,
+ * @str: data to write,
+ * @len: length of @str.
+ *
+ * Writes @len bytes from @str into the send buffer of @io, or into a new
+ * message placed in the send queue.  The data will not be sent immediately
+ * but whenever possible.
+ *
+ * Care should be taken to ensure @len does not include the NULL
+ * terminator unless you really want that sent.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+int
+nih_io_write (NihIo      *io,
+	      const char *str,
+	      size_t      len)
+{
+	nih_assert (io != NULL);
+	nih_assert (str != NULL);
+
+	return nih_io_write_internal (io, str, len, NULL, NULL);
 }
 
 
@@ -1561,18 +2492,28 @@ nih_io_write (NihIo      *io,
  * a delimiter.
  *
  * The string and the delimiter are removed from the buffer or message.
+ * When no delimiter is found, the data searched is remembered so that
+ * the next call with the same @delim only searches data received since.
  *
  * If the message has no more data in the buffer, it is removed from the
  * receive queue, and the next call to this function will operate on the
  * next oldest message in the queue.
  *
+ * If a maximum line length has been set with nih_io_set_max_line() and
+ * the line is longer, the line is discarded up to the delimiter, or all
+ * of the data if the delimiter hasn't been received, and NULL returned.
+ * The error handler is called with NIH_IO_LINE_TOO_LONG once the reader
+ * returns, rather than from this function, so @io remains valid.  In the
+ * latter case in stream mode, later calls discard data up to and
+ * including the next delimiter before looking for a line.
+ *
  * If @parent is not NULL, it should be a pointer to another object which
  * will be used as a parent for the returned string.  When all parents
  * of the returned string are freed, the returned string will also be
  * freed.
  *
- * Returns: newly allocated string or NULL if delimiter not found or
- * insufficient memory.
+ * Returns: newly allocated string or NULL if delimiter not found, line
+ * too long or insufficient memory.
  **/
 char *
 nih_io_get (const void *parent,
@@ -1581,8 +2522,10 @@ nih_io_get (const void *parent,
 {
 	NihIoMessage *message;
 	NihIoBuffer  *buf;
+	NihStrDelim   dset;
 	char         *str;
-	size_t        i;
+	size_t        i, start, limit;
+	int           too_long = FALSE;
 
 	nih_assert (io != NULL);
 	nih_assert (delim != NULL);
@@ -1605,23 +2548,74 @@ nih_io_get (const void *parent,
 		nih_assert_not_reached ();
 	}
 
-	/* Find the end of the string */
-	for (i = 0; i < buf->len; i++) {
-		if (strchr (delim, buf->buf[i]) || (buf->buf[i] == '\0')) {
-			/* Remove the string, and then the delimiter */
-			str = nih_io_buffer_pop (parent, buf, &i);
-			if (! str)
-				return NULL;
+	/* Data searched for other delimiters must be searched again */
+	nih_str_delim_init (&dset, delim);
+	if (memcmp (dset.map, io->get_delim.map, sizeof (dset.map))) {
+		io->get_delim = dset;
+		buf->scan = 0;
+	}
 
-			nih_io_buffer_shrink (buf, 1);
-			break;
+	/* Drop the rest of a line that was too long, which may not all have
+	 * been received yet either.
+	 */
+	if (io->discarding) {
+		i = nih_str_delim_find (&dset, buf->buf, buf->len);
+		if (i == buf->len) {
+			nih_io_buffer_shrink (buf, i);
+			goto finish;
 		}
+
+		nih_io_buffer_shrink (buf, i + 1);
+		io->discarding = FALSE;
+	}
+
+	/* Find the end of the string, carrying on from where we left off
+	 * and not looking further than the longest line.
+	 */
+	limit = buf->len;
+	if (io->max_line && (limit > io->max_line))
+		limit = io->max_line + 1;
+
+	start = nih_min (buf->scan, limit);
+	i = start + nih_str_delim_find (&dset, buf->buf + start,
+					limit - start);
+	if (i < limit) {
+		/* Remove the string, and then the delimiter */
+		str = nih_io_buffer_pop (parent, buf, &i);
+		if (! str)
+			return NULL;
+
+		nih_io_buffer_shrink (buf, 1);
+	} else if (io->max_line && (i > io->max_line)) {
+		/* Discard the line, and the delimiter if we have it;
+		 * otherwise the rest of a stream's line must be discarded
+		 * as it arrives.
+		 */
+		i += nih_str_delim_find (&dset, buf->buf + i, buf->len - i);
+		if ((i == buf->len) && (! message))
+			io->discarding = TRUE;
+
+		nih_io_buffer_shrink (buf, i + 1);
+
+		too_long = TRUE;
+	} else {
+		buf->scan = i;
 	}
 
 	if (message && (! message->data->len))
-		nih_unref (message, io);
+		nih_io_message_release (io, message);
 
 finish:
+	nih_io_water_check (io);
+
+	/* The error handler may free @io, so leave nih_io_watcher() to
+	 * call it once the reader has returned.
+	 */
+	if (too_long) {
+		io->line_too_long = TRUE;
+		return NULL;
+	}
+
 	nih_io_shutdown_check (io);
 
 	return str;
@@ -1643,23 +2637,84 @@ nih_io_printf (NihIo      *io,
 	       const char *format,
 	       ...)
 {
-	nih_local char *str = NULL;
-	va_list         args;
-	int             ret;
+	va_list args;
+	int     ret;
 
 	nih_assert (io != NULL);
 	nih_assert (format != NULL);
 
 	va_start (args, format);
-	str = nih_vsprintf (NULL, format, args);
+	ret = nih_io_write_internal (io, NULL, 0, format, &args);
 	va_end (args);
 
-	if (! str)
+	return ret;
+}
+
+/**
+ * nih_io_write_internal:
+ * @io: structure to write to,
+ * @str: data to write,
+ * @len: length of @str,
+ * @format: printf format string,
+ * @args: arguments to @format.
+ *
+ * Implements nih_io_write() and nih_io_printf(), writing either @len
+ * bytes from @str or, if @format is not NULL, data formatted according
+ * to it into the send buffer of @io, or into a new message placed in the
+ * send queue.  Formatted data is written straight into the buffer rather
+ * than into a string to be copied into it.
+ *
+ * Returns: zero on success, negative value if insufficient memory.
+ **/
+static int
+nih_io_write_internal (NihIo      *io,
+		       const char *str,
+		       size_t      len,
+		       const char *format,
+		       va_list    *args)
+{
+	nih_local NihIoMessage *message = NULL;
+	NihIoBuffer *           buf;
+	int                     ret;
+
+	nih_assert (io != NULL);
+	nih_assert ((str != NULL) || (format != NULL));
+
+	switch (io->type) {
+	case NIH_IO_STREAM:
+		message = NULL;
+		buf = io->send_buf;
+		break;
+	case NIH_IO_MESSAGE:
+		message = nih_io_message_new (NULL);
+		if (! message)
+			return -1;
+
+		buf = message->data;
+		break;
+	default:
+		nih_assert_not_reached ();
+	}
+
+	if (format) {
+		nih_assert (args != NULL);
+
+		ret = nih_io_buffer_vprintf (buf, format, *args);
+	} else {
+		ret = nih_io_buffer_push (buf, str, len);
+	}
+
+	if (ret < 0)
 		return -1;
 
-	ret = nih_io_write (io, str, strlen (str));
+	if (message) {
+		nih_io_send_message (io, message);
+	} else if (buf->len) {
+		io->watch->events |= NIH_IO_WRITE;
+		nih_io_water_check (io);
+	}
 
-	return ret;
+	return 0;
 }
 
 
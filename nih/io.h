@@ -23,8 +23,11 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 
+#include <stdarg.h>
+
 #include <nih/macros.h>
 #include <nih/list.h>
+#include <nih/string.h>
 
 
 /**
@@ -128,6 +131,22 @@ typedef void (*NihIoCloseHandler) (void *data, NihIo *io);
  **/
 typedef void (*NihIoErrorHandler) (void *data, NihIo *io);
 
+/**
+ * NihIoFullHandler:
+ * @data: data pointer given when registered,
+ * @io: NihIo whose send buffer filled or drained.
+ *
+ * An I/O full handler is a function that is called when the send buffer
+ * of @io reaches its high watermark, and again when it has drained to its
+ * low watermark; whether it is full can be obtained by checking for
+ * NIH_IO_WRITE in the full member of @io.
+ *
+ * It should take appropriate action, which may include pausing whatever
+ * is producing the data until the buffer drains.  You must not nih_free()
+ * @io or cause it to be freed from within this function.
+ **/
+typedef void (*NihIoFullHandler) (void *data, NihIo *io);
+
 
 /**
  * NihIoWatch:
@@ -155,17 +174,39 @@ struct nih_io_watch {
 
 /**
  * NihIoBuffer:
- * @buf: memory allocated for buffer,
+ * @buf: start of data in buffer,
  * @size: allocated size of @buf,
- * @len: number of bytes of @buf used.
+ * @len: number of bytes of @buf used,
+ * @off: number of bytes allocated before @buf,
+ * @min_size: size the buffer is allocated at and not reduced below,
+ * @max_grow: largest number of bytes the buffer grows by at once,
+ * @scan: number of bytes at the start of @buf searched by nih_io_get().
  *
  * This structure is used to represent a buffer holding data that is
  * waiting to be sent or processed.
+ *
+ * Data removed from the start of the buffer is not immediately reclaimed,
+ * instead @buf is advanced past it and @off increased; @buf always points
+ * at the data, which is contiguous.
+ *
+ * @min_size and @max_grow may be changed at any time; @min_size is a hint
+ * of how much data the buffer usually holds, and is zero by default, and
+ * @max_grow limits how far the buffer overshoots the size it needs when
+ * it's very large.  The memory is freed while the buffer is empty.
+ *
+ * @scan records how much of the data is known not to contain a delimiter
+ * so that it isn't searched again; it's reduced as data is removed.
  **/
 typedef struct nih_io_buffer {
 	char   *buf;
 	size_t  size;
 	size_t  len;
+	size_t  off;
+
+	size_t  min_size;
+	size_t  max_grow;
+
+	size_t  scan;
 } NihIoBuffer;
 
 /**
@@ -215,7 +256,20 @@ typedef struct nih_io_message {
  * @error_handler: function called when an error occurs,
  * @data: pointer passed to functions,
  * @shutdown: TRUE if the structure should be freed once the buffers are empty,
- * @free: pointer to variable to set to TRUE if freed during the watcher.
+ * @free: pointer to variable to set to TRUE if freed during the watcher,
+ * @high_water: size at which buffers are considered full (NIH_IO_STREAM),
+ * @low_water: size to which full buffers must drain (NIH_IO_STREAM),
+ * @full: buffers that are full,
+ * @full_handler: function called when the send buffer fills or drains,
+ * @read_budget: bytes or messages read each time the watcher is called,
+ * @spare_q: received messages kept to be reused (NIH_IO_MESSAGE),
+ * @spare_count: number of messages in @spare_q,
+ * @msg_size: largest message expected (NIH_IO_MESSAGE),
+ * @recv_area: memory messages are received into when @msg_size is set,
+ * @get_delim: delimiters last searched for by nih_io_get(),
+ * @max_line: longest line accepted by nih_io_get(),
+ * @discarding: TRUE while the rest of a line too long is being discarded,
+ * @line_too_long: TRUE when a line too long is yet to be reported.
  *
  * This structure implements more featureful I/O handling than provided by
  * an NihIoWatch alone.
@@ -235,6 +289,25 @@ typedef struct nih_io_message {
  * When used in the message mode (@type is NIH_IO_MESSAGE), it combines the
  * NihIoWatch with an NihList of NihIoMessage structures to implement
  * asynchronous handling of datagram sockets.
+ *
+ * In stream mode, the amount of data held in the buffers may be limited
+ * with nih_io_set_watermarks().  Once the receive buffer holds
+ * @high_water bytes, no more is read until it drains to @low_water bytes;
+ * once the send buffer holds @high_water bytes, @full_handler is called
+ * so that the writer may stop until it drains.  @full has NIH_IO_READ or
+ * NIH_IO_WRITE set while the receive or send buffer is full.
+ *
+ * In message mode, received messages are reused once they have been read
+ * and have no other references.  Once @msg_size is set with
+ * nih_io_set_message_size(), several messages are received at once.
+ *
+ * nih_io_get() only searches data received since its last call for
+ * the same delimiters, and lines longer than @max_line, if set with
+ * nih_io_set_max_line(), are discarded and reported as errors.  When
+ * the end of such a line hasn't been received in stream mode,
+ * @discarding is set so that the rest of it is discarded as it arrives.
+ * The error is reported once the reader returns, @line_too_long being
+ * set until then.
  **/
 struct nih_io {
 	NihIoType            type;
@@ -256,6 +329,23 @@ struct nih_io {
 
 	int                  shutdown;
 	int                 *free;
+
+	size_t               high_water;
+	size_t               low_water;
+	NihIoEvents          full;
+	NihIoFullHandler     full_handler;
+
+	size_t               read_budget;
+
+	NihList             *spare_q;
+	size_t               spare_count;
+	size_t               msg_size;
+	void                *recv_area;
+
+	NihStrDelim          get_delim;
+	size_t               max_line;
+	int                  discarding;
+	int                  line_too_long;
 };
 
 
@@ -288,6 +378,12 @@ void          nih_io_buffer_shrink       (NihIoBuffer *buffer, size_t len);
 int           nih_io_buffer_push         (NihIoBuffer *buffer,
 					  const char *str, size_t len)
 	__attribute__ ((warn_unused_result));
+int           nih_io_buffer_printf       (NihIoBuffer *buffer,
+					  const char *format, ...)
+	__attribute__ ((format (printf, 2, 3), warn_unused_result));
+int           nih_io_buffer_vprintf      (NihIoBuffer *buffer,
+					  const char *format, va_list args)
+	__attribute__ ((format (printf, 2, 0), warn_unused_result));
 
 
 NihIoMessage *nih_io_message_new         (const void *parent)
@@ -311,6 +407,14 @@ NihIo *       nih_io_reopen              (const void *parent, int fd,
 					  NihIoErrorHandler error_handler,
 					  void *data)
 	__attribute__ ((warn_unused_result, malloc));
+void          nih_io_set_buffer_size     (NihIo *io, size_t recv_size,
+					  size_t send_size);
+void          nih_io_set_watermarks      (NihIo *io, size_t low_water,
+					  size_t high_water,
+					  NihIoFullHandler full_handler);
+void          nih_io_set_read_budget     (NihIo *io, size_t budget);
+void          nih_io_set_message_size    (NihIo *io, size_t size);
+void          nih_io_set_max_line        (NihIo *io, size_t max_line);
 void          nih_io_shutdown            (NihIo *io);
 int           nih_io_destroy             (NihIo *io);
 
@@ -320,6 +424,8 @@ void          nih_io_send_message        (NihIo *io, NihIoMessage *message);
 char *        nih_io_read                (const void *parent, NihIo *io,
 					  size_t *len)
 	__attribute__ ((warn_unused_result, malloc));
+const char *  nih_io_peek                (NihIo *io, size_t *len);
+void          nih_io_consume             (NihIo *io, size_t len);
 int           nih_io_write               (NihIo *io, const char *str,
 					  size_t len)
 	__attribute__ ((warn_unused_result));
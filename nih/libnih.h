@@ -25,7 +25,10 @@
 #include <nih/string.h>
 #include <nih/list.h>
 #include <nih/hash.h>
+#include <nih/flat_hash.h>
 #include <nih/tree.h>
+#include <nih/vector.h>
+#include <nih/intern.h>
 #include <nih/timer.h>
 #include <nih/signal.h>
 #include <nih/child.h>
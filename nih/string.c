@@ -39,6 +39,38 @@
 #include "string.h"
 
 
+/**
+ * NIH_STR_BUF_MIN_SIZE:
+ *
+ * Number of bytes allocated for the string of a buffer when the first
+ * text is appended to it.
+ **/
+#define NIH_STR_BUF_MIN_SIZE 64
+
+/**
+ * NIH_SPRINTF_BUF_SIZE:
+ *
+ * Size of the buffer on the stack that strings are first formatted into
+ * by nih_vsprintf() and nih_strcat_vsprintf(); longer strings have to be
+ * formatted a second time once their length is known.
+ **/
+#define NIH_SPRINTF_BUF_SIZE 256
+
+/**
+ * NIH_STR_DELIM_BLOCK:
+ *
+ * Number of bytes first searched by nih_str_delim_find() for each
+ * character of a small set, doubled for each block after that.
+ **/
+#define NIH_STR_DELIM_BLOCK 64
+
+
+/* Prototypes for static functions */
+static char **nih_str_array_grow (char ***array, const void *parent,
+				  size_t len)
+	__attribute__ ((warn_unused_result));
+
+
 /**
  * nih_sprintf:
  * @parent: parent object for new string,
@@ -92,14 +124,18 @@ nih_vsprintf (const void *parent,
 	      const char *format,
 	      va_list     args)
 {
+	char      buf[NIH_SPRINTF_BUF_SIZE];
 	ssize_t   len;
 	va_list   args_copy;
 	char     *str;
 
 	nih_assert (format != NULL);
 
+	/* Format into a buffer on the stack first; most strings fit, so
+	 * only need to be formatted once and then copied.
+	 */
 	va_copy (args_copy, args);
-	len = vsnprintf (NULL, 0, format, args_copy);
+	len = vsnprintf (buf, sizeof (buf), format, args_copy);
 	va_end (args_copy);
 
 	nih_assert (len >= 0);
@@ -108,9 +144,13 @@ nih_vsprintf (const void *parent,
 	if (! str)
 		return NULL;
 
-	va_copy (args_copy, args);
-	vsnprintf (str, len + 1, format, args_copy);
-	va_end (args_copy);
+	if ((size_t)len < sizeof (buf)) {
+		memcpy (str, buf, len + 1);
+	} else {
+		va_copy (args_copy, args);
+		vsnprintf (str, len + 1, format, args_copy);
+		va_end (args_copy);
+	}
 
 	return str;
 }
@@ -332,6 +372,7 @@ nih_strcat_vsprintf (char       **str,
 		     const char  *format,
 		     va_list      args)
 {
+	char      buf[NIH_SPRINTF_BUF_SIZE];
 	ssize_t   len, str_len;
 	va_list   args_copy;
 	char     *ret;
@@ -342,7 +383,7 @@ nih_strcat_vsprintf (char       **str,
 	str_len = *str ? strlen (*str) : 0;
 
 	va_copy (args_copy, args);
-	len = vsnprintf (NULL, 0, format, args_copy);
+	len = vsnprintf (buf, sizeof (buf), format, args_copy);
 	va_end (args_copy);
 
 	nih_assert (len >= 0);
@@ -353,11 +394,422 @@ nih_strcat_vsprintf (char       **str,
 
 	*str = ret;
 
+	if ((size_t)len < sizeof (buf)) {
+		memcpy (*str + str_len, buf, len + 1);
+	} else {
+		va_copy (args_copy, args);
+		vsnprintf (*str + str_len, len + 1, format, args_copy);
+		va_end (args_copy);
+	}
+
+	return ret;
+}
+
+/**
+ * nih_str_buf_new:
+ * @parent: parent object of new buffer.
+ *
+ * Allocates a new, empty, string buffer which may be used to build up a
+ * long string by appending to it with nih_str_buf_append() and similar
+ * functions, and then obtained with nih_str_buf_finish().
+ *
+ * Unlike nih_strcat() the buffer tracks the length of the string and the
+ * size allocated for it, growing it geometrically, so that appending
+ * takes time proportional to the text appended rather than to the length
+ * of the string built so far.
+ *
+ * The structure is allocated using nih_alloc() so it can be used as a
+ * context to other allocations, the string is a child of it.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned buffer.  When all parents
+ * of the returned buffer are freed, the returned buffer will also be
+ * freed.
+ *
+ * Returns: new buffer or NULL if insufficient memory.
+ **/
+NihStrBuf *
+nih_str_buf_new (const void *parent)
+{
+	NihStrBuf *buf;
+
+	buf = nih_new (parent, NihStrBuf);
+	if (! buf)
+		return NULL;
+
+	buf->str = NULL;
+	buf->len = 0;
+	buf->size = 0;
+
+	return buf;
+}
+
+/**
+ * nih_str_buf_reserve:
+ * @buf: buffer,
+ * @len: number of characters to make room for.
+ *
+ * Ensures that @buf has room for at least @len more characters to be
+ * appended to its string without it being reallocated.  If it needs to
+ * grow, the size of the string is at least doubled.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_reserve (NihStrBuf *buf,
+		     size_t     len)
+{
+	size_t  size;
+	char   *str;
+
+	nih_assert (buf != NULL);
+
+	if (len >= SIZE_MAX - buf->len)
+		return -1;
+
+	if (buf->len + len < buf->size)
+		return 0;
+
+	size = buf->size ? buf->size : NIH_STR_BUF_MIN_SIZE;
+	while (size <= buf->len + len) {
+		if (size > SIZE_MAX / 2)
+			return -1;
+
+		size *= 2;
+	}
+
+	str = nih_realloc (buf->str, buf, size);
+	if (! str)
+		return -1;
+
+	buf->str = str;
+	buf->size = size;
+	buf->str[buf->len] = '\0';
+
+	return 0;
+}
+
+/**
+ * nih_str_buf_append:
+ * @buf: buffer,
+ * @src: string to append.
+ *
+ * Appends @src to the string in @buf.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_append (NihStrBuf  *buf,
+		    const char *src)
+{
+	nih_assert (buf != NULL);
+	nih_assert (src != NULL);
+
+	return nih_str_buf_appendn (buf, src, strlen (src));
+}
+
+/**
+ * nih_str_buf_appendn:
+ * @buf: buffer,
+ * @src: string to append,
+ * @len: length of @src.
+ *
+ * Appends the first @len characters of @src to the string in @buf; @src
+ * need not be NUL-terminated.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_appendn (NihStrBuf  *buf,
+		     const char *src,
+		     size_t      len)
+{
+	nih_assert (buf != NULL);
+	nih_assert ((src != NULL) || (len == 0));
+
+	if (nih_str_buf_reserve (buf, len) < 0)
+		return -1;
+
+	memcpy (buf->str + buf->len, src, len);
+	buf->len += len;
+	buf->str[buf->len] = '\0';
+
+	return 0;
+}
+
+/**
+ * nih_str_buf_sprintf:
+ * @buf: buffer,
+ * @format: format string to append.
+ *
+ * Appends to the string in @buf according to @format as sprintf().
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_sprintf (NihStrBuf  *buf,
+		     const char *format,
+		     ...)
+{
+	int     ret;
+	va_list args;
+
+	nih_assert (buf != NULL);
+	nih_assert (format != NULL);
+
+	va_start (args, format);
+	ret = nih_str_buf_vsprintf (buf, format, args);
+	va_end (args);
+
+	return ret;
+}
+
+/**
+ * nih_str_buf_vsprintf:
+ * @buf: buffer,
+ * @format: format string to append,
+ * @args: arguments to format string.
+ *
+ * Appends to the string in @buf according to @format as vsprintf().
+ *
+ * The text is formatted directly into the room already allocated for the
+ * string where it fits, so it is only formatted a second time when the
+ * string has to grow.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_vsprintf (NihStrBuf  *buf,
+		      const char *format,
+		      va_list     args)
+{
+	int     len;
+	va_list args_copy;
+
+	nih_assert (buf != NULL);
+	nih_assert (format != NULL);
+
 	va_copy (args_copy, args);
-	vsnprintf (*str + str_len, len + 1, format, args_copy);
+	len = vsnprintf (buf->size ? buf->str + buf->len : NULL,
+			 buf->size - buf->len, format, args_copy);
 	va_end (args_copy);
 
-	return ret;
+	nih_assert (len >= 0);
+
+	if ((size_t)len < buf->size - buf->len) {
+		buf->len += len;
+		return 0;
+	}
+
+	if (nih_str_buf_reserve (buf, len) < 0) {
+		if (buf->size)
+			buf->str[buf->len] = '\0';
+		return -1;
+	}
+
+	va_copy (args_copy, args);
+	vsnprintf (buf->str + buf->len, len + 1, format, args_copy);
+	va_end (args_copy);
+
+	buf->len += len;
+
+	return 0;
+}
+
+/**
+ * nih_str_buf_indent:
+ * @buf: buffer,
+ * @src: string to append,
+ * @level: number of tabs to indent by.
+ *
+ * Appends @src to the string in @buf, indenting each non-empty line of
+ * @src, including the last even if that has no terminating newline, by
+ * @level tab characters.  @src is assumed to be appended at the start of
+ * a line.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_str_buf_indent (NihStrBuf  *buf,
+		    const char *src,
+		    int         level)
+{
+	const char *s;
+	size_t      len;
+	char       *ptr;
+
+	nih_assert (buf != NULL);
+	nih_assert (src != NULL);
+	nih_assert (level >= 0);
+
+	/* First figure out how many tab characters we have to insert */
+	len = 0;
+	for (s = src; *s; s++)
+		if (((s == src) || (s[-1] == '\n')) && (*s != '\n'))
+			len += level;
+
+	if (nih_str_buf_reserve (buf, len + (s - src)) < 0)
+		return -1;
+
+	/* Now copy each line, putting the tab characters in */
+	ptr = buf->str + buf->len;
+	for (s = src; *s; s++) {
+		if (((s == src) || (s[-1] == '\n')) && (*s != '\n')) {
+			memset (ptr, '\t', level);
+			ptr += level;
+		}
+
+		*(ptr++) = *s;
+	}
+
+	*ptr = '\0';
+	buf->len = ptr - buf->str;
+
+	return 0;
+}
+
+/**
+ * nih_str_buf_finish:
+ * @buf: buffer,
+ * @parent: parent object of returned string.
+ *
+ * Takes the string built up in @buf, releasing any unused room allocated
+ * for it, and leaves @buf empty so that it may be used to build another
+ * string or freed.  Any objects referenced by the string remain so.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned string.  When all parents
+ * of the returned string are freed, the returned string will also be
+ * freed.
+ *
+ * Returns: string built or NULL if insufficient memory, in which case
+ * @buf is unchanged.
+ **/
+char *
+nih_str_buf_finish (NihStrBuf  *buf,
+		    const void *parent)
+{
+	char *str;
+
+	nih_assert (buf != NULL);
+
+	if (! buf->str)
+		return nih_strdup (parent, "");
+
+	str = nih_realloc (buf->str, buf, buf->len + 1);
+	if (! str)
+		return NULL;
+
+	nih_ref (str, parent);
+	nih_unref (str, buf);
+
+	buf->str = NULL;
+	buf->len = 0;
+	buf->size = 0;
+
+	return str;
+}
+
+
+/**
+ * nih_str_delim_init:
+ * @delim: delimiter set to fill,
+ * @chars: characters in set.
+ *
+ * Fills @delim with the set of characters in the @chars string and the
+ * NUL character, which is always a member of the set as it would be when
+ * using strchr() to test for membership of @chars.
+ **/
+void
+nih_str_delim_init (NihStrDelim *delim,
+		    const char  *chars)
+{
+	nih_assert (delim != NULL);
+	nih_assert (chars != NULL);
+
+	memset (delim->map, 0, sizeof (delim->map));
+	delim->nchars = 0;
+
+	do {
+		unsigned char c = *chars;
+
+		if (NIH_STR_IS_DELIM (delim, c))
+			continue;
+
+		delim->map[c / 32] |= 1U << (c % 32);
+
+		if (c) {
+			if (delim->nchars < sizeof (delim->chars))
+				delim->chars[delim->nchars] = c;
+			delim->nchars++;
+		}
+	} while (*(chars++));
+}
+
+/**
+ * nih_str_delim_find:
+ * @delim: delimiter set,
+ * @str: string to search,
+ * @len: length of @str.
+ *
+ * Searches the first @len bytes of @str, which need not be NUL-terminated,
+ * for a character in @delim.
+ *
+ * When @delim has no more than two characters other than NUL, each is
+ * searched for with memchr() up to the nearest match so far, which is
+ * much faster than testing each character for long strings; otherwise
+ * each character is tested against the bitmap.
+ *
+ * The string is searched a block at a time, starting small and doubling,
+ * so that a character in the set that doesn't occur until much later, or
+ * at all, doesn't make us scan past the first match; the time taken is
+ * always proportional to the offset returned.
+ *
+ * Returns: offset of the first character in @str that is in @delim, or
+ * @len if there is none.
+ **/
+size_t
+nih_str_delim_find (const NihStrDelim *delim,
+		    const char        *str,
+		    size_t             len)
+{
+	const char *ptr;
+	size_t      i;
+
+	nih_assert (delim != NULL);
+	nih_assert ((str != NULL) || (len == 0));
+
+	if (delim->nchars <= sizeof (delim->chars)) {
+		size_t start, block, end;
+
+		block = NIH_STR_DELIM_BLOCK;
+		for (start = 0; start < len; start += block, block *= 2) {
+			block = nih_min (block, len - start);
+			end = start + block;
+
+			for (i = 0; i < delim->nchars; i++) {
+				ptr = memchr (str + start, delim->chars[i],
+					      end - start);
+				if (ptr)
+					end = ptr - str;
+			}
+
+			ptr = memchr (str + start, '\0', end - start);
+			if (ptr)
+				return ptr - str;
+
+			if (end < start + block)
+				return end;
+		}
+
+		return len;
+	}
+
+	for (i = 0; i < len; i++)
+		if (NIH_STR_IS_DELIM (delim, str[i]))
+			return i;
+
+	return len;
 }
 
 
@@ -390,28 +842,32 @@ nih_str_split (const void *parent,
 	       const char *delim,
 	       int         repeat)
 {
-	char   **array;
-	size_t   len;
+	NihStrDelim   dset;
+	char        **array;
+	const char   *end;
+	size_t        len;
 
 	nih_assert (str != NULL);
 	nih_assert (delim != NULL);
 
+	nih_str_delim_init (&dset, delim);
+	end = str + strlen (str);
+
 	len = 0;
 	array = nih_str_array_new (parent);
 	if (! array)
 		return NULL;
 
-	while (*str) {
+	while (str < end) {
 		const char  *ptr;
 
 		/* Skip initial delimiters */
-		while (repeat && *str && strchr (delim, *str))
+		while (repeat && (str < end) && NIH_STR_IS_DELIM (&dset, *str))
 			str++;
 
 		/* Find the end of the token */
 		ptr = str;
-		while (*str && (! strchr (delim, *str)))
-			str++;
+		str += nih_str_delim_find (&dset, str, end - str);
 
 		/* Don't create an empty string array element in repeat
 		 * mode if there is no token (as a result of a
@@ -427,7 +883,7 @@ nih_str_split (const void *parent,
 		}
 
 		/* Skip over the delimiter */
-		if (*str)
+		if (str < end)
 			str++;
 	}
 
@@ -444,6 +900,11 @@ nih_str_split (const void *parent,
  * each array element will be allocated using nih_alloc() as a child of
  * the array itself, the entire array can be freed with nih_free().
  *
+ * The number of elements the array has room for is the size of its
+ * allocation, so the functions that extend it only reallocate it when
+ * it's full and then at least double its size; use nih_str_array_reserve()
+ * to make room for a known number of elements.
+ *
  * If @parent is not NULL, it should be a pointer to another object which
  * will be used as a parent for the returned array.  When all parents
  * of the returned object are freed, the returned array will also be
@@ -465,6 +926,91 @@ nih_str_array_new (const void *parent)
 	return array;
 }
 
+/**
+ * nih_str_array_reserve:
+ * @array: array of strings,
+ * @parent: parent object of new array,
+ * @len: number of elements.
+ *
+ * Ensures that the NULL-terminated string @array has room for @len
+ * elements, excluding the final NULL element, so that it need not be
+ * reallocated until more than that are added.  The elements of @array
+ * are not changed.
+ *
+ * @array will be updated to point to the new array pointer; use the
+ * return value simply to check for success.
+ *
+ * If the array pointed to by @array is NULL, a new empty array will be
+ * allocated, and if @parent is not NULL, it should be a pointer to
+ * another object which will be used as a parent for the returned array.
+ * When all parents of the returned array are freed, the returned array
+ * will also be freed.
+ *
+ * When the array pointed to by @array is not NULL, @parent is ignored;
+ * though it usual to pass a parent of @array for style reasons.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+char **
+nih_str_array_reserve (char       ***array,
+		       const void   *parent,
+		       size_t        len)
+{
+	char **new_array;
+
+	nih_assert (array != NULL);
+
+	if (*array && (nih_alloc_size (*array) / sizeof (char *) > len))
+		return *array;
+
+	if (len >= SIZE_MAX / sizeof (char *))
+		return NULL;
+
+	new_array = nih_realloc (*array, parent, sizeof (char *) * (len + 1));
+	if (! new_array)
+		return NULL;
+
+	if (! *array)
+		new_array[0] = NULL;
+
+	*array = new_array;
+
+	return *array;
+}
+
+/**
+ * nih_str_array_grow:
+ * @array: array of strings,
+ * @parent: parent object of new array,
+ * @len: number of elements.
+ *
+ * Ensures that the NULL-terminated string @array has room for @len
+ * elements, excluding the final NULL element, in the same manner as
+ * nih_str_array_reserve() except that when it must be reallocated, its
+ * size is at least doubled so that adding elements one at a time takes
+ * constant time on average.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+static char **
+nih_str_array_grow (char       ***array,
+		    const void   *parent,
+		    size_t        len)
+{
+	size_t size;
+
+	nih_assert (array != NULL);
+
+	size = *array ? nih_alloc_size (*array) / sizeof (char *) : 0;
+	if (size > len)
+		return *array;
+
+	if ((size > 1) && (len < size * 2 - 1) && (size < SIZE_MAX / 2))
+		len = size * 2 - 1;
+
+	return nih_str_array_reserve (array, parent, len);
+}
+
 /**
  * nih_str_array_add:
  * @array: array of strings,
@@ -620,12 +1166,9 @@ nih_str_array_addp (char       ***array,
 			c_len++;
 	}
 
-	new_array = nih_realloc (*array, parent, sizeof (char *) * (*len + 2));
-	if (! new_array)
+	if (! nih_str_array_grow (array, parent, *len + 1))
 		return NULL;
 
-	*array = new_array;
-
 	nih_ref (ptr, *array);
 
 	(*array)[(*len)++] = ptr;
@@ -647,6 +1190,9 @@ nih_str_array_addp (char       ***array,
  * of the array itself, the entire array can be freed with nih_free().
  * This will not affect the array copied.
  *
+ * Use nih_str_array_copyp() instead to share the elements of @array
+ * rather than copying them.
+ *
  * @len will be updated to contain the new array length.  If you don't care
  * about the length, @len may be set to NULL; this is less efficient as it
  * necessates counting the length on each future add operation.
@@ -716,7 +1262,7 @@ nih_str_array_append (char         ***array,
 		      size_t         *len,
 		      char * const   *args)
 {
-	size_t        c_len, o_len;
+	size_t        c_len, o_len, n_args;
 	int           free_on_error = FALSE;
 	char * const *arg;
 
@@ -737,6 +1283,13 @@ nih_str_array_append (char         ***array,
 
 	o_len = c_len;
 
+	/* Make room for all of the new elements at once */
+	for (n_args = 0; args[n_args]; n_args++)
+		;
+
+	if (! nih_str_array_grow (array, parent, c_len + n_args))
+		return NULL;
+
 	for (arg = args; *arg; arg++) {
 		if (! nih_str_array_add (array, parent, &c_len, *arg)) {
 			if (*array) {
@@ -761,6 +1314,167 @@ nih_str_array_append (char         ***array,
 	return *array;
 }
 
+/**
+ * nih_str_array_copyp:
+ * @parent: parent object of new array.
+ * @len: length of new array,
+ * @array: array of strings to share.
+ *
+ * Allocates a new NULL-terminated array of strings with the same elements
+ * as the existing @array given, which must all have been allocated using
+ * nih_alloc().  Rather than being copied, the elements are referenced by
+ * the new array so they are shared between the two; this takes much less
+ * time and memory than nih_str_array_copy() for large arrays.
+ *
+ * Since the elements are shared, they must not be modified or freed
+ * through either array; nih_str_array_unshare() should be used to obtain
+ * a private copy of an element before modifying it, and nih_unref() to
+ * remove an element from an array.  Freeing the new array with nih_free()
+ * only frees those elements no longer referenced by anything else.
+ *
+ * @len will be updated to contain the new array length.  If you don't care
+ * about the length, @len may be set to NULL; this is less efficient as it
+ * necessates counting the length on each future add operation.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned array.  When all parents
+ * of the returned array are freed, the returned array will also be
+ * freed.
+ *
+ * Returns: newly allocated array or NULL if insufficient memory.
+ **/
+char **
+nih_str_array_copyp (const void   *parent,
+		     size_t       *len,
+		     char * const *array)
+{
+	char **new_array;
+
+	nih_assert (array != NULL);
+
+	new_array = nih_str_array_new (parent);
+	if (! new_array)
+		return NULL;
+
+	if (! nih_str_array_appendp (&new_array, parent, len, array)) {
+		nih_free (new_array);
+		return NULL;
+	}
+
+	return new_array;
+}
+
+/**
+ * nih_str_array_appendp:
+ * @array: array of strings,
+ * @parent: parent object of new array,
+ * @len: length of @array,
+ * @args: array of strings to add.
+ *
+ * Extend the NULL-terminated string @array (which has @len elements,
+ * excluding the final NULL element), appending each element in the
+ * additional NULL-terminated string array @args to it.  The elements
+ * of @args must have been allocated using nih_alloc(), and are referenced
+ * by @array rather than being copied, see nih_str_array_copyp().
+ *
+ * @len will be updated to contain the new array length and @array will
+ * be updated to point to the new array pointer; use the return value
+ * simply to check for success.
+ *
+ * If you don't know or care about the length, @len may be set to NULL;
+ * this is less efficient as it necessates counting the length on each
+ * operation.
+ *
+ * If the array pointed to by @array is NULL, this is equivalent to
+ * nih_str_array_copyp() and if @parent is not NULL, it should be a pointer
+ * to another object which will be used as a parent for the returned array.
+ * When all parents of the returned array are freed, the returned array will
+ * also be freed.
+ *
+ * When the array pointed to by @array is not NULL, @parent is ignored;
+ * though it usual to pass a parent of @array for style reasons.
+ *
+ * Returns: new array pointer or NULL if insufficient memory.
+ **/
+char **
+nih_str_array_appendp (char         ***array,
+		       const void     *parent,
+		       size_t         *len,
+		       char * const   *args)
+{
+	size_t        c_len, n_args;
+	char * const *arg;
+
+	nih_assert (array != NULL);
+	nih_assert (args != NULL);
+
+	if (! len) {
+		c_len = 0;
+
+		for (arg = *array; arg && *arg; arg++)
+			c_len++;
+	} else {
+		c_len = *len;
+	}
+
+	/* Make room for all of the new elements at once, after which
+	 * adding them cannot fail.
+	 */
+	for (n_args = 0; args[n_args]; n_args++)
+		;
+
+	if (! nih_str_array_grow (array, parent, c_len + n_args))
+		return NULL;
+
+	for (arg = args; *arg; arg++) {
+		nih_ref (*arg, *array);
+		(*array)[c_len++] = *arg;
+	}
+
+	(*array)[c_len] = NULL;
+
+	if (len)
+		*len = c_len;
+
+	return *array;
+}
+
+/**
+ * nih_str_array_unshare:
+ * @array: array of strings,
+ * @index: index of element.
+ *
+ * Ensures that the element of @array at @index is referenced only by
+ * @array, so that it may be modified without affecting any other array
+ * or object that shares it.  If it is shared, it is replaced in @array
+ * by a copy allocated as a child of @array and the reference to the
+ * original is removed; otherwise it is left alone.
+ *
+ * Returns: element at @index, which may be modified, or NULL if
+ * insufficient memory.
+ **/
+char *
+nih_str_array_unshare (char   **array,
+		       size_t   index)
+{
+	char *str;
+
+	nih_assert (array != NULL);
+	nih_assert (array[index] != NULL);
+
+	if (! nih_alloc_shared (array[index]))
+		return array[index];
+
+	str = nih_strdup (array, array[index]);
+	if (! str)
+		return NULL;
+
+	nih_unref (array[index], array);
+	array[index] = str;
+
+	return str;
+}
+
 
 /**
  * nih_str_wrap:
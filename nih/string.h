@@ -25,6 +25,10 @@
  * functions for memory management.  This allows you to create and modify
  * strings, and arrays of strings, which may be referenced by other objects
  * and cleaned up automatically.
+ *
+ * Long strings built up piece by piece should use an NihStrBuf rather
+ * than nih_strcat(), since that must find the end of the string and
+ * reallocate it each time.
  **/
 
 #include <stdarg.h>
@@ -32,6 +36,53 @@
 #include <nih/macros.h>
 
 
+/**
+ * NihStrBuf:
+ * @str: string built so far,
+ * @len: length of @str,
+ * @size: number of bytes allocated for @str.
+ *
+ * This structure is used to build up a long string by repeatedly
+ * appending to it, see nih_str_buf_new().  @str is NULL until text is
+ * first appended, and is otherwise a NUL-terminated child of the buffer.
+ **/
+typedef struct nih_str_buf {
+	char   *str;
+	size_t  len;
+	size_t  size;
+} NihStrBuf;
+
+/**
+ * NihStrDelim:
+ * @map: bitmap of characters in the set,
+ * @nchars: number of characters in @chars, or more than two,
+ * @chars: characters in the set other than NUL when there are few.
+ *
+ * This structure represents a set of delimiter characters built from
+ * a string by nih_str_delim_init(), so that strings can be searched for
+ * them with nih_str_delim_find() or individual characters tested with
+ * NIH_STR_IS_DELIM() without scanning the string for every character.
+ * The NUL character is always a member of the set.
+ **/
+typedef struct nih_str_delim {
+	uint32_t map[256 / 32];
+	size_t   nchars;
+	char     chars[2];
+} NihStrDelim;
+
+
+/**
+ * NIH_STR_IS_DELIM:
+ * @delim: delimiter set,
+ * @c: character to check.
+ *
+ * Returns: TRUE if @c is in the set @delim.
+ **/
+#define NIH_STR_IS_DELIM(delim, c)					\
+	((delim)->map[(unsigned char)(c) / 32]				\
+	 & (1U << ((unsigned char)(c) % 32)))
+
+
 NIH_BEGIN_EXTERN
 
 char * nih_sprintf          (const void *parent, const char *format, ...)
@@ -60,12 +111,36 @@ char * nih_strcat_vsprintf  (char **str, const void *parent,
 			     const char *format, va_list args)
 	__attribute__ ((format (printf, 3, 0), warn_unused_result, malloc));
 
+NihStrBuf *nih_str_buf_new   (const void *parent)
+	__attribute__ ((warn_unused_result, malloc));
+int    nih_str_buf_reserve  (NihStrBuf *buf, size_t len)
+	__attribute__ ((warn_unused_result));
+int    nih_str_buf_append   (NihStrBuf *buf, const char *src)
+	__attribute__ ((warn_unused_result));
+int    nih_str_buf_appendn  (NihStrBuf *buf, const char *src, size_t len)
+	__attribute__ ((warn_unused_result));
+int    nih_str_buf_sprintf  (NihStrBuf *buf, const char *format, ...)
+	__attribute__ ((format (printf, 2, 3), warn_unused_result));
+int    nih_str_buf_vsprintf (NihStrBuf *buf, const char *format,
+			     va_list args)
+	__attribute__ ((format (printf, 2, 0), warn_unused_result));
+int    nih_str_buf_indent   (NihStrBuf *buf, const char *src, int level)
+	__attribute__ ((warn_unused_result));
+char * nih_str_buf_finish   (NihStrBuf *buf, const void *parent)
+	__attribute__ ((warn_unused_result, malloc));
+
+void   nih_str_delim_init   (NihStrDelim *delim, const char *chars);
+size_t nih_str_delim_find   (const NihStrDelim *delim, const char *str,
+			     size_t len);
+
 char **nih_str_split        (const void *parent, const char *str,
 			     const char *delim, int repeat)
 	__attribute__ ((warn_unused_result, malloc));
 
 char **nih_str_array_new    (const void *parent)
 	__attribute__ ((warn_unused_result, malloc));
+char **nih_str_array_reserve (char ***array, const void *parent, size_t len)
+	__attribute__ ((warn_unused_result));
 char **nih_str_array_add    (char ***array, const void *parent, size_t *len,
 			     const char *str)
 	__attribute__ ((warn_unused_result, malloc));
@@ -81,6 +156,14 @@ char **nih_str_array_copy   (const void *parent, size_t *len,
 char **nih_str_array_append (char ***array, const void *parent, size_t *len,
 			     char * const *args)
 	__attribute__ ((warn_unused_result, malloc));
+char **nih_str_array_copyp  (const void *parent, size_t *len,
+			     char * const *array)
+	__attribute__ ((warn_unused_result, malloc));
+char **nih_str_array_appendp (char ***array, const void *parent, size_t *len,
+			      char * const *args)
+	__attribute__ ((warn_unused_result, malloc));
+char * nih_str_array_unshare (char **array, size_t index)
+	__attribute__ ((warn_unused_result));
 
 char * nih_str_wrap         (const void *parent, const char *str, size_t len,
 		             size_t first_indent, size_t indent)
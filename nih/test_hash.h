@@ -27,6 +27,7 @@
 #include <stddef.h>
 
 #include <nih/list.h>
+#include <nih/hash.h>
 
 
 /**
@@ -36,8 +37,8 @@
  * Check that the hash table @_hash is empty.
  **/
 #define TEST_HASH_EMPTY(_hash) \
-	for (size_t _hash_i = 0; _hash_i < (_hash)->size; _hash_i++) \
-		if (! NIH_LIST_EMPTY (&(_hash)->bins[_hash_i])) \
+	for (size_t _hash_i = 0; _hash_i < NIH_HASH_NUM_BINS (_hash); _hash_i++) \
+		if (! NIH_LIST_EMPTY (NIH_HASH_BIN ((_hash), _hash_i))) \
 			TEST_FAILED ("hash %p (%s) not empty as expected", \
 				     (_hash), #_hash)
 
@@ -50,8 +51,9 @@
 #define TEST_HASH_NOT_EMPTY(_hash) \
 	do { \
 		int _hash_empty = 1; \
-		for (size_t _hash_i = 0; _hash_i < (_hash)->size; _hash_i++) \
-			if (! NIH_LIST_EMPTY (&(_hash)->bins[_hash_i])) \
+		for (size_t _hash_i = 0; _hash_i < NIH_HASH_NUM_BINS (_hash); \
+		     _hash_i++) \
+			if (! NIH_LIST_EMPTY (NIH_HASH_BIN ((_hash), _hash_i))) \
 				_hash_empty = 0; \
 		if (_hash_empty) \
 			TEST_FAILED ("hash %p (%s) empty, expected multiple members", \
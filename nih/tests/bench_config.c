@@ -0,0 +1,675 @@
+/* libnih
+ *
+ * bench_config.c - benchmark for nih/config.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Generates a synthetic corpus of job-file-like configuration and times
+ * how long the config parser takes to get through it, reporting the
+ * throughput in MB/s and tokens/s and the number of allocations made for
+ * each token.  Results may be saved and compared against later runs so
+ * that changes to the parser can be measured:
+ *
+ *   make bench_config
+ *   ./bench_config --save=before.txt
+ *   ... make changes ...
+ *   ./bench_config --baseline=before.txt
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/config.h>
+#include <nih/logging.h>
+#include <nih/error.h>
+
+
+/**
+ * N_ELEMENTS:
+ * @_array: array.
+ *
+ * Returns: number of elements in @_array.
+ **/
+#define N_ELEMENTS(_array) (sizeof (_array) / sizeof ((_array)[0]))
+
+
+/* Allocator hooks from nih/alloc.c */
+extern void *(*__nih_malloc)(size_t size);
+extern void *(*__nih_realloc)(void *ptr, size_t size);
+
+
+/**
+ * BenchResult:
+ * @name: name of benchmark,
+ * @mbps: megabytes of input parsed per second,
+ * @tokens: tokens parsed per second,
+ * @allocs: allocations made per token.
+ *
+ * Result of a single benchmark, as printed and saved.
+ **/
+typedef struct bench_result {
+	const char *name;
+	double      mbps;
+	double      tokens;
+	double      allocs;
+} BenchResult;
+
+
+/**
+ * size:
+ *
+ * Approximate size of the corpus to generate, in bytes.
+ **/
+static int size = 4 * 1024 * 1024;
+
+/**
+ * quote_percent:
+ *
+ * Percentage of arguments that are quoted.
+ **/
+static int quote_percent = 10;
+
+/**
+ * comment_percent:
+ *
+ * Percentage of lines that are comments.
+ **/
+static int comment_percent = 20;
+
+/**
+ * block_percent:
+ *
+ * Percentage of stanzas that are script blocks.
+ **/
+static int block_percent = 5;
+
+/**
+ * block_lines:
+ *
+ * Number of lines in each script block.
+ **/
+static int block_lines = 10;
+
+/**
+ * iterations:
+ *
+ * Number of times to run each benchmark, the best time is taken.
+ **/
+static int iterations = 5;
+
+/**
+ * seed:
+ *
+ * Seed for the corpus generator, so runs can be compared.
+ **/
+static int seed = 1;
+
+/**
+ * save_file:
+ *
+ * File to save results to.
+ **/
+static char *save_file = NULL;
+
+/**
+ * baseline_file:
+ *
+ * File to load baseline results from for comparison.
+ **/
+static char *baseline_file = NULL;
+
+
+/**
+ * allocs:
+ *
+ * Number of allocations made through nih_alloc() and nih_realloc() while
+ * counting.
+ **/
+static unsigned long allocs = 0;
+
+/**
+ * tokens:
+ *
+ * Number of tokens parsed by the stanza handlers.
+ **/
+static unsigned long tokens = 0;
+
+
+/**
+ * words:
+ *
+ * Words used to build stanza arguments.
+ **/
+static const char *words[] = {
+	"starting", "stopped", "runlevel", "filesystem", "net-device-up",
+	"IFACE=lo", "[2345]", "/sbin/getty", "-8", "38400", "tty1",
+	"console", "output", "normal", "--daemon", "/var/run/foo.pid",
+	"PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin",
+	"or", "and", "local-filesystems", "mounted", "MOUNTPOINT=/tmp",
+};
+
+/**
+ * stanza_names:
+ *
+ * Names of stanzas taking arguments.
+ **/
+static const char *stanza_names[] = {
+	"start", "stop", "env", "emits", "description", "author",
+	"console", "respawn", "normal", "instance", "exec",
+};
+
+
+static void *
+count_malloc (size_t size)
+{
+	allocs++;
+	return malloc (size);
+}
+
+static void *
+count_realloc (void *ptr, size_t size)
+{
+	allocs++;
+	return realloc (ptr, size);
+}
+
+
+static int
+args_handler (void            *data,
+	      NihConfigStanza *stanza,
+	      const char      *file,
+	      size_t           len,
+	      size_t          *pos,
+	      size_t          *lineno)
+{
+	nih_local char **args = NULL;
+
+	args = nih_config_parse_args (NULL, file, len, pos, lineno);
+	if (! args)
+		return -1;
+
+	for (char **arg = args; *arg; arg++)
+		tokens++;
+	tokens++;
+
+	return 0;
+}
+
+static int
+exec_handler (void            *data,
+	      NihConfigStanza *stanza,
+	      const char      *file,
+	      size_t           len,
+	      size_t          *pos,
+	      size_t          *lineno)
+{
+	nih_local char *cmd = NULL;
+
+	cmd = nih_config_parse_command (NULL, file, len, pos, lineno);
+	if (! cmd)
+		return -1;
+
+	tokens += 2;
+
+	return 0;
+}
+
+static int
+script_handler (void            *data,
+		NihConfigStanza *stanza,
+		const char      *file,
+		size_t           len,
+		size_t          *pos,
+		size_t          *lineno)
+{
+	nih_local char *script = NULL;
+
+	if (nih_config_skip_comment (file, len, pos, lineno) < 0)
+		return -1;
+
+	script = nih_config_parse_block (NULL, file, len, pos, lineno,
+					 "script");
+	if (! script)
+		return -1;
+
+	tokens += 2;
+
+	return 0;
+}
+
+static NihConfigStanza stanzas[] = {
+	{ "exec",   exec_handler },
+	{ "script", script_handler },
+	{ "",       args_handler },
+
+	NIH_CONFIG_LAST
+};
+
+
+/**
+ * percent:
+ * @pct: percentage.
+ *
+ * Returns: TRUE with a probability of @pct percent.
+ **/
+static int
+percent (int pct)
+{
+	return (rand () % 100) < pct;
+}
+
+/**
+ * random_word:
+ *
+ * Returns: randomly chosen word, quoted quote_percent of the time.
+ **/
+static char *
+random_word (const void *parent)
+{
+	const char *word;
+
+	word = words[rand () % N_ELEMENTS (words)];
+	if (percent (quote_percent))
+		return nih_sprintf (parent, "\"%s %s\"", word,
+				    words[rand () % N_ELEMENTS (words)]);
+
+	return nih_strdup (parent, word);
+}
+
+/**
+ * generate_corpus:
+ * @parent: parent object for returned string,
+ * @len: pointer to store length of corpus.
+ *
+ * Generates a synthetic corpus of approximately size bytes according to
+ * the options given.
+ *
+ * Returns: newly allocated string.
+ **/
+static char *
+generate_corpus (const void *parent,
+		 size_t     *len)
+{
+	char   *corpus;
+	size_t  corpus_size;
+
+	nih_assert (len != NULL);
+
+	corpus_size = size + BUFSIZ;
+	corpus = NIH_MUST (nih_alloc (parent, corpus_size));
+	*len = 0;
+
+	srand (seed);
+	while (*len < (size_t)size) {
+		nih_local char *line = NULL;
+		size_t          linelen;
+
+		if (percent (comment_percent)) {
+			line = NIH_MUST (nih_strdup (NULL, "# "));
+			for (int i = rand () % 8; i >= 0; i--)
+				NIH_MUST (nih_strcat_sprintf (
+						  &line, NULL, "%s ",
+						  words[rand () % N_ELEMENTS (words)]));
+			NIH_MUST (nih_strcat (&line, NULL, "\n"));
+
+		} else if (percent (block_percent)) {
+			line = NIH_MUST (nih_strdup (NULL, "script\n"));
+			for (int i = 0; i < block_lines; i++) {
+				nih_local char *word = NULL;
+
+				word = NIH_MUST (random_word (NULL));
+				NIH_MUST (nih_strcat_sprintf (
+						  &line, NULL,
+						  "    echo %s >> /tmp/log\n",
+						  word));
+			}
+			NIH_MUST (nih_strcat (&line, NULL, "end script\n"));
+
+		} else {
+			line = NIH_MUST (nih_strdup (
+						 NULL,
+						 stanza_names[rand () % N_ELEMENTS (stanza_names)]));
+			for (int i = rand () % 6; i >= 0; i--) {
+				nih_local char *word = NULL;
+
+				word = NIH_MUST (random_word (NULL));
+				NIH_MUST (nih_strcat_sprintf (&line, NULL,
+							      " %s", word));
+			}
+			if (percent (comment_percent))
+				NIH_MUST (nih_strcat (&line, NULL,
+						      "  # trailing comment"));
+			NIH_MUST (nih_strcat (&line, NULL, "\n"));
+		}
+
+		linelen = strlen (line);
+		while (*len + linelen + 1 > corpus_size) {
+			corpus_size *= 2;
+			corpus = NIH_MUST (nih_realloc (corpus, parent,
+							corpus_size));
+		}
+
+		memcpy (corpus + *len, line, linelen + 1);
+		*len += linelen;
+	}
+
+	return corpus;
+}
+
+
+/**
+ * now:
+ *
+ * Returns: current monotonic time in seconds.
+ **/
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * bench_parse_file:
+ * @corpus: corpus to parse,
+ * @len: length of @corpus,
+ * @ntokens: pointer to store number of tokens.
+ *
+ * Parses @corpus with nih_config_parse_file() and the stanza handlers
+ * above, which call nih_config_parse_args(), nih_config_parse_command()
+ * and nih_config_parse_block().
+ **/
+static void
+bench_parse_file (const char    *corpus,
+		  size_t         len,
+		  unsigned long *ntokens)
+{
+	size_t lineno = 1;
+
+	tokens = 0;
+	if (nih_config_parse_file (corpus, len, NULL, &lineno,
+				   stanzas, NULL) < 0) {
+		NihError *err;
+
+		err = nih_error_get ();
+		nih_fatal ("corpus:%zu: %s", lineno, err->message);
+		exit (1);
+	}
+
+	*ntokens = tokens;
+}
+
+/**
+ * bench_token:
+ * @corpus: corpus to parse,
+ * @len: length of @corpus,
+ * @ntokens: pointer to store number of tokens.
+ *
+ * Scans @corpus with nih_config_token() alone, without allocating or
+ * copying any tokens or calling any handlers; this measures the raw
+ * speed of the tokeniser.
+ **/
+static void
+bench_token (const char    *corpus,
+	     size_t         len,
+	     unsigned long *ntokens)
+{
+	size_t pos = 0, lineno = 1;
+
+	*ntokens = 0;
+	while (pos < len) {
+		size_t toklen;
+
+		nih_config_skip_whitespace (corpus, len, &pos, &lineno);
+		if (! nih_config_has_token (corpus, len, &pos, &lineno)) {
+			if (nih_config_skip_comment (corpus, len,
+						     &pos, &lineno) < 0)
+				nih_assert_not_reached ();
+			continue;
+		}
+
+		if (nih_config_token (corpus, len, &pos, &lineno, NULL,
+				      NIH_CONFIG_CNLWS, TRUE, &toklen) < 0) {
+			NihError *err;
+
+			err = nih_error_get ();
+			nih_fatal ("corpus:%zu: %s", lineno, err->message);
+			exit (1);
+		}
+
+		(*ntokens)++;
+	}
+}
+
+/**
+ * run_bench:
+ * @result: result to fill in,
+ * @name: name of benchmark,
+ * @func: benchmark function,
+ * @corpus: corpus to parse,
+ * @len: length of @corpus.
+ *
+ * Runs @func over @corpus iterations times, taking the best time, and
+ * fills in @result.
+ **/
+static void
+run_bench (BenchResult   *result,
+	   const char    *name,
+	   void         (*func) (const char *, size_t, unsigned long *),
+	   const char    *corpus,
+	   size_t         len)
+{
+	double        best = 0.0;
+	unsigned long ntokens = 0, nallocs = 0;
+
+	for (int i = 0; i < iterations; i++) {
+		double start, elapsed;
+
+		allocs = 0;
+		__nih_malloc = count_malloc;
+		__nih_realloc = count_realloc;
+
+		start = now ();
+		func (corpus, len, &ntokens);
+		elapsed = now () - start;
+
+		__nih_malloc = malloc;
+		__nih_realloc = realloc;
+		nallocs = allocs;
+
+		if ((! i) || (elapsed < best))
+			best = elapsed;
+	}
+
+	result->name = name;
+	result->mbps = len / best / (1024.0 * 1024.0);
+	result->tokens = ntokens / best;
+	result->allocs = ntokens ? (double)nallocs / ntokens : 0.0;
+}
+
+
+/**
+ * save_results:
+ * @filename: file to write,
+ * @results: results to save,
+ * @nresults: number of entries in @results.
+ *
+ * Saves @results to @filename so they may be used as a baseline later.
+ **/
+static void
+save_results (const char  *filename,
+	      BenchResult *results,
+	      size_t       nresults)
+{
+	FILE *fp;
+
+	fp = fopen (filename, "w");
+	if (! fp) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+
+	for (size_t i = 0; i < nresults; i++)
+		fprintf (fp, "%s %f %f %f\n", results[i].name,
+			 results[i].mbps, results[i].tokens,
+			 results[i].allocs);
+
+	if (fclose (fp) < 0) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+}
+
+/**
+ * compare_results:
+ * @filename: baseline file to read,
+ * @results: results to compare,
+ * @nresults: number of entries in @results.
+ *
+ * Prints the change in each of @results against the baseline results
+ * saved in @filename.
+ **/
+static void
+compare_results (const char  *filename,
+		 BenchResult *results,
+		 size_t       nresults)
+{
+	FILE   *fp;
+	char    name[64];
+	double  mbps, ntokens, nallocs;
+
+	fp = fopen (filename, "r");
+	if (! fp) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+
+	printf ("\n%-12s %10s %10s %10s\n", "vs baseline", "MB/s",
+		"tokens/s", "allocs");
+	while (fscanf (fp, "%63s %lf %lf %lf", name,
+		       &mbps, &ntokens, &nallocs) == 4) {
+		for (size_t i = 0; i < nresults; i++) {
+			if (strcmp (results[i].name, name))
+				continue;
+
+			printf ("%-12s %+9.1f%% %+9.1f%% %+9.1f%%\n", name,
+				(results[i].mbps - mbps) / mbps * 100.0,
+				(results[i].tokens - ntokens) / ntokens * 100.0,
+				(nallocs ? ((results[i].allocs - nallocs)
+					    / nallocs * 100.0) : 0.0));
+		}
+	}
+
+	fclose (fp);
+}
+
+
+/**
+ * options:
+ *
+ * Command-line options accepted by this program.
+ **/
+static NihOption options[] = {
+	{ 0, "size", N_("size of corpus to generate in bytes"),
+	  NULL, "BYTES", &size, nih_option_int },
+	{ 0, "quote-percent", N_("percentage of arguments quoted"),
+	  NULL, "PCT", &quote_percent, nih_option_int },
+	{ 0, "comment-percent", N_("percentage of lines that are comments"),
+	  NULL, "PCT", &comment_percent, nih_option_int },
+	{ 0, "block-percent", N_("percentage of stanzas that are blocks"),
+	  NULL, "PCT", &block_percent, nih_option_int },
+	{ 0, "block-lines", N_("number of lines in each block"),
+	  NULL, "LINES", &block_lines, nih_option_int },
+	{ 0, "iterations", N_("number of runs of each benchmark"),
+	  NULL, "N", &iterations, nih_option_int },
+	{ 0, "seed", N_("seed for corpus generator"),
+	  NULL, "N", &seed, nih_option_int },
+	{ 0, "save", N_("save results to FILE"),
+	  NULL, "FILE", &save_file, NULL },
+	{ 0, "baseline", N_("compare results with those saved in FILE"),
+	  NULL, "FILE", &baseline_file, NULL },
+
+	NIH_OPTION_LAST
+};
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char **          args;
+	nih_local char * corpus = NULL;
+	size_t           len;
+	BenchResult      results[2];
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_synopsis (_("Benchmark the configuration parser"));
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	if ((size <= 0) || (iterations <= 0) || (block_lines < 0)) {
+		fprintf (stderr, _("%s: invalid benchmark parameters\n"),
+			 program_name);
+		nih_main_suggest_help ();
+		exit (1);
+	}
+
+	corpus = generate_corpus (NULL, &len);
+
+	printf ("corpus: %zu bytes, %d%% quoted, %d%% comments, "
+		"%d%% blocks of %d lines\n\n", len, quote_percent,
+		comment_percent, block_percent, block_lines);
+
+	run_bench (&results[0], "parse_file", bench_parse_file, corpus, len);
+	run_bench (&results[1], "token", bench_token, corpus, len);
+
+	printf ("%-12s %10s %10s %10s\n", "benchmark", "MB/s",
+		"tokens/s", "allocs");
+	for (size_t i = 0; i < N_ELEMENTS (results); i++)
+		printf ("%-12s %10.1f %10.0f %10.2f\n", results[i].name,
+			results[i].mbps, results[i].tokens,
+			results[i].allocs);
+
+	if (baseline_file)
+		compare_results (baseline_file, results,
+				 N_ELEMENTS (results));
+
+	if (save_file)
+		save_results (save_file, results, N_ELEMENTS (results));
+
+	return 0;
+}
@@ -0,0 +1,613 @@
+/* libnih
+ *
+ * bench_hash.c - benchmark for nih/hash.c and nih/flat_hash.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Times inserting, looking up, iterating and removing string keys in
+ * NihHash and NihFlatHash tables of 1,000, 100,000 and 1,000,000 entries,
+ * and iterating tables sized for that many that hold only a few,
+ * reporting millions of operations per second for each.  Results may be
+ * saved and compared against later runs in the same way as bench_config:
+ *
+ *   make bench_hash
+ *   ./bench_hash --save=before.txt
+ *   ... make changes ...
+ *   ./bench_hash --baseline=before.txt
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/list.h>
+#include <nih/hash.h>
+#include <nih/flat_hash.h>
+#include <nih/main.h>
+#include <nih/option.h>
+#include <nih/logging.h>
+
+
+/**
+ * N_ELEMENTS:
+ * @_array: array.
+ *
+ * Returns: number of elements in @_array.
+ **/
+#define N_ELEMENTS(_array) (sizeof (_array) / sizeof ((_array)[0]))
+
+
+/**
+ * BenchEntry:
+ * @list: list header,
+ * @key: string key.
+ *
+ * Entry placed in the NihHash tables.
+ **/
+typedef struct bench_entry {
+	NihList     list;
+	const char *key;
+} BenchEntry;
+
+/**
+ * BenchResult:
+ * @name: name of benchmark,
+ * @mops: millions of operations per second.
+ *
+ * Result of a single benchmark, as printed and saved.
+ **/
+typedef struct bench_result {
+	char   *name;
+	double  mops;
+} BenchResult;
+
+/**
+ * BenchFunc:
+ * @n: number of entries.
+ *
+ * Function performing @n operations, returning the time taken to do so
+ * in seconds.
+ **/
+typedef double (*BenchFunc) (size_t n);
+
+
+/**
+ * sizes:
+ *
+ * Number of entries in each table benchmarked.
+ **/
+static const size_t sizes[] = { 1000, 100000, 1000000 };
+
+/**
+ * iterations:
+ *
+ * Number of times to run each benchmark, the best time is taken.
+ **/
+static int iterations = 5;
+
+/**
+ * save_file:
+ *
+ * File to save results to.
+ **/
+static char *save_file = NULL;
+
+/**
+ * baseline_file:
+ *
+ * File to load baseline results from for comparison.
+ **/
+static char *baseline_file = NULL;
+
+
+/**
+ * keys:
+ *
+ * Keys of entries in the tables, resembling D-Bus object paths.
+ **/
+static char **keys = NULL;
+
+/**
+ * missing:
+ *
+ * Keys that are not in the tables, with the same length as @keys.
+ **/
+static char **missing = NULL;
+
+/**
+ * entries:
+ *
+ * Entries for the NihHash tables, allocated before timing begins.
+ **/
+static BenchEntry **entries = NULL;
+
+/**
+ * hash:
+ *
+ * NihHash being benchmarked.
+ **/
+static NihHash *hash = NULL;
+
+/**
+ * flat_hash:
+ *
+ * NihFlatHash being benchmarked.
+ **/
+static NihFlatHash *flat_hash = NULL;
+
+/**
+ * SPARSE_ENTRIES:
+ *
+ * Number of entries placed in a table sized for many more by the sparse
+ * iteration benchmark.
+ **/
+#define SPARSE_ENTRIES 30
+
+/**
+ * SPARSE_PASSES:
+ *
+ * Number of times the sparse table is iterated, the time taken is scaled
+ * as if the number of entries the table was sized for had been visited.
+ **/
+#define SPARSE_PASSES 100
+
+/**
+ * sink:
+ *
+ * Results of lookups are stored here so they cannot be optimised away.
+ **/
+static volatile size_t sink = 0;
+
+
+/**
+ * now:
+ *
+ * Returns: current monotonic time in seconds.
+ **/
+static double
+now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * generate_keys:
+ * @n: number of keys.
+ *
+ * Generates @n keys and @n missing keys, along with an entry for each
+ * key, into the global arrays.
+ **/
+static void
+generate_keys (size_t n)
+{
+	keys = NIH_MUST (nih_alloc (NULL, sizeof (char *) * n));
+	missing = NIH_MUST (nih_alloc (NULL, sizeof (char *) * n));
+	entries = NIH_MUST (nih_alloc (NULL, sizeof (BenchEntry *) * n));
+
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = NIH_MUST (nih_sprintf (
+					    keys, "/com/ubuntu/Upstart/jobs/%08zx/_",
+					    i * 2654435761U));
+		missing[i] = NIH_MUST (nih_sprintf (
+					       missing, "/com/ubuntu/Upstart/jobs/%08zx/x",
+					       i * 2654435761U));
+
+		entries[i] = NIH_MUST (nih_new (entries, BenchEntry));
+		nih_list_init (&entries[i]->list);
+		entries[i]->key = keys[i];
+	}
+}
+
+
+static double
+hash_insert (size_t n)
+{
+	double start;
+
+	hash = NIH_MUST (nih_hash_string_new (NULL, n));
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		nih_hash_add (hash, &entries[i]->list);
+
+	return now () - start;
+}
+
+static double
+hash_lookup (size_t n)
+{
+	double start;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		sink += (nih_hash_lookup (hash, keys[i]) != NULL);
+
+	return now () - start;
+}
+
+static double
+hash_miss (size_t n)
+{
+	double start;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		sink += (nih_hash_lookup (hash, missing[i]) != NULL);
+
+	return now () - start;
+}
+
+static double
+hash_iterate (size_t n)
+{
+	double start;
+
+	start = now ();
+	NIH_HASH_FOREACH (hash, iter)
+		sink++;
+
+	return now () - start;
+}
+
+static double
+hash_remove (size_t n)
+{
+	double start, elapsed;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		nih_list_remove (nih_hash_lookup (hash, keys[i]));
+	elapsed = now () - start;
+
+	nih_free (hash);
+	hash = NULL;
+
+	return elapsed;
+}
+
+static double
+hash_sparse (size_t n)
+{
+	double start, elapsed;
+
+	hash = NIH_MUST (nih_hash_string_new (NULL, n));
+	for (size_t i = 0; i < SPARSE_ENTRIES; i++)
+		nih_hash_add (hash, &entries[i]->list);
+
+	start = now ();
+	for (size_t i = 0; i < SPARSE_PASSES; i++)
+		NIH_HASH_FOREACH (hash, iter)
+			sink++;
+	elapsed = now () - start;
+
+	for (size_t i = 0; i < SPARSE_ENTRIES; i++)
+		nih_list_remove (&entries[i]->list);
+
+	nih_free (hash);
+	hash = NULL;
+
+	return elapsed * n / (SPARSE_PASSES * SPARSE_ENTRIES);
+}
+
+
+static double
+flat_insert (size_t n)
+{
+	double start;
+
+	flat_hash = NIH_MUST (nih_flat_hash_string_new (NULL, n));
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		if (nih_flat_hash_insert (flat_hash, keys[i], entries[i]) < 0)
+			nih_assert_not_reached ();
+
+	return now () - start;
+}
+
+static double
+flat_lookup (size_t n)
+{
+	double start;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		sink += (nih_flat_hash_lookup (flat_hash, keys[i]) != NULL);
+
+	return now () - start;
+}
+
+static double
+flat_miss (size_t n)
+{
+	double start;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		sink += (nih_flat_hash_lookup (flat_hash, missing[i]) != NULL);
+
+	return now () - start;
+}
+
+static double
+flat_iterate (size_t n)
+{
+	double start;
+
+	start = now ();
+	NIH_FLAT_HASH_FOREACH (flat_hash, iter)
+		sink++;
+
+	return now () - start;
+}
+
+static double
+flat_remove (size_t n)
+{
+	double start, elapsed;
+
+	start = now ();
+	for (size_t i = 0; i < n; i++)
+		nih_flat_hash_erase (flat_hash, keys[i]);
+	elapsed = now () - start;
+
+	nih_free (flat_hash);
+	flat_hash = NULL;
+
+	return elapsed;
+}
+
+static double
+flat_sparse (size_t n)
+{
+	double start, elapsed;
+
+	flat_hash = NIH_MUST (nih_flat_hash_string_new (NULL, n));
+	for (size_t i = 0; i < SPARSE_ENTRIES; i++)
+		if (nih_flat_hash_insert (flat_hash, keys[i], entries[i]) < 0)
+			nih_assert_not_reached ();
+
+	start = now ();
+	for (size_t i = 0; i < SPARSE_PASSES; i++)
+		NIH_FLAT_HASH_FOREACH (flat_hash, iter)
+			sink++;
+	elapsed = now () - start;
+
+	nih_free (flat_hash);
+	flat_hash = NULL;
+
+	return elapsed * n / (SPARSE_PASSES * SPARSE_ENTRIES);
+}
+
+
+/**
+ * benchmarks:
+ *
+ * Benchmarks run for each table, in order; the insert benchmark creates
+ * the table and the remove benchmark frees it.  The sparse benchmark
+ * iterates a separate table sized for the same number of entries, but
+ * holding only SPARSE_ENTRIES of them.
+ **/
+static const struct {
+	const char *name;
+	BenchFunc   hash;
+	BenchFunc   flat;
+} benchmarks[] = {
+	{ "insert",  hash_insert,  flat_insert },
+	{ "lookup",  hash_lookup,  flat_lookup },
+	{ "miss",    hash_miss,    flat_miss },
+	{ "iterate", hash_iterate, flat_iterate },
+	{ "remove",  hash_remove,  flat_remove },
+	{ "sparse",  hash_sparse,  flat_sparse },
+};
+
+
+/**
+ * run_table:
+ * @results: results to fill in,
+ * @table: name of table,
+ * @flat: TRUE to benchmark NihFlatHash,
+ * @n: number of entries.
+ *
+ * Runs each of the benchmarks for a table of @n entries iterations times,
+ * taking the best time for each, and fills in @results.
+ **/
+static void
+run_table (BenchResult *results,
+	   const char  *table,
+	   int          flat,
+	   size_t       n)
+{
+	double best[N_ELEMENTS (benchmarks)];
+
+	for (int i = 0; i < iterations; i++) {
+		for (size_t j = 0; j < N_ELEMENTS (benchmarks); j++) {
+			double elapsed;
+
+			elapsed = (flat ? benchmarks[j].flat
+				   : benchmarks[j].hash) (n);
+
+			if ((! i) || (elapsed < best[j]))
+				best[j] = elapsed;
+		}
+	}
+
+	for (size_t j = 0; j < N_ELEMENTS (benchmarks); j++) {
+		results[j].name = NIH_MUST (nih_sprintf (NULL, "%s/%s/%zu",
+							 table,
+							 benchmarks[j].name,
+							 n));
+		results[j].mops = n / best[j] / 1e6;
+	}
+}
+
+
+/**
+ * save_results:
+ * @filename: file to write,
+ * @results: results to save,
+ * @nresults: number of entries in @results.
+ *
+ * Saves @results to @filename so they may be used as a baseline later.
+ **/
+static void
+save_results (const char  *filename,
+	      BenchResult *results,
+	      size_t       nresults)
+{
+	FILE *fp;
+
+	fp = fopen (filename, "w");
+	if (! fp) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+
+	for (size_t i = 0; i < nresults; i++)
+		fprintf (fp, "%s %f\n", results[i].name, results[i].mops);
+
+	if (fclose (fp) < 0) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+}
+
+/**
+ * compare_results:
+ * @filename: baseline file to read,
+ * @results: results to compare,
+ * @nresults: number of entries in @results.
+ *
+ * Prints the change in each of @results against the baseline results
+ * saved in @filename.
+ **/
+static void
+compare_results (const char  *filename,
+		 BenchResult *results,
+		 size_t       nresults)
+{
+	FILE   *fp;
+	char    name[64];
+	double  mops;
+
+	fp = fopen (filename, "r");
+	if (! fp) {
+		nih_fatal ("%s: %s", filename, strerror (errno));
+		exit (1);
+	}
+
+	printf ("\n%-28s %10s\n", "vs baseline", "Mops/s");
+	while (fscanf (fp, "%63s %lf", name, &mops) == 2) {
+		for (size_t i = 0; i < nresults; i++) {
+			if (strcmp (results[i].name, name))
+				continue;
+
+			printf ("%-28s %+9.1f%%\n", name,
+				(results[i].mops - mops) / mops * 100.0);
+		}
+	}
+
+	fclose (fp);
+}
+
+
+/**
+ * options:
+ *
+ * Command-line options accepted by this program.
+ **/
+static NihOption options[] = {
+	{ 0, "iterations", N_("number of runs of each benchmark"),
+	  NULL, "N", &iterations, nih_option_int },
+	{ 0, "save", N_("save results to FILE"),
+	  NULL, "FILE", &save_file, NULL },
+	{ 0, "baseline", N_("compare results with those saved in FILE"),
+	  NULL, "FILE", &baseline_file, NULL },
+
+	NIH_OPTION_LAST
+};
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	char **     args;
+	BenchResult results[N_ELEMENTS (sizes) * 2 * N_ELEMENTS (benchmarks)];
+	size_t      nresults = 0;
+
+	nih_main_init (argv[0]);
+
+	nih_option_set_synopsis (_("Benchmark the hash table implementations"));
+
+	args = nih_option_parser (NULL, argc, argv, options, FALSE);
+	if (! args)
+		exit (1);
+
+	if (iterations <= 0) {
+		fprintf (stderr, _("%s: invalid benchmark parameters\n"),
+			 program_name);
+		nih_main_suggest_help ();
+		exit (1);
+	}
+
+	generate_keys (sizes[N_ELEMENTS (sizes) - 1]);
+
+	printf ("%-28s %10s %10s\n", "benchmark", "Mops/s", "vs hash");
+	for (size_t i = 0; i < N_ELEMENTS (sizes); i++) {
+		BenchResult *hash_results = &results[nresults];
+		BenchResult *flat_results;
+
+		run_table (hash_results, "hash", FALSE, sizes[i]);
+		nresults += N_ELEMENTS (benchmarks);
+
+		flat_results = &results[nresults];
+		run_table (flat_results, "flat_hash", TRUE, sizes[i]);
+		nresults += N_ELEMENTS (benchmarks);
+
+		for (size_t j = 0; j < N_ELEMENTS (benchmarks); j++)
+			printf ("%-28s %10.2f\n", hash_results[j].name,
+				hash_results[j].mops);
+		for (size_t j = 0; j < N_ELEMENTS (benchmarks); j++)
+			printf ("%-28s %10.2f %9.2fx\n", flat_results[j].name,
+				flat_results[j].mops,
+				flat_results[j].mops / hash_results[j].mops);
+	}
+
+	if (baseline_file)
+		compare_results (baseline_file, results, nresults);
+
+	if (save_file)
+		save_results (save_file, results, nresults);
+
+	return 0;
+}
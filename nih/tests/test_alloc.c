@@ -766,6 +766,50 @@ test_parent (void)
 	nih_free (ptr2);
 }
 
+void
+test_shared (void)
+{
+	void *ptr1;
+	void *ptr2;
+	void *ptr3;
+
+	TEST_FUNCTION ("nih_alloc_shared");
+
+
+	/* Check that an object with a single parent, including the NULL
+	 * parent, is not shared.
+	 */
+	TEST_FEATURE ("with one parent");
+	ptr1 = nih_alloc (NULL, 10);
+	ptr2 = nih_alloc (ptr1, 10);
+
+	TEST_FALSE (nih_alloc_shared (ptr1));
+	TEST_FALSE (nih_alloc_shared (ptr2));
+
+	nih_free (ptr1);
+
+
+	/* Check that an object referenced by a second parent is shared,
+	 * and is no longer once that reference is removed.
+	 */
+	TEST_FEATURE ("with two parents");
+	ptr1 = nih_alloc (NULL, 10);
+	ptr2 = nih_alloc (ptr1, 10);
+	ptr3 = nih_alloc (NULL, 10);
+
+	nih_ref (ptr2, ptr3);
+
+	TEST_TRUE (nih_alloc_shared (ptr2));
+
+	nih_unref (ptr2, ptr1);
+
+	TEST_FALSE (nih_alloc_shared (ptr2));
+	TEST_ALLOC_PARENT (ptr2, ptr3);
+
+	nih_free (ptr1);
+	nih_free (ptr3);
+}
+
 
 void
 test_local (void)
@@ -833,6 +877,7 @@ main (int   argc,
 	test_ref ();
 	test_unref ();
 	test_parent ();
+	test_shared ();
 	test_local ();
 
 	return 0;
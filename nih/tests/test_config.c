@@ -21,6 +21,8 @@
 
 #include <nih/test.h>
 
+#include <sys/stat.h>
+
 #include <errno.h>
 #include <limits.h>
 #include <unistd.h>
@@ -2914,6 +2916,294 @@ test_parse (void)
 	unlink (filename);
 }
 
+void
+test_parse_cached (void)
+{
+	FILE            *fd;
+	char             filename[PATH_MAX], cachename[PATH_MAX];
+	size_t           pos, lineno;
+	struct stat      statbuf;
+	NihConfigStanza  no_stanzas[] = { NIH_CONFIG_LAST };
+	NihError        *err;
+	char             buf[1024];
+	size_t           len, i;
+	int              ret, parsed;
+
+	TEST_FUNCTION ("nih_config_parse_cached");
+	TEST_FILENAME (filename);
+	TEST_FILENAME (cachename);
+
+	fd = fopen (filename, "w");
+	fprintf (fd, "# first line comment\n");
+	fprintf (fd, "\n");
+	fprintf (fd, "frodo test\n");
+	fprintf (fd, "  bilbo test\n");
+	fclose (fd);
+
+
+	/* Check that a file without a cache is parsed, with the handlers
+	 * called and zero returned, and that the cache is written out.
+	 */
+	TEST_FEATURE ("without cache");
+	handler_called = 0;
+	last_data = NULL;
+	last_file = NULL;
+	last_len = 0;
+	last_pos = -1;
+	last_lineno = 0;
+
+	pos = 0;
+	lineno = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, &pos, &lineno,
+				       stanzas, &ret);
+
+	TEST_EQ (ret, 0);
+
+	TEST_EQ (handler_called, 2);
+	TEST_EQ_P (last_data, &ret);
+	TEST_NE_P (last_file, NULL);
+	TEST_EQ (last_len, 46);
+	TEST_EQ (last_pos, 41);
+	TEST_EQ (last_lineno, 4);
+
+	TEST_EQ (pos, 46);
+	TEST_EQ (lineno, 5);
+
+	TEST_EQ (stat (cachename, &statbuf), 0);
+
+
+	/* Check that when the cache is valid it is replayed, with the
+	 * handlers called with the same arguments as parsing the text.
+	 * The name of the second stanza in the cache is changed, which
+	 * leaves the cache valid, so that we can tell that the handler was
+	 * called from the cache rather than from the text.
+	 */
+	TEST_FEATURE ("with valid cache");
+	fd = fopen (cachename, "r+");
+	TEST_NE_P (fd, NULL);
+	len = fread (buf, 1, sizeof (buf), fd);
+	TEST_GT (len, 0);
+
+	for (i = 0; i + 5 <= len; i++)
+		if (! memcmp (buf + i, "bilbo", 5))
+			break;
+	TEST_LE (i + 5, len);
+
+	fseek (fd, i, SEEK_SET);
+	fwrite ("frodo", 1, 5, fd);
+	fclose (fd);
+
+	handler_called = 0;
+	last_data = NULL;
+	last_stanza = NULL;
+	last_file = NULL;
+	last_len = 0;
+	last_pos = -1;
+	last_lineno = 0;
+
+	pos = 0;
+	lineno = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, &pos, &lineno,
+				       stanzas, &ret);
+
+	TEST_EQ (ret, 0);
+
+	TEST_EQ (handler_called, 2);
+	TEST_EQ_P (last_data, &ret);
+	TEST_NE_P (last_file, NULL);
+	TEST_EQ_P (last_stanza, &stanzas[2]);
+	TEST_EQ (last_len, 46);
+	TEST_EQ (last_pos, 41);
+	TEST_EQ (last_lineno, 4);
+
+	TEST_EQ (pos, 46);
+	TEST_EQ (lineno, 5);
+
+
+	/* Check that a cache for a different version of the file is
+	 * ignored, the text parsed instead and the cache replaced.
+	 */
+	TEST_FEATURE ("with stale cache");
+	fd = fopen (filename, "a");
+	fprintf (fd, "frodo again\n");
+	fclose (fd);
+
+	handler_called = 0;
+	last_data = NULL;
+	last_file = NULL;
+	last_len = 0;
+	last_pos = -1;
+	last_lineno = 0;
+
+	pos = 0;
+	lineno = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, &pos, &lineno,
+				       stanzas, &ret);
+
+	TEST_EQ (ret, 0);
+
+	TEST_EQ (handler_called, 3);
+	TEST_EQ (last_len, 58);
+	TEST_EQ (last_pos, 52);
+	TEST_EQ (last_lineno, 5);
+
+	TEST_EQ (pos, 58);
+	TEST_EQ (lineno, 6);
+
+	handler_called = 0;
+	ret = nih_config_parse_cached (filename, cachename, NULL, NULL,
+				       stanzas, &ret);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (handler_called, 3);
+	TEST_EQ (last_pos, 52);
+	TEST_EQ (last_lineno, 5);
+
+
+	/* Check that a cache that isn't valid is ignored and the text
+	 * parsed instead.
+	 */
+	TEST_FEATURE ("with corrupt cache");
+	fd = fopen (cachename, "w");
+	fprintf (fd, "NIHCFGC this is not a cache\n");
+	fclose (fd);
+
+	handler_called = 0;
+	last_pos = -1;
+	last_lineno = 0;
+
+	pos = 0;
+	lineno = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, &pos, &lineno,
+				       stanzas, &ret);
+
+	TEST_EQ (ret, 0);
+
+	TEST_EQ (handler_called, 3);
+	TEST_EQ (last_pos, 52);
+	TEST_EQ (last_lineno, 5);
+
+	TEST_EQ (pos, 58);
+	TEST_EQ (lineno, 6);
+
+
+	/* Check that a cache naming a stanza that is no longer known is
+	 * ignored and the text parsed instead, so the error is raised
+	 * before any handler is called.
+	 */
+	TEST_FEATURE ("with unknown stanza in cache");
+	handler_called = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, NULL, NULL,
+				       no_stanzas, &ret);
+
+	TEST_LT (ret, 0);
+	TEST_EQ (handler_called, 0);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNKNOWN_STANZA);
+	nih_free (err);
+
+	unlink (cachename);
+
+
+	/* Check that running out of memory while recording the stanzas
+	 * for the cache doesn't stop the file being parsed; only running
+	 * out while reading or tokenising the file itself is an error.
+	 * Failing to allocate the builder, its array or any of the three
+	 * stanza names should each still parse the file.
+	 */
+	TEST_FEATURE ("with insufficient memory to record cache");
+	parsed = 0;
+	TEST_ALLOC_FAIL {
+		handler_called = 0;
+		last_pos = -1;
+		last_lineno = 0;
+
+		pos = 0;
+		lineno = 0;
+
+		ret = nih_config_parse_cached (filename, cachename,
+					       &pos, &lineno, stanzas, &ret);
+
+		if (test_alloc_failed && (ret < 0)) {
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+
+			unlink (cachename);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+
+		TEST_EQ (handler_called, 3);
+		TEST_EQ (last_pos, 52);
+		TEST_EQ (last_lineno, 5);
+
+		TEST_EQ (pos, 58);
+		TEST_EQ (lineno, 6);
+
+		if (test_alloc_failed)
+			parsed++;
+
+		unlink (cachename);
+	}
+
+	TEST_GE (parsed, 5);
+
+
+	/* Check that a parser error is raised with the position and line
+	 * number set to where it was found, and that no cache is written.
+	 */
+	TEST_FEATURE ("with parser error");
+	fd = fopen (filename, "w");
+	fprintf (fd, "frodo test\n");
+	fprintf (fd, "\"bilbo test\n");
+	fclose (fd);
+
+	handler_called = 0;
+
+	pos = 0;
+	lineno = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, &pos, &lineno,
+				       stanzas, &ret);
+
+	TEST_LT (ret, 0);
+	TEST_EQ (handler_called, 1);
+
+	TEST_EQ (pos, 23);
+	TEST_EQ (lineno, 3);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, NIH_CONFIG_UNTERMINATED_QUOTE);
+	nih_free (err);
+
+	TEST_LT (stat (cachename, &statbuf), 0);
+
+	unlink (filename);
+
+
+	/* Check that an error is raised if the file doesn't exist. */
+	TEST_FEATURE ("with non-existant file");
+	handler_called = 0;
+
+	ret = nih_config_parse_cached (filename, cachename, NULL, NULL,
+				       stanzas, &ret);
+
+	TEST_LT (ret, 0);
+	TEST_FALSE (handler_called);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, ENOENT);
+	nih_free (err);
+}
+
 
 int
 main (int   argc,
@@ -2933,6 +3223,7 @@ main (int   argc,
 	test_parse_stanza ();
 	test_parse_file ();
 	test_parse ();
+	test_parse_cached ();
 
 	return 0;
 }
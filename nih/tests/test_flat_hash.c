@@ -0,0 +1,430 @@
+/* libnih
+ *
+ * test_flat_hash.c - test suite for nih/flat_hash.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/string.h>
+#include <nih/hash.h>
+#include <nih/flat_hash.h>
+
+
+static uint32_t
+my_hash_function (const void *key)
+{
+	/* Every key hashes to the same group and control byte, so every
+	 * lookup has to compare keys.
+	 */
+	return 0;
+}
+
+
+void
+test_new (void)
+{
+	NihFlatHash *hash;
+
+	TEST_FUNCTION ("nih_flat_hash_new");
+
+	/* Check that we can create a small hash table; a single group of
+	 * slots should be allocated as a child of the hash table, with
+	 * all of the slots empty.
+	 */
+	TEST_FEATURE ("with zero size");
+	TEST_ALLOC_FAIL {
+		hash = nih_flat_hash_new (NULL, 0,
+					  (NihHashFunction)nih_hash_string_hash,
+					  (NihCmpFunction)nih_hash_string_cmp);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (hash, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (hash, sizeof (NihFlatHash));
+		TEST_EQ_P (hash->hash_function,
+			   (NihHashFunction)nih_hash_string_hash);
+		TEST_EQ_P (hash->cmp_function,
+			   (NihCmpFunction)nih_hash_string_cmp);
+
+		TEST_EQ (hash->capacity, NIH_FLAT_HASH_GROUP);
+		TEST_EQ (hash->entries, 0);
+		TEST_EQ (hash->growth_left, 7);
+		TEST_ALLOC_PARENT (hash->slots, hash);
+
+		for (size_t i = 0; i < hash->capacity; i++)
+			TEST_EQ (hash->ctrl[i], NIH_FLAT_HASH_EMPTY);
+
+		nih_free (hash);
+	}
+
+
+	/* Check that a larger size allocates enough slots to hold that
+	 * many entries, rounded up to a power of two.
+	 */
+	TEST_FEATURE ("with larger size");
+	TEST_ALLOC_FAIL {
+		hash = nih_flat_hash_string_new (NULL, 600);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (hash, NULL);
+			continue;
+		}
+
+		TEST_EQ (hash->capacity, 1024);
+		TEST_EQ (hash->min_capacity, 1024);
+		TEST_EQ (hash->growth_left, 896);
+
+		nih_free (hash);
+	}
+}
+
+void
+test_insert (void)
+{
+	NihFlatHash *hash;
+	char        *keys[100];
+	int          ret, value1, value2;
+
+	TEST_FUNCTION ("nih_flat_hash_insert");
+	hash = nih_flat_hash_string_new (NULL, 0);
+
+
+	/* Check that inserting an entry places it into a slot whose
+	 * control byte holds the low bits of the hash.
+	 */
+	TEST_FEATURE ("with new entry");
+	ret = nih_flat_hash_insert (hash, "entry 1", &value1);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (hash->entries, 1);
+	TEST_EQ (hash->growth_left, 6);
+
+	for (size_t i = 0; i < hash->capacity; i++) {
+		if (! NIH_FLAT_HASH_FULL (hash->ctrl[i]))
+			continue;
+
+		TEST_EQ (hash->ctrl[i],
+			 nih_hash_string_hash ("entry 1") & 0x7f);
+		TEST_EQ_STR ((const char *)hash->slots[i].key, "entry 1");
+		TEST_EQ_P (hash->slots[i].value, &value1);
+	}
+
+
+	/* Check that inserting an entry with the same key replaces the
+	 * value of the existing entry.
+	 */
+	TEST_FEATURE ("with existing key");
+	ret = nih_flat_hash_insert (hash, "entry 1", &value2);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (hash->entries, 1);
+	TEST_EQ_P (nih_flat_hash_lookup (hash, "entry 1"), &value2);
+
+	nih_free (hash);
+
+
+	/* Check that inserting more entries than fit in the table grows
+	 * it, keeping all of the entries; and that if the allocation
+	 * fails, the table is left unchanged.
+	 */
+	TEST_FEATURE ("with full table");
+	for (int i = 0; i < 100; i++)
+		keys[i] = NIH_MUST (nih_sprintf (NULL, "entry %d", i));
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			hash = nih_flat_hash_string_new (NULL, 0);
+			for (int i = 0; i < 7; i++)
+				assert0 (nih_flat_hash_insert (hash, keys[i],
+							       keys[i]));
+		}
+
+		ret = nih_flat_hash_insert (hash, keys[7], keys[7]);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (hash->capacity, 8);
+			TEST_EQ (hash->entries, 7);
+			TEST_EQ_P (nih_flat_hash_lookup (hash, keys[7]), NULL);
+
+			nih_free (hash);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (hash->capacity, 16);
+		TEST_EQ (hash->entries, 8);
+
+		for (int i = 0; i < 8; i++)
+			TEST_EQ_P (nih_flat_hash_lookup (hash, keys[i]),
+				   keys[i]);
+
+		nih_free (hash);
+	}
+
+
+	/* Check that many entries which all hash to the same value can
+	 * be inserted and found again.
+	 */
+	TEST_FEATURE ("with colliding keys");
+	hash = nih_flat_hash_new (NULL, 0, my_hash_function,
+				  (NihCmpFunction)nih_hash_string_cmp);
+
+	for (int i = 0; i < 100; i++) {
+		ret = nih_flat_hash_insert (hash, keys[i], keys[i]);
+
+		TEST_EQ (ret, 0);
+	}
+
+	TEST_EQ (hash->entries, 100);
+	TEST_EQ (hash->capacity, 128);
+
+	for (int i = 0; i < 100; i++)
+		TEST_EQ_P (nih_flat_hash_lookup (hash, keys[i]), keys[i]);
+
+	TEST_EQ_P (nih_flat_hash_lookup (hash, "entry 100"), NULL);
+
+	nih_free (hash);
+
+	for (int i = 0; i < 100; i++)
+		nih_free (keys[i]);
+}
+
+void
+test_reserve (void)
+{
+	NihFlatHash *hash;
+	int          ret;
+
+	/* Check that reserving room for a number of entries grows the
+	 * table so that they can be inserted without it being resized
+	 * again.
+	 */
+	TEST_FUNCTION ("nih_flat_hash_reserve");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			hash = nih_flat_hash_string_new (NULL, 0);
+			assert0 (nih_flat_hash_insert (hash, "entry 1", NULL));
+		}
+
+		ret = nih_flat_hash_reserve (hash, 1000);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (hash->capacity, 8);
+			TEST_NE_P (nih_flat_hash_find (hash, "entry 1"), NULL);
+
+			nih_free (hash);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (hash->capacity, 2048);
+		TEST_EQ (hash->entries, 1);
+		TEST_GE (hash->growth_left, 999);
+		TEST_NE_P (nih_flat_hash_find (hash, "entry 1"), NULL);
+
+		nih_free (hash);
+	}
+}
+
+void
+test_find (void)
+{
+	NihFlatHash     *hash;
+	NihFlatHashSlot *slot;
+
+	TEST_FUNCTION ("nih_flat_hash_find");
+	hash = nih_flat_hash_string_new (NULL, 0);
+	assert0 (nih_flat_hash_insert (hash, "entry 1", NULL));
+	assert0 (nih_flat_hash_insert (hash, "entry 2", "value 2"));
+
+
+	/* Check that finding an entry with a NULL value returns its slot,
+	 * distinguishing it from a missing entry.
+	 */
+	TEST_FEATURE ("with NULL value");
+	slot = nih_flat_hash_find (hash, "entry 1");
+
+	TEST_NE_P (slot, NULL);
+	TEST_EQ_STR ((const char *)slot->key, "entry 1");
+	TEST_EQ_P (slot->value, NULL);
+
+
+	/* Check that the value of an entry can be changed through the
+	 * slot returned.
+	 */
+	TEST_FEATURE ("with changed value");
+	slot = nih_flat_hash_find (hash, "entry 2");
+
+	TEST_NE_P (slot, NULL);
+	slot->value = "new value";
+
+	TEST_EQ_STR ((char *)nih_flat_hash_lookup (hash, "entry 2"),
+		     "new value");
+
+
+	/* Check that NULL is returned for a missing entry. */
+	TEST_FEATURE ("with missing entry");
+	slot = nih_flat_hash_find (hash, "entry 3");
+
+	TEST_EQ_P (slot, NULL);
+
+	nih_free (hash);
+}
+
+void
+test_erase (void)
+{
+	NihFlatHash *hash;
+	char        *keys[64];
+	int          ret;
+
+	TEST_FUNCTION ("nih_flat_hash_erase");
+	hash = nih_flat_hash_string_new (NULL, 0);
+	assert0 (nih_flat_hash_insert (hash, "entry 1", "value 1"));
+	assert0 (nih_flat_hash_insert (hash, "entry 2", "value 2"));
+
+
+	/* Check that erasing an entry from a group with empty slots makes
+	 * its slot empty again.
+	 */
+	TEST_FEATURE ("with empty slots in group");
+	ret = nih_flat_hash_erase (hash, "entry 1");
+
+	TEST_TRUE (ret);
+	TEST_EQ (hash->entries, 1);
+	TEST_EQ (hash->growth_left, 6);
+	TEST_EQ_P (nih_flat_hash_lookup (hash, "entry 1"), NULL);
+	TEST_EQ_STR ((char *)nih_flat_hash_lookup (hash, "entry 2"),
+		     "value 2");
+
+
+	/* Check that FALSE is returned when there is no such entry. */
+	TEST_FEATURE ("with missing entry");
+	ret = nih_flat_hash_erase (hash, "entry 1");
+
+	TEST_FALSE (ret);
+	TEST_EQ (hash->entries, 1);
+
+	nih_free (hash);
+
+
+	/* Check that erasing entries from full groups of colliding keys
+	 * leaves deleted slots behind, so that the entries beyond can still
+	 * be found; and that the deleted slots are reused.
+	 */
+	TEST_FEATURE ("with full group");
+	hash = nih_flat_hash_new (NULL, 32, my_hash_function,
+				  (NihCmpFunction)nih_hash_string_cmp);
+
+	for (int i = 0; i < 20; i++) {
+		keys[i] = nih_sprintf (hash, "entry %d", i);
+		assert0 (nih_flat_hash_insert (hash, keys[i], keys[i]));
+	}
+
+	for (int i = 0; i < 8; i++)
+		TEST_TRUE (nih_flat_hash_erase (hash, keys[i]));
+
+	TEST_EQ (hash->entries, 12);
+	TEST_EQ (hash->ctrl[0], NIH_FLAT_HASH_DELETED);
+
+	for (int i = 8; i < 20; i++)
+		TEST_EQ_P (nih_flat_hash_lookup (hash, keys[i]), keys[i]);
+
+	assert0 (nih_flat_hash_insert (hash, keys[0], keys[0]));
+
+	TEST_EQ (hash->entries, 13);
+	TEST_EQ (hash->ctrl[0], 0);
+	TEST_EQ_P (hash->slots[0].key, keys[0]);
+
+	nih_free (hash);
+}
+
+void
+test_foreach (void)
+{
+	NihFlatHash *hash;
+	char        *keys[100];
+	int          seen[100];
+
+	TEST_FUNCTION ("NIH_FLAT_HASH_FOREACH");
+	hash = nih_flat_hash_string_new (NULL, 0);
+
+	for (int i = 0; i < 100; i++) {
+		keys[i] = nih_sprintf (hash, "entry %d", i);
+		assert0 (nih_flat_hash_insert (hash, keys[i], &seen[i]));
+		seen[i] = 0;
+	}
+
+
+	/* Check that every entry is visited exactly once. */
+	TEST_FEATURE ("with full table");
+	NIH_FLAT_HASH_FOREACH (hash, iter)
+		(*(int *)iter->value)++;
+
+	for (int i = 0; i < 100; i++)
+		TEST_EQ (seen[i], 1);
+
+
+	/* Check that the entry being visited can be removed, and that all
+	 * of the others are still visited.
+	 */
+	TEST_FEATURE ("with entries removed");
+	NIH_FLAT_HASH_FOREACH (hash, iter) {
+		int *value = iter->value;
+
+		(*value)++;
+		if ((value - seen) % 2)
+			nih_flat_hash_remove (hash, iter);
+	}
+
+	TEST_EQ (hash->entries, 50);
+
+	for (int i = 0; i < 100; i++) {
+		TEST_EQ (seen[i], 2);
+
+		if (i % 2) {
+			TEST_EQ_P (nih_flat_hash_lookup (hash, keys[i]), NULL);
+		} else {
+			TEST_EQ_P (nih_flat_hash_lookup (hash, keys[i]),
+				   &seen[i]);
+		}
+	}
+
+	nih_free (hash);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_new ();
+	test_insert ();
+	test_reserve ();
+	test_find ();
+	test_erase ();
+	test_foreach ();
+
+	return 0;
+}
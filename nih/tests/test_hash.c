@@ -23,6 +23,7 @@
 
 #include <nih/macros.h>
 #include <nih/alloc.h>
+#include <nih/string.h>
 #include <nih/list.h>
 #include <nih/hash.h>
 
@@ -46,6 +47,26 @@ new_entry (void       *parent,
 	return (NihList *)entry;
 }
 
+typedef struct cached_entry {
+	NihHashEntry  entry;
+	const char   *key;
+} CachedEntry;
+
+static NihList *
+new_cached_entry (void       *parent,
+		  const char *key)
+{
+	CachedEntry *entry;
+
+	entry = nih_new (parent, CachedEntry);
+
+	nih_list_init (&entry->entry.entry);
+	entry->entry.hash = 0;
+	entry->key = key;
+
+	return (NihList *)entry;
+}
+
 static const void *
 my_key_function (NihList *entry)
 {
@@ -60,6 +81,12 @@ my_hash_function (const void *key)
 	return hash++;
 }
 
+static uint32_t
+my_constant_hash_function (const void *key)
+{
+	return 42;
+}
+
 static int
 my_cmp_function (const void *key1,
 		 const void *key2)
@@ -67,6 +94,35 @@ my_cmp_function (const void *key1,
 	return 0;
 }
 
+static uint32_t
+my_dup_hash_function (const char *key)
+{
+	/* Last of the bins in the initial table */
+	if (! strcmp (key, "dup"))
+		return 16;
+
+	return nih_hash_string_hash (key);
+}
+
+static int key_calls = 0;
+static int hash_calls = 0;
+
+static const void *
+my_counting_key_function (NihList *entry)
+{
+	key_calls++;
+
+	return nih_hash_string_entry_key (entry);
+}
+
+static uint32_t
+my_counting_hash_function (const void *key)
+{
+	hash_calls++;
+
+	return nih_hash_string_hash (key);
+}
+
 
 void
 test_new (void)
@@ -198,6 +254,45 @@ test_string_new (void)
 	}
 }
 
+void
+test_cached_new (void)
+{
+	NihHash *hash;
+	size_t   i;
+
+	/* Check that we can create a hash table that caches the hash in
+	 * each entry; it should be otherwise identical to an ordinary
+	 * string hash table, but using the entry key function.
+	 */
+	TEST_FUNCTION ("nih_hash_string_cached_new");
+	TEST_ALLOC_FAIL {
+		hash = nih_hash_string_cached_new (NULL, 0);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (hash, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (hash, sizeof(NihHash));
+		TEST_EQ_P (hash->key_function,
+			   (NihKeyFunction)nih_hash_string_entry_key);
+		TEST_EQ_P (hash->hash_function,
+			   (NihHashFunction)nih_hash_string_hash);
+		TEST_EQ_P (hash->cmp_function,
+			   (NihCmpFunction)nih_hash_string_cmp);
+		TEST_TRUE (hash->cache_hash);
+
+		TEST_EQ (hash->size, 17);
+		TEST_NE_P (hash->bins, NULL);
+		TEST_ALLOC_PARENT (hash->bins, hash);
+
+		for (i = 0; i < hash->size; i++)
+			TEST_LIST_EMPTY (&hash->bins[i]);
+
+		nih_free (hash);
+	}
+}
+
 void
 test_add (void)
 {
@@ -501,13 +596,490 @@ test_lookup (void)
 	nih_free (hash);
 }
 
+void
+test_resize (void)
+{
+	NihHash *hash;
+	NihList *entries[1000], *dup[2], *ptr;
+	size_t   size;
+	int      i, count;
+
+	TEST_FUNCTION ("nih_hash_add (resize)");
+
+	/* Check that adding many more entries than the hash table was
+	 * created for causes it to grow, with the entries moved into the
+	 * new bins over the following operations, and that every entry can
+	 * be found throughout.
+	 */
+	TEST_FEATURE ("with growing table");
+	hash = nih_hash_string_new (NULL, 0);
+
+	for (i = 0; i < 1000; i++) {
+		entries[i] = new_entry (hash, nih_sprintf (hash, "entry %d", i));
+		nih_hash_add (hash, entries[i]);
+	}
+
+	TEST_GT (hash->size, 17);
+
+	for (i = 0; i < 1000; i++) {
+		char key[32];
+
+		sprintf (key, "entry %d", i);
+		ptr = nih_hash_lookup (hash, key);
+
+		TEST_EQ_P (ptr, entries[i]);
+	}
+
+	TEST_EQ_P (hash->old_bins, NULL);
+	TEST_EQ (hash->old_size, 0);
+	TEST_GE (hash->size, 331);
+	TEST_ALLOC_PARENT (hash->bins, hash);
+
+
+	/* Check that iteration while the table is being resized visits each
+	 * entry once, whether it's been moved to the new bins or not.
+	 */
+	TEST_FEATURE ("with iteration during resize");
+	for (i = 0; i < 1000; i++) {
+		nih_hash_add (hash, new_entry (hash, "duplicate"));
+		if (hash->old_bins && (hash->cursor > 0))
+			break;
+	}
+
+	TEST_NE_P (hash->old_bins, NULL);
+
+	count = 0;
+	NIH_HASH_FOREACH (hash, iter)
+		count++;
+
+	TEST_EQ (count, 1000 + i + 1);
+
+
+	/* Check that searching for duplicate keys during a resize finds
+	 * every entry once, even when they're moved between calls.
+	 */
+	TEST_FEATURE ("with search during resize");
+	count = 0;
+	ptr = NULL;
+	while ((ptr = nih_hash_search (hash, "duplicate", ptr)) != NULL)
+		count++;
+
+	TEST_EQ (count, i + 1);
+
+
+	/* Check that the table isn't resized while it's being iterated,
+	 * even if entries are added.
+	 */
+	TEST_FEATURE ("with entries added during iteration");
+	while (hash->old_bins)
+		nih_hash_lookup (hash, "entry 0");
+
+	size = hash->size;
+
+	count = 0;
+	NIH_HASH_FOREACH_SAFE (hash, iter) {
+		if (count++)
+			continue;
+
+		for (i = 0; i < 5000; i++)
+			nih_hash_add (hash, new_entry (hash, "added"));
+
+		TEST_EQ (hash->size, size);
+		TEST_EQ_P (hash->old_bins, NULL);
+	}
+
+	TEST_EQ (hash->iterating, 0);
+
+	nih_hash_lookup (hash, "entry 0");
+
+	TEST_GT (hash->size, size);
+
+
+	/* Check that removing the entries from the table causes it to
+	 * shrink back to the size it was created with once they've been
+	 * counted.
+	 */
+	TEST_FEATURE ("with shrinking table");
+	NIH_HASH_FOREACH_SAFE (hash, iter)
+		nih_free (nih_list_remove (iter));
+
+	for (i = 0; (i < 100000) && (hash->size > 17); i++)
+		nih_hash_lookup (hash, "entry 0");
+
+	TEST_EQ (hash->size, 17);
+	TEST_HASH_EMPTY (hash);
+
+	nih_free (hash);
+
+
+	/* Check that duplicate keys added while the table is growing are
+	 * still found in the order they were added, even though the first
+	 * was added to an old bin that won't be moved for a while.
+	 */
+	TEST_FEATURE ("with duplicate keys added during resize");
+	hash = nih_hash_new (NULL, 0,
+			     (NihKeyFunction)nih_hash_string_key,
+			     (NihHashFunction)my_dup_hash_function,
+			     (NihCmpFunction)nih_hash_string_cmp);
+
+	dup[0] = nih_hash_add (hash, new_entry (hash, "dup"));
+
+	for (i = 0; (i < 1000) && (! hash->old_bins); i++)
+		nih_hash_add (hash, new_entry (hash, nih_sprintf (
+					      hash, "entry %d", i)));
+
+	TEST_NE_P (hash->old_bins, NULL);
+	TEST_EQ (hash->old_size, 17);
+	TEST_EQ (hash->size, 37);
+
+	dup[1] = nih_hash_add (hash, new_entry (hash, "dup"));
+
+	ptr = nih_hash_lookup (hash, "dup");
+	TEST_EQ_P (ptr, dup[0]);
+
+	ptr = nih_hash_search (hash, "dup", ptr);
+	TEST_EQ_P (ptr, dup[1]);
+
+	ptr = nih_hash_search (hash, "dup", ptr);
+	TEST_EQ_P (ptr, NULL);
+
+	nih_free (hash);
+}
+
+
+void
+test_cached (void)
+{
+	NihHash *hash;
+	NihList *entry1, *entry2, *entry3, *ptr;
+	char    *key;
+	int      i;
+
+	TEST_FUNCTION ("nih_hash_cached_new (search)");
+	hash = nih_hash_cached_new (NULL, 0,
+				    my_counting_key_function,
+				    my_counting_hash_function,
+				    (NihCmpFunction)nih_hash_string_cmp);
+	entry1 = new_cached_entry (hash, "entry 1");
+	entry2 = new_cached_entry (hash, "entry 39");
+	entry3 = new_cached_entry (hash, "entry 1");
+
+
+	/* Check that adding an entry stores the hash of its key in the
+	 * entry header.
+	 */
+	TEST_FEATURE ("with entry added");
+	nih_hash_add (hash, entry2);
+	nih_hash_add (hash, entry1);
+	nih_hash_add (hash, entry3);
+
+	TEST_EQ (((NihHashEntry *)entry1)->hash,
+		 nih_hash_string_hash ("entry 1"));
+	TEST_EQ (((NihHashEntry *)entry2)->hash,
+		 nih_hash_string_hash ("entry 39"));
+	TEST_EQ (((NihHashEntry *)entry3)->hash,
+		 nih_hash_string_hash ("entry 1"));
+
+
+	/* Check that searching for a key only looks at the keys of entries
+	 * with a matching hash; "entry 39" shares a bin with "entry 1" and
+	 * comes before it, but its key should not be examined.
+	 */
+	TEST_FEATURE ("with entries in same bin");
+	key_calls = 0;
+	hash_calls = 0;
+
+	ptr = nih_hash_search (hash, "entry 1", NULL);
+
+	TEST_EQ_P (ptr, entry1);
+	TEST_EQ (key_calls, 1);
+	TEST_EQ (hash_calls, 1);
+
+
+	/* Check that continuing the search uses the hash stored in the
+	 * previous entry rather than hashing the key again.
+	 */
+	TEST_FEATURE ("with continued search");
+	key_calls = 0;
+	hash_calls = 0;
+
+	ptr = nih_hash_search (hash, "entry 1", ptr);
+
+	TEST_EQ_P (ptr, entry3);
+	TEST_EQ (key_calls, 1);
+	TEST_EQ (hash_calls, 0);
+
+	ptr = nih_hash_search (hash, "entry 1", ptr);
+
+	TEST_EQ_P (ptr, NULL);
+	TEST_EQ (hash_calls, 0);
+
+
+	/* Check that a key with no matching hash is never compared. */
+	TEST_FEATURE ("with missing key");
+	key_calls = 0;
+
+	ptr = nih_hash_lookup (hash, "entry 3");
+
+	TEST_EQ_P (ptr, NULL);
+	TEST_EQ (key_calls, 0);
+
+	nih_free (hash);
+
+
+	/* Check that entries are moved to new bins when the table is
+	 * resized without the keys being hashed again.
+	 */
+	TEST_FEATURE ("with table resized");
+	hash = nih_hash_cached_new (NULL, 0,
+				    my_counting_key_function,
+				    my_counting_hash_function,
+				    (NihCmpFunction)nih_hash_string_cmp);
+
+	hash_calls = 0;
+	for (i = 0; i < 1000; i++) {
+		key = nih_sprintf (hash, "entry %d", i);
+		nih_hash_add (hash, new_cached_entry (hash, key));
+	}
+
+	TEST_GT (hash->size, 17);
+	TEST_EQ (hash_calls, 1000);
+
+	for (i = 0; i < 1000; i++) {
+		char buf[32];
+
+		sprintf (buf, "entry %d", i);
+		ptr = nih_hash_lookup (hash, buf);
+
+		TEST_NE_P (ptr, NULL);
+		TEST_EQ_STR (((CachedEntry *)ptr)->key, buf);
+	}
+
+	TEST_EQ (hash_calls, 2000);
+
+	nih_free (hash);
+}
+
+
+void
+test_freeze (void)
+{
+	NihHash       *hash;
+	NihFrozenHash *frozen;
+	NihList       *entries[1000], *dup, *ptr;
+	char          *key;
+	int            i;
+
+	TEST_FUNCTION ("nih_hash_freeze");
+
+	/* Check that an empty hash table can be frozen, and that nothing
+	 * is found in the frozen table.
+	 */
+	TEST_FEATURE ("with empty table");
+	hash = nih_hash_string_new (NULL, 0);
+
+	TEST_ALLOC_FAIL {
+		frozen = nih_hash_freeze (NULL, hash);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (frozen, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (frozen, sizeof (NihFrozenHash)
+				 + sizeof (uint32_t));
+		TEST_EQ (frozen->size, 0);
+		TEST_EQ (frozen->entries, 0);
+		TEST_EQ_P (nih_frozen_hash_lookup (frozen, "entry 1"), NULL);
+
+		nih_free (frozen);
+	}
+
+	nih_free (hash);
+
+
+	/* Check that a populated hash table can be frozen into a single
+	 * allocation, with each distinct hash in its own slot.  Every
+	 * entry should be found in the frozen table, including both
+	 * entries with a duplicate key in the same order as the hash
+	 * table itself returns them.
+	 */
+	TEST_FEATURE ("with populated table");
+	hash = nih_hash_string_new (NULL, 0);
+	for (i = 0; i < 1000; i++) {
+		key = nih_sprintf (hash, "entry %d", i);
+		entries[i] = nih_hash_add (hash, new_entry (hash, key));
+	}
+	dup = nih_hash_add (hash, new_entry (hash, "entry 500"));
+
+	TEST_ALLOC_FAIL {
+		frozen = nih_hash_freeze (NULL, hash);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (frozen, NULL);
+			continue;
+		}
+
+		TEST_EQ (frozen->entries, 1001);
+		TEST_EQ (frozen->size, 1000);
+		TEST_ALLOC_SIZE (frozen, (sizeof (NihFrozenHash)
+					  + sizeof (NihList *) * 1001
+					  + sizeof (uint32_t) * frozen->nbuckets
+					  + sizeof (uint32_t) * 1000
+					  + sizeof (uint32_t) * 1001));
+
+		for (size_t j = 0; j < frozen->size; j++)
+			TEST_GT (frozen->offsets[j + 1], frozen->offsets[j]);
+
+		for (i = 0; i < 1000; i++) {
+			char buf[32];
+
+			sprintf (buf, "entry %d", i);
+			TEST_EQ_P (nih_frozen_hash_lookup (frozen, buf),
+				   entries[i]);
+		}
+
+		ptr = nih_frozen_hash_search (frozen, "entry 500", entries[500]);
+		TEST_EQ_P (ptr, dup);
+
+		ptr = nih_frozen_hash_search (frozen, "entry 500", ptr);
+		TEST_EQ_P (ptr, NULL);
+
+		TEST_EQ_P (nih_frozen_hash_lookup (frozen, "entry 1000"), NULL);
+
+		nih_free (frozen);
+	}
+
+
+	/* Check that the frozen table is not affected by later changes
+	 * to the hash table.
+	 */
+	TEST_FEATURE ("with hash table changed");
+	frozen = nih_hash_freeze (NULL, hash);
+	nih_hash_add (hash, new_entry (hash, "entry 1000"));
+
+	TEST_EQ_P (nih_frozen_hash_lookup (frozen, "entry 1000"), NULL);
+	TEST_EQ_P (nih_frozen_hash_lookup (frozen, "entry 999"), entries[999]);
+
+	nih_free (frozen);
+	nih_free (hash);
+
+
+	/* Check that entries whose keys all have the same hash share a
+	 * single slot, and can still each be found.
+	 */
+	TEST_FEATURE ("with colliding hashes");
+	hash = nih_hash_new (NULL, 0,
+			     (NihKeyFunction)nih_hash_string_key,
+			     my_constant_hash_function,
+			     (NihCmpFunction)nih_hash_string_cmp);
+	for (i = 0; i < 10; i++) {
+		key = nih_sprintf (hash, "entry %d", i);
+		entries[i] = nih_hash_add (hash, new_entry (hash, key));
+	}
+
+	frozen = nih_hash_freeze (NULL, hash);
+
+	TEST_EQ (frozen->size, 1);
+	TEST_EQ (frozen->entries, 10);
+
+	for (i = 0; i < 10; i++) {
+		char buf[32];
+
+		sprintf (buf, "entry %d", i);
+		TEST_EQ_P (nih_frozen_hash_lookup (frozen, buf), entries[i]);
+	}
+
+	TEST_EQ_P (nih_frozen_hash_lookup (frozen, "entry 10"), NULL);
+
+	nih_free (frozen);
+	nih_free (hash);
+}
+
+void
+test_freeze_c (void)
+{
+	NihHash *hash;
+	char    *code;
+
+	TEST_FUNCTION ("nih_hash_freeze_c");
+
+	/* Check that code for an empty table has a lookup function which
+	 * always fails.
+	 */
+	TEST_FEATURE ("with empty table");
+	hash = nih_hash_string_new (NULL, 0);
+
+	TEST_ALLOC_FAIL {
+		code = nih_hash_freeze_c (NULL, hash, "test");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (code, NULL);
+			continue;
+		}
+
+		TEST_EQ_STR (code, ("/* Generated by nih_hash_freeze_c() */\n"
+				    "\n"
+				    "static int\n"
+				    "test_lookup (const char *key)\n"
+				    "{\n"
+				    "\treturn -1;\n"
+				    "}\n"));
+
+		nih_free (code);
+	}
+
+
+	/* Check that code for a populated table contains each distinct
+	 * key once, escaped as necessary, and a lookup function using the
+	 * FNV-1 hash.
+	 */
+	TEST_FEATURE ("with populated table");
+	nih_hash_add (hash, new_entry (hash, "foo"));
+	nih_hash_add (hash, new_entry (hash, "bar"));
+	nih_hash_add (hash, new_entry (hash, "foo"));
+	nih_hash_add (hash, new_entry (hash, "say \"hello\"\n"));
+
+	TEST_ALLOC_FAIL {
+		code = nih_hash_freeze_c (NULL, hash, "test");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (code, NULL);
+			continue;
+		}
+
+		TEST_NE_P (strstr (code, "static const char *const test_keys[] = {\n"),
+			   NULL);
+		TEST_NE_P (strstr (code, "\t\"foo\",\n"), NULL);
+		TEST_EQ_P (strstr (strstr (code, "\"foo\"") + 1, "\"foo\""),
+			   NULL);
+		TEST_NE_P (strstr (code, "\t\"bar\",\n"), NULL);
+		TEST_NE_P (strstr (code, "\t\"say \\\"hello\\\"\\012\",\n"),
+			   NULL);
+		TEST_NE_P (strstr (code, "static const uint32_t test_disp[] = {"),
+			   NULL);
+		TEST_NE_P (strstr (code, "static const uint32_t test_offsets[] = {\n"
+				   "\t0, 1, 2, 3,\n};"),
+			   NULL);
+		TEST_NE_P (strstr (code, "test_lookup (const char *key)\n"),
+			   NULL);
+		TEST_NE_P (strstr (code, "nih_frozen_hash_slot (nih_hash_fnv_hash (key),\n"
+				   "\t\t\t\t     test_disp, 1, 3);\n"),
+			   NULL);
+
+		nih_free (code);
+	}
+
+	nih_free (hash);
+}
+
 
 void
 test_foreach (void)
 {
 	NihHash *hash;
 	NihList *entry[4], *entry0, *entry1, *entry2, *entry3;
-	int      i;
+	int      i, used;
 
 	/* Check that NIH_HASH_FOREACH iterates the hash correctly in order,
 	 * visiting each entry in each bin.  Note that we stage the entries
@@ -540,6 +1112,46 @@ test_foreach (void)
 	}
 
 	nih_free (hash);
+
+
+	/* Check that iterating a table with many more bins than entries
+	 * visits only the entries, and that bins emptied without the
+	 * table's knowledge are no longer marked as used afterwards.
+	 */
+	TEST_FEATURE ("with sparse table");
+	hash = nih_hash_string_new (NULL, 100000);
+	entry0 = new_entry (hash, "entry 1");
+	entry1 = new_entry (hash, "entry 2");
+	entry2 = new_entry (hash, "entry 3");
+
+	nih_hash_add (hash, entry0);
+	nih_hash_add (hash, entry1);
+	nih_hash_add (hash, entry2);
+
+	i = 0;
+	NIH_HASH_FOREACH (hash, iter)
+		i++;
+
+	TEST_EQ (i, 3);
+
+	nih_list_remove (entry0);
+	nih_list_remove (entry2);
+
+	i = 0;
+	NIH_HASH_FOREACH (hash, iter) {
+		TEST_EQ_P (iter, entry1);
+		i++;
+	}
+
+	TEST_EQ (i, 1);
+
+	used = 0;
+	for (size_t j = 0; j < (hash->size + 63) / 64; j++)
+		used += __builtin_popcountll (hash->used[j]);
+
+	TEST_EQ (used, 1);
+
+	nih_free (hash);
 }
 
 void
@@ -605,21 +1217,150 @@ test_string_key (void)
 	nih_free (entry);
 }
 
+void
+test_string_entry_key (void)
+{
+	NihList    *entry;
+	const char *key;
+
+
+	/* Check that the string entry key function returns a pointer to
+	 * the key following the hash entry header in our test structure.
+	 */
+	TEST_FUNCTION ("nih_hash_string_entry_key");
+	entry = new_cached_entry (NULL, "my entry");
+
+	key = nih_hash_string_entry_key (entry);
+
+	TEST_EQ_P (key, ((CachedEntry *)entry)->key);
+	TEST_EQ_STR (key, "my entry");
+
+	nih_free (entry);
+}
+
+void
+test_string_hash (void)
+{
+	const char *keys[] = {
+		"", "a", "ab", "abc", "abcd", "entry 1", "entry 12345678",
+		"/com/ubuntu/Upstart", "/com/ubuntu/Upstart/jobs/tty1",
+		"/com/ubuntu/Upstart/jobs/tty1/_/and/then/some/more/elements",
+		NULL
+	};
+	char        buf[128];
+	uint32_t    hash1, hash2;
+	int         differ;
+
+	TEST_FUNCTION ("nih_hash_string_hash");
+	nih_hash_set_fnv_compat (FALSE);
+
+
+	/* Check that the hash of a string is the same as the hash of the
+	 * same bytes given with a length, for each of the different
+	 * lengths handled separately; and that the bytes after the length
+	 * are ignored.
+	 */
+	TEST_FEATURE ("with length");
+	for (const char **key = keys; *key; key++) {
+		size_t len = strlen (*key);
+
+		memcpy (buf, *key, len);
+		memset (buf + len, 'x', sizeof (buf) - len);
+
+		hash1 = nih_hash_string_hash (*key);
+		hash2 = nih_hash_string_hash_len (buf, len);
+
+		TEST_EQ (hash1, hash2);
+	}
+
+
+	/* Check that the hash depends on every byte of the key, by changing
+	 * each byte in turn of a key long enough to be hashed in blocks.
+	 */
+	TEST_FEATURE ("with changed byte");
+	strcpy (buf, keys[9]);
+	hash1 = nih_hash_string_hash (buf);
+
+	for (size_t i = 0; i < strlen (keys[9]); i++) {
+		buf[i] ^= 1;
+		hash2 = nih_hash_string_hash (buf);
+		buf[i] ^= 1;
+
+		TEST_NE (hash1, hash2);
+	}
+
+
+	/* Check that the hash is the same for the same seed, but that
+	 * changing the seed changes the hash.
+	 */
+	TEST_FEATURE ("with seed");
+	nih_hash_set_seed (0x1234);
+	hash1 = nih_hash_string_hash ("entry 1");
+	hash2 = nih_hash_string_hash ("entry 1");
+
+	TEST_EQ (hash1, hash2);
+
+	differ = FALSE;
+	for (const char **key = keys; *key; key++) {
+		nih_hash_set_seed (0x1234);
+		hash1 = nih_hash_string_hash (*key);
+		nih_hash_set_seed (0x5678);
+		hash2 = nih_hash_string_hash (*key);
+
+		if (hash1 != hash2)
+			differ = TRUE;
+	}
+
+	TEST_TRUE (differ);
+
+
+	/* Check that with the compatibility switch set, the FNV-1 hash is
+	 * returned by both functions instead.
+	 */
+	TEST_FEATURE ("with FNV-1 compatibility");
+	nih_hash_set_fnv_compat (TRUE);
+
+	TEST_EQ (nih_hash_string_hash ("entry 1"), 88816634);
+	TEST_EQ (nih_hash_string_hash_len ("entry 1xxx", 7), 88816634);
+}
+
+void
+test_fnv_hash (void)
+{
+	/* Check that the FNV-1 hash of some strings is as documented. */
+	TEST_FUNCTION ("nih_hash_fnv_hash");
+	TEST_EQ (nih_hash_fnv_hash (""), 2166136261U);
+	TEST_EQ (nih_hash_fnv_hash ("entry 1"), 88816634);
+	TEST_EQ (nih_hash_fnv_hash ("/com/ubuntu/Upstart/jobs/tty1"),
+		 1413518823);
+}
+
 
 int
 main (int   argc,
       char *argv[])
 {
+	/* The tests place entries with known keys in known bins */
+	nih_hash_set_fnv_compat (TRUE);
+
 	test_new ();
 	test_string_new ();
+	test_cached_new ();
 	test_add ();
 	test_add_unique ();
 	test_replace ();
 	test_search ();
 	test_lookup ();
+	test_resize ();
+	test_cached ();
+	test_freeze ();
+	test_freeze_c ();
 	test_foreach ();
 	test_foreach_safe ();
 	test_string_key ();
+	test_string_entry_key ();
+	test_string_hash ();
+	test_fnv_hash ();
 
 	return 0;
 }
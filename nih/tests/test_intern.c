@@ -0,0 +1,244 @@
+/* libnih
+ *
+ * test_intern.c - test suite for nih/intern.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/intern.h>
+
+
+void
+test_new (void)
+{
+	NihIntern *pool;
+
+	/* Check that a new pool is allocated with nih_alloc, is empty
+	 * and has a hash table allocated as a child of it.
+	 */
+	TEST_FUNCTION ("nih_intern_new");
+	TEST_ALLOC_FAIL {
+		pool = nih_intern_new (NULL);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (pool, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (pool, sizeof (NihIntern));
+		TEST_ALLOC_PARENT (pool->strings, pool);
+		TEST_EQ (pool->count, 0);
+		TEST_EQ (pool->bytes, 0);
+
+		nih_free (pool);
+	}
+}
+
+void
+test_strdup (void)
+{
+	NihIntern  *pool;
+	void       *parent1, *parent2;
+	const char *str1, *str2, *str3;
+	char        buf[16];
+
+	TEST_FUNCTION ("nih_intern_strdup");
+	pool = nih_intern_new (NULL);
+	parent1 = nih_alloc (NULL, 1);
+	parent2 = nih_alloc (NULL, 1);
+
+
+	/* Check that a string not in the pool is copied with the parent
+	 * given, and counted in the pool.
+	 */
+	TEST_FEATURE ("with new string");
+	TEST_ALLOC_FAIL {
+		str1 = nih_intern_strdup (pool, parent1, "test");
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str1, NULL);
+			TEST_EQ (pool->count, 0);
+			TEST_EQ (pool->bytes, 0);
+			continue;
+		}
+
+		TEST_ALLOC_PARENT (str1, parent1);
+		TEST_EQ_STR (str1, "test");
+		TEST_EQ (pool->count, 1);
+		TEST_GT (pool->bytes, 5);
+
+		nih_unref ((void *)str1, parent1);
+	}
+
+
+	/* Check that interning an equal string returns the same pointer
+	 * with a reference from the new parent, and doesn't change the
+	 * size of the pool.
+	 */
+	TEST_FEATURE ("with existing string");
+	str1 = nih_intern_strdup (pool, parent1, "test");
+
+	TEST_ALLOC_FAIL {
+		size_t bytes = pool->bytes;
+
+		strcpy (buf, "test");
+		str2 = nih_intern_strdup (pool, parent2, buf);
+
+		TEST_EQ_P (str2, str1);
+		TEST_ALLOC_PARENT (str2, parent1);
+		TEST_ALLOC_PARENT (str2, parent2);
+		TEST_EQ (pool->count, 1);
+		TEST_EQ (pool->bytes, bytes);
+
+		nih_unref ((void *)str2, parent2);
+	}
+
+
+	/* Check that different strings are different pointers. */
+	TEST_FEATURE ("with different string");
+	str3 = nih_intern_strdup (pool, parent1, "other");
+
+	TEST_NE_P (str3, str1);
+	TEST_EQ_STR (str3, "other");
+	TEST_EQ (pool->count, 2);
+
+
+	/* Check that the string remains in the pool until all of its
+	 * parents are freed, after which it's removed from the pool and
+	 * interning it again gives a new string.
+	 */
+	TEST_FEATURE ("with all parents freed");
+	str2 = nih_intern_strdup (pool, parent2, "test");
+	TEST_EQ_P (str2, str1);
+
+	nih_free (parent1);
+
+	TEST_EQ (pool->count, 1);
+	TEST_EQ_P (nih_intern_lookup (pool, "test"), str1);
+	TEST_EQ_P (nih_intern_lookup (pool, "other"), NULL);
+
+	nih_free (parent2);
+
+	TEST_EQ (pool->count, 0);
+	TEST_EQ (pool->bytes, 0);
+	TEST_EQ_P (nih_intern_lookup (pool, "test"), NULL);
+
+
+	/* Check that strings may outlive the pool they were interned in,
+	 * and may be freed afterwards.
+	 */
+	TEST_FEATURE ("with pool freed first");
+	parent1 = nih_alloc (NULL, 1);
+	str1 = nih_intern_strdup (pool, parent1, "test");
+
+	nih_free (pool);
+
+	TEST_EQ_STR (str1, "test");
+
+	nih_free (parent1);
+}
+
+void
+test_lookup (void)
+{
+	NihIntern  *pool;
+	void       *parent;
+	const char *str;
+
+	/* Check that looking up a string in the pool returns it without
+	 * adding a reference, and that a string not in the pool returns
+	 * NULL.
+	 */
+	TEST_FUNCTION ("nih_intern_lookup");
+	pool = nih_intern_new (NULL);
+	parent = nih_alloc (NULL, 1);
+	str = nih_intern_strdup (pool, parent, "test");
+
+	TEST_EQ_P (nih_intern_lookup (pool, "test"), str);
+	TEST_FALSE (nih_alloc_shared (str));
+	TEST_EQ_P (nih_intern_lookup (pool, "tes"), NULL);
+
+	nih_free (parent);
+	nih_free (pool);
+}
+
+void
+test_cmp (void)
+{
+	NihIntern  *pool;
+	NihHash    *hash;
+	NihList    *entry;
+	void       *parent;
+	const char *str;
+	struct {
+		NihList     entry;
+		const char *name;
+	} *member;
+
+	TEST_FUNCTION ("nih_intern_cmp");
+	pool = nih_intern_new (NULL);
+	parent = nih_alloc (NULL, 1);
+
+	/* Check that the same pointer compares equal, and that different
+	 * strings compare in the same order as strcmp().
+	 */
+	TEST_FEATURE ("with strings");
+	str = nih_intern_strdup (pool, parent, "foo");
+
+	TEST_EQ (nih_intern_cmp (str, str), 0);
+	TEST_EQ (nih_intern_cmp (str, "foo"), 0);
+	TEST_LT (nih_intern_cmp (str, "goo"), 0);
+	TEST_GT (nih_intern_cmp (str, "bar"), 0);
+
+
+	/* Check that a hash table keyed by interned strings can be
+	 * searched using the interned string.
+	 */
+	TEST_FEATURE ("with hash table");
+	hash = nih_hash_new (parent, 0,
+			     (NihKeyFunction)nih_hash_string_key,
+			     (NihHashFunction)nih_hash_string_hash,
+			     (NihCmpFunction)nih_intern_cmp);
+
+	member = nih_new (hash, typeof (*member));
+	nih_list_init (&member->entry);
+	member->name = nih_intern_strdup (pool, member, "foo");
+	nih_hash_add (hash, &member->entry);
+
+	entry = nih_hash_lookup (hash, nih_intern_lookup (pool, "foo"));
+
+	TEST_EQ_P (entry, &member->entry);
+
+	nih_free (parent);
+	nih_free (pool);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_new ();
+	test_strdup ();
+	test_lookup ();
+	test_cmp ();
+
+	return 0;
+}
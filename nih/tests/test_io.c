@@ -243,6 +243,10 @@ test_buffer_new (void)
 		TEST_EQ_P (buf->buf, NULL);
 		TEST_EQ (buf->size, 0);
 		TEST_EQ (buf->len, 0);
+		TEST_EQ (buf->off, 0);
+		TEST_EQ (buf->min_size, 0);
+		TEST_GT (buf->max_grow, 0);
+		TEST_EQ (buf->scan, 0);
 
 		nih_free (buf);
 	}
@@ -257,8 +261,8 @@ test_buffer_resize (void)
 	TEST_FUNCTION ("nih_io_buffer_resize");
 
 	/* Check that we can resize a NULL buffer; we ask for half a page
-	 * and expect to get a full page allocated as a child of the buffer
-	 * itself.
+	 * and expect to get just that allocated as a child of the buffer
+	 * itself, rather than a full page.
 	 */
 	TEST_FEATURE ("with empty buffer and half increase");
 	buf = nih_io_buffer_new (NULL);
@@ -274,18 +278,18 @@ test_buffer_resize (void)
 
 		TEST_EQ (ret, 0);
 		TEST_ALLOC_PARENT (buf->buf, buf);
-		TEST_ALLOC_SIZE (buf->buf, BUFSIZ);
-		TEST_EQ (buf->size, BUFSIZ);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ / 2);
+		TEST_EQ (buf->size, BUFSIZ / 2);
 		TEST_EQ (buf->len, 0);
 	}
 
 
-	/* Check that we can increase the size by a full page, and not
-	 * have anything change because there's no space used yet.
+	/* Check that we can increase the size to a full page, with the
+	 * buffer doubling in size.
 	 */
 	TEST_FEATURE ("with empty but alloc'd buffer and full increase");
 	TEST_ALLOC_FAIL {
-		buf->size = BUFSIZ;
+		buf->size = BUFSIZ / 2;
 		ret = nih_io_buffer_resize (buf, BUFSIZ);
 
 		if (test_alloc_failed) {
@@ -338,7 +342,7 @@ test_buffer_resize (void)
 
 
 	/* Check that asking for a page more space when we claim to be
-	 * using half a page gives us a full two pages of space.
+	 * using half a page gives us just that much space.
 	 */
 	TEST_FEATURE ("with part-full buffer and increase");
 	TEST_ALLOC_FAIL {
@@ -352,8 +356,8 @@ test_buffer_resize (void)
 		}
 
 		TEST_EQ (ret, 0);
-		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 2);
-		TEST_EQ (buf->size, BUFSIZ * 2);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ + BUFSIZ / 2);
+		TEST_EQ (buf->size, BUFSIZ + BUFSIZ / 2);
 		TEST_EQ (buf->len, BUFSIZ / 2);
 	}
 
@@ -363,22 +367,229 @@ test_buffer_resize (void)
 	 */
 	TEST_FEATURE ("with no change");
 	TEST_ALLOC_FAIL {
-		buf->size = BUFSIZ * 2;
-		buf->len = BUFSIZ + BUFSIZ / 2;
+		buf->size = BUFSIZ + BUFSIZ / 2;
+		buf->len = BUFSIZ;
+		ret = nih_io_buffer_resize (buf, 80);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ + BUFSIZ / 2);
+		TEST_EQ (buf->size, BUFSIZ + BUFSIZ / 2);
+		TEST_EQ (buf->len, BUFSIZ);
+	}
+
+	nih_free (buf);
+
+
+	/* Check that a buffer that needs to grow doubles in size, rather
+	 * than just growing by enough for the data.
+	 */
+	TEST_FEATURE ("with full buffer");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			assert0 (nih_io_buffer_resize (buf, BUFSIZ * 4));
+			buf->len = BUFSIZ * 4;
+		}
+
+		ret = nih_io_buffer_resize (buf, 1);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->size, BUFSIZ * 4);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 8);
+		TEST_EQ (buf->size, BUFSIZ * 8);
+		TEST_EQ (buf->len, BUFSIZ * 4);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that a buffer larger than its maximum growth only grows
+	 * by that much.
+	 */
+	TEST_FEATURE ("with full buffer and maximum growth");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			buf->max_grow = BUFSIZ;
+			assert0 (nih_io_buffer_resize (buf, BUFSIZ * 4));
+			buf->len = BUFSIZ * 4;
+		}
+
+		ret = nih_io_buffer_resize (buf, 1);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->size, BUFSIZ * 4);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 5);
+		TEST_EQ (buf->size, BUFSIZ * 5);
+		TEST_EQ (buf->len, BUFSIZ * 4);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that a buffer with a minimum size is allocated at that
+	 * size, and isn't reduced below it.
+	 */
+	TEST_FEATURE ("with minimum size");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			buf->min_size = BUFSIZ * 16;
+		}
+
+		ret = nih_io_buffer_resize (buf, 80);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->size, 0);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 16);
+		TEST_EQ (buf->size, BUFSIZ * 16);
+
+		buf->len = 80;
+		ret = nih_io_buffer_resize (buf, 0);
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 16);
+		TEST_EQ (buf->size, BUFSIZ * 16);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that room left before the data by shrinking the buffer is
+	 * reclaimed by moving the data back to the start, rather than
+	 * increasing the size, when there's not enough room after it and
+	 * there's at least as much room before it as data to move.
+	 */
+	TEST_FEATURE ("with room before data");
+	TEST_ALLOC_FAIL {
+		char *ptr;
+
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			assert0 (nih_io_buffer_resize (buf, BUFSIZ));
+			memset (buf->buf, 'x', BUFSIZ);
+			memcpy (buf->buf + BUFSIZ / 2, "test", 4);
+			buf->len = BUFSIZ;
+		}
+
+		ptr = buf->buf;
+		nih_io_buffer_shrink (buf, BUFSIZ / 2);
+
+		TEST_EQ_P (buf->buf, ptr + BUFSIZ / 2);
+		TEST_EQ (buf->size, BUFSIZ / 2);
+
 		ret = nih_io_buffer_resize (buf, 80);
 
+		TEST_EQ (ret, 0);
+		TEST_EQ_P (buf->buf, ptr);
+		TEST_ALLOC_SIZE (buf->buf, BUFSIZ);
+		TEST_EQ (buf->size, BUFSIZ);
+		TEST_EQ (buf->off, 0);
+		TEST_EQ (buf->len, BUFSIZ / 2);
+		TEST_EQ_MEM (buf->buf, "test", 4);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that when there's less room before the data than data to
+	 * move, the buffer is grown as well as the data being moved back
+	 * to the start, so that a full buffer used as a queue isn't moved
+	 * every time a little is taken from the front.
+	 */
+	TEST_FEATURE ("with little room before data");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			assert0 (nih_io_buffer_resize (buf, BUFSIZ));
+			memset (buf->buf, 'x', BUFSIZ);
+			memcpy (buf->buf + 64, "test", 4);
+			buf->len = BUFSIZ;
+		}
+
+		nih_io_buffer_shrink (buf, 64);
+
+		TEST_EQ (buf->off, 64);
+		TEST_EQ (buf->size, BUFSIZ - 64);
+
+		ret = nih_io_buffer_resize (buf, 64);
+
 		if (test_alloc_failed) {
 			TEST_LT (ret, 0);
+			TEST_EQ (buf->len, BUFSIZ - 64);
+			TEST_EQ_MEM (buf->buf, "test", 4);
+
+			nih_free (buf);
 			continue;
 		}
 
 		TEST_EQ (ret, 0);
 		TEST_ALLOC_SIZE (buf->buf, BUFSIZ * 2);
 		TEST_EQ (buf->size, BUFSIZ * 2);
-		TEST_EQ (buf->len, BUFSIZ + BUFSIZ / 2);
+		TEST_EQ (buf->off, 0);
+		TEST_EQ (buf->len, BUFSIZ - 64);
+		TEST_EQ_MEM (buf->buf, "test", 4);
+
+		nih_free (buf);
 	}
 
-	nih_free (buf);
+
+	/* Check that a buffer much larger than needed for the data in it
+	 * is reduced to the size needed.
+	 */
+	TEST_FEATURE ("with much larger buffer");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			assert0 (nih_io_buffer_resize (buf, BUFSIZ * 8));
+			memcpy (buf->buf, "test", 4);
+			buf->len = 4;
+		}
+
+		ret = nih_io_buffer_resize (buf, 0);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->size, BUFSIZ * 8);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_SIZE (buf->buf, 4);
+		TEST_EQ (buf->size, 4);
+		TEST_EQ (buf->len, 4);
+		TEST_EQ_MEM (buf->buf, "test", 4);
+
+		nih_free (buf);
+	}
 }
 
 void
@@ -531,6 +742,49 @@ test_buffer_shrink (void)
 		TEST_EQ_P (buf->buf, NULL);
 	}
 
+
+	/* Check that the data isn't moved when the buffer is shrunk, but
+	 * that the start of the buffer is advanced past the removed bytes
+	 * and the room left there is remembered.
+	 */
+	TEST_FEATURE ("with data left in buffer");
+	assert0 (nih_io_buffer_push (buf,
+				     "this is a test of the buffer code", 33));
+	TEST_ALLOC_FAIL {
+		char *ptr;
+
+		TEST_ALLOC_SAFE {
+			nih_io_buffer_shrink (buf, buf->len);
+			assert0 (nih_io_buffer_push (
+					 buf, "this is a test of the buffer code",
+					 33));
+		}
+
+		ptr = buf->buf;
+		nih_io_buffer_shrink (buf, 5);
+		nih_io_buffer_shrink (buf, 3);
+
+		TEST_EQ_P (buf->buf, ptr + 8);
+		TEST_EQ (buf->len, 25);
+		TEST_EQ (buf->size, 25);
+		TEST_EQ (buf->off, 8);
+		TEST_EQ_MEM (buf->buf, "a test of the buffer code", 25);
+	}
+
+
+	/* Check that the amount of the buffer already searched is reduced
+	 * by the number of bytes removed, but not below zero.
+	 */
+	TEST_FEATURE ("with searched data");
+	buf->scan = 10;
+	nih_io_buffer_shrink (buf, 7);
+
+	TEST_EQ (buf->scan, 3);
+
+	nih_io_buffer_shrink (buf, 7);
+
+	TEST_EQ (buf->scan, 0);
+
 	nih_free (buf);
 }
 
@@ -558,20 +812,20 @@ test_buffer_push (void)
 		}
 
 		TEST_EQ (ret, 0);
-		TEST_ALLOC_SIZE (buf->buf, BUFSIZ);
-		TEST_EQ (buf->size, BUFSIZ);
+		TEST_ALLOC_SIZE (buf->buf, 4);
+		TEST_EQ (buf->size, 4);
 		TEST_EQ (buf->len, 4);
 		TEST_EQ_MEM (buf->buf, "test", 4);
 	}
 
 
 	/* Check that we can push more data into that buffer, which will
-	 * append it to the data already there.
+	 * append it to the data already there, growing the buffer.
 	 */
 	TEST_FEATURE ("with data in the buffer");
 	TEST_ALLOC_FAIL {
 		buf->len = 4;
-		buf->size = BUFSIZ;
+		buf->size = 4;
 		ret = nih_io_buffer_push (buf, "ing the buffer code", 14);
 
 		if (test_alloc_failed) {
@@ -580,8 +834,8 @@ test_buffer_push (void)
 		}
 
 		TEST_EQ (ret, 0);
-		TEST_ALLOC_SIZE (buf->buf, BUFSIZ);
-		TEST_EQ (buf->size, BUFSIZ);
+		TEST_ALLOC_SIZE (buf->buf, 32);
+		TEST_EQ (buf->size, 32);
 		TEST_EQ (buf->len, 18);
 		TEST_EQ_MEM (buf->buf, "testing the buffer code", 18);
 	}
@@ -589,6 +843,81 @@ test_buffer_push (void)
 	nih_free (buf);
 }
 
+void
+test_buffer_printf (void)
+{
+	NihIoBuffer *buf;
+	char        *large;
+	int          ret;
+
+	TEST_FUNCTION ("nih_io_buffer_printf");
+
+	/* Check that we can format data into an empty buffer, which will
+	 * store it in the buffer without the NULL terminator.
+	 */
+	TEST_FEATURE ("with empty buffer");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+		}
+
+		ret = nih_io_buffer_printf (buf, "test %d", 42);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->len, 0);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (buf->size, 8);
+		TEST_EQ (buf->len, 7);
+		TEST_EQ_MEM (buf->buf, "test 42", 7);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that formatted data is appended to the data already in
+	 * the buffer, and that the buffer grows when it doesn't fit in the
+	 * room left.
+	 */
+	TEST_FEATURE ("with data in the buffer");
+	large = nih_alloc (NULL, BUFSIZ + 1);
+	memset (large, 'x', BUFSIZ);
+	large[BUFSIZ] = '\0';
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_io_buffer_new (NULL);
+			assert0 (nih_io_buffer_push (buf, "test", 4));
+		}
+
+		ret = nih_io_buffer_printf (buf, "ing %s!", large);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ (buf->len, 4);
+			TEST_EQ_MEM (buf->buf, "test", 4);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (buf->size, BUFSIZ * 2);
+		TEST_EQ (buf->len, BUFSIZ + 9);
+		TEST_EQ_MEM (buf->buf, "testing xx", 10);
+		TEST_EQ_MEM (buf->buf + BUFSIZ + 7, "x!", 2);
+
+		nih_free (buf);
+	}
+
+	nih_free (large);
+}
+
 
 void
 test_message_new (void)
@@ -797,10 +1126,10 @@ test_message_recv (void)
 		len = 0;
 		msg = nih_io_message_recv (NULL, fds[1], &len);
 
-		/* 8th alloc onwards is control data, and we mandate that
+		/* 6th alloc onwards is control data, and we mandate that
 		 * always succeeds.
 		 */
-		if (test_alloc_failed && (test_alloc_failed < 8)) {
+		if (test_alloc_failed && (test_alloc_failed < 6)) {
 			TEST_EQ_P (msg, NULL);
 
 			err = nih_error_get ();
@@ -954,7 +1283,7 @@ test_message_recv (void)
 		TEST_EQ_P (msg, NULL);
 
 		err = nih_error_get ();
-		if (test_alloc_failed && (test_alloc_failed < 7)) {
+		if (test_alloc_failed && (test_alloc_failed < 4)) {
 			TEST_EQ (err->number, ENOMEM);
 		} else {
 			TEST_EQ (err->number, EBADF);
@@ -1111,7 +1440,9 @@ test_message_send (void)
 	close (fds[1]);
 
 
-	/* Check that we get an error if the socket is closed. */
+	/* Check that we get an error if the socket is closed; no memory
+	 * is allocated to send a message without control data.
+	 */
 	TEST_FEATURE ("with closed socket");
 	nih_error_push_context ();
 	msg = nih_io_message_new (NULL);
@@ -1123,11 +1454,7 @@ test_message_send (void)
 		TEST_LT (ret, 0);
 
 		err = nih_error_get ();
-		if (test_alloc_failed && (test_alloc_failed < 2)) {
-			TEST_EQ (err->number, ENOMEM);
-		} else {
-			TEST_EQ (err->number, EBADF);
-		}
+		TEST_EQ (err->number, EBADF);
 		nih_free (err);
 	}
 
@@ -1233,81 +1560,699 @@ test_reopen (void)
 		TEST_EQ (io->watch->events, NIH_IO_READ);
 		TEST_TRUE (fcntl (fds[0], F_GETFL) & O_NONBLOCK);
 
-		nih_free (io);
-		close (fds[1]);
-	}
+		nih_free (io);
+		close (fds[1]);
+	}
+
+
+	/* Check that we can create a message mode NihIo structure from an
+	 * existing file descriptor; the structure should be correctly
+	 * populated and assigned an NihIoWatch.  The file descriptor
+	 * should be altered so that it is non-blocking.
+	 */
+	TEST_FEATURE ("with message mode");
+	TEST_ALLOC_FAIL {
+		assert0 (pipe (fds));
+		io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+				    my_reader, my_close_handler,
+				    my_error_handler, &io);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (io, NULL);
+
+			err = nih_error_get ();
+			TEST_EQ (err->number, ENOMEM);
+			nih_free (err);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (io, sizeof (NihIo));
+		TEST_ALLOC_PARENT (io->send_q, io);
+		TEST_ALLOC_SIZE (io->send_q, sizeof (NihList));
+		TEST_ALLOC_PARENT (io->recv_q, io);
+		TEST_ALLOC_SIZE (io->recv_q, sizeof (NihList));
+		TEST_ALLOC_PARENT (io->spare_q, io);
+		TEST_LIST_EMPTY (io->spare_q);
+		TEST_EQ (io->spare_count, 0);
+		TEST_EQ (io->msg_size, 0);
+		TEST_EQ_P (io->recv_area, NULL);
+		TEST_EQ (io->type, NIH_IO_MESSAGE);
+		TEST_EQ_P (io->reader, my_reader);
+		TEST_EQ_P (io->close_handler, my_close_handler);
+		TEST_EQ_P (io->error_handler, my_error_handler);
+		TEST_EQ_P (io->data, &io);
+		TEST_FALSE (io->shutdown);
+		TEST_EQ_P (io->free, NULL);
+
+		TEST_ALLOC_PARENT (io->watch, io);
+		TEST_EQ (io->watch->fd, fds[0]);
+		TEST_EQ (io->watch->events, NIH_IO_READ);
+		TEST_TRUE (fcntl (fds[0], F_GETFL) & O_NONBLOCK);
+
+		nih_free (io);
+		close (fds[1]);
+	}
+
+
+	/* Check that the SIGPIPE signal will now be ignored */
+	sigaction (SIGPIPE, NULL, &oldact);
+	TEST_EQ (oldact.sa_handler, SIG_IGN);
+
+
+	/* Check that we get EBADF raised if we try and reopen a file that
+	 * is closed.
+	 */
+	TEST_FEATURE ("with closed file");
+	nih_error_push_context ();
+	assert0 (pipe (fds));
+	close (fds[0]);
+	close (fds[1]);
+
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    my_reader, my_close_handler,
+			    my_error_handler, &io);
+
+	TEST_EQ_P (io, NULL);
+
+	err = nih_error_get ();
+	TEST_EQ (err->number, EBADF);
+	nih_free (err);
+	nih_error_pop_context ();
+}
+
+
+void
+test_set_buffer_size (void)
+{
+	NihIo *io;
+	int    fds[2];
+
+	/* Check that the size hints are set on each buffer. */
+	TEST_FUNCTION ("nih_io_set_buffer_size");
+	assert0 (pipe (fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, NULL);
+
+	nih_io_set_buffer_size (io, BUFSIZ * 16, BUFSIZ * 2);
+
+	TEST_EQ (io->recv_buf->min_size, BUFSIZ * 16);
+	TEST_EQ (io->send_buf->min_size, BUFSIZ * 2);
+
+	assert0 (nih_io_write (io, "test", 4));
+
+	TEST_EQ (io->send_buf->size, BUFSIZ * 2);
+
+	nih_free (io);
+	close (fds[1]);
+}
+
+static int full_called = 0;
+static NihIoEvents last_full = NIH_IO_NONE;
+
+static void
+my_full_handler (void  *data,
+		 NihIo *io)
+{
+	last_data = data;
+	last_full = io->full;
+	full_called++;
+}
+
+void
+test_set_watermarks (void)
+{
+	NihIo  *io;
+	char    buf[BUFSIZ * 4], *str;
+	size_t  len;
+	int     fds[2];
+	fd_set  readfds, writefds, exceptfds;
+
+	TEST_FUNCTION ("nih_io_set_watermarks");
+	assert0 (socketpair (PF_UNIX, SOCK_STREAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, buf);
+
+	nih_io_set_watermarks (io, BUFSIZ, BUFSIZ * 2, my_full_handler);
+
+	memset (buf, 'x', sizeof (buf));
+
+
+	/* Check that once the receive buffer reaches the high watermark,
+	 * no more data is read and the file descriptor is no longer
+	 * watched for reading.  Reads are limited so that the buffer stops
+	 * exactly at the high watermark.
+	 */
+	TEST_FEATURE ("with receive buffer filled");
+	assert (write (fds[1], buf, sizeof (buf)) == sizeof (buf));
+
+	full_called = 0;
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (io->recv_buf->len, BUFSIZ * 2);
+	TEST_TRUE (io->full & NIH_IO_READ);
+	TEST_FALSE (io->watch->events & NIH_IO_READ);
+	TEST_FALSE (full_called);
+
+
+	/* Check that reading resumes only once the receive buffer has
+	 * drained to the low watermark.
+	 */
+	TEST_FEATURE ("with receive buffer drained");
+	len = io->recv_buf->len - BUFSIZ - 1;
+	str = nih_io_read (NULL, io, &len);
+	nih_free (str);
+
+	TEST_TRUE (io->full & NIH_IO_READ);
+	TEST_FALSE (io->watch->events & NIH_IO_READ);
+
+	len = 1;
+	str = nih_io_read (NULL, io, &len);
+	nih_free (str);
+
+	TEST_FALSE (io->full & NIH_IO_READ);
+	TEST_TRUE (io->watch->events & NIH_IO_READ);
+
+	len = io->recv_buf->len;
+	str = nih_io_read (NULL, io, &len);
+	nih_free (str);
+
+
+	/* Check that once the send buffer reaches the high watermark the
+	 * full handler is called, and that the data is still added.
+	 */
+	TEST_FEATURE ("with send buffer filled");
+	full_called = 0;
+	last_data = NULL;
+	last_full = NIH_IO_NONE;
+
+	assert0 (nih_io_write (io, buf, BUFSIZ));
+
+	TEST_FALSE (full_called);
+
+	assert0 (nih_io_write (io, buf, BUFSIZ));
+
+	TEST_EQ (full_called, 1);
+	TEST_EQ_P (last_data, buf);
+	TEST_TRUE (last_full & NIH_IO_WRITE);
+	TEST_EQ (io->send_buf->len, BUFSIZ * 2);
+
+
+	/* Check that the full handler is called again once the send buffer
+	 * has drained.
+	 */
+	TEST_FEATURE ("with send buffer drained");
+	full_called = 0;
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &writefds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (io->send_buf->len, 0);
+	TEST_EQ (full_called, 1);
+	TEST_FALSE (last_full & NIH_IO_WRITE);
+
+	nih_free (io);
+	close (fds[1]);
+}
+
+void
+test_set_read_budget (void)
+{
+	NihIo  *io;
+	char    buf[BUFSIZ * 4];
+	size_t  len;
+	int     fds[2];
+	fd_set  readfds, writefds, exceptfds;
+
+	TEST_FUNCTION ("nih_io_set_read_budget");
+	memset (buf, 'x', sizeof (buf));
+
+
+	/* Check that in stream mode, reading stops once the budget has been
+	 * used even though more data is available, and that the rest is
+	 * read when the descriptor is handled again.
+	 */
+	TEST_FEATURE ("with stream");
+	assert0 (socketpair (PF_UNIX, SOCK_STREAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, NULL);
+	nih_io_set_read_budget (io, BUFSIZ);
+
+	TEST_EQ (io->read_budget, BUFSIZ);
+
+	assert (write (fds[1], buf, sizeof (buf)) == sizeof (buf));
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (io->recv_buf->len, BUFSIZ);
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (io->recv_buf->len, BUFSIZ * 2);
+
+	nih_free (io);
+	close (fds[1]);
+
+
+	/* Check that the budget limits each read even when the receive
+	 * buffer has far more room than that.
+	 */
+	TEST_FEATURE ("with large receive buffer");
+	assert0 (socketpair (PF_UNIX, SOCK_STREAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, NULL);
+	nih_io_set_read_budget (io, 100);
+	assert0 (nih_io_buffer_resize (io->recv_buf, sizeof (buf)));
+
+	assert (write (fds[1], buf, sizeof (buf)) == sizeof (buf));
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (io->recv_buf->len, 100);
+
+	nih_free (io);
+	close (fds[1]);
+
+
+	/* Check that in message mode, the budget is a number of messages. */
+	TEST_FEATURE ("with messages");
+	assert0 (socketpair (PF_UNIX, SOCK_DGRAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, NULL, NULL);
+	nih_io_set_read_budget (io, 2);
+
+	assert (write (fds[1], "one", 3) == 3);
+	assert (write (fds[1], "two", 3) == 3);
+	assert (write (fds[1], "three", 5) == 5);
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	len = 0;
+	NIH_LIST_FOREACH (io->recv_q, iter)
+		len++;
+
+	TEST_EQ (len, 2);
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	len = 0;
+	NIH_LIST_FOREACH (io->recv_q, iter)
+		len++;
+
+	TEST_EQ (len, 3);
+
+	nih_free (io);
+	close (fds[1]);
+}
+
+void
+test_set_message_size (void)
+{
+	NihIo          *io;
+	NihIoMessage   *msg, *ptr;
+	struct msghdr   msghdr;
+	struct iovec    iov[1];
+	struct cmsghdr *cmsg;
+	char            buf[128], cbuf[CMSG_SPACE (sizeof (int))];
+	char            rbuf[CMSG_SPACE (sizeof (int) * 100)];
+	char           *str;
+	size_t          len;
+	int             fds[2], pipefds[2], i;
+	fd_set          readfds, writefds, exceptfds;
+
+	TEST_FUNCTION ("nih_io_set_message_size");
+	memset (buf, 'x', sizeof (buf));
+
+	msghdr.msg_name = NULL;
+	msghdr.msg_namelen = 0;
+	msghdr.msg_iov = iov;
+	msghdr.msg_iovlen = 1;
+	msghdr.msg_control = NULL;
+	msghdr.msg_controllen = 0;
+	msghdr.msg_flags = 0;
+
+
+	/* Check that a message read from the receive queue is reused for
+	 * the next message received, rather than being freed.
+	 */
+	TEST_FEATURE ("with message reused");
+	assert0 (socketpair (PF_UNIX, SOCK_DGRAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, NULL, NULL);
+
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+
+	assert (write (fds[1], "one", 3) == 3);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	msg = (NihIoMessage *)io->recv_q->next;
+	TEST_FREE_TAG (msg);
+
+	len = 3;
+	str = nih_io_read (NULL, io, &len);
+	nih_free (str);
+
+	TEST_NOT_FREE (msg);
+	TEST_EQ (io->spare_count, 1);
+
+	assert (write (fds[1], "two", 3) == 3);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ_P (io->recv_q->next, &msg->entry);
+	TEST_EQ (io->spare_count, 0);
+	TEST_EQ (msg->data->len, 3);
+	TEST_EQ_MEM (msg->data->buf, "two", 3);
+
+
+	/* Check that once the message size is set, more messages than are
+	 * received at once all end up in the receive queue in order, with
+	 * their control data.
+	 */
+	TEST_FEATURE ("with many messages");
+	nih_io_set_message_size (io, 64);
+
+	TEST_EQ (io->msg_size, 64);
+
+	for (i = 0; i < 40; i++) {
+		iov[0].iov_base = &i;
+		iov[0].iov_len = sizeof (i);
+
+		if (i == 20) {
+			msghdr.msg_control = cbuf;
+			msghdr.msg_controllen = sizeof (cbuf);
+
+			cmsg = CMSG_FIRSTHDR (&msghdr);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+			memcpy (CMSG_DATA (cmsg), &fds[1], sizeof (int));
+		} else {
+			msghdr.msg_control = NULL;
+			msghdr.msg_controllen = 0;
+		}
+
+		assert (sendmsg (fds[1], &msghdr, 0) == sizeof (i));
+	}
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_NE_P (io->recv_area, NULL);
+	TEST_ALLOC_PARENT (io->recv_area, io);
+
+	i = -1;
+	NIH_LIST_FOREACH (io->recv_q, iter) {
+		ptr = (NihIoMessage *)iter;
+
+		TEST_ALLOC_PARENT (ptr, io);
+
+		if (i < 0) {
+			TEST_EQ_P (ptr, msg);
+		} else {
+			TEST_EQ (ptr->data->len, sizeof (i));
+			TEST_EQ_MEM (ptr->data->buf, &i, sizeof (i));
+
+			if (i == 20) {
+				TEST_NE_P (ptr->control[0], NULL);
+				TEST_EQ (ptr->control[0]->cmsg_type,
+					 SCM_RIGHTS);
+				close (*(int *)CMSG_DATA (ptr->control[0]));
+			} else {
+				TEST_EQ_P (ptr->control[0], NULL);
+			}
+		}
+
+		i++;
+	}
+
+	TEST_EQ (i, 40);
+
+	nih_free (io);
+	close (fds[1]);
+
+
+	/* Check that a message longer than the size set is discarded, and
+	 * the error handler called, while those before it are queued.
+	 */
+	TEST_FEATURE ("with message too long");
+	assert0 (socketpair (PF_UNIX, SOCK_DGRAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, my_error_handler, &io);
+	nih_io_set_message_size (io, 64);
+
+	FD_ZERO (&readfds);
+	FD_SET (fds[0], &readfds);
+
+	assert (write (fds[1], "short", 5) == 5);
+	assert (write (fds[1], buf, sizeof (buf)) == sizeof (buf));
+
+	error_called = 0;
+	last_error = NULL;
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_TRUE (error_called);
+	TEST_EQ (last_error->number, EMSGSIZE);
+	nih_free (last_error);
+
+	TEST_LIST_NOT_EMPTY (io->recv_q);
+	msg = (NihIoMessage *)io->recv_q->next;
+	TEST_EQ (msg->data->len, 5);
+	TEST_EQ_MEM (msg->data->buf, "short", 5);
+	TEST_EQ_P (msg->entry.next, io->recv_q);
+
+	nih_free (io);
+	close (fds[1]);
+
+
+	/* Check that a message with more file descriptors than there's room
+	 * for in the control data is discarded, and the descriptors that
+	 * were received closed rather than leaked.
+	 */
+	TEST_FEATURE ("with too much control data");
+	assert0 (socketpair (PF_UNIX, SOCK_DGRAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, my_error_handler, &io);
+	nih_io_set_message_size (io, 64);
+
+	FD_ZERO (&readfds);
+	FD_SET (fds[0], &readfds);
+
+	assert0 (pipe (pipefds));
+	assert0 (fcntl (pipefds[0], F_SETFL, O_NONBLOCK));
+
+	iov[0].iov_base = "rights";
+	iov[0].iov_len = 6;
+	msghdr.msg_control = rbuf;
+	msghdr.msg_controllen = sizeof (rbuf);
+
+	cmsg = CMSG_FIRSTHDR (&msghdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof (int) * 100);
+	for (i = 0; i < 100; i++)
+		memcpy (CMSG_DATA (cmsg) + sizeof (int) * i, &pipefds[1],
+			sizeof (int));
+
+	assert (sendmsg (fds[1], &msghdr, 0) == 6);
+	close (pipefds[1]);
+
+	error_called = 0;
+	last_error = NULL;
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_TRUE (error_called);
+	TEST_EQ (last_error->number, EMSGSIZE);
+	nih_free (last_error);
+
+	TEST_LIST_EMPTY (io->recv_q);
+
+	/* Every copy of the write end has been closed */
+	TEST_EQ (read (pipefds[0], buf, sizeof (buf)), 0);
+
+	nih_free (io);
+	close (fds[1]);
+	close (pipefds[0]);
+}
+
+static void
+my_line_reader (void       *data,
+		NihIo      *io,
+		const char *str,
+		size_t      len)
+{
+	read_called++;
+
+	/* The error handler mustn't be called by nih_io_get() */
+	last_str = nih_io_get (NULL, io, "\n");
+	TEST_FALSE (error_called);
+}
+
+void
+test_set_max_line (void)
+{
+	NihIo  *io;
+	char   *str;
+	int     fds[2];
+	fd_set  readfds, writefds, exceptfds;
+
+	TEST_FUNCTION ("nih_io_set_max_line");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, my_error_handler, &io);
+	nih_io_set_max_line (io, 8);
+
+	TEST_EQ (io->max_line, 8);
+
+
+	/* Check that a line as long as the maximum is returned. */
+	TEST_FEATURE ("with line of maximum length");
+	assert0 (nih_io_buffer_push (io->recv_buf, "12345678\n", 9));
+
+	error_called = 0;
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_STR (str, "12345678");
+	TEST_FALSE (error_called);
+
+	nih_free (str);
+
+
+	/* Check that a longer line is discarded along with its delimiter,
+	 * leaving the next line to be read, and that the error is left to
+	 * be reported rather than the error handler being called.
+	 */
+	TEST_FEATURE ("with line too long");
+	assert0 (nih_io_buffer_push (io->recv_buf, "123456789\nnext\n", 15));
+
+	error_called = 0;
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_P (str, NULL);
+	TEST_FALSE (error_called);
+	TEST_TRUE (io->line_too_long);
+	io->line_too_long = FALSE;
+
+	TEST_EQ (io->recv_buf->len, 5);
+	TEST_EQ_MEM (io->recv_buf->buf, "next\n", 5);
+
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_STR (str, "next");
+
+	nih_free (str);
+
+
+	/* Check that a line that isn't yet complete is discarded once it's
+	 * longer than the maximum.
+	 */
+	TEST_FEATURE ("with incomplete line too long");
+	assert0 (nih_io_buffer_push (io->recv_buf, "12345678", 8));
+
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_P (str, NULL);
+	TEST_FALSE (io->line_too_long);
+	TEST_EQ (io->recv_buf->len, 8);
+
+	assert0 (nih_io_buffer_push (io->recv_buf, "9", 1));
 
+	str = nih_io_get (NULL, io, "\n");
 
-	/* Check that we can create a message mode NihIo structure from an
-	 * existing file descriptor; the structure should be correctly
-	 * populated and assigned an NihIoWatch.  The file descriptor
-	 * should be altered so that it is non-blocking.
+	TEST_EQ_P (str, NULL);
+	TEST_TRUE (io->line_too_long);
+	io->line_too_long = FALSE;
+
+	TEST_EQ (io->recv_buf->len, 0);
+	TEST_TRUE (io->discarding);
+
+	/* The rest of the line is discarded as it arrives, without being
+	 * returned as a line of its own or reported again.
 	 */
-	TEST_FEATURE ("with message mode");
-	TEST_ALLOC_FAIL {
-		assert0 (pipe (fds));
-		io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
-				    my_reader, my_close_handler,
-				    my_error_handler, &io);
+	assert0 (nih_io_buffer_push (io->recv_buf, "more", 4));
 
-		if (test_alloc_failed) {
-			TEST_EQ_P (io, NULL);
+	str = nih_io_get (NULL, io, "\n");
 
-			err = nih_error_get ();
-			TEST_EQ (err->number, ENOMEM);
-			nih_free (err);
-			continue;
-		}
+	TEST_EQ_P (str, NULL);
+	TEST_FALSE (io->line_too_long);
+	TEST_EQ (io->recv_buf->len, 0);
+	TEST_TRUE (io->discarding);
 
-		TEST_ALLOC_SIZE (io, sizeof (NihIo));
-		TEST_ALLOC_PARENT (io->send_q, io);
-		TEST_ALLOC_SIZE (io->send_q, sizeof (NihList));
-		TEST_ALLOC_PARENT (io->recv_q, io);
-		TEST_ALLOC_SIZE (io->recv_q, sizeof (NihList));
-		TEST_EQ (io->type, NIH_IO_MESSAGE);
-		TEST_EQ_P (io->reader, my_reader);
-		TEST_EQ_P (io->close_handler, my_close_handler);
-		TEST_EQ_P (io->error_handler, my_error_handler);
-		TEST_EQ_P (io->data, &io);
-		TEST_FALSE (io->shutdown);
-		TEST_EQ_P (io->free, NULL);
+	assert0 (nih_io_buffer_push (io->recv_buf, "EVIL\nok\n", 8));
 
-		TEST_ALLOC_PARENT (io->watch, io);
-		TEST_EQ (io->watch->fd, fds[0]);
-		TEST_EQ (io->watch->events, NIH_IO_READ);
-		TEST_TRUE (fcntl (fds[0], F_GETFL) & O_NONBLOCK);
+	str = nih_io_get (NULL, io, "\n");
 
-		nih_free (io);
-		close (fds[1]);
-	}
+	TEST_FALSE (io->line_too_long);
+	TEST_EQ_STR (str, "ok");
+	TEST_EQ (io->recv_buf->len, 0);
+	TEST_FALSE (io->discarding);
 
+	nih_free (str);
 
-	/* Check that the SIGPIPE signal will now be ignored */
-	sigaction (SIGPIPE, NULL, &oldact);
-	TEST_EQ (oldact.sa_handler, SIG_IGN);
+	nih_free (io);
 
 
-	/* Check that we get EBADF raised if we try and reopen a file that
-	 * is closed.
+	/* Check that when the reader finds a line too long, the error
+	 * handler is only called once the reader has returned, so that
+	 * it may free the structure without the reader using it after.
 	 */
-	TEST_FEATURE ("with closed file");
-	nih_error_push_context ();
-	assert0 (pipe (fds));
-	close (fds[0]);
-	close (fds[1]);
+	TEST_FEATURE ("with line too long found by reader");
+	assert0 (socketpair (PF_UNIX, SOCK_STREAM, 0, fds));
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    my_line_reader, NULL, my_error_handler, &io);
+	nih_io_set_max_line (io, 8);
 
-	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
-			    my_reader, my_close_handler,
-			    my_error_handler, &io);
+	assert (write (fds[1], "123456789\nnext\n", 15) == 15);
 
-	TEST_EQ_P (io, NULL);
+	read_called = 0;
+	error_called = 0;
+	last_data = NULL;
+	last_error = NULL;
+	last_str = NULL;
 
-	err = nih_error_get ();
-	TEST_EQ (err->number, EBADF);
-	nih_free (err);
-	nih_error_pop_context ();
-}
+	FD_ZERO (&readfds);
+	FD_ZERO (&writefds);
+	FD_ZERO (&exceptfds);
+	FD_SET (fds[0], &readfds);
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_EQ (read_called, 1);
+	TEST_EQ_P (last_str, NULL);
+	TEST_EQ (error_called, 1);
+	TEST_EQ_P (last_data, &io);
+	TEST_EQ (last_error->number, NIH_IO_LINE_TOO_LONG);
+	nih_free (last_error);
+
+	TEST_FALSE (io->line_too_long);
+	TEST_EQ (io->recv_buf->len, 5);
+	TEST_EQ_MEM (io->recv_buf->buf, "next\n", 5);
 
+	nih_free (io);
+	close (fds[1]);
+}
 
 void
 test_shutdown (void)
@@ -1493,7 +2438,7 @@ test_watcher (void)
 {
 	NihIo         *io;
 	NihIoMessage  *msg, *msg2;
-	int            fds[2];
+	int            fds[2], i;
 	ssize_t        len;
 	struct msghdr  msghdr;
 	struct iovec   iov[1];
@@ -1853,7 +2798,7 @@ test_watcher (void)
 
 		nih_io_handle_fds (&readfds, &writefds, &exceptfds);
 
-		if (test_alloc_failed && (test_alloc_failed < 8)) {
+		if (test_alloc_failed && (test_alloc_failed < 6)) {
 			TEST_EQ (recvmsg (fds[0], &msghdr, 0), 14);
 			continue;
 		} else if (test_alloc_failed) {
@@ -2181,6 +3126,42 @@ test_watcher (void)
 	TEST_EQ_MEM (buf, "another test", 12);
 
 
+	/* Check that more messages than are sent at once all go out in
+	 * the order they were queued, including one with control data
+	 * in the middle of them.
+	 */
+	TEST_FEATURE ("with many messages to write");
+	for (i = 0; i < 40; i++) {
+		msg = nih_io_message_new (NULL);
+		assert0 (nih_io_buffer_push (msg->data, "message", 7));
+		assert0 (nih_io_buffer_push (msg->data, (char *)&i,
+					     sizeof (i)));
+		if (i == 20)
+			assert0 (nih_io_message_add_control (msg, SOL_SOCKET,
+							     SCM_RIGHTS,
+							     sizeof (int),
+							     &fds[1]));
+		nih_io_send_message (io, msg);
+		nih_discard (msg);
+	}
+
+	FD_ZERO (&writefds);
+	FD_SET (fds[0], &writefds);
+
+	nih_io_handle_fds (&readfds, &writefds, &exceptfds);
+
+	TEST_LIST_EMPTY (io->send_q);
+	TEST_FALSE (io->watch->events & NIH_IO_WRITE);
+
+	for (i = 0; i < 40; i++) {
+		len = recvmsg (fds[1], &msghdr, 0);
+
+		TEST_EQ (len, 7 + sizeof (i));
+		TEST_EQ_MEM (buf, "message", 7);
+		TEST_EQ_MEM (buf + 7, &i, sizeof (i));
+	}
+
+
 	/* Check that an attempt to write to a closed descriptor results in
 	 * the error handler being called directly, rather than needing to
 	 * wait for a read again.
@@ -2486,8 +3467,8 @@ test_read (void)
 	}
 
 
-	/* Check that when we empty the buffer of the message, it is freed
-	 * and removed from the receive queue.
+	/* Check that when we empty the buffer of the message, it is removed
+	 * from the receive queue and kept to be reused.
 	 */
 	TEST_FEATURE ("with request to empty message buffer");
 	TEST_FREE_TAG (msg);
@@ -2505,9 +3486,11 @@ test_read (void)
 		TEST_ALLOC_SIZE (str, 16);
 		TEST_EQ (str[15], '\0');
 		TEST_EQ_STR (str, " of the io code");
-		TEST_FREE (msg);
+		TEST_NOT_FREE (msg);
 
 		TEST_LIST_EMPTY (io->recv_q);
+		TEST_EQ_P (io->spare_q->next, &msg->entry);
+		TEST_EQ (io->spare_count, 1);
 
 		nih_free (str);
 	}
@@ -2558,6 +3541,179 @@ test_read (void)
 	nih_free (str);
 }
 
+void
+test_peek (void)
+{
+	NihIo        *io;
+	NihIoMessage *msg;
+	const char   *ptr;
+	size_t        len;
+	int           fds[2];
+
+	TEST_FUNCTION ("nih_io_peek");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, NULL);
+
+
+	/* Check that NULL is returned with a zero length if there is
+	 * nothing in the buffer.
+	 */
+	TEST_FEATURE ("with empty buffer");
+	len = 1;
+	ptr = nih_io_peek (io, &len);
+
+	TEST_EQ_P (ptr, NULL);
+	TEST_EQ (len, 0);
+
+
+	/* Check that the data in the buffer is returned in place, without
+	 * being removed.
+	 */
+	TEST_FEATURE ("with data in buffer");
+	assert0 (nih_io_buffer_push (io->recv_buf, "this is a test", 14));
+
+	ptr = nih_io_peek (io, &len);
+
+	TEST_EQ_P (ptr, io->recv_buf->buf);
+	TEST_EQ (len, 14);
+	TEST_EQ (io->recv_buf->len, 14);
+
+	nih_free (io);
+
+
+	/* Check that in message mode the data of the oldest message is
+	 * returned in place.
+	 */
+	TEST_FEATURE ("with message in queue");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, NULL, NULL);
+
+	msg = nih_io_message_new (io);
+	assert0 (nih_io_buffer_push (msg->data, "this is a test", 14));
+	nih_list_add (io->recv_q, &msg->entry);
+
+	msg = nih_io_message_new (io);
+	assert0 (nih_io_buffer_push (msg->data, "another", 7));
+	nih_list_add (io->recv_q, &msg->entry);
+
+	msg = (NihIoMessage *)io->recv_q->next;
+	ptr = nih_io_peek (io, &len);
+
+	TEST_EQ_P (ptr, msg->data->buf);
+	TEST_EQ (len, 14);
+	TEST_EQ_P (io->recv_q->next, &msg->entry);
+
+	nih_free (io);
+
+
+	/* Check that NULL is returned with a zero length if there are no
+	 * messages in the queue.
+	 */
+	TEST_FEATURE ("with empty message queue");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, NULL, NULL);
+
+	len = 1;
+	ptr = nih_io_peek (io, &len);
+
+	TEST_EQ_P (ptr, NULL);
+	TEST_EQ (len, 0);
+
+	nih_free (io);
+}
+
+void
+test_consume (void)
+{
+	NihIo        *io;
+	NihIoMessage *msg1, *msg2;
+	int           fds[2];
+
+	TEST_FUNCTION ("nih_io_consume");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_STREAM,
+			    NULL, NULL, NULL, NULL);
+	assert0 (nih_io_buffer_push (io->recv_buf, "this is a test", 14));
+
+
+	/* Check that bytes are removed from the front of the buffer. */
+	TEST_FEATURE ("with data in buffer");
+	nih_io_consume (io, 5);
+
+	TEST_EQ (io->recv_buf->len, 9);
+	TEST_EQ_MEM (io->recv_buf->buf, "is a test", 9);
+
+
+	/* Check that removing more than is in the buffer empties it. */
+	TEST_FEATURE ("with more than in buffer");
+	nih_io_consume (io, 20);
+
+	TEST_EQ (io->recv_buf->len, 0);
+
+
+	/* Check that emptying the buffer of a shutdown socket closes the
+	 * socket and frees the structure.
+	 */
+	TEST_FEATURE ("with shutdown socket and emptied buffer");
+	TEST_FREE_TAG (io);
+
+	assert0 (nih_io_buffer_push (io->recv_buf, "some data", 9));
+	nih_io_shutdown (io);
+	nih_io_consume (io, 9);
+
+	TEST_FREE (io);
+	TEST_LT (fcntl (fds[0], F_GETFD), 0);
+	TEST_EQ (errno, EBADF);
+
+
+	/* Check that in message mode bytes are removed from the oldest
+	 * message, which is removed from the queue and kept to be reused
+	 * once empty.
+	 */
+	TEST_FEATURE ("with messages in queue");
+	assert0 (pipe (fds));
+	close (fds[1]);
+	io = nih_io_reopen (NULL, fds[0], NIH_IO_MESSAGE,
+			    NULL, NULL, NULL, NULL);
+
+	msg1 = nih_io_message_new (io);
+	assert0 (nih_io_buffer_push (msg1->data, "this is a test", 14));
+	nih_list_add (io->recv_q, &msg1->entry);
+
+	msg2 = nih_io_message_new (io);
+	assert0 (nih_io_buffer_push (msg2->data, "another", 7));
+	nih_list_add (io->recv_q, &msg2->entry);
+
+	nih_io_consume (io, 10);
+
+	TEST_EQ_P (io->recv_q->next, &msg1->entry);
+	TEST_EQ (msg1->data->len, 4);
+	TEST_EQ_MEM (msg1->data->buf, "test", 4);
+
+	nih_io_consume (io, 4);
+
+	TEST_EQ_P (io->recv_q->next, &msg2->entry);
+	TEST_EQ_P (io->spare_q->next, &msg1->entry);
+	TEST_EQ (msg2->data->len, 7);
+
+
+	/* Check that nothing happens with an empty message queue. */
+	TEST_FEATURE ("with empty message queue");
+	nih_io_consume (io, 7);
+	nih_io_consume (io, 7);
+
+	TEST_LIST_EMPTY (io->recv_q);
+
+	nih_free (io);
+}
+
 void
 test_write (void)
 {
@@ -2573,7 +3729,7 @@ test_write (void)
 			    NULL, NULL, NULL, NULL);
 
 	/* Check that we can write data into the NihIo send buffer, the
-	 * buffer should contain the data and be a page in size.  The
+	 * buffer should contain the data and be sized to fit it.  The
 	 * watch should also now be looking for writability.
 	 */
 	TEST_FEATURE ("with empty buffer");
@@ -2588,8 +3744,8 @@ test_write (void)
 		}
 
 		TEST_EQ (ret, 0);
-		TEST_ALLOC_SIZE (io->send_buf->buf, BUFSIZ);
-		TEST_EQ (io->send_buf->size, BUFSIZ);
+		TEST_ALLOC_SIZE (io->send_buf->buf, 4);
+		TEST_EQ (io->send_buf->size, 4);
 		TEST_EQ (io->send_buf->len, 4);
 		TEST_EQ_MEM (io->send_buf->buf, "test", 4);
 		TEST_TRUE (io->watch->events & NIH_IO_WRITE);
@@ -2602,7 +3758,7 @@ test_write (void)
 	TEST_FEATURE ("with data in the buffer");
 	TEST_ALLOC_FAIL {
 		io->send_buf->len = 4;
-		io->send_buf->size = BUFSIZ;
+		io->send_buf->size = 4;
 		ret = nih_io_write (io, "ing the io code", 10);
 
 		if (test_alloc_failed) {
@@ -2613,10 +3769,10 @@ test_write (void)
 		TEST_EQ (ret, 0);
 		TEST_EQ (io->send_buf->len, 14);
 		TEST_EQ_MEM (io->send_buf->buf, "testing the io", 14);
-
-		nih_free (io);
 	}
 
+	nih_free (io);
+
 
 	/* Check that we can write data into a message mode NihIo, and
 	 * have it made into a new message in the send queue.
@@ -2642,8 +3798,8 @@ test_write (void)
 
 		TEST_ALLOC_PARENT (msg, io);
 		TEST_ALLOC_SIZE (msg, sizeof (NihIoMessage));
-		TEST_ALLOC_SIZE (msg->data->buf, BUFSIZ);
-		TEST_EQ (msg->data->size, BUFSIZ);
+		TEST_ALLOC_SIZE (msg->data->buf, 4);
+		TEST_EQ (msg->data->size, 4);
 		TEST_EQ (msg->data->len, 4);
 		TEST_EQ_MEM (msg->data->buf, "test", 4);
 		TEST_TRUE (io->watch->events & NIH_IO_WRITE);
@@ -2674,8 +3830,8 @@ test_write (void)
 
 		TEST_ALLOC_PARENT (msg, io);
 		TEST_ALLOC_SIZE (msg, sizeof (NihIoMessage));
-		TEST_ALLOC_SIZE (msg->data->buf, BUFSIZ);
-		TEST_EQ (msg->data->size, BUFSIZ);
+		TEST_ALLOC_SIZE (msg->data->buf, 10);
+		TEST_EQ (msg->data->size, 10);
 		TEST_EQ (msg->data->len, 10);
 		TEST_EQ_MEM (msg->data->buf, "ing the io code", 10);
 		TEST_TRUE (io->watch->events & NIH_IO_WRITE);
@@ -2762,6 +3918,7 @@ test_get (void)
 
 	TEST_EQ (io->recv_buf->len, 10);
 	TEST_EQ_MEM (io->recv_buf->buf, "incomplete", 10);
+	TEST_EQ (io->recv_buf->scan, 10);
 
 	/* Check that a NULL terminator is sufficient to return the data
 	 * in the buffer, which should now be empty.
@@ -2774,8 +3931,59 @@ test_get (void)
 	TEST_EQ_STR (str, "incomplete");
 
 	TEST_EQ (io->recv_buf->len, 0);
+	TEST_EQ (io->recv_buf->scan, 0);
+
+	nih_free (str);
+
+
+	/* Check that data already searched for the delimiter isn't searched
+	 * again, and that the line is returned once the rest of it has
+	 * been received.
+	 */
+	TEST_FEATURE ("with line received in parts");
+	assert0 (nih_io_buffer_push (io->recv_buf, "part", 4));
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_P (str, NULL);
+	TEST_EQ (io->recv_buf->scan, 4);
+
+	assert0 (nih_io_buffer_push (io->recv_buf, "ial", 3));
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_P (str, NULL);
+	TEST_EQ (io->recv_buf->scan, 7);
+
+	assert0 (nih_io_buffer_push (io->recv_buf, " line\nmore", 10));
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_STR (str, "partial line");
+
+	TEST_EQ (io->recv_buf->len, 4);
+	TEST_EQ_MEM (io->recv_buf->buf, "more", 4);
+	TEST_EQ (io->recv_buf->scan, 0);
+
+	nih_free (str);
+
+
+	/* Check that data searched for one set of delimiters is searched
+	 * again for a different set.
+	 */
+	TEST_FEATURE ("with different delimiters");
+	assert0 (nih_io_buffer_push (io->recv_buf, " data", 5));
+	str = nih_io_get (NULL, io, "\n");
+
+	TEST_EQ_P (str, NULL);
+	TEST_EQ (io->recv_buf->scan, 9);
+
+	str = nih_io_get (NULL, io, " ");
+
+	TEST_EQ_STR (str, "more");
+
+	TEST_EQ (io->recv_buf->len, 4);
+	TEST_EQ_MEM (io->recv_buf->buf, "data", 4);
 
 	nih_free (str);
+	nih_io_buffer_shrink (io->recv_buf, 4);
 
 
 	/* Check that if we empty the buffer of a shutdown socket, the
@@ -2873,7 +4081,8 @@ test_get (void)
 
 	/* Check that a NULL terminator is sufficient to return the data
 	 * in the buffer, which should now be empty.  This should result
-	 * in the message being removed from the queue and freed.
+	 * in the message being removed from the queue and kept to be
+	 * reused.
 	 */
 	TEST_FEATURE ("with null-terminated string in message");
 	TEST_FREE_TAG (msg);
@@ -2884,8 +4093,9 @@ test_get (void)
 	TEST_ALLOC_SIZE (str, 11);
 	TEST_EQ_STR (str, "incomplete");
 
-	TEST_FREE (msg);
+	TEST_NOT_FREE (msg);
 	TEST_LIST_EMPTY (io->recv_q);
+	TEST_EQ_P (io->spare_q->next, &msg->entry);
 
 	nih_free (str);
 
@@ -2951,8 +4161,8 @@ test_printf (void)
 		}
 
 		TEST_EQ (ret, 0);
-		TEST_ALLOC_SIZE (io->send_buf->buf, BUFSIZ);
-		TEST_EQ (io->send_buf->size, BUFSIZ);
+		TEST_ALLOC_SIZE (io->send_buf->buf, 25);
+		TEST_EQ (io->send_buf->size, 25);
 		TEST_EQ (io->send_buf->len, 24);
 		TEST_EQ_MEM (io->send_buf->buf,
 			     "this is a 4 format test\n", 24);
@@ -2966,7 +4176,7 @@ test_printf (void)
 	TEST_FEATURE ("with data in the buffer");
 	TEST_ALLOC_FAIL {
 		io->send_buf->len = 24;
-		io->send_buf->size = BUFSIZ;
+		io->send_buf->size = 25;
 		ret = nih_io_printf (io, "and this is %s line\n", "another");
 
 		if (test_alloc_failed) {
@@ -3012,8 +4222,8 @@ test_printf (void)
 
 		TEST_ALLOC_PARENT (msg, io);
 		TEST_ALLOC_SIZE (msg, sizeof (NihIoMessage));
-		TEST_ALLOC_SIZE (msg->data->buf, BUFSIZ);
-		TEST_EQ (msg->data->size, BUFSIZ);
+		TEST_ALLOC_SIZE (msg->data->buf, 25);
+		TEST_EQ (msg->data->size, 25);
 		TEST_EQ (msg->data->len, 24);
 		TEST_EQ_MEM (msg->data->buf, "this is a 4 format test\n", 24);
 		TEST_TRUE (io->watch->events & NIH_IO_WRITE);
@@ -3045,8 +4255,8 @@ test_printf (void)
 
 		TEST_ALLOC_PARENT (msg, io);
 		TEST_ALLOC_SIZE (msg, sizeof (NihIoMessage));
-		TEST_ALLOC_SIZE (msg->data->buf, BUFSIZ);
-		TEST_EQ (msg->data->size, BUFSIZ);
+		TEST_ALLOC_SIZE (msg->data->buf, 26);
+		TEST_EQ (msg->data->size, 26);
 		TEST_EQ (msg->data->len, 25);
 		TEST_EQ_MEM (msg->data->buf, "and this is another line\n", 25);
 		TEST_TRUE (io->watch->events & NIH_IO_WRITE);
@@ -3172,17 +4382,25 @@ main (int   argc,
 	test_buffer_pop ();
 	test_buffer_shrink ();
 	test_buffer_push ();
+	test_buffer_printf ();
 	test_message_new ();
 	test_message_add_control ();
 	test_message_recv ();
 	test_message_send ();
 	test_reopen ();
+	test_set_buffer_size ();
+	test_set_watermarks ();
+	test_set_read_budget ();
+	test_set_message_size ();
+	test_set_max_line ();
 	test_shutdown ();
 	test_destroy ();
 	test_watcher ();
 	test_read_message ();
 	test_send_message ();
 	test_read ();
+	test_peek ();
+	test_consume ();
 	test_write ();
 	test_get ();
 	test_printf ();
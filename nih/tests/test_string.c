@@ -23,6 +23,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <pty.h>
 #include <fcntl.h>
@@ -84,6 +85,33 @@ test_sprintf (void)
 	}
 
 	nih_free (str1);
+
+
+	/* Check that a string too long to be formatted in one go is
+	 * still formatted in full and allocated at the right length.
+	 */
+	TEST_FEATURE ("with long string");
+	str1 = NIH_MUST (nih_alloc (NULL, 1000));
+	memset (str1, 'x', 999);
+	str1[999] = '\0';
+
+	TEST_ALLOC_FAIL {
+		str2 = nih_sprintf (NULL, "%s %d", str1, 54321);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str2, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (str2, 1006);
+		TEST_EQ (strlen (str2), 1005);
+		TEST_EQ_STRN (str2, str1);
+		TEST_EQ_STR (str2 + 999, " 54321");
+
+		nih_free (str2);
+	}
+
+	nih_free (str1);
 }
 
 
@@ -498,6 +526,38 @@ test_strcat_sprintf (void)
 
 		nih_free (str);
 	}
+
+
+	/* Check that a string too long to be formatted in one go is
+	 * still appended in full.
+	 */
+	TEST_FEATURE ("with long string");
+	TEST_ALLOC_FAIL {
+		char large[1000];
+
+		memset (large, 'x', sizeof (large) - 1);
+		large[sizeof (large) - 1] = '\0';
+
+		TEST_ALLOC_SAFE {
+			str = nih_strdup (NULL, "this");
+		}
+
+		ret = nih_strcat_sprintf (&str, NULL, " %s %d", large, 42);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			TEST_EQ_STR (str, "this");
+
+			nih_free (str);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (str, 4 + 1 + 999 + 3 + 1);
+		TEST_EQ_STRN (str, "this xxx");
+		TEST_EQ_STR (str + 4 + 1 + 999, " 42");
+
+		nih_free (str);
+	}
 }
 
 static char *
@@ -583,6 +643,458 @@ test_strcat_vsprintf (void)
 }
 
 
+void
+test_str_buf_new (void)
+{
+	NihStrBuf *buf;
+
+	/* Check that a new buffer is empty and has nothing allocated for
+	 * the string yet.
+	 */
+	TEST_FUNCTION ("nih_str_buf_new");
+	TEST_ALLOC_FAIL {
+		buf = nih_str_buf_new (NULL);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (buf, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (buf, sizeof (NihStrBuf));
+		TEST_EQ_P (buf->str, NULL);
+		TEST_EQ (buf->len, 0);
+		TEST_EQ (buf->size, 0);
+
+		nih_free (buf);
+	}
+}
+
+void
+test_str_buf_append (void)
+{
+	NihStrBuf *buf;
+	char      *str;
+	size_t     i;
+	int        ret, reallocs;
+
+	TEST_FUNCTION ("nih_str_buf_append");
+
+	/* Check that we can append to an empty buffer, which allocates the
+	 * string as a child of the buffer with room to spare.
+	 */
+	TEST_FEATURE ("with empty buffer");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+		}
+
+		ret = nih_str_buf_append (buf, "this is");
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_P (buf->str, NULL);
+			TEST_EQ (buf->len, 0);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_ALLOC_PARENT (buf->str, buf);
+		TEST_EQ_STR (buf->str, "this is");
+		TEST_EQ (buf->len, 7);
+		TEST_GT (buf->size, 7);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that further text is appended to the end of the string,
+	 * and that nih_str_buf_appendn() only takes the given number of
+	 * characters.
+	 */
+	TEST_FEATURE ("with existing text");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "this is"));
+		}
+
+		ret = nih_str_buf_append (buf, " a test");
+		TEST_EQ (ret, 0);
+
+		ret = nih_str_buf_appendn (buf, " of appending, not", 13);
+		TEST_EQ (ret, 0);
+
+		TEST_EQ_STR (buf->str, "this is a test of appending");
+		TEST_EQ (buf->len, 27);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that the string grows geometrically, so that appending
+	 * many times only reallocates it a few times.
+	 */
+	TEST_FEATURE ("with many appends");
+	buf = nih_str_buf_new (NULL);
+	str = NULL;
+	reallocs = 0;
+
+	for (i = 0; i < 10000; i++) {
+		assert0 (nih_str_buf_append (buf, "abcdefgh"));
+
+		if (buf->str != str)
+			reallocs++;
+		str = buf->str;
+	}
+
+	TEST_EQ (buf->len, 80000);
+	TEST_EQ (strlen (buf->str), 80000);
+	TEST_LE (reallocs, 15);
+	TEST_EQ_STRN (buf->str + 79992, "abcdefgh");
+
+	nih_free (buf);
+}
+
+void
+test_str_buf_sprintf (void)
+{
+	NihStrBuf *buf;
+	char       large[200];
+	int        ret;
+
+	TEST_FUNCTION ("nih_str_buf_sprintf");
+
+	/* Check that we can append a formatted string to the buffer.
+	 */
+	TEST_FEATURE ("with short string");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "this"));
+		}
+
+		ret = nih_str_buf_sprintf (buf, " %s a test %d", "is", 54321);
+
+		TEST_EQ (ret, 0);
+		TEST_EQ_STR (buf->str, "this is a test 54321");
+		TEST_EQ (buf->len, 20);
+
+		nih_free (buf);
+	}
+
+
+	/* Check that a formatted string that does not fit in the room
+	 * left causes the string to grow, leaving it unchanged if that
+	 * fails.
+	 */
+	TEST_FEATURE ("with string larger than room left");
+	memset (large, 'x', sizeof (large) - 1);
+	large[sizeof (large) - 1] = '\0';
+
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "this"));
+		}
+
+		ret = nih_str_buf_sprintf (buf, " %s %d", large, 42);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_STR (buf->str, "this");
+			TEST_EQ (buf->len, 4);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (buf->len, 4 + 1 + 199 + 3);
+		TEST_EQ (strlen (buf->str), buf->len);
+		TEST_EQ_STRN (buf->str, "this xxx");
+		TEST_EQ_STR (buf->str + buf->len - 4, "x 42");
+
+		nih_free (buf);
+	}
+}
+
+void
+test_str_buf_indent (void)
+{
+	NihStrBuf *buf;
+	int        ret;
+
+	TEST_FUNCTION ("nih_str_buf_indent");
+
+	/* Check that each non-empty line of the appended string is
+	 * indented by the given number of tabs, including the last.
+	 */
+	TEST_FEATURE ("with multiple lines");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "{\n"));
+		}
+
+		ret = nih_str_buf_indent (buf, "foo;\n\nbar;\nbaz;", 2);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_STR (buf->str, "{\n");
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ_STR (buf->str, "{\n\t\tfoo;\n\n\t\tbar;\n\t\tbaz;");
+		TEST_EQ (buf->len, strlen (buf->str));
+
+		nih_free (buf);
+	}
+
+
+	/* Check that a string beginning with a blank line is not indented
+	 * on that line.
+	 */
+	TEST_FEATURE ("with leading blank line");
+	buf = nih_str_buf_new (NULL);
+
+	ret = nih_str_buf_indent (buf, "\nfoo;\n", 1);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ_STR (buf->str, "\n\tfoo;\n");
+	TEST_EQ (buf->len, 7);
+
+	nih_free (buf);
+}
+
+void
+test_str_buf_finish (void)
+{
+	NihStrBuf *buf;
+	char      *str;
+	void      *parent;
+
+	TEST_FUNCTION ("nih_str_buf_finish");
+	parent = nih_alloc (NULL, 0);
+
+	/* Check that the string built is returned with the given parent
+	 * and sized exactly, and that the buffer is left empty.
+	 */
+	TEST_FEATURE ("with string");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "this is a test"));
+		}
+
+		str = nih_str_buf_finish (buf, parent);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str, NULL);
+			TEST_EQ_STR (buf->str, "this is a test");
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_ALLOC_PARENT (str, parent);
+		TEST_ALLOC_SIZE (str, 15);
+		TEST_EQ_STR (str, "this is a test");
+
+		TEST_EQ_P (buf->str, NULL);
+		TEST_EQ (buf->len, 0);
+		TEST_EQ (buf->size, 0);
+
+		nih_free (buf);
+
+		TEST_EQ_STR (str, "this is a test");
+
+		nih_free (str);
+	}
+
+
+	/* Check that objects referenced by the string while it was being
+	 * built remain referenced by the returned string.
+	 */
+	TEST_FEATURE ("with referenced objects");
+	TEST_ALLOC_FAIL {
+		char *child;
+
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+			assert0 (nih_str_buf_append (buf, "this is a test"));
+			child = nih_strdup (buf->str, "child");
+		}
+
+		str = nih_str_buf_finish (buf, NULL);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str, NULL);
+			TEST_ALLOC_PARENT (child, buf->str);
+
+			nih_free (buf);
+			continue;
+		}
+
+		nih_free (buf);
+
+		TEST_ALLOC_PARENT (child, str);
+		TEST_EQ_STR (child, "child");
+
+		nih_free (str);
+	}
+
+
+	/* Check that an empty string is returned when nothing has been
+	 * appended to the buffer.
+	 */
+	TEST_FEATURE ("with empty buffer");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			buf = nih_str_buf_new (NULL);
+		}
+
+		str = nih_str_buf_finish (buf, parent);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (str, NULL);
+
+			nih_free (buf);
+			continue;
+		}
+
+		TEST_ALLOC_PARENT (str, parent);
+		TEST_EQ_STR (str, "");
+
+		nih_free (buf);
+		nih_free (str);
+	}
+
+	nih_free (parent);
+}
+
+
+void
+test_str_delim (void)
+{
+	NihStrDelim delim;
+	char        str[1024];
+	char       *map;
+	size_t      page;
+
+	TEST_FUNCTION ("nih_str_delim_find");
+
+	/* Check that a delimiter set with a single character finds the
+	 * first occurrence of that character, and that characters outside
+	 * the set are not members of it.
+	 */
+	TEST_FEATURE ("with single character");
+	nih_str_delim_init (&delim, "\n");
+
+	TEST_TRUE (NIH_STR_IS_DELIM (&delim, '\n'));
+	TEST_TRUE (NIH_STR_IS_DELIM (&delim, '\0'));
+	TEST_FALSE (NIH_STR_IS_DELIM (&delim, ' '));
+
+	TEST_EQ (nih_str_delim_find (&delim, "this is\na test\n", 15), 7);
+
+
+	/* Check that a delimiter set with two characters finds whichever
+	 * occurs first.
+	 */
+	TEST_FEATURE ("with two characters");
+	nih_str_delim_init (&delim, " \t");
+
+	TEST_EQ (nih_str_delim_find (&delim, "this\tis a test", 14), 4);
+	TEST_EQ (nih_str_delim_find (&delim, "this is\ta test", 14), 4);
+
+
+	/* Check that a delimiter set with many characters finds the first
+	 * of any of them.
+	 */
+	TEST_FEATURE ("with many characters");
+	nih_str_delim_init (&delim, ":;,.");
+
+	TEST_TRUE (NIH_STR_IS_DELIM (&delim, ','));
+	TEST_TRUE (NIH_STR_IS_DELIM (&delim, '\0'));
+	TEST_FALSE (NIH_STR_IS_DELIM (&delim, 'a'));
+
+	TEST_EQ (nih_str_delim_find (&delim, "this is, a; test", 16), 7);
+
+
+	/* Check that a NUL character is always found, even though it
+	 * was not given in the set.
+	 */
+	TEST_FEATURE ("with embedded NUL");
+	nih_str_delim_init (&delim, "\n");
+
+	TEST_EQ (nih_str_delim_find (&delim, "this\0is\na test", 14), 4);
+
+	nih_str_delim_init (&delim, ":;,.");
+
+	TEST_EQ (nih_str_delim_find (&delim, "this\0is,a test", 14), 4);
+
+
+	/* Check that the length of the string is returned when there are
+	 * no delimiters in it, and that characters beyond the given length
+	 * are not examined.
+	 */
+	TEST_FEATURE ("with no delimiter");
+	nih_str_delim_init (&delim, " \t");
+
+	TEST_EQ (nih_str_delim_find (&delim, "this is a test", 4), 4);
+	TEST_EQ (nih_str_delim_find (&delim, "", 0), 0);
+
+	nih_str_delim_init (&delim, ":;,.");
+
+	TEST_EQ (nih_str_delim_find (&delim, "this:is:a:test", 4), 4);
+
+
+	/* Check that a delimiter is found a long way into a string. */
+	TEST_FEATURE ("with long string");
+	memset (str, 'x', sizeof (str));
+	str[1000] = '\n';
+
+	nih_str_delim_init (&delim, "\n");
+
+	TEST_EQ (nih_str_delim_find (&delim, str, sizeof (str)), 1000);
+
+	nih_str_delim_init (&delim, "\n\r;");
+
+	TEST_EQ (nih_str_delim_find (&delim, str, sizeof (str)), 1000);
+
+
+	/* Check that when the first character of the set never occurs,
+	 * the second is still found without searching the rest of the
+	 * string; the string is followed by memory that can't be read, so
+	 * searching any further would crash.
+	 */
+	TEST_FEATURE ("with first delimiter absent");
+	page = sysconf (_SC_PAGESIZE);
+	map = mmap (NULL, page * 2, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert (map != MAP_FAILED);
+	assert0 (mprotect (map + page, page, PROT_NONE));
+
+	memset (map, 'x', page);
+	map[3] = '\t';
+
+	nih_str_delim_init (&delim, " \t");
+
+	TEST_EQ (nih_str_delim_find (&delim, map, page * 1024), 3);
+
+	nih_str_delim_init (&delim, "\r\n");
+	map[3] = '\n';
+
+	TEST_EQ (nih_str_delim_find (&delim, map, page * 1024), 3);
+
+	munmap (map, page * 2);
+}
+
+
 void
 test_str_split (void)
 {
@@ -1026,6 +1538,30 @@ test_str_split (void)
 		nih_free (array);
 	}
 
+	/* Check that we can split a string at any of a larger number of
+	 * delimiter characters.
+	 */
+	TEST_FEATURE ("with many delimiter characters");
+	TEST_ALLOC_FAIL {
+		array = nih_str_split (NULL, "this:is;;a,test", ":;,", FALSE);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (array, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (array, sizeof (char *) * 6);
+
+		TEST_EQ_STR (array[0], "this");
+		TEST_EQ_STR (array[1], "is");
+		TEST_EQ_STR (array[2], "");
+		TEST_EQ_STR (array[3], "a");
+		TEST_EQ_STR (array[4], "test");
+		TEST_EQ_P (array[5], NULL);
+
+		nih_free (array);
+	}
+
 	/* Check that we can give an empty string, and end up with a
 	 * one-element array that only contains a NULL pointer.
 	 */
@@ -1069,11 +1605,103 @@ test_array_new (void)
 	}
 }
 
+void
+test_array_reserve (void)
+{
+	char   **array, **ret, **old_array;
+	size_t   len;
+
+	TEST_FUNCTION ("nih_str_array_reserve");
+
+	/* Check that we can reserve room in a NULL array pointer, and get
+	 * an empty array allocated with room for that many elements and
+	 * the NULL terminator.
+	 */
+	TEST_FEATURE ("with no array given");
+	TEST_ALLOC_FAIL {
+		array = NULL;
+
+		ret = nih_str_array_reserve (&array, NULL, 10);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			TEST_EQ_P (array, NULL);
+			continue;
+		}
+
+		TEST_EQ_P (ret, array);
+		TEST_EQ (nih_alloc_size (array), sizeof (char *) * 11);
+		TEST_EQ_P (array[0], NULL);
+
+		nih_free (array);
+	}
+
+
+	/* Check that reserving room in an existing array keeps its
+	 * elements, and that adding up to that many elements afterwards
+	 * doesn't move the array.
+	 */
+	TEST_FEATURE ("with existing array");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			array = nih_str_array_new (NULL);
+			len = 0;
+			assert (nih_str_array_add (&array, NULL, &len, "test"));
+		}
+
+		ret = nih_str_array_reserve (&array, NULL, 100);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			TEST_EQ_STR (array[0], "test");
+			TEST_EQ_P (array[1], NULL);
+
+			nih_free (array);
+			continue;
+		}
+
+		TEST_EQ_P (ret, array);
+		TEST_EQ (nih_alloc_size (array), sizeof (char *) * 101);
+		TEST_EQ_STR (array[0], "test");
+		TEST_EQ_P (array[1], NULL);
+
+		TEST_ALLOC_SAFE {
+			old_array = array;
+			while (len < 100)
+				assert (nih_str_array_add (&array, NULL, &len,
+							   "test"));
+		}
+
+		TEST_EQ_P (array, old_array);
+		TEST_EQ_P (array[100], NULL);
+
+		nih_free (array);
+	}
+
+
+	/* Check that reserving less room than the array already has
+	 * leaves it unchanged.
+	 */
+	TEST_FEATURE ("with smaller size");
+	array = nih_str_array_new (NULL);
+	assert (nih_str_array_reserve (&array, NULL, 10));
+	old_array = array;
+
+	ret = nih_str_array_reserve (&array, NULL, 5);
+
+	TEST_EQ_P (ret, old_array);
+	TEST_EQ_P (array, old_array);
+	TEST_EQ (nih_alloc_size (array), sizeof (char *) * 11);
+
+	nih_free (array);
+}
+
 void
 test_array_add (void)
 {
 	char   **array, **ret;
 	size_t   len;
+	int      reallocs;
 
 	/* Check that we can append strings to a NULL-terminated array.
 	 */
@@ -1103,6 +1731,30 @@ test_array_add (void)
 	}
 
 	nih_free (array);
+
+
+	/* Check that adding many strings to an array reallocates it only
+	 * a few times, since its size is doubled each time it's full.
+	 */
+	TEST_FEATURE ("with many strings");
+	array = nih_str_array_new (NULL);
+	len = 0;
+	reallocs = 0;
+
+	for (int i = 0; i < 10000; i++) {
+		size_t size = nih_alloc_size (array);
+
+		assert (nih_str_array_add (&array, NULL, &len, "test"));
+
+		if (nih_alloc_size (array) != size)
+			reallocs++;
+	}
+
+	TEST_EQ (len, 10000);
+	TEST_EQ_P (array[10000], NULL);
+	TEST_LE (reallocs, 15);
+
+	nih_free (array);
 }
 
 void
@@ -1547,6 +2199,229 @@ test_array_append (void)
 	nih_free (args);
 }
 
+void
+test_array_copyp (void)
+{
+	char   **array, **args;
+	size_t   len;
+
+	TEST_FUNCTION ("nih_str_array_copyp");
+	args = NIH_MUST (nih_str_array_new (NULL));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "this"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "is"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "a"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "test"));
+
+
+	/* Check that we can make a copy of an array that shares the
+	 * strings of the original, each being referenced by both arrays.
+	 */
+	TEST_FEATURE ("with length given");
+	TEST_ALLOC_FAIL {
+		len = 0;
+		array = nih_str_array_copyp (NULL, &len, args);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (array, NULL);
+			TEST_FALSE (nih_alloc_shared (args[0]));
+			continue;
+		}
+
+		TEST_NE_P (array, NULL);
+		TEST_EQ (len, 4);
+
+		for (len = 0; len < 4; len++) {
+			TEST_EQ_P (array[len], args[len]);
+			TEST_ALLOC_PARENT (array[len], array);
+			TEST_ALLOC_PARENT (array[len], args);
+		}
+		TEST_EQ_P (array[4], NULL);
+
+		nih_free (array);
+
+		TEST_FALSE (nih_alloc_shared (args[0]));
+		TEST_EQ_STR (args[0], "this");
+	}
+
+
+	/* Check that the shared strings remain when the original array is
+	 * freed, with only the copy referencing them.
+	 */
+	TEST_FEATURE ("with original freed");
+	TEST_ALLOC_FAIL {
+		char **orig;
+
+		TEST_ALLOC_SAFE {
+			orig = nih_str_array_copy (NULL, NULL, args);
+		}
+
+		array = nih_str_array_copyp (NULL, NULL, orig);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (array, NULL);
+
+			nih_free (orig);
+			continue;
+		}
+
+		nih_free (orig);
+
+		TEST_EQ_STR (array[0], "this");
+		TEST_EQ_STR (array[1], "is");
+		TEST_EQ_STR (array[2], "a");
+		TEST_EQ_STR (array[3], "test");
+		TEST_EQ_P (array[4], NULL);
+
+		TEST_FALSE (nih_alloc_shared (array[0]));
+
+		nih_free (array);
+	}
+
+	nih_free (args);
+}
+
+void
+test_array_appendp (void)
+{
+	char   **array, **args, **ret;
+	size_t   len;
+
+	TEST_FUNCTION ("nih_str_array_appendp");
+	args = NIH_MUST (nih_str_array_new (NULL));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "this"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "is"));
+
+
+	/* Check that we can append one array onto the end of the other,
+	 * with the new elements shared rather than copied.
+	 */
+	TEST_FEATURE ("with length given");
+	TEST_ALLOC_FAIL {
+		len = 0;
+
+		TEST_ALLOC_SAFE {
+			array = nih_str_array_new (NULL);
+			NIH_MUST (nih_str_array_add (&array, NULL, &len,
+						     "foo"));
+		}
+
+		ret = nih_str_array_appendp (&array, NULL, &len, args);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+
+			TEST_EQ (len, 1);
+			TEST_EQ_STR (array[0], "foo");
+			TEST_EQ_P (array[1], NULL);
+			TEST_FALSE (nih_alloc_shared (args[0]));
+
+			nih_free (array);
+			continue;
+		}
+
+		TEST_NE_P (ret, NULL);
+
+		TEST_EQ (len, 3);
+		TEST_EQ_STR (array[0], "foo");
+		TEST_FALSE (nih_alloc_shared (array[0]));
+		TEST_EQ_P (array[1], args[0]);
+		TEST_ALLOC_PARENT (array[1], array);
+		TEST_EQ_P (array[2], args[1]);
+		TEST_ALLOC_PARENT (array[2], array);
+		TEST_EQ_P (array[3], NULL);
+
+		nih_free (array);
+	}
+
+
+	/* Check that we can pass a NULL array to get a shared copy of it.
+	 */
+	TEST_FEATURE ("with NULL array and no length");
+	TEST_ALLOC_FAIL {
+		array = NULL;
+		ret = nih_str_array_appendp (&array, NULL, NULL, args);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			TEST_EQ_P (array, NULL);
+			continue;
+		}
+
+		TEST_NE_P (ret, NULL);
+		TEST_EQ_P (array[0], args[0]);
+		TEST_EQ_P (array[1], args[1]);
+		TEST_EQ_P (array[2], NULL);
+
+		nih_free (array);
+	}
+
+	nih_free (args);
+}
+
+void
+test_array_unshare (void)
+{
+	char **array, **args, *str, *ret;
+
+	TEST_FUNCTION ("nih_str_array_unshare");
+	args = NIH_MUST (nih_str_array_new (NULL));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "this"));
+	NIH_MUST (nih_str_array_add (&args, NULL, NULL, "is"));
+
+
+	/* Check that a shared element is replaced by a copy belonging to
+	 * the array, leaving the original untouched.
+	 */
+	TEST_FEATURE ("with shared element");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			array = nih_str_array_copyp (NULL, NULL, args);
+		}
+
+		str = array[1];
+		ret = nih_str_array_unshare (array, 1);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ret, NULL);
+			TEST_EQ_P (array[1], str);
+			TEST_TRUE (nih_alloc_shared (str));
+
+			nih_free (array);
+			continue;
+		}
+
+		TEST_NE_P (ret, NULL);
+		TEST_EQ_P (array[1], ret);
+		TEST_NE_P (ret, args[1]);
+		TEST_ALLOC_PARENT (ret, array);
+		TEST_EQ_STR (ret, "is");
+
+		TEST_FALSE (nih_alloc_shared (args[1]));
+		TEST_FALSE (nih_alloc_parent (args[1], array));
+		TEST_EQ_P (array[0], args[0]);
+
+		ret[0] = 'I';
+		TEST_EQ_STR (args[1], "is");
+
+		nih_free (array);
+	}
+
+
+	/* Check that an element only referenced by the array is returned
+	 * as it is.
+	 */
+	TEST_FEATURE ("with unshared element");
+	TEST_ALLOC_FAIL {
+		str = args[0];
+		ret = nih_str_array_unshare (args, 0);
+
+		TEST_EQ_P (ret, str);
+		TEST_EQ_P (args[0], str);
+	}
+
+	nih_free (args);
+}
+
 
 void
 test_str_wrap (void)
@@ -1912,13 +2787,23 @@ main (int   argc,
 	test_strncat ();
 	test_strcat_sprintf ();
 	test_strcat_vsprintf ();
+	test_str_buf_new ();
+	test_str_buf_append ();
+	test_str_buf_sprintf ();
+	test_str_buf_indent ();
+	test_str_buf_finish ();
+	test_str_delim ();
 	test_str_split ();
 	test_array_new ();
+	test_array_reserve ();
 	test_array_add ();
 	test_array_addn ();
 	test_array_addp ();
 	test_array_copy ();
 	test_array_append ();
+	test_array_copyp ();
+	test_array_appendp ();
+	test_array_unshare ();
 	test_str_wrap ();
 	test_str_screen_width ();
 	test_str_screen_wrap ();
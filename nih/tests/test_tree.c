@@ -21,6 +21,8 @@
 
 #include <nih/test.h>
 
+#include <limits.h>
+
 #include <nih/macros.h>
 #include <nih/alloc.h>
 #include <nih/tree.h>
@@ -2201,6 +2203,541 @@ test_prev_post_full (void)
 }
 
 
+typedef struct sorted_entry {
+	NihSortedNode node;
+	int           key;
+	int           seq;
+} SortedEntry;
+
+static const void *
+sorted_key (NihTree *node)
+{
+	return &((SortedEntry *)node)->key;
+}
+
+static int
+sorted_cmp (const int *key1,
+	    const int *key2)
+{
+	return (*key1 > *key2) - (*key1 < *key2);
+}
+
+static SortedEntry *
+sorted_entry_new (const void *parent,
+		  int         key,
+		  int         seq)
+{
+	SortedEntry *entry;
+
+	entry = nih_new (parent, SortedEntry);
+	nih_tree_init (&entry->node.node);
+	entry->node.height = 0;
+	entry->key = key;
+	entry->seq = seq;
+
+	return entry;
+}
+
+static NihSortedTree *
+sorted_new (void)
+{
+	return nih_tree_sorted_new (NULL, sorted_key,
+				    (NihTreeCmpFunction)sorted_cmp);
+}
+
+/* Checks the subtree rooted at node for correct parent pointers, heights
+ * and balance, and that its keys lie within lower and upper; returns its
+ * height.
+ */
+static int
+sorted_check (NihTree *node,
+	      NihTree *parent,
+	      int      lower,
+	      int      upper)
+{
+	SortedEntry *entry = (SortedEntry *)node;
+	int          left, right;
+
+	if (! node)
+		return 0;
+
+	if (node->parent != parent)
+		TEST_FAILED ("wrong parent of node %d, expected %p got %p",
+			     entry->key, parent, node->parent);
+
+	if ((entry->key < lower) || (entry->key > upper))
+		TEST_FAILED ("node %d out of order, expected %d to %d",
+			     entry->key, lower, upper);
+
+	left = sorted_check (node->left, node, lower, entry->key);
+	right = sorted_check (node->right, node, entry->key, upper);
+
+	if ((left - right > 1) || (right - left > 1))
+		TEST_FAILED ("node %d unbalanced, left %d right %d",
+			     entry->key, left, right);
+
+	if (entry->node.height != (left > right ? left : right) + 1)
+		TEST_FAILED ("wrong height of node %d, expected %d got %d",
+			     entry->key, (left > right ? left : right) + 1,
+			     entry->node.height);
+
+	return entry->node.height;
+}
+
+/* Checks the whole sorted tree, including that its count is correct and
+ * that nodes with equal keys are in the order they were inserted.
+ */
+static void
+sorted_check_tree (NihSortedTree *tree)
+{
+	SortedEntry *last = NULL;
+	size_t       count = 0;
+
+	sorted_check (tree->root, NULL, INT_MIN, INT_MAX);
+
+	if (! tree->root) {
+		TEST_EQ (tree->count, 0);
+		return;
+	}
+
+	NIH_TREE_FOREACH (tree->root, iter) {
+		SortedEntry *entry = (SortedEntry *)iter;
+
+		if (last && (last->key == entry->key)
+		    && (last->seq > entry->seq))
+			TEST_FAILED ("equal keys %d out of order, %d before %d",
+				     entry->key, last->seq, entry->seq);
+
+		last = entry;
+		count++;
+	}
+
+	TEST_EQ (count, tree->count);
+}
+
+
+void
+test_sorted_new (void)
+{
+	NihSortedTree *tree;
+
+	/* Check that nih_tree_sorted_new allocates a new empty sorted tree
+	 * with nih_alloc, with the key and comparison functions we gave.
+	 * If allocation fails, we should get NULL returned.
+	 */
+	TEST_FUNCTION ("nih_tree_sorted_new");
+	TEST_ALLOC_FAIL {
+		tree = nih_tree_sorted_new (NULL, sorted_key,
+					    (NihTreeCmpFunction)sorted_cmp);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (tree, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (tree, sizeof (NihSortedTree));
+		TEST_EQ_P (tree->root, NULL);
+		TEST_EQ (tree->count, 0);
+		TEST_EQ_P (tree->key_function, sorted_key);
+		TEST_EQ_P (tree->cmp_function, (NihTreeCmpFunction)sorted_cmp);
+
+		nih_free (tree);
+	}
+}
+
+void
+test_insert (void)
+{
+	NihSortedTree *tree;
+	SortedEntry   *entry;
+	NihTree       *ptr;
+	int            i;
+
+	TEST_FUNCTION ("nih_tree_insert");
+
+	/* Check that inserting a node into an empty tree makes it the
+	 * root of the tree, with a height of one.
+	 */
+	TEST_FEATURE ("with empty tree");
+	tree = sorted_new ();
+	entry = sorted_entry_new (tree, 42, 0);
+
+	ptr = nih_tree_insert (tree, &entry->node);
+
+	TEST_EQ_P (ptr, &entry->node.node);
+	TEST_EQ_P (tree->root, &entry->node.node);
+	TEST_EQ (tree->count, 1);
+	TEST_EQ (entry->node.height, 1);
+	TEST_EQ_P (entry->node.node.parent, NULL);
+	TEST_EQ_P (entry->node.node.left, NULL);
+	TEST_EQ_P (entry->node.node.right, NULL);
+
+	nih_free (tree);
+
+
+	/* Check that inserting nodes in ascending order, the worst case
+	 * for an unbalanced tree, keeps the tree balanced.
+	 */
+	TEST_FEATURE ("with ascending keys");
+	tree = sorted_new ();
+
+	for (i = 0; i < 1000; i++)
+		nih_tree_insert (tree, &sorted_entry_new (tree, i, i)->node);
+
+	sorted_check_tree (tree);
+
+	TEST_EQ (tree->count, 1000);
+	TEST_LE (((NihSortedNode *)tree->root)->height, 14);
+
+	nih_free (tree);
+
+
+	/* Check that inserting nodes in a scattered order, with many
+	 * equal keys, keeps the tree balanced and ordered with the nodes
+	 * with equal keys in the order they were inserted.
+	 */
+	TEST_FEATURE ("with equal keys");
+	tree = sorted_new ();
+
+	for (i = 0; i < 1000; i++)
+		nih_tree_insert (tree, &sorted_entry_new (
+					 tree, (i * 7919) % 100, i)->node);
+
+	sorted_check_tree (tree);
+
+	TEST_EQ (tree->count, 1000);
+
+	nih_free (tree);
+}
+
+void
+test_insert_unique (void)
+{
+	NihSortedTree *tree;
+	SortedEntry   *entry1, *entry2, *entry3;
+	NihTree       *ptr;
+
+	/* Check that nodes with different keys may be inserted, but that
+	 * a node with the same key as an existing one is not inserted and
+	 * NULL is returned instead.
+	 */
+	TEST_FUNCTION ("nih_tree_insert_unique");
+	tree = sorted_new ();
+	entry1 = sorted_entry_new (tree, 1, 0);
+	entry2 = sorted_entry_new (tree, 2, 1);
+	entry3 = sorted_entry_new (tree, 1, 2);
+
+	ptr = nih_tree_insert_unique (tree, &entry1->node);
+
+	TEST_EQ_P (ptr, &entry1->node.node);
+
+	ptr = nih_tree_insert_unique (tree, &entry2->node);
+
+	TEST_EQ_P (ptr, &entry2->node.node);
+
+	ptr = nih_tree_insert_unique (tree, &entry3->node);
+
+	TEST_EQ_P (ptr, NULL);
+	TEST_EQ (tree->count, 2);
+	TEST_EQ_P (entry3->node.node.parent, NULL);
+
+	sorted_check_tree (tree);
+
+	nih_free (tree);
+}
+
+void
+test_build (void)
+{
+	NihSortedTree *tree;
+	SortedEntry   *entries[1000];
+	int            i;
+
+	TEST_FUNCTION ("nih_tree_build");
+
+	/* Check that a tree built from sorted nodes contains each of them
+	 * in the same order, and is balanced.
+	 */
+	TEST_FEATURE ("with sorted nodes");
+	tree = sorted_new ();
+
+	for (i = 0; i < 1000; i++)
+		entries[i] = sorted_entry_new (tree, i / 3, i);
+
+	nih_tree_build (tree, (NihSortedNode **)entries, 1000);
+
+	sorted_check_tree (tree);
+
+	TEST_EQ (tree->count, 1000);
+	TEST_EQ (((NihSortedNode *)tree->root)->height, 10);
+
+	i = 0;
+	NIH_TREE_FOREACH (tree->root, iter)
+		TEST_EQ_P (iter, &entries[i++]->node.node);
+
+	TEST_EQ (i, 1000);
+
+
+	/* Check that nodes may be inserted into and deleted from the tree
+	 * afterwards.
+	 */
+	TEST_FEATURE ("with later changes");
+	for (i = 0; i < 100; i++)
+		nih_tree_insert (tree, &sorted_entry_new (tree, i * 5,
+							  1000 + i)->node);
+
+	for (i = 0; i < 500; i++)
+		nih_tree_delete (tree, &entries[i * 2]->node);
+
+	sorted_check_tree (tree);
+
+	TEST_EQ (tree->count, 600);
+
+	nih_free (tree);
+
+
+	/* Check that building a tree from no nodes leaves it empty.
+	 */
+	TEST_FEATURE ("with no nodes");
+	tree = sorted_new ();
+
+	nih_tree_build (tree, NULL, 0);
+
+	TEST_EQ_P (tree->root, NULL);
+	TEST_EQ (tree->count, 0);
+
+	nih_free (tree);
+}
+
+void
+test_delete (void)
+{
+	NihSortedTree *tree;
+	SortedEntry   *entries[1000], *entry;
+	NihTree       *ptr;
+	int            i;
+
+	TEST_FUNCTION ("nih_tree_delete");
+
+	/* Check that deleting the only node in a tree leaves it empty,
+	 * and returns the node with its pointers cleared.
+	 */
+	TEST_FEATURE ("with only node");
+	tree = sorted_new ();
+	entry = sorted_entry_new (tree, 1, 0);
+
+	nih_tree_insert (tree, &entry->node);
+	ptr = nih_tree_delete (tree, &entry->node);
+
+	TEST_EQ_P (ptr, &entry->node.node);
+	TEST_EQ_P (tree->root, NULL);
+	TEST_EQ (tree->count, 0);
+	TEST_EQ_P (entry->node.node.parent, NULL);
+
+	nih_free (tree);
+
+
+	/* Check that deleting nodes in a scattered order, including those
+	 * with two children and the root, keeps the tree ordered and
+	 * balanced after each deletion.
+	 */
+	TEST_FEATURE ("with many nodes");
+	tree = sorted_new ();
+
+	for (i = 0; i < 1000; i++) {
+		entries[i] = sorted_entry_new (tree, (i * 7919) % 250, i);
+		nih_tree_insert (tree, &entries[i]->node);
+	}
+
+	nih_tree_delete (tree, (NihSortedNode *)tree->root);
+
+	sorted_check_tree (tree);
+
+	for (i = 0; i < 1000; i++) {
+		entry = entries[(i * 401) % 1000];
+		if (! entry->node.node.parent
+		    && (tree->root != &entry->node.node))
+			continue;
+
+		ptr = nih_tree_delete (tree, &entry->node);
+
+		TEST_EQ_P (ptr, &entry->node.node);
+		TEST_EQ_P (ptr->parent, NULL);
+		TEST_EQ_P (ptr->left, NULL);
+		TEST_EQ_P (ptr->right, NULL);
+
+		sorted_check_tree (tree);
+	}
+
+	TEST_EQ_P (tree->root, NULL);
+	TEST_EQ (tree->count, 0);
+
+	nih_free (tree);
+}
+
+void
+test_lookup (void)
+{
+	NihSortedTree *tree;
+	SortedEntry   *entry;
+	NihTree       *ptr;
+	int            i, key;
+
+	tree = sorted_new ();
+
+	for (i = 0; i < 100; i++) {
+		nih_tree_insert (tree, &sorted_entry_new (tree, i * 2, i)->node);
+		nih_tree_insert (tree, &sorted_entry_new (tree, i * 2,
+							  100 + i)->node);
+	}
+
+	TEST_FUNCTION ("nih_tree_lookup");
+
+	/* Check that looking up a key in the tree returns the first node
+	 * inserted with that key.
+	 */
+	TEST_FEATURE ("with key in tree");
+	key = 42;
+	ptr = nih_tree_lookup (tree, &key);
+	entry = (SortedEntry *)ptr;
+
+	TEST_NE_P (ptr, NULL);
+	TEST_EQ (entry->key, 42);
+	TEST_EQ (entry->seq, 21);
+
+
+	/* Check that looking up a key that isn't in the tree returns NULL.
+	 */
+	TEST_FEATURE ("with key not in tree");
+	key = 43;
+	ptr = nih_tree_lookup (tree, &key);
+
+	TEST_EQ_P (ptr, NULL);
+
+	key = 500;
+	ptr = nih_tree_lookup (tree, &key);
+
+	TEST_EQ_P (ptr, NULL);
+
+
+	/* Check that nih_tree_lower_bound returns the first node with a key
+	 * equal to or greater than that given, or NULL if there is none.
+	 */
+	TEST_FUNCTION ("nih_tree_lower_bound");
+	key = 42;
+	entry = (SortedEntry *)nih_tree_lower_bound (tree, &key);
+
+	TEST_EQ (entry->key, 42);
+	TEST_EQ (entry->seq, 21);
+
+	key = 43;
+	entry = (SortedEntry *)nih_tree_lower_bound (tree, &key);
+
+	TEST_EQ (entry->key, 44);
+	TEST_EQ (entry->seq, 22);
+
+	key = -1;
+	entry = (SortedEntry *)nih_tree_lower_bound (tree, &key);
+
+	TEST_EQ (entry->key, 0);
+
+	key = 199;
+	ptr = nih_tree_lower_bound (tree, &key);
+
+	TEST_EQ_P (ptr, NULL);
+
+
+	/* Check that nih_tree_upper_bound returns the first node with a key
+	 * greater than that given, or NULL if there is none.
+	 */
+	TEST_FUNCTION ("nih_tree_upper_bound");
+	key = 42;
+	entry = (SortedEntry *)nih_tree_upper_bound (tree, &key);
+
+	TEST_EQ (entry->key, 44);
+	TEST_EQ (entry->seq, 22);
+
+	key = 43;
+	entry = (SortedEntry *)nih_tree_upper_bound (tree, &key);
+
+	TEST_EQ (entry->key, 44);
+
+	key = 198;
+	ptr = nih_tree_upper_bound (tree, &key);
+
+	TEST_EQ_P (ptr, NULL);
+
+	nih_free (tree);
+
+
+	/* Check that searching an empty tree returns NULL.
+	 */
+	TEST_FUNCTION ("nih_tree_lookup");
+	TEST_FEATURE ("with empty tree");
+	tree = sorted_new ();
+
+	key = 0;
+	ptr = nih_tree_lookup (tree, &key);
+
+	TEST_EQ_P (ptr, NULL);
+
+	nih_free (tree);
+}
+
+void
+test_foreach_range (void)
+{
+	NihSortedTree *tree;
+	int            i, lower, upper, expected;
+
+	TEST_FUNCTION ("NIH_TREE_FOREACH_RANGE");
+	tree = sorted_new ();
+
+	for (i = 0; i < 100; i++)
+		nih_tree_insert (tree, &sorted_entry_new (
+					 tree, (i * 37) % 100, i)->node);
+
+	/* Check that iterating a range visits each node with a key from
+	 * the lower key up to, but not including, the upper key in order.
+	 */
+	TEST_FEATURE ("with range in tree");
+	lower = 20;
+	upper = 30;
+	expected = 20;
+
+	NIH_TREE_FOREACH_RANGE (tree, iter, &lower, &upper)
+		TEST_EQ (((SortedEntry *)iter)->key, expected++);
+
+	TEST_EQ (expected, 30);
+
+
+	/* Check that a range extending past the last key stops at the
+	 * end of the tree.
+	 */
+	TEST_FEATURE ("with range past end");
+	lower = 95;
+	upper = 1000;
+	expected = 95;
+
+	NIH_TREE_FOREACH_RANGE (tree, iter, &lower, &upper)
+		TEST_EQ (((SortedEntry *)iter)->key, expected++);
+
+	TEST_EQ (expected, 100);
+
+
+	/* Check that an empty range visits no nodes.
+	 */
+	TEST_FEATURE ("with empty range");
+	lower = 50;
+	upper = 50;
+
+	NIH_TREE_FOREACH_RANGE (tree, iter, &lower, &upper)
+		TEST_FAILED ("unexpected node %d", ((SortedEntry *)iter)->key);
+
+	nih_free (tree);
+}
+
+
 int
 main (int   argc,
       char *argv[])
@@ -2230,6 +2767,13 @@ main (int   argc,
 	test_next_post_full ();
 	test_foreach_post_full ();
 	test_prev_post_full ();
+	test_sorted_new ();
+	test_insert ();
+	test_insert_unique ();
+	test_build ();
+	test_delete ();
+	test_lookup ();
+	test_foreach_range ();
 
 	return 0;
 }
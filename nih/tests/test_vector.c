@@ -0,0 +1,554 @@
+/* libnih
+ *
+ * test_vector.c - test suite for nih/vector.c
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <nih/test.h>
+
+#include <nih/macros.h>
+#include <nih/alloc.h>
+#include <nih/vector.h>
+
+
+typedef struct record {
+	int  key;
+	char name[12];
+} Record;
+
+static int
+int_cmp (const int *key,
+	 const int *elem)
+{
+	return (*key > *elem) - (*key < *elem);
+}
+
+
+void
+test_new (void)
+{
+	NihVector *vector;
+
+	/* Check that a new vector is allocated with nih_alloc, is empty
+	 * and has the element size we gave; no room for elements should
+	 * have been allocated yet.
+	 */
+	TEST_FUNCTION ("nih_vector_new");
+	TEST_ALLOC_FAIL {
+		vector = nih_vector_new (NULL, sizeof (Record));
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (vector, NULL);
+			continue;
+		}
+
+		TEST_ALLOC_SIZE (vector, sizeof (NihVector));
+		TEST_EQ_P (vector->data, NULL);
+		TEST_EQ (vector->len, 0);
+		TEST_EQ (vector->capacity, 0);
+		TEST_EQ (vector->elem_size, sizeof (Record));
+
+		nih_free (vector);
+	}
+}
+
+void
+test_reserve (void)
+{
+	NihVector *vector;
+	int        ret;
+
+	TEST_FUNCTION ("nih_vector_reserve");
+
+	/* Check that reserving room in an empty vector allocates exactly
+	 * that many elements as a child of the vector.
+	 */
+	TEST_FEATURE ("with empty vector");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			vector = nih_vector_new_type (NULL, Record);
+		}
+
+		ret = nih_vector_reserve (vector, 100);
+
+		if (test_alloc_failed) {
+			TEST_LT (ret, 0);
+			TEST_EQ_P (vector->data, NULL);
+			TEST_EQ (vector->capacity, 0);
+
+			nih_free (vector);
+			continue;
+		}
+
+		TEST_EQ (ret, 0);
+		TEST_EQ (vector->capacity, 100);
+		TEST_ALLOC_PARENT (vector->data, vector);
+		TEST_ALLOC_SIZE (vector->data, sizeof (Record) * 100);
+
+		nih_free (vector);
+	}
+
+
+	/* Check that reserving less room than the vector already has does
+	 * nothing.
+	 */
+	TEST_FEATURE ("with smaller capacity");
+	vector = nih_vector_new_type (NULL, Record);
+	assert0 (nih_vector_reserve (vector, 100));
+
+	ret = nih_vector_reserve (vector, 10);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (vector->capacity, 100);
+
+	nih_free (vector);
+}
+
+void
+test_shrink (void)
+{
+	NihVector *vector;
+	int        ret;
+
+	TEST_FUNCTION ("nih_vector_shrink");
+
+	/* Check that shrinking a vector reduces its capacity to the number
+	 * of elements it contains, keeping them.
+	 */
+	TEST_FEATURE ("with elements");
+	vector = nih_vector_new_type (NULL, int);
+
+	for (int i = 0; i < 10; i++)
+		assert (nih_vector_push (vector, &i));
+
+	TEST_EQ (vector->capacity, 16);
+
+	ret = nih_vector_shrink (vector);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (vector->capacity, 10);
+	TEST_EQ (vector->len, 10);
+	TEST_ALLOC_SIZE (vector->data, sizeof (int) * 10);
+
+	for (int i = 0; i < 10; i++)
+		TEST_EQ (NIH_VECTOR_DATA (vector, int)[i], i);
+
+
+	/* Check that shrinking an empty vector frees its elements.
+	 */
+	TEST_FEATURE ("with no elements");
+	nih_vector_clear (vector);
+
+	ret = nih_vector_shrink (vector);
+
+	TEST_EQ (ret, 0);
+	TEST_EQ (vector->capacity, 0);
+	TEST_EQ_P (vector->data, NULL);
+
+	nih_free (vector);
+}
+
+void
+test_push (void)
+{
+	NihVector *vector;
+	Record     record, *ptr;
+	void      *data;
+
+	TEST_FUNCTION ("nih_vector_push");
+
+	/* Check that pushing an element onto an empty vector makes room
+	 * for several elements and copies the element into the first.
+	 */
+	TEST_FEATURE ("with empty vector");
+	TEST_ALLOC_FAIL {
+		TEST_ALLOC_SAFE {
+			vector = nih_vector_new_type (NULL, Record);
+		}
+
+		record.key = 42;
+		strcpy (record.name, "forty-two");
+
+		ptr = nih_vector_push (vector, &record);
+
+		if (test_alloc_failed) {
+			TEST_EQ_P (ptr, NULL);
+			TEST_EQ (vector->len, 0);
+
+			nih_free (vector);
+			continue;
+		}
+
+		TEST_EQ_P (ptr, vector->data);
+		TEST_EQ (vector->len, 1);
+		TEST_EQ (vector->capacity, 8);
+		TEST_ALLOC_PARENT (vector->data, vector);
+
+		TEST_EQ (ptr->key, 42);
+		TEST_EQ_STR (ptr->name, "forty-two");
+
+		nih_free (vector);
+	}
+
+
+	/* Check that pushing many elements doubles the capacity as needed,
+	 * keeping each element in order.
+	 */
+	TEST_FEATURE ("with many elements");
+	vector = nih_vector_new_type (NULL, Record);
+
+	for (int i = 0; i < 1000; i++) {
+		record.key = i;
+		sprintf (record.name, "%d", i);
+
+		assert (nih_vector_push (vector, &record));
+	}
+
+	TEST_EQ (vector->len, 1000);
+	TEST_EQ (vector->capacity, 1024);
+
+	for (int i = 0; i < 1000; i++) {
+		char name[12];
+
+		ptr = NIH_VECTOR_AT (vector, i);
+		sprintf (name, "%d", i);
+
+		TEST_EQ (ptr->key, i);
+		TEST_EQ_STR (ptr->name, name);
+	}
+
+	nih_free (vector);
+
+
+	/* Check that pushing an element into reserved room doesn't move
+	 * the elements, and that pushing NULL adds a zeroed element.
+	 */
+	TEST_FEATURE ("with reserved room");
+	vector = nih_vector_new_type (NULL, Record);
+	assert0 (nih_vector_reserve (vector, 2));
+	data = vector->data;
+
+	ptr = nih_vector_push (vector, NULL);
+
+	TEST_EQ_P (vector->data, data);
+	TEST_EQ_P (ptr, data);
+	TEST_EQ (ptr->key, 0);
+	TEST_EQ_STR (ptr->name, "");
+
+	nih_free (vector);
+
+
+	/* Check that an element of the vector itself can be pushed, even
+	 * when the vector is grown and its elements moved.
+	 */
+	TEST_FEATURE ("with element of vector");
+	vector = nih_vector_new_type (NULL, Record);
+
+	for (int i = 0; i < 8; i++) {
+		record.key = i;
+		sprintf (record.name, "%d", i);
+
+		assert (nih_vector_push (vector, &record));
+	}
+
+	TEST_EQ (vector->capacity, 8);
+
+	ptr = nih_vector_push (vector, NIH_VECTOR_AT (vector, 5));
+
+	TEST_NE_P (ptr, NULL);
+	TEST_EQ (vector->len, 9);
+	TEST_EQ (vector->capacity, 16);
+	TEST_EQ (ptr->key, 5);
+	TEST_EQ_STR (ptr->name, "5");
+
+	nih_free (vector);
+}
+
+void
+test_pop (void)
+{
+	NihVector *vector;
+	int        value;
+
+	/* Check that popping elements removes them from the end of the
+	 * vector in turn, copying each one, without changing the capacity.
+	 */
+	TEST_FUNCTION ("nih_vector_pop");
+	vector = nih_vector_new_type (NULL, int);
+
+	for (int i = 0; i < 3; i++)
+		assert (nih_vector_push (vector, &i));
+
+	nih_vector_pop (vector, &value);
+
+	TEST_EQ (value, 2);
+	TEST_EQ (vector->len, 2);
+
+	nih_vector_pop (vector, NULL);
+	nih_vector_pop (vector, &value);
+
+	TEST_EQ (value, 0);
+	TEST_EQ (vector->len, 0);
+	TEST_EQ (vector->capacity, 8);
+
+	nih_free (vector);
+}
+
+void
+test_insert (void)
+{
+	NihVector *vector;
+	int        value, *ptr;
+
+	TEST_FUNCTION ("nih_vector_insert");
+	vector = nih_vector_new_type (NULL, int);
+
+	for (int i = 0; i < 8; i++)
+		assert (nih_vector_push (vector, &i));
+
+
+	/* Check that inserting an element in the middle of a full vector
+	 * grows it and moves the following elements along.
+	 */
+	TEST_FEATURE ("in middle");
+	value = 100;
+	ptr = nih_vector_insert (vector, 3, &value);
+
+	TEST_EQ_P (ptr, NIH_VECTOR_AT (vector, 3));
+	TEST_EQ (vector->len, 9);
+	TEST_EQ (vector->capacity, 16);
+
+	for (int i = 0; i < 9; i++)
+		TEST_EQ (NIH_VECTOR_DATA (vector, int)[i],
+			 i < 3 ? i : i == 3 ? 100 : i - 1);
+
+
+	/* Check that an element can be inserted at the start.
+	 */
+	TEST_FEATURE ("at start");
+	value = 200;
+	ptr = nih_vector_insert (vector, 0, &value);
+
+	TEST_EQ_P (ptr, vector->data);
+	TEST_EQ (vector->len, 10);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[0], 200);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[1], 0);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[4], 100);
+
+
+	/* Check that an element can be inserted at the end.
+	 */
+	TEST_FEATURE ("at end");
+	value = 300;
+	ptr = nih_vector_insert (vector, vector->len, &value);
+
+	TEST_EQ_P (ptr, NIH_VECTOR_AT (vector, 10));
+	TEST_EQ (vector->len, 11);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[9], 7);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[10], 300);
+
+
+	/* Check that an element of the vector itself can be inserted
+	 * before its own position, even when the vector is grown.
+	 */
+	TEST_FEATURE ("with element of vector");
+	assert0 (nih_vector_shrink (vector));
+	TEST_EQ (vector->capacity, 11);
+
+	ptr = nih_vector_insert (vector, 2, NIH_VECTOR_AT (vector, 10));
+
+	TEST_EQ_P (ptr, NIH_VECTOR_AT (vector, 2));
+	TEST_EQ (vector->len, 12);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[2], 300);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[11], 300);
+
+	ptr = nih_vector_insert (vector, 4, NIH_VECTOR_AT (vector, 1));
+
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[4], 0);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[1], 0);
+
+	nih_free (vector);
+}
+
+void
+test_erase (void)
+{
+	NihVector *vector;
+
+	TEST_FUNCTION ("nih_vector_erase");
+	vector = nih_vector_new_type (NULL, int);
+
+	for (int i = 0; i < 10; i++)
+		assert (nih_vector_push (vector, &i));
+
+
+	/* Check that erasing elements in the middle of the vector moves
+	 * the following elements into their place.
+	 */
+	TEST_FEATURE ("in middle");
+	nih_vector_erase (vector, 2, 3);
+
+	TEST_EQ (vector->len, 7);
+	TEST_EQ (vector->capacity, 16);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[1], 1);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[2], 5);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[6], 9);
+
+
+	/* Check that erasing elements at the end of the vector just
+	 * shortens it.
+	 */
+	TEST_FEATURE ("at end");
+	nih_vector_erase (vector, 5, 2);
+
+	TEST_EQ (vector->len, 5);
+	TEST_EQ (NIH_VECTOR_DATA (vector, int)[4], 7);
+
+
+	/* Check that erasing no elements does nothing.
+	 */
+	TEST_FEATURE ("with no elements");
+	nih_vector_erase (vector, 5, 0);
+
+	TEST_EQ (vector->len, 5);
+
+	nih_free (vector);
+}
+
+void
+test_sort (void)
+{
+	NihVector *vector;
+	int        key, *ptr;
+	size_t     index;
+
+	/* Check that sorting a vector puts its elements into ascending
+	 * order.
+	 */
+	TEST_FUNCTION ("nih_vector_sort");
+	vector = nih_vector_new_type (NULL, int);
+
+	for (int i = 0; i < 1000; i++) {
+		int value = (i * 7919) % 500 * 2;
+
+		assert (nih_vector_push (vector, &value));
+	}
+
+	nih_vector_sort (vector, (NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ (vector->len, 1000);
+	for (int i = 0; i < 1000; i++)
+		TEST_EQ (NIH_VECTOR_DATA (vector, int)[i], i / 2 * 2);
+
+
+	/* Check that searching a sorted vector finds the first element
+	 * equal to the key, or NULL if there is none.
+	 */
+	TEST_FUNCTION ("nih_vector_search");
+	TEST_FEATURE ("with key in vector");
+	key = 500;
+	ptr = nih_vector_search (vector, &key, (NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ_P (ptr, NIH_VECTOR_AT (vector, 500));
+
+	TEST_FEATURE ("with key not in vector");
+	key = 501;
+	ptr = nih_vector_search (vector, &key, (NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ_P (ptr, NULL);
+
+	key = 1000;
+	ptr = nih_vector_search (vector, &key, (NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ_P (ptr, NULL);
+
+
+	/* Check that the lower bound is the index of the first element
+	 * not less than the key, or the length of the vector.
+	 */
+	TEST_FUNCTION ("nih_vector_lower_bound");
+	key = 500;
+	index = nih_vector_lower_bound (vector, &key,
+					(NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ (index, 500);
+
+	key = 501;
+	index = nih_vector_lower_bound (vector, &key,
+					(NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ (index, 502);
+
+	key = -1;
+	index = nih_vector_lower_bound (vector, &key,
+					(NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ (index, 0);
+
+	key = 1000;
+	index = nih_vector_lower_bound (vector, &key,
+					(NihVectorCmpFunction)int_cmp);
+
+	TEST_EQ (index, 1000);
+
+	nih_free (vector);
+}
+
+void
+test_foreach (void)
+{
+	NihVector *vector;
+	int        i;
+
+	/* Check that NIH_VECTOR_FOREACH visits each element in order,
+	 * and none for an empty vector.
+	 */
+	TEST_FUNCTION ("NIH_VECTOR_FOREACH");
+	vector = nih_vector_new_type (NULL, int);
+
+	NIH_VECTOR_FOREACH (vector, int, iter)
+		TEST_FAILED ("unexpected element %d", *iter);
+
+	for (i = 0; i < 20; i++)
+		assert (nih_vector_push (vector, &i));
+
+	i = 0;
+	NIH_VECTOR_FOREACH (vector, int, iter)
+		TEST_EQ (*iter, i++);
+
+	TEST_EQ (i, 20);
+
+	nih_free (vector);
+}
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+	test_new ();
+	test_reserve ();
+	test_shrink ();
+	test_push ();
+	test_pop ();
+	test_insert ();
+	test_erase ();
+	test_sort ();
+	test_foreach ();
+
+	return 0;
+}
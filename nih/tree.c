@@ -31,6 +31,28 @@
 #include "tree.h"
 
 
+/**
+ * NIH_TREE_HEIGHT:
+ * @_node: node of a sorted tree, or NULL.
+ *
+ * Returns: height of the subtree rooted at @_node, zero for NULL.
+ **/
+#define NIH_TREE_HEIGHT(_node) \
+	((_node) ? ((NihSortedNode *)(_node))->height : 0)
+
+
+/* Prototypes for static functions */
+static int      nih_tree_has_node     (NihSortedTree *tree, NihTree *node);
+static void     nih_tree_replace      (NihSortedTree *tree, NihTree *node,
+				       NihTree *with);
+static void     nih_tree_update       (NihTree *node);
+static NihTree *nih_tree_rotate       (NihSortedTree *tree, NihTree *node,
+				       NihTreeWhere where);
+static void     nih_tree_rebalance    (NihSortedTree *tree, NihTree *node);
+static NihTree *nih_tree_build_range  (NihSortedNode **nodes, size_t len,
+				       NihTree *parent);
+
+
 /**
  * nih_tree_init:
  * @tree: tree node to be initialised.
@@ -619,3 +641,553 @@ nih_tree_prev_post_full (NihTree       *tree,
 		prev = tmp;
 	}
 }
+
+
+/**
+ * nih_tree_sorted_new:
+ * @parent: parent object for new tree,
+ * @key_function: function used to obtain keys for nodes,
+ * @cmp_function: function used to compare keys.
+ *
+ * Allocates a new, empty, sorted tree.  Nodes of the tree must begin
+ * with an NihSortedNode, @key_function is called to obtain the key of
+ * each node and @cmp_function to compare those keys.
+ *
+ * The structure is allocated using nih_alloc() so can be used as a context
+ * to other allocations; the nodes are not owned by the tree, and remain
+ * linked to each other if it is freed.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned tree.  When all parents
+ * of the returned tree are freed, the returned tree will also be freed.
+ *
+ * Returns: the new tree or NULL if the allocation failed.
+ **/
+NihSortedTree *
+nih_tree_sorted_new (const void         *parent,
+		     NihTreeKeyFunction  key_function,
+		     NihTreeCmpFunction  cmp_function)
+{
+	NihSortedTree *tree;
+
+	nih_assert (key_function != NULL);
+	nih_assert (cmp_function != NULL);
+
+	tree = nih_new (parent, NihSortedTree);
+	if (! tree)
+		return NULL;
+
+	tree->root = NULL;
+	tree->count = 0;
+
+	tree->key_function = key_function;
+	tree->cmp_function = cmp_function;
+
+	return tree;
+}
+
+
+/**
+ * nih_tree_insert:
+ * @tree: sorted tree,
+ * @node: node to be inserted.
+ *
+ * Inserts @node into @tree in order of its key, after any nodes with an
+ * equal key, and rebalances the tree.  @node must not already be in a
+ * tree.
+ *
+ * This function does not check whether a node with the same key already
+ * exists; if you need that constraint use nih_tree_insert_unique().
+ *
+ * Returns: @node.
+ **/
+NihTree *
+nih_tree_insert (NihSortedTree *tree,
+		 NihSortedNode *node)
+{
+	const void  *key;
+	NihTree     *parent = NULL, **link;
+
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+	nih_assert (node->node.parent == NULL);
+
+	key = tree->key_function (&node->node);
+
+	link = &tree->root;
+	while (*link) {
+		parent = *link;
+
+		if (tree->cmp_function (key, tree->key_function (parent)) < 0) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+		}
+	}
+
+	node->node.parent = parent;
+	node->node.left = node->node.right = NULL;
+	node->height = 1;
+
+	*link = &node->node;
+	tree->count++;
+
+	nih_tree_rebalance (tree, parent);
+
+	return &node->node;
+}
+
+/**
+ * nih_tree_insert_unique:
+ * @tree: sorted tree,
+ * @node: node to be inserted.
+ *
+ * Inserts @node into @tree in order of its key, provided that no node
+ * with an equal key exists already, and rebalances the tree.  @node must
+ * not already be in a tree.
+ *
+ * Returns: @node, or NULL if a node already existed with the same key.
+ **/
+NihTree *
+nih_tree_insert_unique (NihSortedTree *tree,
+			NihSortedNode *node)
+{
+	const void  *key;
+	NihTree     *parent = NULL, **link;
+
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+	nih_assert (node->node.parent == NULL);
+
+	key = tree->key_function (&node->node);
+
+	link = &tree->root;
+	while (*link) {
+		int cmp;
+
+		parent = *link;
+
+		cmp = tree->cmp_function (key, tree->key_function (parent));
+		if (cmp < 0) {
+			link = &parent->left;
+		} else if (cmp > 0) {
+			link = &parent->right;
+		} else {
+			return NULL;
+		}
+	}
+
+	node->node.parent = parent;
+	node->node.left = node->node.right = NULL;
+	node->height = 1;
+
+	*link = &node->node;
+	tree->count++;
+
+	nih_tree_rebalance (tree, parent);
+
+	return &node->node;
+}
+
+/**
+ * nih_tree_build:
+ * @tree: empty sorted tree,
+ * @nodes: nodes sorted by key,
+ * @len: number of entries in @nodes.
+ *
+ * Builds @tree from the @len nodes in @nodes, which must already be in
+ * order of their keys, in time proportional to @len rather than inserting
+ * each node in turn.  Nodes with equal keys remain in the order given.
+ *
+ * @tree must be empty, and none of @nodes may already be in a tree.
+ **/
+void
+nih_tree_build (NihSortedTree  *tree,
+		NihSortedNode **nodes,
+		size_t          len)
+{
+	size_t i;
+
+	nih_assert (tree != NULL);
+	nih_assert (tree->root == NULL);
+	nih_assert ((nodes != NULL) || (len == 0));
+
+	for (i = 1; i < len; i++)
+		nih_assert (tree->cmp_function (
+				    tree->key_function (&nodes[i - 1]->node),
+				    tree->key_function (&nodes[i]->node)) <= 0);
+
+	tree->root = nih_tree_build_range (nodes, len, NULL);
+	tree->count = len;
+}
+
+/**
+ * nih_tree_build_range:
+ * @nodes: nodes sorted by key,
+ * @len: number of entries in @nodes,
+ * @parent: parent of the subtree.
+ *
+ * Links the @len nodes in @nodes into a perfectly balanced subtree, by
+ * taking the middle node as its root and building its left and right
+ * subtrees from the nodes either side in the same way.
+ *
+ * Returns: root of the subtree, or NULL if @len is zero.
+ **/
+static NihTree *
+nih_tree_build_range (NihSortedNode **nodes,
+		      size_t          len,
+		      NihTree        *parent)
+{
+	NihSortedNode *node;
+	size_t         mid;
+
+	if (! len)
+		return NULL;
+
+	mid = len / 2;
+	node = nodes[mid];
+
+	nih_assert (node->node.parent == NULL);
+
+	node->node.parent = parent;
+	node->node.left = nih_tree_build_range (nodes, mid, &node->node);
+	node->node.right = nih_tree_build_range (nodes + mid + 1,
+						 len - mid - 1, &node->node);
+
+	nih_tree_update (&node->node);
+
+	return &node->node;
+}
+
+/**
+ * nih_tree_delete:
+ * @tree: sorted tree,
+ * @node: node to be deleted.
+ *
+ * Removes @node from @tree and rebalances the tree; unlike
+ * nih_tree_remove(), the children of @node remain in the tree.  The node
+ * is not freed, but is returned with its pointers set to NULL so that it
+ * may be freed or inserted into another tree.
+ *
+ * @node must be a member of @tree; passing a node that has already been
+ * deleted, or that belongs to another tree, is a programming error.
+ *
+ * Returns: @node.
+ **/
+NihTree *
+nih_tree_delete (NihSortedTree *tree,
+		 NihSortedNode *node)
+{
+	NihTree *n, *rebalance;
+
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+	nih_assert (tree->count > 0);
+	nih_assert (nih_tree_has_node (tree, &node->node));
+
+	n = &node->node;
+
+	if (n->left && n->right) {
+		NihTree *next;
+
+		/* Replace the node with the next node in order, the leftmost
+		 * node of its right subtree, which has no left child of its
+		 * own; the tree needs rebalancing from where that was taken.
+		 */
+		next = n->right;
+		while (next->left)
+			next = next->left;
+
+		if (next->parent != n) {
+			rebalance = next->parent;
+
+			rebalance->left = next->right;
+			if (next->right)
+				next->right->parent = rebalance;
+
+			next->right = n->right;
+			next->right->parent = next;
+		} else {
+			rebalance = next;
+		}
+
+		next->left = n->left;
+		next->left->parent = next;
+
+		nih_tree_replace (tree, n, next);
+		((NihSortedNode *)next)->height = node->height;
+	} else {
+		rebalance = n->parent;
+
+		nih_tree_replace (tree, n, n->left ? n->left : n->right);
+	}
+
+	n->parent = n->left = n->right = NULL;
+	tree->count--;
+
+	nih_tree_rebalance (tree, rebalance);
+
+	return n;
+}
+
+
+/**
+ * nih_tree_lower_bound:
+ * @tree: sorted tree,
+ * @key: key to look for.
+ *
+ * Finds the first node in @tree, in order, whose key is not less than
+ * @key.
+ *
+ * Returns: node found or NULL if every key is less than @key.
+ **/
+NihTree *
+nih_tree_lower_bound (NihSortedTree *tree,
+		      const void    *key)
+{
+	NihTree *node, *found = NULL;
+
+	nih_assert (tree != NULL);
+
+	node = tree->root;
+	while (node) {
+		if (tree->cmp_function (tree->key_function (node), key) >= 0) {
+			found = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * nih_tree_upper_bound:
+ * @tree: sorted tree,
+ * @key: key to look for.
+ *
+ * Finds the first node in @tree, in order, whose key is greater than
+ * @key.
+ *
+ * Returns: node found or NULL if no key is greater than @key.
+ **/
+NihTree *
+nih_tree_upper_bound (NihSortedTree *tree,
+		      const void    *key)
+{
+	NihTree *node, *found = NULL;
+
+	nih_assert (tree != NULL);
+
+	node = tree->root;
+	while (node) {
+		if (tree->cmp_function (tree->key_function (node), key) > 0) {
+			found = node;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * nih_tree_lookup:
+ * @tree: sorted tree,
+ * @key: key to look for.
+ *
+ * Finds the first node in @tree with a key of @key; any further nodes
+ * with the same key follow it, and may be found with nih_tree_next().
+ *
+ * Returns: node found or NULL if no node has that key.
+ **/
+NihTree *
+nih_tree_lookup (NihSortedTree *tree,
+		 const void    *key)
+{
+	NihTree *node;
+
+	nih_assert (tree != NULL);
+
+	node = nih_tree_lower_bound (tree, key);
+	if (node && tree->cmp_function (tree->key_function (node), key))
+		return NULL;
+
+	return node;
+}
+
+
+/**
+ * nih_tree_has_node:
+ * @tree: sorted tree,
+ * @node: node to check.
+ *
+ * Follows the parents of @node to find whether it is the root of @tree
+ * or one of its descendants.
+ *
+ * Returns: TRUE if @node is in @tree, FALSE otherwise.
+ **/
+static int
+nih_tree_has_node (NihSortedTree *tree,
+		   NihTree       *node)
+{
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+
+	while (node->parent)
+		node = node->parent;
+
+	return node == tree->root;
+}
+
+/**
+ * nih_tree_replace:
+ * @tree: sorted tree,
+ * @node: node to be replaced,
+ * @with: replacement node or NULL.
+ *
+ * Links @with into the place of @node in @tree, as the child of the
+ * parent of @node or as the root; the children of neither are changed.
+ **/
+static void
+nih_tree_replace (NihSortedTree *tree,
+		  NihTree       *node,
+		  NihTree       *with)
+{
+	NihTree *parent;
+
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+
+	parent = node->parent;
+	if (! parent) {
+		tree->root = with;
+	} else if (parent->left == node) {
+		parent->left = with;
+	} else {
+		parent->right = with;
+	}
+
+	if (with)
+		with->parent = parent;
+}
+
+/**
+ * nih_tree_update:
+ * @node: node of sorted tree.
+ *
+ * Recalculates the height of @node from the heights of its children.
+ **/
+static void
+nih_tree_update (NihTree *node)
+{
+	int left, right;
+
+	nih_assert (node != NULL);
+
+	left = NIH_TREE_HEIGHT (node->left);
+	right = NIH_TREE_HEIGHT (node->right);
+
+	((NihSortedNode *)node)->height = (left > right ? left : right) + 1;
+}
+
+/**
+ * nih_tree_rotate:
+ * @tree: sorted tree,
+ * @node: node to rotate,
+ * @where: direction of rotation.
+ *
+ * Rotates the subtree rooted at @node towards @where, so that its child
+ * on the opposite side takes its place and @node becomes the child of
+ * that node on the @where side.  The order of the nodes is unchanged.
+ *
+ * Returns: new root of the subtree.
+ **/
+static NihTree *
+nih_tree_rotate (NihSortedTree *tree,
+		 NihTree       *node,
+		 NihTreeWhere   where)
+{
+	NihTree *pivot;
+
+	nih_assert (tree != NULL);
+	nih_assert (node != NULL);
+
+	if (where == NIH_TREE_LEFT) {
+		pivot = node->right;
+		nih_assert (pivot != NULL);
+
+		node->right = pivot->left;
+		if (pivot->left)
+			pivot->left->parent = node;
+
+		nih_tree_replace (tree, node, pivot);
+
+		pivot->left = node;
+	} else {
+		pivot = node->left;
+		nih_assert (pivot != NULL);
+
+		node->left = pivot->right;
+		if (pivot->right)
+			pivot->right->parent = node;
+
+		nih_tree_replace (tree, node, pivot);
+
+		pivot->right = node;
+	}
+
+	node->parent = pivot;
+
+	nih_tree_update (node);
+	nih_tree_update (pivot);
+
+	return pivot;
+}
+
+/**
+ * nih_tree_rebalance:
+ * @tree: sorted tree,
+ * @node: lowest node whose subtree changed, or NULL.
+ *
+ * Walks from @node up to the root of @tree recalculating heights, and
+ * rotating any subtree whose left and right heights differ by more than
+ * one so that they no longer do.
+ **/
+static void
+nih_tree_rebalance (NihSortedTree *tree,
+		    NihTree       *node)
+{
+	nih_assert (tree != NULL);
+
+	while (node) {
+		int balance;
+
+		balance = (NIH_TREE_HEIGHT (node->left)
+			   - NIH_TREE_HEIGHT (node->right));
+
+		if (balance > 1) {
+			NihTree *left = node->left;
+
+			if (NIH_TREE_HEIGHT (left->left)
+			    < NIH_TREE_HEIGHT (left->right))
+				nih_tree_rotate (tree, left, NIH_TREE_LEFT);
+
+			node = nih_tree_rotate (tree, node, NIH_TREE_RIGHT);
+		} else if (balance < -1) {
+			NihTree *right = node->right;
+
+			if (NIH_TREE_HEIGHT (right->right)
+			    < NIH_TREE_HEIGHT (right->left))
+				nih_tree_rotate (tree, right, NIH_TREE_RIGHT);
+
+			node = nih_tree_rotate (tree, node, NIH_TREE_LEFT);
+		} else {
+			nih_tree_update (node);
+		}
+
+		node = node->parent;
+	}
+}
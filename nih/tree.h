@@ -63,6 +63,17 @@
  * NIH_TREE_FOREACH_FULL(), NIH_TREE_FOREACH_PRE_FULL() and
  * NIH_TREE_FOREACH_POST_FULL().  Versions which pass NULL for the filter
  * are provided without the _FULL extension.
+ *
+ * Where nodes are ordered by a key, an NihSortedTree created with
+ * nih_tree_sorted_new() places them itself, keeping the tree balanced so
+ * that no path from the root is more than about 1.44 times longer than
+ * the shortest possible.  Such nodes begin with an NihSortedNode, and are
+ * added with nih_tree_insert() or all at once from sorted input with
+ * nih_tree_build(), and removed with nih_tree_delete().  They may be
+ * found with nih_tree_lookup(), nih_tree_lower_bound() and
+ * nih_tree_upper_bound(), and a range of keys iterated with
+ * NIH_TREE_FOREACH_RANGE(); the other iteration functions may be used
+ * with the root of the tree as usual.
  **/
 
 
@@ -126,6 +137,68 @@ typedef struct nih_tree_entry {
 } NihTreeEntry;
 
 
+/**
+ * NihSortedNode:
+ * @node: tree node,
+ * @height: height of the subtree rooted at this node.
+ *
+ * Nodes of an NihSortedTree must begin with this structure in place of
+ * the usual NihTree; @height is maintained by the tree and is the number
+ * of nodes on the longest path from this node down to a leaf.
+ **/
+typedef struct nih_sorted_node {
+	NihTree node;
+	int     height;
+} NihSortedNode;
+
+/**
+ * NihTreeKeyFunction:
+ * @node: node to key.
+ *
+ * This function is used to obtain a constant key for a given node of
+ * an NihSortedTree.
+ *
+ * Returns: constant key from node.
+ **/
+typedef const void *(*NihTreeKeyFunction) (NihTree *node);
+
+/**
+ * NihTreeCmpFunction:
+ * @key1: key to compare,
+ * @key2: key to compare against.
+ *
+ * This function is used to compare the keys of nodes of an NihSortedTree.
+ *
+ * Returns: integer less than, equal to or greater than zero if @key1 is
+ * respectively less then, equal to or greater than @key2.
+ **/
+typedef int (*NihTreeCmpFunction) (const void *key1, const void *key2);
+
+/**
+ * NihSortedTree:
+ * @root: root node of the tree,
+ * @count: number of nodes in the tree,
+ * @key_function: function used to obtain keys for nodes,
+ * @cmp_function: function used to compare keys.
+ *
+ * This structure represents a balanced binary tree whose nodes are kept
+ * in order of their keys, with nodes that have equal keys in the order
+ * they were inserted.  @root is NULL when the tree is empty, and changes
+ * as nodes are inserted and deleted.
+ *
+ * Nodes must be removed from the tree with nih_tree_delete(), never with
+ * nih_tree_remove() or nih_tree_unlink(), and so must be deleted before
+ * they are freed.
+ **/
+typedef struct nih_sorted_tree {
+	NihTree            *root;
+	size_t              count;
+
+	NihTreeKeyFunction  key_function;
+	NihTreeCmpFunction  cmp_function;
+} NihSortedTree;
+
+
 /**
  * NihTreeFilter:
  * @data: data pointer,
@@ -339,6 +412,27 @@ typedef int (*NihTreeFilter) (void *data, NihTree *node);
 	for (NihTree *iter = nih_tree_next_post ((tree), NULL); iter != NULL; \
 	     iter = nih_tree_next_post ((tree), iter))
 
+/**
+ * NIH_TREE_FOREACH_RANGE:
+ * @tree: sorted tree to iterate,
+ * @iter: name of iterator variable,
+ * @lower: lowest key to visit,
+ * @upper: key to stop at.
+ *
+ * Expands to a for statement that in-order iterates over each node in
+ * the sorted @tree with a key no less than @lower and less than @upper,
+ * setting @iter to each node for the block within the loop.
+ *
+ * You must not insert or delete nodes while iterating, since this may
+ * rebalance the tree.
+ **/
+#define NIH_TREE_FOREACH_RANGE(tree, iter, lower, upper)		\
+	for (NihTree *iter = nih_tree_lower_bound ((tree), (lower));	\
+	     (iter != NULL)						\
+		     && ((tree)->cmp_function ((tree)->key_function (iter), \
+					       (upper)) < 0);		\
+	     iter = nih_tree_next ((tree)->root, iter))
+
 
 NIH_BEGIN_EXTERN
 
@@ -370,6 +464,24 @@ NihTree *     nih_tree_next_post_full (NihTree *tree, NihTree *node,
 NihTree *     nih_tree_prev_post_full (NihTree *tree, NihTree *node,
 				       NihTreeFilter filter, void *data);
 
+NihSortedTree *nih_tree_sorted_new    (const void *parent,
+				       NihTreeKeyFunction key_function,
+				       NihTreeCmpFunction cmp_function)
+	__attribute__ ((warn_unused_result, malloc));
+
+NihTree *     nih_tree_insert         (NihSortedTree *tree,
+				       NihSortedNode *node);
+NihTree *     nih_tree_insert_unique  (NihSortedTree *tree,
+				       NihSortedNode *node);
+void          nih_tree_build          (NihSortedTree *tree,
+				       NihSortedNode **nodes, size_t len);
+NihTree *     nih_tree_delete         (NihSortedTree *tree,
+				       NihSortedNode *node);
+
+NihTree *     nih_tree_lookup         (NihSortedTree *tree, const void *key);
+NihTree *     nih_tree_lower_bound    (NihSortedTree *tree, const void *key);
+NihTree *     nih_tree_upper_bound    (NihSortedTree *tree, const void *key);
+
 NIH_END_EXTERN
 
 #endif /* NIH_TREE_H */
@@ -0,0 +1,461 @@
+/* libnih
+ *
+ * vector.c - growable array implementation
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nih/macros.h>
+#include <nih/logging.h>
+#include <nih/alloc.h>
+
+#include "vector.h"
+
+
+/**
+ * NIH_VECTOR_MIN_CAPACITY:
+ *
+ * Number of elements room is made for when the first element is added
+ * to a vector.
+ **/
+#define NIH_VECTOR_MIN_CAPACITY 8
+
+
+/* Prototypes for static functions */
+static int nih_vector_resize (NihVector *vector, size_t capacity)
+	__attribute__ ((warn_unused_result));
+static int nih_vector_grow   (NihVector *vector, size_t len)
+	__attribute__ ((warn_unused_result));
+
+
+/**
+ * nih_vector_new:
+ * @parent: parent of new vector,
+ * @elem_size: size of each element.
+ *
+ * Allocates a new, empty, vector of elements each @elem_size bytes long;
+ * no room is made for elements until the first is added, or room is
+ * reserved with nih_vector_reserve().
+ *
+ * The structure is allocated using nih_alloc() so it can be used as a
+ * context to other allocations, the elements are stored in a child of it.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned vector.  When all parents
+ * of the returned vector are freed, the returned vector will also be
+ * freed.
+ *
+ * Returns: the new vector or NULL if the allocation failed.
+ **/
+NihVector *
+nih_vector_new (const void *parent,
+		size_t      elem_size)
+{
+	NihVector *vector;
+
+	nih_assert (elem_size > 0);
+
+	vector = nih_new (parent, NihVector);
+	if (! vector)
+		return NULL;
+
+	vector->data = NULL;
+	vector->len = 0;
+	vector->capacity = 0;
+	vector->elem_size = elem_size;
+
+	return vector;
+}
+
+
+/**
+ * nih_vector_resize:
+ * @vector: vector to resize,
+ * @capacity: new capacity.
+ *
+ * Reallocates the elements of @vector to have room for exactly @capacity
+ * elements, which must be no fewer than the number it contains; the
+ * elements are freed when @capacity is zero.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+static int
+nih_vector_resize (NihVector *vector,
+		   size_t     capacity)
+{
+	void *data;
+
+	nih_assert (vector != NULL);
+	nih_assert (capacity >= vector->len);
+
+	if (! capacity) {
+		if (vector->data)
+			nih_free (vector->data);
+
+		vector->data = NULL;
+		vector->capacity = 0;
+
+		return 0;
+	}
+
+	if (capacity > SIZE_MAX / vector->elem_size)
+		return -1;
+
+	data = nih_realloc (vector->data, vector,
+			    capacity * vector->elem_size);
+	if (! data)
+		return -1;
+
+	vector->data = data;
+	vector->capacity = capacity;
+
+	return 0;
+}
+
+/**
+ * nih_vector_grow:
+ * @vector: vector to grow,
+ * @len: number of elements needed.
+ *
+ * Ensures that @vector has room for at least @len elements, at least
+ * doubling its capacity if it needs to grow so that repeatedly adding
+ * elements takes constant time on average.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+static int
+nih_vector_grow (NihVector *vector,
+		 size_t     len)
+{
+	size_t capacity;
+
+	nih_assert (vector != NULL);
+
+	if (len <= vector->capacity)
+		return 0;
+
+	capacity = vector->capacity;
+	if (capacity < NIH_VECTOR_MIN_CAPACITY)
+		capacity = NIH_VECTOR_MIN_CAPACITY;
+
+	while (capacity < len) {
+		if (capacity > SIZE_MAX / 2)
+			return -1;
+
+		capacity *= 2;
+	}
+
+	return nih_vector_resize (vector, capacity);
+}
+
+/**
+ * nih_vector_reserve:
+ * @vector: vector,
+ * @capacity: number of elements to make room for.
+ *
+ * Ensures that @vector has room for at least @capacity elements, so
+ * that adding elements up to that number cannot fail or move them.
+ *
+ * Returns: zero on success, negative value on insufficient memory.
+ **/
+int
+nih_vector_reserve (NihVector *vector,
+		    size_t     capacity)
+{
+	nih_assert (vector != NULL);
+
+	if (capacity <= vector->capacity)
+		return 0;
+
+	return nih_vector_resize (vector, capacity);
+}
+
+/**
+ * nih_vector_shrink:
+ * @vector: vector.
+ *
+ * Releases any room in @vector beyond that needed for the elements it
+ * contains; this moves the elements.
+ *
+ * Returns: zero on success, negative value on insufficient memory in
+ * which case @vector is unchanged.
+ **/
+int
+nih_vector_shrink (NihVector *vector)
+{
+	nih_assert (vector != NULL);
+
+	if (vector->capacity == vector->len)
+		return 0;
+
+	return nih_vector_resize (vector, vector->len);
+}
+
+
+/**
+ * nih_vector_push:
+ * @vector: vector,
+ * @elem: element to add.
+ *
+ * Adds a copy of @elem to the end of @vector, growing it if necessary.
+ * If @elem is NULL, the new element is filled with zeros instead.  @elem
+ * may be one of the elements of @vector itself.
+ *
+ * Returns: pointer to the new element in @vector or NULL on insufficient
+ * memory.
+ **/
+void *
+nih_vector_push (NihVector  *vector,
+		 const void *elem)
+{
+	nih_assert (vector != NULL);
+
+	return nih_vector_insert (vector, vector->len, elem);
+}
+
+/**
+ * nih_vector_pop:
+ * @vector: vector,
+ * @elem: location to copy element to.
+ *
+ * Removes the last element from @vector, which must not be empty,
+ * copying it to @elem if that is not NULL.  The capacity of @vector
+ * is not changed.
+ **/
+void
+nih_vector_pop (NihVector *vector,
+		void      *elem)
+{
+	nih_assert (vector != NULL);
+	nih_assert (vector->len > 0);
+
+	vector->len--;
+
+	if (elem)
+		memcpy (elem, NIH_VECTOR_AT (vector, vector->len),
+			vector->elem_size);
+}
+
+/**
+ * nih_vector_insert:
+ * @vector: vector,
+ * @index: position of new element,
+ * @elem: element to insert.
+ *
+ * Inserts a copy of @elem into @vector before the element at @index,
+ * which may be the number of elements in @vector to add it to the end,
+ * growing @vector if necessary.  If @elem is NULL, the new element is
+ * filled with zeros instead.
+ *
+ * The elements after @index are moved to make room, so this takes time
+ * proportional to their number.
+ *
+ * @elem may be one of the elements of @vector itself, which is found
+ * again after @vector is grown and its elements moved.
+ *
+ * Returns: pointer to the new element in @vector or NULL on insufficient
+ * memory.
+ **/
+void *
+nih_vector_insert (NihVector  *vector,
+		   size_t      index,
+		   const void *elem)
+{
+	void   *ptr;
+	size_t  offset = 0;
+	int     inside = FALSE;
+
+	nih_assert (vector != NULL);
+	nih_assert (index <= vector->len);
+
+	/* Growing may move the elements, so remember where @elem is within
+	 * them rather than copying from where it used to be.
+	 */
+	if (elem && vector->len
+	    && ((const char *)elem >= (const char *)vector->data)
+	    && ((const char *)elem < (const char *)NIH_VECTOR_AT (vector,
+								  vector->len))) {
+		offset = (const char *)elem - (const char *)vector->data;
+		inside = TRUE;
+	}
+
+	if (nih_vector_grow (vector, vector->len + 1) < 0)
+		return NULL;
+
+	ptr = NIH_VECTOR_AT (vector, index);
+	if (index < vector->len)
+		memmove (NIH_VECTOR_AT (vector, index + 1), ptr,
+			 (vector->len - index) * vector->elem_size);
+
+	if (inside) {
+		if (offset >= index * vector->elem_size)
+			offset += vector->elem_size;
+
+		elem = (const char *)vector->data + offset;
+	}
+
+	if (elem) {
+		memcpy (ptr, elem, vector->elem_size);
+	} else {
+		memset (ptr, 0, vector->elem_size);
+	}
+
+	vector->len++;
+
+	return ptr;
+}
+
+/**
+ * nih_vector_erase:
+ * @vector: vector,
+ * @index: position of first element to erase,
+ * @count: number of elements to erase.
+ *
+ * Removes @count elements from @vector starting with the element at
+ * @index, moving the elements after them into their place.  The
+ * capacity of @vector is not changed.
+ **/
+void
+nih_vector_erase (NihVector *vector,
+		  size_t     index,
+		  size_t     count)
+{
+	nih_assert (vector != NULL);
+	nih_assert (index <= vector->len);
+	nih_assert (count <= vector->len - index);
+
+	if (index + count < vector->len)
+		memmove (NIH_VECTOR_AT (vector, index),
+			 NIH_VECTOR_AT (vector, index + count),
+			 (vector->len - index - count) * vector->elem_size);
+
+	vector->len -= count;
+}
+
+/**
+ * nih_vector_clear:
+ * @vector: vector.
+ *
+ * Removes all elements from @vector, without changing its capacity.
+ **/
+void
+nih_vector_clear (NihVector *vector)
+{
+	nih_assert (vector != NULL);
+
+	vector->len = 0;
+}
+
+
+/**
+ * nih_vector_sort:
+ * @vector: vector,
+ * @cmp_function: function used to compare elements.
+ *
+ * Sorts the elements of @vector in place into ascending order as
+ * determined by @cmp_function, which is called with pointers to two
+ * elements.  The order of equal elements is not preserved.
+ **/
+void
+nih_vector_sort (NihVector            *vector,
+		 NihVectorCmpFunction  cmp_function)
+{
+	nih_assert (vector != NULL);
+	nih_assert (cmp_function != NULL);
+
+	if (vector->len > 1)
+		qsort (vector->data, vector->len, vector->elem_size,
+		       cmp_function);
+}
+
+/**
+ * nih_vector_lower_bound:
+ * @vector: sorted vector,
+ * @key: key to look for,
+ * @cmp_function: function used to compare @key with elements.
+ *
+ * Searches @vector, which must be sorted in the order determined by
+ * @cmp_function, for the first element not less than @key; this is the
+ * position at which an element with that key would be inserted with
+ * nih_vector_insert() to keep @vector sorted.  @cmp_function is called
+ * with @key and a pointer to an element.
+ *
+ * Returns: index of element found, or the number of elements in @vector
+ * if every element is less than @key.
+ **/
+size_t
+nih_vector_lower_bound (const NihVector      *vector,
+			const void           *key,
+			NihVectorCmpFunction  cmp_function)
+{
+	size_t lower, upper;
+
+	nih_assert (vector != NULL);
+	nih_assert (cmp_function != NULL);
+
+	lower = 0;
+	upper = vector->len;
+	while (lower < upper) {
+		size_t mid = lower + (upper - lower) / 2;
+
+		if (cmp_function (key, NIH_VECTOR_AT (vector, mid)) > 0) {
+			lower = mid + 1;
+		} else {
+			upper = mid;
+		}
+	}
+
+	return lower;
+}
+
+/**
+ * nih_vector_search:
+ * @vector: sorted vector,
+ * @key: key to look for,
+ * @cmp_function: function used to compare @key with elements.
+ *
+ * Searches @vector, which must be sorted in the order determined by
+ * @cmp_function, for the first element equal to @key.  @cmp_function is
+ * called with @key and a pointer to an element.
+ *
+ * Returns: pointer to element found or NULL if no element is equal
+ * to @key.
+ **/
+void *
+nih_vector_search (const NihVector      *vector,
+		   const void           *key,
+		   NihVectorCmpFunction  cmp_function)
+{
+	size_t index;
+
+	nih_assert (vector != NULL);
+	nih_assert (cmp_function != NULL);
+
+	index = nih_vector_lower_bound (vector, key, cmp_function);
+	if ((index == vector->len)
+	    || cmp_function (key, NIH_VECTOR_AT (vector, index)))
+		return NULL;
+
+	return NIH_VECTOR_AT (vector, index);
+}
@@ -0,0 +1,166 @@
+/* libnih
+ *
+ * Copyright © 2026 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NIH_VECTOR_H
+#define NIH_VECTOR_H
+
+/**
+ * Provides a growable array of fixed-size elements stored contiguously,
+ * for records that are more often scanned than moved between containers;
+ * unlike NihList there is no allocation or pair of pointers for each
+ * element, but elements move whenever the array grows or elements are
+ * inserted or erased before them.
+ *
+ * Vectors are created with nih_vector_new(), giving the size of each
+ * element, or with nih_vector_new_type() giving its type.  The storage is
+ * allocated as a child of the vector, and grows by doubling so that
+ * appending with nih_vector_push() takes constant time on average; use
+ * nih_vector_reserve() beforehand if the number of elements is known, and
+ * nih_vector_shrink() to release unused capacity afterwards.
+ *
+ * Elements are removed from the end with nih_vector_pop(), and may be
+ * inserted or erased elsewhere with nih_vector_insert() and
+ * nih_vector_erase().  The elements may be sorted with nih_vector_sort()
+ * and sorted vectors searched with nih_vector_search() and
+ * nih_vector_lower_bound().
+ *
+ * Elements are accessed with NIH_VECTOR_AT() or NIH_VECTOR_DATA(), and
+ * iterated with NIH_VECTOR_FOREACH().
+ **/
+
+#include <nih/macros.h>
+
+
+/**
+ * NihVectorCmpFunction:
+ * @key: key or element to compare,
+ * @elem: element to compare against.
+ *
+ * This function is used to compare elements of a vector when sorting
+ * it, and a key against its elements when searching it.
+ *
+ * Returns: integer less than, equal to or greater than zero if @key is
+ * respectively less then, equal to or greater than @elem.
+ **/
+typedef int (*NihVectorCmpFunction) (const void *key, const void *elem);
+
+
+/**
+ * NihVector:
+ * @data: elements,
+ * @len: number of elements,
+ * @capacity: number of elements @data has room for,
+ * @elem_size: size of each element.
+ *
+ * This structure represents a contiguous, growable array of elements
+ * each @elem_size bytes long.  @data is NULL until room for the first
+ * element is needed, and is otherwise a child of the vector.
+ **/
+typedef struct nih_vector {
+	void   *data;
+	size_t  len;
+	size_t  capacity;
+	size_t  elem_size;
+} NihVector;
+
+
+/**
+ * NIH_VECTOR_AT:
+ * @vector: vector,
+ * @i: index of element.
+ *
+ * Returns: pointer to element @i of @vector.
+ **/
+#define NIH_VECTOR_AT(vector, i)					\
+	((void *)((char *)(vector)->data + (i) * (vector)->elem_size))
+
+/**
+ * NIH_VECTOR_DATA:
+ * @vector: vector,
+ * @type: type of elements.
+ *
+ * Returns: elements of @vector as an array of @type.
+ **/
+#define NIH_VECTOR_DATA(vector, type) ((type *)(vector)->data)
+
+/**
+ * NIH_VECTOR_FOREACH:
+ * @vector: vector to iterate,
+ * @type: type of elements,
+ * @iter: name of iterator variable.
+ *
+ * Expands to a for statement that iterates over each element of @vector
+ * in order, setting @iter to a pointer to each element for the block
+ * within the loop.
+ *
+ * Elements must not be pushed, inserted or erased while iterating, since
+ * that may move them.
+ **/
+#define NIH_VECTOR_FOREACH(vector, type, iter)				\
+	for (type *iter = NIH_VECTOR_DATA (vector, type);		\
+	     iter < NIH_VECTOR_DATA (vector, type) + (vector)->len;	\
+	     iter++)
+
+
+/**
+ * nih_vector_new_type:
+ * @parent: parent of new vector,
+ * @type: type of elements.
+ *
+ * Allocates a new, empty, vector of elements of @type.
+ *
+ * If @parent is not NULL, it should be a pointer to another object which
+ * will be used as a parent for the returned vector.  When all parents
+ * of the returned vector are freed, the returned vector will also be
+ * freed.
+ *
+ * Returns: the new vector or NULL if the allocation failed.
+ **/
+#define nih_vector_new_type(parent, type)		\
+	nih_vector_new ((parent), sizeof (type))
+
+
+NIH_BEGIN_EXTERN
+
+NihVector *nih_vector_new         (const void *parent, size_t elem_size)
+	__attribute__ ((warn_unused_result, malloc));
+
+int        nih_vector_reserve     (NihVector *vector, size_t capacity)
+	__attribute__ ((warn_unused_result));
+int        nih_vector_shrink      (NihVector *vector);
+
+void *     nih_vector_push        (NihVector *vector, const void *elem)
+	__attribute__ ((warn_unused_result));
+void       nih_vector_pop         (NihVector *vector, void *elem);
+void *     nih_vector_insert      (NihVector *vector, size_t index,
+				   const void *elem)
+	__attribute__ ((warn_unused_result));
+void       nih_vector_erase       (NihVector *vector, size_t index,
+				   size_t count);
+void       nih_vector_clear       (NihVector *vector);
+
+void       nih_vector_sort        (NihVector *vector,
+				   NihVectorCmpFunction cmp_function);
+void *     nih_vector_search      (const NihVector *vector, const void *key,
+				   NihVectorCmpFunction cmp_function);
+size_t     nih_vector_lower_bound (const NihVector *vector, const void *key,
+				   NihVectorCmpFunction cmp_function);
+
+NIH_END_EXTERN
+
+#endif /* NIH_VECTOR_H */